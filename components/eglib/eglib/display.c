@@ -33,6 +33,29 @@ void display_default_draw_line(
 	}
 }
 
+uint8_t eglib_PackColor(eglib_t *eglib, color_t color, uint8_t *buffer) {
+	enum pixel_format_t pixel_format;
+
+	eglib_GetPixelFormat(eglib, &pixel_format);
+
+	switch(pixel_format) {
+		case PIXEL_FORMAT_16BIT_RGB:
+			buffer[0] = (color.r & 0xf8) | (color.g >> 5);
+			buffer[1] = ((color.g << 3) & 0xe0) | (color.b >> 3);
+			return 2;
+		case PIXEL_FORMAT_18BIT_RGB_24BIT:
+			buffer[0] = color.r & ~0x03;
+			buffer[1] = color.g & ~0x03;
+			buffer[2] = color.b & ~0x03;
+			return 3;
+		default:
+			buffer[0] = color.r;
+			buffer[1] = color.g;
+			buffer[2] = color.b;
+			return 3;
+	}
+}
+
 coordinate_t eglib_GetWidth(eglib_t *eglib) {
 	coordinate_t width, heigh;
 
@@ -346,6 +346,18 @@ void display_default_draw_line(
 	(eglib)->display.driver->get_pixel_format(eglib, pixel_format) \
 )
 
+/**
+ * Packs a color the way the display takes it over the wire: 2 bytes for
+ * :c:type:`PIXEL_FORMAT_16BIT_RGB` (RGB565), 3 bytes for the 18 and 24 bit
+ * formats. Other formats get the 3 color channels as they are.
+ *
+ * :param eglib: :c:type:`eglib_t` handle.
+ * :param color: Color to pack.
+ * :param buffer: Where to write the packed color to, at least 3 bytes.
+ * :return: Number of bytes per pixel written to ``buffer``.
+ */
+uint8_t eglib_PackColor(eglib_t *eglib, color_t color, uint8_t *buffer);
+
 /** Returns display width as :c:type:`coordinate_t`. */
 coordinate_t eglib_GetWidth(eglib_t *eglib);
 
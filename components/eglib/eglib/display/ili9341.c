@@ -1,6 +1,7 @@
 #include "ili9341.h"
 #include "frame_buffer.h"
 #include <esp_log.h>
+#include <string.h>
 
 
 //
@@ -190,10 +191,10 @@ static void set_interface_pixel_format(eglib_t *eglib) {
 			interface_pixel_format |= ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_12BIT;
 			break;
 		case ILI9341_COLOR_16_BIT:
-			interface_pixel_format |= ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_16BIT;
+			interface_pixel_format |= ILI9341_INTERFACE_PIXEL_FORMAT_RGB_INTERFACE_65K | ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_16BIT;
 			break;
 		case ILI9341_COLOR_18_BIT:
-			interface_pixel_format |= ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_18BIT;
+			interface_pixel_format |= ILI9341_INTERFACE_PIXEL_FORMAT_RGB_INTERFACE_262K | ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_18BIT;
 			break;
 	}
 	eglib_SendCommandByte(eglib, ILI9341_INTERFACE_PIXEL_FORMAT);
@@ -383,10 +384,6 @@ static void init(eglib_t *eglib) {
 	// ILI9341_DISPLAY_INVERSION_ON will have no effect.
 	eglib_SendCommandByte(eglib, ILI9341_NORMAL_DISPLAY_MODE_ON);
 
-    // UCG_C11(0x03a, 0x066),                /* set pixel format to 18 bit */
-	eglib_SendCommandByte(eglib, ILI9341_INTERFACE_PIXEL_FORMAT);
-	eglib_SendDataByte(eglib, ILI9341_INTERFACE_PIXEL_FORMAT_RGB_INTERFACE_262K | ILI9341_INTERFACE_PIXEL_FORMAT_COLOR_18BIT );
-
 	// UCG_C14(0x0b6, 0x00a, 0x082 | (1<<5), 0x027, 0x000),  /* display function control (POR values, except for shift direction bit) */
 	eglib_SendCommandByte(eglib, 0xb6 );
 	eglib_SendDataByte(eglib,0x0a );
@@ -554,14 +551,13 @@ static void draw_line(
 		ESP_LOGW("draw_line","draw_line method not implemented");
 	}
 	eglib_SendCommandByte(eglib, ILI9341_MEMORY_WRITE);
-	color_t c = eglib->drawing.color_index[0];
-	buffer = malloc( length*3 );
-	for( int i=0; i<length*3; i+=3 ){
-		buffer[i]   = c.r;
-		buffer[i+1] = c.g;
-		buffer[i+2] = c.b;
+	uint8_t px[3];
+	uint8_t bpp = eglib_PackColor(eglib, eglib->drawing.color_index[0], px);
+	buffer = malloc( length*bpp );
+	for( int i=0; i<length*bpp; i+=bpp ){
+		memcpy(buffer+i, px, bpp);
 	}
-	eglib_SendData(eglib, buffer, length*3  );
+	eglib_SendData(eglib, buffer, length*bpp  );
 	free( buffer );
 	eglib_CommEnd(eglib);
 }
@@ -581,7 +577,7 @@ static void send_buffer(
     set_column_address(eglib, x, x + width -1);
     set_row_address(eglib, y-height -1, y );
     eglib_SendCommandByte(eglib, ILI9341_MEMORY_WRITE);
-    eglib_SendData( eglib, (uint8_t *)buffer_ptr, width*height*3 );
+    eglib_SendData( eglib, (uint8_t *)buffer_ptr, width*height*get_bits_per_pixel(eglib)/8 );
 	eglib_CommEnd(eglib);
 }
 
@@ -159,10 +159,10 @@ static void set_interface_pixel_format(eglib_t *eglib) {
 			interface_pixel_format |= ST7789_INTERFACE_PIXEL_FORMAT_COLOR_12BIT;
 			break;
 		case ST7789_COLOR_16_BIT:
-			interface_pixel_format |= ST7789_INTERFACE_PIXEL_FORMAT_COLOR_16BIT;
+			interface_pixel_format |= ST7789_INTERFACE_PIXEL_FORMAT_RGB_INTERFACE_65K | ST7789_INTERFACE_PIXEL_FORMAT_COLOR_16BIT;
 			break;
 		case ST7789_COLOR_18_BIT:
-			interface_pixel_format |= ST7789_INTERFACE_PIXEL_FORMAT_COLOR_18BIT;
+			interface_pixel_format |= ST7789_INTERFACE_PIXEL_FORMAT_RGB_INTERFACE_262K | ST7789_INTERFACE_PIXEL_FORMAT_COLOR_18BIT;
 			break;
 	}
 	eglib_SendCommandByte(eglib, ST7789_INTERFACE_PIXEL_FORMAT);
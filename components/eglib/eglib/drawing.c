@@ -1,5 +1,6 @@
 #include "drawing.h"
 #include "display.h"
+#include "glyph_cache.h"
 #include <math.h>
 #include <stdlib.h>
 #include <esp_log.h>
@@ -1209,38 +1210,136 @@ struct font_t {
 
 #define MAX 400
 
-void eglib_DrawGlyph(eglib_t *eglib, coordinate_t x, coordinate_t y, const struct glyph_t *glyph) {
-	if(glyph == NULL)
-		return;
-	// uint8_t *buffer;
+// Text is composed here and sent in one window, the old per glyph path needs 27 * 48 * 3 bytes at the most
+#define TEXT_BUFFER 6144
+#define TEXT_RUN_GLYPHS 16
+static uint8_t text_buffer[TEXT_BUFFER];
+
+// Rows of the glyph cells of the current font, the same for all glyphs
+struct text_cell {
+	int16_t height;
+	int16_t first_row;
+	int16_t alignment;
+};
+
+static void text_cell(eglib_t *eglib, struct text_cell *c) {
 	int16_t ascent = eglib->drawing.font->ascent;
 	int16_t descent = eglib->drawing.font->descent;
 	int16_t ascheight = ascent - descent;
-	int16_t alignment = 0; // FONT_BOTTOM
-	// ESP_LOGI("eglib_DrawGlyph 1","x:%d, y:%d, gly width:%d adv:%d hei:%d asc:%d dec:%d", x,y, glyph->width, glyph->advance, eglib->drawing.font->pixel_size, ascent, descent );
 
-  if( eglib->drawing.font_origin == FONT_MIDDLE )
-		alignment = ascent/2 - descent;
+	c->alignment = 0; // FONT_BOTTOM
+	if( eglib->drawing.font_origin == FONT_MIDDLE )
+		c->alignment = ascent/2 - descent;
 	else if( eglib->drawing.font_origin == FONT_TOP )
-		alignment = ascheight;
+		c->alignment = ascheight;
+	c->height = eglib->drawing.font->pixel_size > ascheight ? eglib->drawing.font->pixel_size : ascheight;
+	c->first_row = 0;
+	if( eglib->drawing.filled_mode == false ){
+		c->first_row = c->height/8;   // WA as fonts bounding boxes to high over the top
+	}
+}
+
+// Whether the whole cell of a glyph with given advance at (x, y) is within the clip area
+static bool text_cell_inside(eglib_t *eglib, const struct text_cell *c, coordinate_t x, coordinate_t y, int16_t advance) {
+	return advance > 0 && c->height > c->first_row
+		&& eglib_inClipArea( eglib, x+1, c->first_row-c->height+y+c->alignment )
+		&& eglib_inClipArea( eglib, x+advance, y+c->alignment-1 );
+}
+
+// Expands the cell of a glyph into packed pixels, stride bytes per row
+static void expand_glyph(
+	const struct text_cell *c, const struct glyph_t *glyph, int16_t head,
+	const uint8_t *fg, const uint8_t *bg, uint8_t bpp,
+	uint8_t *dst, uint32_t stride
+) {
+	for(coordinate_t v1=c->first_row; v1 < c->height ; v1++) {
+		uint8_t *p = dst;
+		coordinate_t v = v1 - head;
+		for(coordinate_t u=0 ; u < glyph->advance; u++) {
+			const uint8_t *px = bg;
+			if( (u < glyph->width) && (v < glyph->height) && v>=0 && get_bit2( glyph, u, v ) )
+				px = fg;
+			memcpy(p, px, bpp);
+			p += bpp;
+		}
+		dst += stride;
+	}
+}
+
+// Composes the cells of glyphs fully within the clip area side by side, the glyph cache
+// provides the expanded cells, and sends them as one window
+static void draw_text_run(
+	eglib_t *eglib, const struct text_cell *c,
+	const struct glyph_t **glyphs, int count,
+	coordinate_t x, coordinate_t y, coordinate_t width
+) {
+	uint8_t fg[3], bg[3];
+	uint8_t bpp = eglib_PackColor(eglib, eglib->drawing.color_index[0], fg);
+	eglib_PackColor(eglib, eglib->drawing.color_index[1], bg);
+	int16_t rows = c->height - c->first_row;
+	uint32_t stride = (uint32_t)width * bpp;
+	uint8_t *dst = text_buffer;
+
+	struct glyph_cache_key key = {
+		.font = eglib->drawing.font,
+		.fg = eglib->drawing.color_index[0],
+		.bg = eglib->drawing.color_index[1],
+		.bpp = bpp,
+		.first_row = (uint8_t)c->first_row,
+	};
+	for(int i=0 ; i < count ; i++) {
+		const struct glyph_t *glyph = glyphs[i];
+		int16_t head = eglib->drawing.font->ascent - glyph->top;
+		uint32_t cell_stride = (uint32_t)glyph->advance * bpp;
+		bool hit;
+		key.glyph = glyph;
+		uint8_t *cell = eglib_GlyphCacheLookup(&key, cell_stride * rows, &hit);
+		if( cell == NULL ) {
+			expand_glyph(c, glyph, head, fg, bg, bpp, dst, stride);
+		}
+		else {
+			if( !hit )
+				expand_glyph(c, glyph, head, fg, bg, bpp, cell, cell_stride);
+			for(int16_t r=0 ; r < rows ; r++)
+				memcpy(dst + r*stride, cell + r*cell_stride, cell_stride);
+		}
+		dst += cell_stride;
+	}
+	eglib->display.driver->send_buffer( eglib, text_buffer, x, y+c->alignment, width, rows );
+}
+
+void eglib_DrawGlyph(eglib_t *eglib, coordinate_t x, coordinate_t y, const struct glyph_t *glyph) {
+	if(glyph == NULL)
+		return;
+	struct text_cell c;
+	text_cell(eglib, &c);
+	uint8_t fg[3], bg[3];
+	uint8_t bpp = eglib_PackColor(eglib, eglib->drawing.color_index[0], fg);
+	eglib_PackColor(eglib, eglib->drawing.color_index[1], bg);
+	if( text_cell_inside(eglib, &c, x, y, glyph->advance)
+		&& (uint32_t)glyph->advance * (c.height - c.first_row) * bpp <= TEXT_BUFFER ) {
+		draw_text_run(eglib, &c, &glyph, 1, x, y, glyph->advance);
+		return;
+	}
+	// partly clipped, the bounding box of what is within the clip area
+	int16_t ascent = eglib->drawing.font->ascent;
+	int16_t alignment = c.alignment;
+	// ESP_LOGI("eglib_DrawGlyph 1","x:%d, y:%d, gly width:%d adv:%d hei:%d asc:%d dec:%d", x,y, glyph->width, glyph->advance, eglib->drawing.font->pixel_size, ascent, descent );
 
 	int16_t width = glyph->advance;
-	int16_t height = eglib->drawing.font->pixel_size > ascheight ? eglib->drawing.font->pixel_size : ascheight;
+	int16_t height = c.height;
 
 	int16_t top = glyph->top;
 	int16_t head = ascent - top;
-	uint32_t pos3 = 0;
+	uint32_t pos = 0;
 
 	int16_t startx = MAX;
 	int16_t starty = MAX;
 	int16_t lenx = 0;
 	int16_t leny = 0;
 
-  static uint8_t buffer[4000]; // max. ever needed is 27 * 48 * 3
-	int16_t y1 = 0;
-	if( eglib->drawing.filled_mode == false ){
-		y1 =  height/8;   // WA as fonts bounding boxes to high over the top
-	}
+	uint8_t *buffer = text_buffer;
+	int16_t y1 = c.first_row;
 
 	for(coordinate_t v1=y1; v1 < height ; v1++){
 		//char line[width+1];
@@ -1255,16 +1354,17 @@ void eglib_DrawGlyph(eglib_t *eglib, coordinate_t x, coordinate_t y, const struc
 					lenx = u-startx;
 				if( leny < v1-starty )
 					leny = v1-starty;
-				*(color_t *)(buffer+pos3) = eglib->drawing.color_index[1];  // preinitialize with background
+				const uint8_t *px = bg;  // preinitialize with background
 				// line[u] = '.';
 				if( (u < glyph->width) && (v < glyph->height) && v>=0 && u>=0  )
 				{
 					if( get_bit2( glyph, u, v ) ){
-						*(color_t *)(buffer+pos3) = eglib->drawing.color_index[0];
+						px = fg;
 						// line[u] = 'X';
 					}
 				}
-				pos3 +=3;
+				memcpy(buffer+pos, px, bpp);
+				pos += bpp;
 			}
 		}
 		// line[width] = 0;
@@ -1341,14 +1441,38 @@ static wchar_t utf8_nextchar(const char *utf8_text, uint16_t *index) {
     return c;
 }
 
+// Runs of glyphs fully within the clip area go out as one window each
 size_t eglib_DrawText(eglib_t *eglib, coordinate_t x, coordinate_t y, const char *utf8_text) {
   const struct glyph_t *glyph;
   // ESP_LOGI( "DrawText()",">%s<  X:%d Y:%d",utf8_text, x,y );
   size_t total_advance = 0;
+  struct text_cell c;
+  text_cell(eglib, &c);
+  uint8_t px[3];
+  uint32_t row_bytes = (uint32_t)(c.height - c.first_row) * eglib_PackColor(eglib, eglib->drawing.color_index[0], px);
+  const struct glyph_t *run[TEXT_RUN_GLYPHS];
+  int run_len = 0;
+  coordinate_t run_x = x, run_width = 0;
+
   for(uint16_t index=0 ; utf8_text[index] ; ) {
 	wchar_t w = utf8_nextchar(utf8_text, &index);
     glyph = eglib_GetGlyph(eglib, w );
-    if(glyph == NULL) {
+    bool in_run = glyph != NULL && text_cell_inside(eglib, &c, x, y, glyph->advance)
+      && (uint32_t)glyph->advance * row_bytes <= TEXT_BUFFER;
+    if( run_len && (!in_run || run_len == TEXT_RUN_GLYPHS || (uint32_t)(run_width + glyph->advance) * row_bytes > TEXT_BUFFER) ) {
+      draw_text_run(eglib, &c, run, run_len, run_x, y, run_width);
+      run_len = 0;
+    }
+    if(in_run) {
+      if( !run_len ) {
+        run_x = x;
+        run_width = 0;
+      }
+      run[run_len++] = glyph;
+      run_width += glyph->advance;
+      x += glyph->advance;
+      total_advance += glyph->advance;
+    } else if(glyph == NULL) {
       x += draw_missing_glyph(eglib, w, x, y);
       total_advance += x;
     } else {
@@ -1357,6 +1481,8 @@ size_t eglib_DrawText(eglib_t *eglib, coordinate_t x, coordinate_t y, const char
       total_advance += glyph->advance;
     }
   }
+  if( run_len )
+    draw_text_run(eglib, &c, run, run_len, run_x, y, run_width);
   return total_advance;
 }
 
@@ -1381,6 +1507,14 @@ coordinate_t eglib_GetTextWidth(eglib_t *eglib, const char *utf8_text) {
   return width;
 }
 
+void eglib_GetTextCell(eglib_t *eglib, coordinate_t *top, coordinate_t *height) {
+  struct text_cell c;
+  text_cell(eglib, &c);
+  // send_buffer puts the window one row above the y passed
+  *top = c.alignment - c.height + c.first_row - 1;
+  *height = c.height - c.first_row;
+}
+
 void eglib_setFilledMode(eglib_t *eglib, bool fill ) {
 	eglib->drawing.filled_mode = fill;
 };
@@ -1005,4 +1005,12 @@ size_t eglib_DrawText(eglib_t *eglib, coordinate_t x, coordinate_t y, const char
  */
 coordinate_t eglib_GetTextWidth(eglib_t *eglib, const char *utf8_text);
 
+/**
+ * Return the rows a text line covers with the current font and origin, relative to the y
+ * coordinate passed to :c:func:`eglib_DrawText`. A glyph cell spans from x to x+advance-1.
+ *
+ * :See also: :c:func:`eglib_setFontOrigin`.
+ */
+void eglib_GetTextCell(eglib_t *eglib, coordinate_t *top, coordinate_t *height);
+
 #endif
@@ -0,0 +1,102 @@
+#include "glyph_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct entry {
+	struct glyph_cache_key key;
+	uint16_t offset;
+	uint16_t size;  // 0 for a free entry
+	uint32_t used;  // lookup stamp
+};
+
+static uint8_t *arena;
+static struct entry entries[GLYPH_CACHE_ENTRIES];
+static uint32_t stamp;
+static struct glyph_cache_stats stats;
+
+static bool key_equal(const struct glyph_cache_key *a, const struct glyph_cache_key *b) {
+	return a->glyph == b->glyph && a->font == b->font
+		&& a->fg.r == b->fg.r && a->fg.g == b->fg.g && a->fg.b == b->fg.b
+		&& a->bg.r == b->bg.r && a->bg.g == b->bg.g && a->bg.b == b->bg.b
+		&& a->bpp == b->bpp && a->first_row == b->first_row;
+}
+
+// Start of a gap of size bytes in between the entries, or -1
+static int find_gap(uint16_t size) {
+	uint32_t start = 0;
+	for(;;) {
+		// the entry closest above start that overlaps [start, start+size)
+		uint32_t next = GLYPH_CACHE_ARENA;
+		int overlap = -1;
+		for(int i = 0 ; i < GLYPH_CACHE_ENTRIES ; i++) {
+			if(!entries[i].size)
+				continue;
+			uint32_t end = (uint32_t)entries[i].offset + entries[i].size;
+			if(end > start && entries[i].offset < start + size && entries[i].offset < next) {
+				next = entries[i].offset;
+				overlap = i;
+			}
+		}
+		if(overlap < 0)
+			return start + size <= GLYPH_CACHE_ARENA ? (int)start : -1;
+		start = (uint32_t)entries[overlap].offset + entries[overlap].size;
+		if(start + size > GLYPH_CACHE_ARENA)
+			return -1;
+	}
+}
+
+uint8_t *eglib_GlyphCacheLookup(const struct glyph_cache_key *key, uint16_t size, bool *hit) {
+	*hit = false;
+	if(size == 0 || size > GLYPH_CACHE_ARENA) {
+		stats.uncached++;
+		return NULL;
+	}
+	if(arena == NULL) {
+		arena = malloc(GLYPH_CACHE_ARENA);
+		if(arena == NULL) {
+			stats.uncached++;
+			return NULL;
+		}
+	}
+	stamp++;
+	int free_slot = -1;
+	for(int i = 0 ; i < GLYPH_CACHE_ENTRIES ; i++) {
+		if(!entries[i].size) {
+			free_slot = i;
+		} else if(key_equal(&entries[i].key, key)) {
+			entries[i].used = stamp;
+			stats.hits++;
+			*hit = true;
+			return arena + entries[i].offset;
+		}
+	}
+	stats.misses++;
+
+	// evict the least recently used until there is an entry and a gap for the cell
+	int offset = 0;
+	while(free_slot < 0 || (offset = find_gap(size)) < 0) {
+		int lru = -1;
+		for(int i = 0 ; i < GLYPH_CACHE_ENTRIES ; i++) {
+			if(entries[i].size && (lru < 0 || entries[i].used < entries[lru].used))
+				lru = i;
+		}
+		entries[lru].size = 0;
+		free_slot = lru;
+		stats.evictions++;
+	}
+	entries[free_slot].key = *key;
+	entries[free_slot].offset = offset;
+	entries[free_slot].size = size;
+	entries[free_slot].used = stamp;
+	return arena + offset;
+}
+
+void eglib_GlyphCacheClear(void) {
+	memset(entries, 0, sizeof(entries));
+}
+
+struct glyph_cache_stats eglib_GlyphCacheStats(void) {
+	struct glyph_cache_stats s = stats;
+	memset(&stats, 0, sizeof(stats));
+	return s;
+}
@@ -0,0 +1,57 @@
+#ifndef EGLIB_GLYPH_CACHE_H
+#define EGLIB_GLYPH_CACHE_H
+
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct font_t;
+struct glyph_t;
+
+/**
+ * Glyph Cache
+ * ===========
+ *
+ * Glyphs already expanded to the pixel format of the display, kept in a fixed
+ * arena and evicted least recently used first. An entry holds the full glyph
+ * cell, ``advance`` columns by the drawn rows of the font height, in the
+ * colors it was drawn with.
+ */
+
+/** Size of the arena, allocated at the first lookup. */
+#define GLYPH_CACHE_ARENA 16384
+/** Maximum number of cached glyphs. */
+#define GLYPH_CACHE_ENTRIES 48
+
+struct glyph_cache_key {
+	const struct font_t *font;
+	const struct glyph_t *glyph;
+	color_t fg;
+	color_t bg;
+	uint8_t bpp;
+	uint8_t first_row;
+};
+
+struct glyph_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t uncached;  // cells that do not fit the arena
+};
+
+/**
+ * Looks up the cell of ``key``. On a hit ``*hit`` is set and the cached
+ * pixels are returned. On a miss room for ``size`` bytes is made, least
+ * recently used entries evicted, and returned for the caller to fill.
+ *
+ * :return: Pointer into the arena, or ``NULL`` when the cell can not be cached.
+ */
+uint8_t *eglib_GlyphCacheLookup(const struct glyph_cache_key *key, uint16_t size, bool *hit);
+
+/** Drops all entries. */
+void eglib_GlyphCacheClear(void);
+
+/** Returns the counters since the last call and resets them. */
+struct glyph_cache_stats eglib_GlyphCacheStats(void);
+
+#endif
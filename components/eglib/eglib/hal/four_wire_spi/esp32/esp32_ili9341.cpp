@@ -3,28 +3,45 @@
 #include <driver/spi_master.h>
 #include <driver/gpio.h>
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cassert>
 #include <cstring>
+#include <algorithm>
 
 extern "C" {
 #include "esp32_ili9341.h"
 
-extern SemaphoreHandle_t spiMutex;
+// SPI bus arbitration, implemented in main/comm/SpiBus.cpp
+void spibus_acquire(int client);
+void spibus_release(int client);
+bool spibus_preempt(int client);
+static const int SPI_DISPLAY = 2;       // SpiClient of the display
+static const uint32_t CHUNK_LEN = 1536; // bytes, ~0.6 msec on the bus and a multiple of 2 and 3 byte pixels
+static const int NUM_BUFS = 2;          // DMA staging buffers, one fills while the other is on the wire
+static const int NUM_TRANS = 8;         // queued transactions, commands and parameters included
+static const uint32_t INLINE_LEN = 4;   // data up to this length goes within the transaction
 
 static esp32_hal_config_t *config;
 static spi_device_handle_t spi;
-static spi_transaction_t ta = {
-	.flags = 0,//SPI_TRANS_USE_RXDATA, //| SPI_TRANS_MODE_OCT | SPI_TRANS_CS_KEEP_ACTIVE,
-	.cmd = 0,
-	.addr = 0,
-	.length = 0,
-	.rxlength = 0,
-	.user = nullptr,
-	.tx_buffer = nullptr,
-	.rx_buffer = nullptr,
-};
 static bool init = false;
 
-// static void spi_pre_transfer_callback(spi_transaction_t *t);
+// The transactions are queued to the driver and reaped in order, a slot of the ring is free again
+// once its result came back. The user field carries the D/C level in bit 0 and the staging buffer
+// index + 1 above, the pre transfer callback sets the D/C pin from it.
+static spi_transaction_t trans[NUM_TRANS];
+static int trans_next = 0;
+static int inflight = 0;
+static uint8_t *buf[NUM_BUFS];
+static bool buf_busy[NUM_BUFS];
+static int fill = -1;          // staging buffer taking data, or -1
+static uint32_t fill_len = 0;
+static uint8_t small[INLINE_LEN]; // data collected before a staging buffer is needed
+static uint32_t small_len = 0;
+
+static IRAM_ATTR void pre_transfer(spi_transaction_t *t)
+{
+	gpio_set_level(config->gpio_dc, (uintptr_t)t->user & 1);
+}
 
 static void einit(eglib_t *eglib)
 {
@@ -52,45 +69,156 @@ static void einit(eglib_t *eglib)
 		.sample_point = SPI_SAMPLING_POINT_PHASE_0,
 		.spics_io_num = config->gpio_cs,
 		.flags = SPI_DEVICE_HALFDUPLEX,
-		.queue_size = 1, // Transaction queue size
-		.pre_cb = NULL, // spi_pre_transfer_callback, // Pre-transaction callback
+		.queue_size = NUM_TRANS, // Transaction queue size
+		.pre_cb = pre_transfer, // Pre-transaction callback, sets D/C
 		.post_cb = NULL  // Post-transaction callback
 	};
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
+	spibus_acquire(SPI_DISPLAY);
 	ESP_ERROR_CHECK(spi_bus_add_device((spi_host_device_t)config->spi_num, &devcfg, &spi));
-	xSemaphoreGive(spiMutex);
+	spibus_release(SPI_DISPLAY);
+	for (int i = 0; i < NUM_BUFS; i++) {
+		buf[i] = (uint8_t *)heap_caps_malloc(CHUNK_LEN, MALLOC_CAP_DMA);
+		assert(buf[i]);
+	}
 
-	// init GPIO pins of 4 WIRE SPI bus
-	gpio_reset_pin(config->gpio_cs);
+	// init GPIO pins of 4 WIRE SPI bus, CS is driven by the SPI peripheral per transaction
 	gpio_reset_pin(config->gpio_rs);
 	gpio_reset_pin(config->gpio_dc);
-	gpio_set_direction(config->gpio_cs, GPIO_MODE_OUTPUT);
 	gpio_set_direction(config->gpio_rs, GPIO_MODE_OUTPUT);
 	gpio_set_direction(config->gpio_dc, GPIO_MODE_OUTPUT);
 	// set default state for all output pins
 	gpio_set_level(config->gpio_rs, 1);
 	gpio_set_level(config->gpio_dc, 1 );
-	gpio_set_level(config->gpio_cs, 1 );
 	ESP_LOGI("ILI9341","pins dc%d rs%d cs%d", config->gpio_dc, config->gpio_rs, config->gpio_cs);
 }
 
+// Takes back the oldest queued transaction, waits for it when still on the wire
+static void reap_one()
+{
+	spi_transaction_t *t;
+	if ( spi_device_get_trans_result(spi, &t, portMAX_DELAY) != ESP_OK ) {
+		ESP_LOGE("SPI", "SPI transfer lost");
+		return;
+	}
+	inflight--;
+	int b = (int)((uintptr_t)t->user >> 1) - 1;
+	if ( b >= 0 ) {
+		buf_busy[b] = false;
+	}
+}
+
+static spi_transaction_t *next_trans()
+{
+	if ( inflight == NUM_TRANS ) {
+		reap_one();
+	}
+	spi_transaction_t *t = &trans[trans_next];
+	trans_next = (trans_next + 1) % NUM_TRANS;
+	memset(t, 0, sizeof(*t));
+	return t;
+}
+
+static void queue(spi_transaction_t *t)
+{
+	esp_err_t ret = spi_device_queue_trans(spi, t, portMAX_DELAY);
+	if (ret != ESP_OK)
+	{
+		ESP_LOGE("SPI", "SPI transfer failed: %s", esp_err_to_name(ret));
+		int b = (int)((uintptr_t)t->user >> 1) - 1;
+		if ( b >= 0 ) {
+			buf_busy[b] = false;
+		}
+		return;
+	}
+	inflight++;
+}
+
+// Hand the bus to a waiting pressure sensor in between two chunks. The display is deselected after
+// each transaction, the sensor read waits for the chunks already queued, NUM_BUFS of them at the most.
+static IRAM_ATTR void yield_bus()
+{
+	spibus_release(SPI_DISPLAY);
+	spibus_acquire(SPI_DISPLAY);
+}
+
+// Queues the collected data, a filled staging buffer or the few inline bytes
+static void flush_data()
+{
+	if ( fill >= 0 ) {
+		if ( spibus_preempt(SPI_DISPLAY) ) {
+			yield_bus();
+		}
+		spi_transaction_t *t = next_trans();
+		t->tx_buffer = buf[fill];
+		t->length = fill_len * 8;
+		t->user = (void *)(uintptr_t)(1 | ((fill + 1) << 1));
+		buf_busy[fill] = true;
+		fill = -1;
+		queue(t);
+	}
+	else if ( small_len ) {
+		spi_transaction_t *t = next_trans();
+		t->flags = SPI_TRANS_USE_TXDATA;
+		memcpy(t->tx_data, small, small_len);
+		t->length = small_len * 8;
+		t->user = (void *)1;
+		small_len = 0;
+		queue(t);
+	}
+}
+
+// A staging buffer off the wire to fill, the data collected so far moves into it
+static void take_buffer()
+{
+	for (;;) {
+		for (int i = 0; i < NUM_BUFS; i++) {
+			if ( ! buf_busy[i] ) {
+				fill = i;
+				memcpy(buf[i], small, small_len);
+				fill_len = small_len;
+				small_len = 0;
+				return;
+			}
+		}
+		reap_one();
+	}
+}
+
+// Everything sent so far is out on the wire
+static void drain()
+{
+	flush_data();
+	while ( inflight ) {
+		reap_one();
+	}
+}
+
+void esp32_ili9341_fence(void)
+{
+	drain();
+}
+
 static void esleep_in(eglib_t *_eglib) {
 	ESP_LOGI("ILI9341","sleep in");
+	drain();
 	vTaskDelay( 120 / portTICK_PERIOD_MS);
 }
 
 static void esleep_out(eglib_t *_eglib) {
 	ESP_LOGI("ILI9341","sleep out");
+	drain();
 	vTaskDelay( 120 / portTICK_PERIOD_MS);
 }
 
 static void edelay_ns(eglib_t *_eglib, uint32_t ns) {
 	ESP_LOGI("ILI9341","delay %d ms", (int)ns/1000000 );
+	drain();
 	vTaskDelay( (ns/1000000) / portTICK_PERIOD_MS);
 }
 
 static void eset_reset(eglib_t *_eglib, bool state) {
 	ESP_LOGI("ILI9341","reset IO:%d state=%d", config->gpio_rs, state );
+	drain();
 	gpio_set_level(config->gpio_rs, (unsigned int)state );
 }
 
@@ -100,8 +228,7 @@ static IRAM_ATTR bool eget_busy(eglib_t *_eglib) {
 
 static IRAM_ATTR void ecomm_begin(eglib_t *_eglib) {
 	// ESP_LOGI("ILI9341", "comm begin(): eglib:%x config:%x CS-PIN:%d", (unsigned int)_eglib, (unsigned int)config, (unsigned int)config->gpio_cs );
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
-	gpio_set_level(config->gpio_cs, 0 );
+	spibus_acquire(SPI_DISPLAY);
 	// spi_device_acquire_bus(spi, portMAX_DELAY);
 }
 
@@ -141,44 +268,52 @@ static IRAM_ATTR void ecomm_begin(eglib_t *_eglib) {
 // 	return false;
 // }
 
+// Pixel data is copied into a staging buffer and queued when the buffer is full, or with the next
+// command or comm end, so the caller rasterizes the next span while the previous one is on the wire.
 static IRAM_ATTR void esend(eglib_t *_eglib, enum hal_dc_t dc, uint8_t *bytes, uint32_t length)
 {
 	// if ( length == 0 ) ESP_LOGI("ILI9341", "esend() DC-IO:%d dc:%s len:%u\n", config->gpio_dc, dc? "DAT": "CMD", (unsigned)length);
 	// ESP_LOG_BUFFER_HEXDUMP("ILI9341", bytes, length, ESP_LOG_INFO);
 	if (dc == HAL_DATA)
 	{
-		gpio_set_level(config->gpio_dc, 1);
-		// ESP_LOGI("ILI9341", "esend() DAT %d", length );
-		// ta.user = (void *)1;
-		ta.flags =  0; // SPI_TRANS_MODE_OCT;
-		ta.rx_buffer = nullptr;
-		ta.tx_buffer = bytes;
-		ta.length = length * 8;
+		if ( fill < 0 && small_len + length <= INLINE_LEN ) {
+			// command parameters and single pixels
+			memcpy(&small[small_len], bytes, length);
+			small_len += length;
+			return;
+		}
+		while ( length ) {
+			if ( fill < 0 ) {
+				take_buffer();
+			}
+			uint32_t n = std::min(length, CHUNK_LEN - fill_len);
+			memcpy(buf[fill] + fill_len, bytes, n);
+			fill_len += n;
+			bytes += n;
+			length -= n;
+			if ( fill_len == CHUNK_LEN ) {
+				flush_data();
+			}
+		}
 	}
 	else
 	{
 		// ESP_LOGI("ILI9341", "esend() CMD 0x%x", *bytes );
-		// ta.user = (void *)0;
-		ta.flags = SPI_TRANS_USE_TXDATA; // | SPI_TRANS_MODE_OCT;
-		ta.rx_buffer = nullptr;
-		// ta.tx_data[0] = 0;
-		// if ( bytes ) {
-		ta.tx_data[0] = *bytes;
-		// }
-		ta.length = 8;
-		gpio_set_level(config->gpio_dc, 0);
-	}
-	esp_err_t ret = spi_device_transmit(spi, &ta);
-	if (ret != ESP_OK)
-	{
-		ESP_LOGE("SPI", "SPI transfer failed: %s", esp_err_to_name(ret));
+		flush_data();
+		spi_transaction_t *t = next_trans();
+		t->flags = SPI_TRANS_USE_TXDATA;
+		t->tx_data[0] = *bytes;
+		t->length = 8;
+		t->user = (void *)0;
+		queue(t);
 	}
 }
 
+// The transactions still queued go on after the bus is released, a sensor read queues behind them.
 static IRAM_ATTR void ecomm_end(eglib_t *_eglib) {
 	// ESP_LOGI("ILI9341","comm end()");
-	gpio_set_level(config->gpio_cs, 1 );
-	xSemaphoreGive(spiMutex);
+	flush_data();
+	spibus_release(SPI_DISPLAY);
 	// spi_device_release_bus(spi);
 }
 
@@ -194,3 +329,197 @@ hal_t esp32_ili9341 = {
 	.comm_end = ecomm_end,
 };
 }
+
+
+#ifdef ILI9341_Test
+#include <vector>
+
+// Simulates the bus with frames of typical screen updates, once with one blocking transfer per
+// command, parameter set and chunk of the former driver, and once through the staging buffers and the
+// transaction ring above. Logs per frame the time to the last pixel on the wire, the CPU busy and idle
+// time, the time the CPU rasterized while the bus was busy, and the longest transfer queued ahead of a
+// sensor read.
+namespace {
+
+// ESP32 at 240MHz, SPI clock freq/2 of ~19.7MHz, usec
+const double BYTE_US = 8 / 19.67;
+const double GAP_US = 1.5;     // CS toggle and start of the next queued transaction in the ISR
+const double BLOCK_US = 14;    // spi_device_transmit(), queue, interrupt, task wake up
+const double QUEUE_US = 5;     // spi_device_queue_trans()
+const double REAP_US = 3;      // spi_device_get_trans_result() of a finished transaction
+const double DRAW_US = 8;      // a draw call down to the display driver, malloc included
+const double RASTER_US = 0.03; // per pixel byte
+const double COPY_US = 0.008;  // per byte into a staging buffer
+
+struct Draw {
+	int count;
+	int bytes; // pixel data of each
+};
+
+struct Frame {
+	double cpu = 0, bus = 0;       // where the CPU and the wire are in time
+	double cpu_busy = 0, bus_busy = 0;
+	double max_ahead = 0;          // wire time queued ahead of a sensor read
+	std::vector<std::pair<double, double>> cpu_iv, bus_iv;
+
+	void work(double us) {
+		cpu_iv.push_back({ cpu, cpu + us });
+		cpu += us;
+		cpu_busy += us;
+	}
+	void waitUntil(double t) {
+		if ( t > cpu ) {
+			cpu = t;
+		}
+	}
+	// a transaction of len bytes handed to the wire when the CPU is at cpu, returns its end
+	double wire(int len, bool queued) {
+		double start = std::max(cpu, bus) + (queued && bus > cpu ? GAP_US : 0);
+		double end = start + len * BYTE_US;
+		bus_iv.push_back({ start, end });
+		bus_busy += end - start;
+		bus = end;
+		return end;
+	}
+	double overlap() const {
+		double sum = 0;
+		size_t j = 0;
+		for (auto &c : cpu_iv) {
+			while ( j < bus_iv.size() && bus_iv[j].second <= c.first ) {
+				j++;
+			}
+			for (size_t k = j; k < bus_iv.size() && bus_iv[k].first < c.second; k++) {
+				sum += std::max(0.0, std::min(c.second, bus_iv[k].second) - std::max(c.first, bus_iv[k].first));
+			}
+		}
+		return sum;
+	}
+};
+
+void blocking(Frame &f, int len)
+{
+	f.work(BLOCK_US);
+	double end = f.wire(len, false);
+	f.max_ahead = std::max(f.max_ahead, end - f.cpu);
+	f.waitUntil(end + BLOCK_US / 2);
+}
+
+void frameBlocking(Frame &f, const std::vector<Draw> &draws)
+{
+	for (const Draw &d : draws) {
+		for (int i = 0; i < d.count; i++) {
+			f.work(DRAW_US);
+			for (int p = 0; p < 2; p++) {
+				blocking(f, 1); // address set command
+				blocking(f, 4); // and its parameters
+			}
+			blocking(f, 1);     // memory write
+			f.work(d.bytes * RASTER_US);
+			for (int left = d.bytes; left > 0; left -= 3072) {
+				blocking(f, std::min(left, 3072));
+			}
+		}
+	}
+}
+
+struct Pipe {
+	Frame &f;
+	std::vector<double> ring;      // end times of the queued transactions
+	double buf_end[NUM_BUFS] = {};
+	int fill = -1;
+	uint32_t fill_len = 0;
+
+	void reap() {
+		f.waitUntil(ring.front());
+		f.work(REAP_US);
+		ring.erase(ring.begin());
+	}
+	double queue(int len) {
+		if ( (int)ring.size() == NUM_TRANS ) {
+			reap();
+		}
+		f.work(QUEUE_US);
+		double end = f.wire(len, true);
+		f.max_ahead = std::max(f.max_ahead, end - f.cpu);
+		ring.push_back(end);
+		return end;
+	}
+	void flush() {
+		if ( fill >= 0 ) {
+			buf_end[fill] = queue(fill_len);
+			fill = -1;
+		}
+	}
+	void data(int len) {
+		f.work(len * COPY_US);
+		while ( len > 0 ) {
+			if ( fill < 0 ) {
+				int b = buf_end[0] <= buf_end[1] ? 0 : 1;
+				while ( ! ring.empty() && ring.front() <= buf_end[b] ) {
+					reap();
+				}
+				fill = b;
+				fill_len = 0;
+			}
+			uint32_t n = std::min((uint32_t)len, CHUNK_LEN - fill_len);
+			fill_len += n;
+			len -= n;
+			if ( fill_len == CHUNK_LEN ) {
+				flush();
+			}
+		}
+	}
+};
+
+void frameQueued(Frame &f, const std::vector<Draw> &draws)
+{
+	Pipe p{ f };
+	for (const Draw &d : draws) {
+		for (int i = 0; i < d.count; i++) {
+			f.work(DRAW_US);
+			for (int a = 0; a < 2; a++) {
+				p.queue(1);
+				p.queue(INLINE_LEN); // the parameters, within the transaction
+			}
+			p.queue(1);
+			f.work(d.bytes * RASTER_US);
+			p.data(d.bytes);
+			p.flush();
+		}
+	}
+	while ( ! p.ring.empty() ) {
+		p.reap();
+	}
+}
+
+} // namespace
+
+extern "C" void esp32_ili9341_sim_test(void)
+{
+	struct Case {
+		const char *name;
+		std::vector<Draw> draws;
+	};
+	const Case cases[] = {
+		{ "clear screen", { { 320, 720 } } },
+		{ "gauge update", { { 160, 60 }, { 40, 240 } } },
+		{ "text lines",   { { 400, 18 }, { 100, 3 } } },
+		{ "bitmap",       { { 1, 100 * 100 * 3 } } },
+	};
+	for (const Case &c : cases) {
+		for (int q = 0; q < 2; q++) {
+			Frame f;
+			if ( q ) {
+				frameQueued(f, c.draws);
+			}
+			else {
+				frameBlocking(f, c.draws);
+			}
+			double frame = std::max(f.cpu, f.bus);
+			ESP_LOGI("ILI9341", "%-12s %s: frame %6.2f ms, cpu busy %6.2f idle %6.2f ms, bus busy %6.2f ms, overlap %6.2f ms (%2.0f%%), sensor wait max %4.0f us",
+				c.name, q ? "queued  " : "blocking", frame / 1000, f.cpu_busy / 1000, (frame - f.cpu_busy) / 1000,
+				f.bus_busy / 1000, f.overlap() / 1000, 100 * f.overlap() / frame, f.max_ahead);
+		}
+	}
+}
+#endif
@@ -16,6 +16,10 @@
 #include "hal.h"
 #include <driver/gpio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern hal_t esp32_ili9341;
 
 typedef struct esp32_hal_config{
@@ -31,4 +35,19 @@ typedef struct esp32_hal_config{
 	gpio_num_t gpio_rs;
 }esp32_hal_config_t;
 
+/**
+ * Waits until the queued transfers are out on the wire. The pixel data goes out asynchronously
+ * after a draw call returns, call this before anything that depends on the screen content being
+ * complete, as a screen switch. Not within a comm_begin/comm_end sequence of another task.
+ */
+void esp32_ili9341_fence(void);
+
+#ifdef ILI9341_Test
+void esp32_ili9341_sim_test(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 // void send( eglib_t *_eglib, enum hal_dc_t dc, uint8_t *bytes, uint32_t length );
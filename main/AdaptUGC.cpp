@@ -2,7 +2,11 @@
 
 #include "setup/SetupNG.h"
 #include "sensor.h"
+#ifdef GlyphCache_Test
+#include "logdef.h"
+#else
 #include "logdefnone.h"
+#endif
 
 
 #include <eglib/display/ili9341.h>
@@ -143,6 +147,9 @@ void  AdaptUGC::begin() {
 		ili9341_config.width = 320;
 		ili9341_config.height = 240;
 	}
+	if( display_colors.get() == DISPLAY_RGB565 ){
+		ili9341_config.color = ILI9341_COLOR_16_BIT;
+	}
 	esp32_ili9341_config.freq = rint( FREQ_BMP_SPI * 3 * ((100.0 + display_clock_adj.get())/100.0));
 	ESP_LOGI(FNAME, "eglib_Send() &eglib:%x  hal-driv:%x config:%x  clk:%.3f MHz\n", (unsigned int)eglib, (unsigned int)&esp32_ili9341, (unsigned int)&esp32_ili9341_config, (double)(esp32_ili9341_config.freq/1000000.0) );
 	eglib_Init( &myeglib, &esp32_ili9341, &esp32_ili9341_config, &ili9341, &ili9341_config );
@@ -153,6 +160,56 @@ void  AdaptUGC::begin() {
 
 	}
 }
+void AdaptUGC::fence()
+{
+	esp32_ili9341_fence();
+}
+
+#ifdef GlyphCache_Test
+extern "C" {
+#include <eglib/glyph_cache.h>
+}
+#include <esp_timer.h>
+
+// Draws the figures of the vario screen 500 times each, once with the glyph cache cleared before
+// every string and once warm. Logs the time per string until the pixels are on the wire and the
+// cache counters of the run.
+void AdaptUGC::glyph_cache_test()
+{
+	struct Case {
+		const uint8_t *font;
+		const char *s;
+	} cases[] = {
+		{ ucg_font_fub35_hn, "-2.4" },
+		{ ucg_font_fub25_hr, "1234" },
+		{ ucg_font_fub14_hr, "118 km/h" },
+		{ ucg_font_fub11_hr, "12.6V" },
+	};
+	const int N = 500;
+	setColor( 255, 255, 255 );
+	for ( const Case &c : cases ) {
+		setFont( c.font, true );
+		for ( int warm = 0; warm < 2; warm++ ) {
+			eglib_GlyphCacheClear();
+			eglib_GlyphCacheStats(); // reset the counters
+			int64_t t0 = esp_timer_get_time();
+			for ( int i = 0; i < N; i++ ) {
+				if ( ! warm ) {
+					eglib_GlyphCacheClear();
+				}
+				setPrintPos( 20, 120 );
+				print( c.s );
+			}
+			fence();
+			int64_t dt = esp_timer_get_time() - t0;
+			struct glyph_cache_stats st = eglib_GlyphCacheStats();
+			ESP_LOGI(FNAME, "glyph cache %s %-8s: %6.1f us/string, hits %u misses %u evictions %u uncached %u", warm ? "warm" : "cold", c.s,
+				(float)dt / N, (unsigned)st.hits, (unsigned)st.misses, (unsigned)st.evictions, (unsigned)st.uncached);
+		}
+	}
+	clearScreen();
+}
+#endif
 int16_t AdaptUGC::getDisplayWidth() const
 {
 	return ili9341_config.width;
@@ -8,6 +8,8 @@
 
 #define FREQ_BMP_SPI 13111111  // *3 for SPI display clock, /2 for BMP pressure sensor clock
 
+// #define GlyphCache_Test 1
+
 // later we want to get rid of UGC, so lets add all needed API definitions here
 
 typedef struct _ucg_color_t
@@ -135,6 +137,8 @@ public:
 	inline void setFontPosCenter() { eglib_setFontOrigin( eglib, FONT_MIDDLE ); };
 	inline int16_t getFontAscent() { return eglib->drawing.font->ascent; };
 	inline int16_t getFontDescent() { return eglib->drawing.font->descent; };
+	// rows of a text line relative to the print position y
+	inline void getTextCell(int16_t &top, int16_t &height) { eglib_GetTextCell(eglib, &top, &height); };
 
 
 	// scrolling, clipping, clear
@@ -142,6 +146,10 @@ public:
 	inline void scrollLines(int16_t lines) {  eglib_scrollScreen( eglib, lines ); };                    // display driver function  todo
 	inline void scrollSetMargins( int16_t top, int16_t bottom ) { eglib_setScrollMargins( eglib, top, bottom ); }; // display driver function
 	inline void setClipRange( int16_t x, int16_t y, int16_t w, int16_t h ) { eglib_setClipRange(eglib, x, y, w, h );};
+	void fence();  // wait for the pixel data still on the way to the display
+#ifdef GlyphCache_Test
+	void glyph_cache_test();
+#endif
 
 private:
 	inline void advanceCursor( size_t delta );
@@ -1,6 +1,7 @@
 #include "Atmosphere.h"
 
 #include <cmath>
+#include <cstdint>
 
 // With density of water from: http://www.csgnetwork.com/waterinformation.html
 // @ 22.8 degree: 0.997585
@@ -40,13 +41,86 @@
 // p = p0​⋅(1−​L⋅h/T0​)^E
 //
 
+// Atmosphere kernel
+//
+// The powf() calls with the 5.255 exponent cost ~10k cycles each on the esp32 (no double unit, soft
+// exp/log). They are replaced by piecewise cubic Hermite polynomials, sampled once at startup from the
+// exact function and its derivative. The interpolant is C1 continuous, so no steps show up in the vario
+// differentiation of the altitude. Evaluation is a table index plus a 3rd order Horner scheme.
+//
+// Error bound of a cubic Hermite segment: max|f^(4)| * h^4 / 384
+//  altitude: (p/p0)^(1/5.255) on [0.15, 1.15], 64 segments -> ~1e-7 rel. (~5mm @ 12000m incl. float rounding)
+//  pressure: (1-h/44330.77)^5.255 on [-1000m, 14000m], 32 segments -> < 1e-8 rel. (< 0.001hPa)
+// Arguments outside of these ranges fall back to the exact powf() calls.
+namespace {
+
+constexpr float ALT_EXP = 1.0f / 5.255f;
+constexpr float PRESS_EXP = 5.255f;
+constexpr float ALT_SCALE = 44330.0f;       // calcAltitude
+constexpr float PRESS_SCALE = 44330.76923f; // calcPressure
+
+template<int N>
+class PowKernel
+{
+public:
+    PowKernel(double lo, double hi, double e) :
+        _lo(lo), _hi(hi), _inv_step(N / (hi - lo)), _exp(e)
+    {
+        const double h = (hi - lo) / N;
+        for (int i = 0; i < N; i++) {
+            double x0 = lo + i * h;
+            double x1 = x0 + h;
+            double y0 = std::pow(x0, e);
+            double y1 = std::pow(x1, e);
+            double m0 = e * y0 / x0 * h; // derivatives scaled to the unit segment
+            double m1 = e * y1 / x1 * h;
+            _c[i][0] = y0;
+            _c[i][1] = m0;
+            _c[i][2] = 3. * (y1 - y0) - 2. * m0 - m1;
+            _c[i][3] = 2. * (y0 - y1) + m0 + m1;
+        }
+    }
+    float operator()(float x) const
+    {
+        if ( x < _lo || x >= _hi ) {
+            return std::powf(x, _exp);
+        }
+        float t = (x - _lo) * _inv_step;
+        int i = (int)t;
+        t -= (float)i;
+        const float *c = _c[i];
+        return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+    }
+
+private:
+    const float _lo, _hi, _inv_step, _exp;
+    float _c[N][4];
+};
+
+// pressure ratio -> ratio^(1/5.255), 1KB
+const PowKernel<64> altKernel(0.15, 1.15, ALT_EXP);
+// (1 - h/44330.77) -> ^5.255, 512B
+const PowKernel<32> pressKernel(1. - 14000. / PRESS_SCALE, 1. + 1000. / PRESS_SCALE, PRESS_EXP);
+
+// ISA altitude -> p/p0
+inline float pressureRatio(float altitude) {
+    return pressKernel(1.0f - altitude / PRESS_SCALE);
+}
+
+// sqrt(rho/rho0) from pressure ratio and temperature
+inline float densityFactor(float pratio, float temp) {
+    return std::sqrtf(288.15f / (temp + 273.15f) * pratio);
+}
+
+} // anonymous namespace
+
 float Atmosphere::TAS(float ias, float baro, float temp) {
      return (ias * std::sqrtf(1.225 / (baro * 100.0 / (287.058 * (273.15 + temp)))));
 }
 
 // TAS=IAS/sqrt( 288.15/(T+273.15) * (P/1013.25) )
 float Atmosphere::TAS2(float ias, float altitude, float temp) {
-    return (ias / std::sqrtf(288.15 / (temp + 273.15) * (Atmosphere::calcPressureISA(altitude) / 1013.25)));
+    return ias / densityFactor(pressureRatio(altitude), temp);
 }
 
 // float Atmosphere::CAS(float dp) {
@@ -76,14 +150,75 @@ float Atmosphere::kmh2pascal(float kmh) {
 }
 
 float Atmosphere::calcAltitude(float SeaLevel_Pres, float pressure) {
-    return (44330.0f * (1.0f - std::powf((float)(pressure) / SeaLevel_Pres, (1.0f / 5.255f))));
+    return ALT_SCALE * (1.0f - altKernel(pressure / SeaLevel_Pres));
 }
 
 // respect temp gradient 6.5 K / km
 float Atmosphere::calcPressure(float seaLevelPressure, float altitude) {
-    return (seaLevelPressure * std::powf((1.0f - ((float)(altitude) / 44330.76923f)), 5.255f));
+    return seaLevelPressure * pressureRatio(altitude);
 }
 
 float Atmosphere::calcQNHPressure(float pressure, float altitude) {
-    return pressure / std::powf((1.0f - (6.5f * (float)(altitude) / 288150.0f)), 5.255f);
+    return pressure / pressureRatio(altitude);
+}
+
+// (p/qnh)^a = (p/1013.25)^a * (1013.25/qnh)^a, the QNH factor is cached by the caller
+void Atmosphere::calcAltitudes(float seaLevelPressure, float pressure, float &altSTD, float &altQNH, QNHFactor &cache)
+{
+    if ( seaLevelPressure != cache.qnh ) {
+        cache.qnh = seaLevelPressure;
+        cache.factor = altKernel(1013.25f / seaLevelPressure);
+    }
+    float r = altKernel(pressure / 1013.25f);
+    altSTD = ALT_SCALE * (1.0f - r);
+    altQNH = ALT_SCALE * (1.0f - r * cache.factor);
+}
+
+void Atmosphere::calcPressureTAS(float seaLevelPressure, float altitude, float ias, float temp, float &pressure, float &tas)
+{
+    float r = pressureRatio(altitude);
+    pressure = seaLevelPressure * r;
+    tas = ias / densityFactor(r, temp);
+}
+
+
+#ifdef Atmosphere_Test
+#include "logdef.h"
+#include <esp_timer.h>
+
+// Max deviation against the exact powf() implementation in the flight envelope and cost per call
+void Atmosphere::kernel_test()
+{
+    float max_alt_err = 0, max_p_err = 0;
+    for (float qnh = 950.f; qnh <= 1050.f; qnh += 10.f) {
+        for (float h = -500.f; h <= 12000.f; h += 0.7f) {
+            float pexact = qnh * std::powf(1.0f - h / PRESS_SCALE, PRESS_EXP);
+            float p = calcPressure(qnh, h);
+            max_p_err = std::fmax(max_p_err, std::fabs(p - pexact));
+            float hexact = ALT_SCALE * (1.0f - std::powf(pexact / qnh, ALT_EXP));
+            max_alt_err = std::fmax(max_alt_err, std::fabs(calcAltitude(qnh, pexact) - hexact));
+        }
+    }
+    ESP_LOGI(FNAME, "Kernel max error: altitude %.4fm, pressure %.5fhPa", max_alt_err, max_p_err);
+
+    constexpr int N = 1000;
+    volatile float sink = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < N; i++) {
+        sink = sink + ALT_SCALE * (1.0f - std::powf((800.f + i * 0.1f) / 1013.25f, ALT_EXP));
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (int i = 0; i < N; i++) {
+        sink = sink + calcAltitude(1013.25f, 800.f + i * 0.1f);
+    }
+    int64_t t2 = esp_timer_get_time();
+    QNHFactor cache;
+    for (int i = 0; i < N; i++) {
+        float a, b;
+        calcAltitudes(1020.f, 800.f + i * 0.1f, a, b, cache);
+        sink = sink + a + b;
+    }
+    int64_t t3 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "Altitude, %d calls: powf %lldusec, kernel %lldusec, batch(std+qnh) %lldusec", N, t1 - t0, t2 - t1, t3 - t2);
 }
+#endif
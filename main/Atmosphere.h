@@ -21,4 +21,18 @@ float calcPressure(float seaLevelPressure, float alti);
 inline float calcPressureISA(float alti) { return calcPressure(1013.25f, alti); }
 float calcQNHPressure(float pressure, float altitude);
 
+// Batch evaluation, one kernel pass for all results that share the same pressure ratio
+// pressure -> ISA altitude and QNH altitude, the QNH factor is kept by each caller over its calls
+struct QNHFactor {
+    float qnh = 1013.25f;
+    float factor = 1.f;
+};
+void calcAltitudes(float seaLevelPressure, float pressure, float &altSTD, float &altQNH, QNHFactor &cache);
+// altitude -> static pressure at QNH and TAS
+void calcPressureTAS(float seaLevelPressure, float altitude, float ias, float temp, float &pressure, float &tas);
+
+#ifdef Atmosphere_Test
+void kernel_test();
+#endif
+
 }; // namespace Atmosphere
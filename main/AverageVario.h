@@ -1,8 +1,7 @@
 
 #pragma once
 
-#include <list>
-#include <array>
+#include "sensor/Filters.h"
 
 class AverageVario{
 	AverageVario() {};
@@ -16,9 +15,9 @@ public:
 private:
 	static float averageClimbSec;
 	static float averageClimb;
-	static std::array<float, 10> avClimb100MSec;
-	static std::array<float, 60> avClimbSec;
-	static std::list<float> avClimbMin;
+	static MovingAverage<10> avClimb100MSec;
+	static MovingAverage<60> avClimbSec;
+	static MovingAverage<300> avClimbMin; // up to the longest core climb history
 	static int avindex100MSec;
 	static int avindexSec;
 	static int samples;
@@ -6,6 +6,7 @@
 
 #include "Atmosphere.h"
 #include "sensor.h"
+#include "comm/SpiBus.h"
 #include <logdefnone.h>
 
 #include <freertos/FreeRTOS.h>
@@ -15,10 +16,10 @@
 #include <cstdint>
 #include <cstdio>
 
-extern SemaphoreHandle_t spiMutex;
 
-bool BME280_ESP32_SPI::setSPIBus(gpio_num_t sclk, gpio_num_t mosi, gpio_num_t miso, gpio_num_t cs, uint32_t freq)
+bool BME280_ESP32_SPI::setSPIBus(gpio_num_t sclk, gpio_num_t mosi, gpio_num_t miso, gpio_num_t cs, uint32_t freq, SpiClient client)
 {
+	_client = client;
 	_sclk = sclk;
 	_mosi = mosi;
 	_miso = miso;
@@ -143,7 +144,7 @@ bool BME280_ESP32_SPI::begin(){
 
 //***************BME280 ****************************
 void BME280_ESP32_SPI::WriteRegister(uint8_t reg_address, uint8_t data) {
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
+	SpiBus::acquire(_client);
 	ta.addr =  reg_address & 0x7F;   // Bit 7 != 0 for Write operation!
 	ta.tx_data[0] = data;
 	ta.length = 8; // Total length in bits
@@ -154,7 +155,7 @@ void BME280_ESP32_SPI::WriteRegister(uint8_t reg_address, uint8_t data) {
 		ESP_LOGI(FNAME, "Failed to write register: %s\n", esp_err_to_name(ret));
 	}
 
-	xSemaphoreGive(spiMutex);
+	SpiBus::release(_client);
 }
 
 //*******************************************************
@@ -335,9 +336,9 @@ uint8_t BME280_ESP32_SPI::readID()
 	ta.addr = 0xD0 | 0x80;
 	ta.length = 8; // Total transaction length in bits
 	// Perform the SPI transaction
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
+	SpiBus::acquire(_client);
 	esp_err_t ret = spi_device_transmit(spi, &ta);
-	xSemaphoreGive(spiMutex);
+	SpiBus::release(_client);
 	if (ret != ESP_OK)
 	{
 		ESP_LOGE(FNAME, "SPI Read failed: %s", esp_err_to_name(ret));
@@ -354,9 +355,9 @@ uint32_t BME280_ESP32_SPI::readADC(uint8_t reg)
 	ta.addr =  reg | 0x80;
 	ta.length = 24;
 
-	xSemaphoreTake(spiMutex, portMAX_DELAY);
+	SpiBus::acquire(_client);
 	esp_err_t ret = spi_device_transmit(spi, &ta);
-	xSemaphoreGive(spiMutex);
+	SpiBus::release(_client);
 	if (ret != ESP_OK)
 	{
 		ESP_LOGE("SPI", "SPI read failed: %s", esp_err_to_name(ret));
@@ -371,10 +372,10 @@ uint16_t BME280_ESP32_SPI::read16bit(uint8_t reg)
 	ta.addr =  reg | 0x80; // 0xFD Humidity msb read =bit 7 high
 	ta.length = 16;
 
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
+	SpiBus::acquire(_client);
 	// Perform the SPI transaction
 	esp_err_t ret = spi_device_transmit(spi, &ta);
-	xSemaphoreGive(spiMutex);
+	SpiBus::release(_client);
 	if (ret != ESP_OK)
 	{
 		ESP_LOGE(FNAME, "Failed to read 16-bit value: %s", esp_err_to_name(ret));
@@ -392,9 +393,9 @@ uint8_t BME280_ESP32_SPI::read8bit(uint8_t reg) {
 	ta.addr =  reg | 0x80;
 	ta.length = 8;
 
-	xSemaphoreTake(spiMutex,portMAX_DELAY );
+	SpiBus::acquire(_client);
 	esp_err_t ret = spi_device_transmit(spi, &ta);
-	xSemaphoreGive(spiMutex);
+	SpiBus::release(_client);
 	if (ret != ESP_OK)
 	{
 		ESP_LOGE(FNAME, "Failed to read 16-bit value: %s", esp_err_to_name(ret));
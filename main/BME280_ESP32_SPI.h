@@ -28,6 +28,7 @@ altitude calculation by open source community on github.
 #pragma once
 
 #include "PressureSensor.h"
+#include "comm/SpiBus.h"
 
 #include <driver/gpio.h>
 #include <driver/spi_master.h>
@@ -38,7 +39,7 @@ class BME280_ESP32_SPI: public PressureSensor
 public:
 	BME280_ESP32_SPI();
 	bool  setBus( I2C_t *_theBus ) { return true; };  // for future
-	bool  setSPIBus(gpio_num_t sclk, gpio_num_t mosi, gpio_num_t miso, gpio_num_t cs, uint32_t freq );
+	bool  setSPIBus(gpio_num_t sclk, gpio_num_t mosi, gpio_num_t miso, gpio_num_t cs, uint32_t freq, SpiClient client );
 	bool begin();
     bool selfTest( float& p, float& t );
 
@@ -65,6 +66,7 @@ private:
 private:
 	gpio_num_t _sclk, _mosi, _miso;
 	gpio_num_t _cs;
+	SpiClient _client = SPI_BARO;
 	int _freq;
 	int32_t  _t_fine;
 
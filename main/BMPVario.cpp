@@ -6,7 +6,12 @@
 #include "AverageVario.h"
 #include "setup/SetupNG.h"
 #include "sensor.h"
+#include "EventTrace.h"
+#ifdef BMPVario_Test
+#include "logdef.h"
+#else
 #include "logdefnone.h"
+#endif
 
 
 #include <cmath>
@@ -27,7 +32,7 @@ double BMPVario::readAVGTE() {
 }
 
 float BMPVario::readS2FTE() {
-	return _TEF;
+	return _TEF.value();
 }
 
 
@@ -36,9 +41,9 @@ uint64_t lastrts = 0;
 void BMPVario::configChange(){
 	_damping = vario_delay.get();
 	_damping_factor = (1.0/(_damping));
-	int filter_len = rint(_damping*(10.0/3));
-	TEavg.setLength( filter_len );
-	ESP_LOGI(FNAME, "configChange damping:%f filter_len:%d", _damping, filter_len );
+	float window = rint(_damping*(10.0/3)) * 0.1; // sec, same as the former 10Hz sample count
+	TEavg.setWindow( window );
+	ESP_LOGI(FNAME, "configChange damping:%f window:%.1f", _damping, window );
 }
 
 void BMPVario::setup() {
@@ -52,7 +57,7 @@ void BMPVario::setup() {
 		lastAltitude = _currentAlt;
 		predictAlt = _currentAlt;
 		Altitude = _currentAlt;
-		averageAlt = _currentAlt;
+		averageAlt.reset(_currentAlt);
 		ESP_LOGI(FNAME, "Initial Alt=%0.1f",Altitude );
 	}else{
 		ESP_LOGE(FNAME, "Initial Alt read error Alt=%0.1f",Altitude );
@@ -60,82 +65,133 @@ void BMPVario::setup() {
 }
 
 
+// Scale a filter gain tuned for the 10Hz cycle to a step of dt seconds
+static inline float gainFor(float k, float dt)
+{
+	return 1.f - std::pow(1.f - k, dt * 10.f);
+}
+
+// TE vario filter, the sample interval dt is measured by the caller and may vary from sample to sample
+double BMPVario::filterStep( double alt, float dt ) {
+	_currentAlt = alt;
+	// ESP_LOGI(FNAME,"TE alt: %4.3f m, ST: %.1f PI: %.1f", _currentAlt, baroP, (dynamicP*100) );
+	averageAlt.filter(_currentAlt, gainFor(0.19f, dt));
+	float adiff = _currentAlt - Altitude;
+	// ESP_LOGI(FNAME,"BMPVario new alt %0.1f err %0.1f", _currentAlt, err);
+	float diff = (abs(adiff) * 1000) + 1;
+	if(diff > 1000000){  // more than 100 m altitude diff in 0.1 second not plausible ( > 400 km/h vertical ) -> handled by Kalman filter
+		 ETRACE(TE_OOB, diff/10000);
+	}
+	float err = (abs(_currentAlt - predictAlt) * 1000) + 1;
+	float kg = (diff / (err*_errorval + diff)) * _alpha;
+	Altitude += (adiff) * gainFor(kg, dt);
+	float altDiff = Altitude - lastAltitude;
+	// ESP_LOGI(FNAME," altDiff %0.1f diff %0.1f", TE, diff);
+	lastAltitude = Altitude;
+	float TEAVG = TEavg( altDiff / dt, dt );
+	predictAlt = Altitude + (TEAVG * dt);
+	_TEF.filter(TEAVG, gainFor(_damping_factor, dt));
+	// Bird catcher
+	if( abs(altDiff) > 2.f * dt ){
+		ETRACE(TE_STEP, _currentAlt, _TEF.value(), TEAVG, dt);
+	}
+	return _TEF.value();
+}
+
 double BMPVario::readTE( float tas, float tep ) {
 	if ( _test )     // we are in testmode, just return what has been set
-		return _TEF;
+		return _TEF.value();
 	bool success;
-	N++;
-	// Latency supervision and correction
+	// Measured sample interval, no padding, the filter takes any dt
 	uint64_t rts = esp_timer_get_time();
 	float time_delta = (float)(rts - lastrts)/1000000.0;   // in seconds
-	if( time_delta < 0.095 ) {   // ensure time_delta is 100 mS at least
-		int addwait = (int)(100.0-time_delta*1000);
-		// ESP_LOGW(FNAME, "Too short TE time time_delta <95 mS: %4.1f, add wait %d ", time_delta*1000, addwait );
-		delay( addwait );
-		rts = esp_timer_get_time();
-		time_delta = (float)(rts - lastrts)/1000000.0;
+	if( time_delta < 0.001 ) {
+		return _TEF.value();
 	}
 	lastrts = rts;
-	if( time_delta < 0.090 || time_delta > 0.2 ) {
-		ESP_LOGW(FNAME,"Vario time_delta=%2.3f sec", time_delta );
+	if( time_delta > 0.2 ) {
+		ETRACE(TE_GAP, time_delta);
 	}
 	bmpTemp = _sensorTE->readTemperature( success );
 	// ESP_LOGI(FNAME,"BMP temp=%0.1f", bmpTemp );
+	double alt;
 	if( te_comp_enable.get() == TE_TEK_EPOT ) {
-		_currentAlt = altitude.get(); // already read
+		alt = altitude.get(); // already read
 		if( !success )
-			_currentAlt = lastAltitude;  // ignore readout when failed
+			alt = lastAltitude;  // ignore readout when failed
 		float mps = tas / 3.6;  // m/s
 		float cw  = myS2F->cw( mps );
 		float ealt = (((  (mps*mps)/19.62) * (1+(te_comp_adjust.get()/100.0) ))) * ( 1 - cw );  // Ekin ~ h = v²/2g  * adjust * (1-cw)
-		_currentAlt += ealt;
+		alt += ealt;
 		ESP_LOGD(FNAME,"Energiehöhe @%0.1f km/h: %0.1f cw: %f", tas, ealt, cw );
 	}
 	else if( te_comp_enable.get() == TE_TEK_PRESSURE ){
-		_currentAlt = Atmosphere::calcAltitude(_qnh, baroP-(dynamicP/100.0)*(1+(te_comp_adjust.get()/100.0) ));  // subtract PI pressure like TEK probe does
+		alt = Atmosphere::calcAltitude(_qnh, baroP-(dynamicP/100.0)*(1+(te_comp_adjust.get()/100.0) ));  // subtract PI pressure like TEK probe does
 	}
 	else{
-		_currentAlt = Atmosphere::calcAltitude(_qnh, tep );
+		alt = Atmosphere::calcAltitude(_qnh, tep );
 	}
-	// ESP_LOGI(FNAME,"TE alt: %4.3f m, ST: %.1f PI: %.1f", _currentAlt, baroP, (dynamicP*100) );
-	averageAlt += (_currentAlt - averageAlt) * 0.1;
-	float adiff = _currentAlt - Altitude;
-	// ESP_LOGI(FNAME,"BMPVario new alt %0.1f err %0.1f", _currentAlt, err);
-	float diff = (abs(adiff) * 1000) + 1;
-	if(diff > 1000000){  // more than 100 m altitude diff in 0.1 second not plausible ( > 400 km/h vertical ) -> handled by Kalman filter
-		 ESP_LOGW(FNAME,"TE sensor delta OOB: %f m", diff/10000 );
-	}
-	float err = (abs(_currentAlt - predictAlt) * 1000) + 1;
-	averageAlt += (_currentAlt - averageAlt) * 0.1;
-	float kg = (diff / (err*_errorval + diff)) * _alpha;
-	Altitude += (adiff) * kg;
-	float altDiff = Altitude - lastAltitude;
-	// ESP_LOGI(FNAME," altDiff %0.1f diff %0.1f", TE, diff);
-	lastAltitude = Altitude;
-	float TEAVG = TEavg( altDiff / time_delta );
-	predictAlt = Altitude + (TEAVG * time_delta);
-	_TEF += ((TEAVG - _TEF)) * _damping_factor;
-	if( !(N%10) ){ // every second one sample
-		_avgTE = avgTE( _TEF );
+	filterStep( alt, time_delta );
+
+	// the averagers stay on their 1 sec and 100 msec grid, independent of the TE sample rate
+	_sec_time += time_delta;
+	if( _sec_time >= 1.f ){ // every second one sample
+		_sec_time = std::fmod(_sec_time, 1.f);
+		_avgTE = avgTE.filter( _TEF.value() );
 		// ESP_LOGI(FNAME," _avgTE: %f ", _avgTE);
 	}
- 	if( holddown > 0 ) {
-		holddown--;
+	_tick_time += time_delta;
+	for( int i=0; _tick_time >= 0.1f && i<10; i++ ) {
+		_tick_time -= 0.1f;
+		if( holddown > 0 ) {
+			holddown--;
+		}
+		else
+		{
+			AverageVario::newSample( _TEF.value() );
+		}
 	}
-	else
-	{
-		AverageVario::newSample( _TEF );
-	}
-	// Bird catcher
-	if( (altDiff > 0.2) || (altDiff < -0.2) ){
-		ESP_LOGI(FNAME,"Vario alt: %f, Vario: %f, Vario-AVG: %f, t-delta=%2.3f sec \b\b\b", _currentAlt, _TEF, TEAVG, time_delta );
+	_tick_time = std::fmod(_tick_time, 0.1f);
+	return _TEF.value();
+}
+
+#ifdef BMPVario_Test
+// Feed a synthetic TE altitude trace, 10 sec level and then a 2 m/s climb with 10 cm of sensor noise,
+// at 10, 20 and 50Hz with jittered intervals. Prints the settled vario and the 50% and 90% step latency,
+// which should stay the same for all rates.
+void BMPVario::filter_test()
+{
+	const int rates[] = { 10, 20, 50 };
+	for( int rate : rates ) {
+		BMPVario v;
+		v._damping = 3.f;
+		v._damping_factor = 1.f/3.f;
+		v.TEavg.setWindow( 1.f );
+		v.Altitude = v.lastAltitude = v.predictAlt = 500.;
+		v.averageAlt.reset( 500. );
+		uint32_t seed = 1;
+		float t = 0, t50 = -1, t90 = -1, sum = 0;
+		int n = 0;
+		while( t < 30.f ) {
+			seed = seed * 1664525 + 1013904223;
+			float dt = (1.f / rate) * (0.8f + 0.4f * (seed >> 8) / 16777216.f); // +-20% jitter
+			t += dt;
+			seed = seed * 1664525 + 1013904223;
+			float noise = 0.1f * ((seed >> 8) / 16777216.f - 0.5f);
+			float alt = 500.f + (t > 10.f ? 2.f * (t - 10.f) : 0.f) + noise;
+			float te = v.filterStep( alt, dt );
+			if( t50 < 0 && te > 1.f ) t50 = t - 10.f;
+			if( t90 < 0 && te > 1.8f ) t90 = t - 10.f;
+			if( t > 25.f ) { sum += te; n++; }
+		}
+		ESP_LOGI(FNAME, "TE filter %2dHz: settled %.3f m/s, latency 50%% %.2f sec, 90%% %.2f sec", rate, sum/n, t50, t90 );
 	}
-	return _TEF;
 }
+#endif
 
 void BMPVario::setTE( double te ) {
 	_test = true;
-	_TEF = te;
+	_TEF.reset( te );
 	// calcAnalogOut();
 }  // for testing purposes
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "average.h"
+#include "sensor/Filters.h"
 #include "S2F.h"
 
 #include <driver/gpio.h>
@@ -14,7 +15,8 @@
 class PressureSensor;
 
 // #define SPS 10                   // samples per second
-constexpr const int FILTER_LEN = 34; // Max Filter length
+constexpr const int FILTER_LEN = 34; // Max Filter length at 10Hz
+constexpr const int TE_MAX_RATE = 50; // Hz, highest TE sample rate the filter window is sized for
 constexpr const double ALPHA = 0.2; // Kalman Gain alpha
 #define ERRORVAL 1.6             // damping Factor for values off the weeds
 constexpr const float STANDARD = 1013.25; // ICAO standard pressure
@@ -32,11 +34,9 @@ public:
 		Altitude = 0;
 		lastAltitude = 0;
 		_errorval = ERRORVAL;
-		_TEF = 0;
 		_test = false;
 		_sensorTE = 0;
 		_avgTE = 0;
-		averageAlt = 0;
 		bmpTemp = 0;
 		_damping = 1.0;
 		_damping_factor = 1.0;
@@ -45,7 +45,8 @@ public:
 		_analog_adj = 0;
 		myS2F = 0;
 		_sensorBARO = 0;
-		N = 0;
+		_sec_time = 0;
+		_tick_time = 0;
 	}
 
 	void begin( PressureSensor *te,  PressureSensor *baro, S2F* s2f );
@@ -58,12 +59,17 @@ public:
 	double readTE(float tas, float tePressure);   // get TE value im m/s
 	double readAVGTE();   // get TE value im m/s
 	float  readS2FTE();   // get TE value im m/s for S2F
-	double readAVGalt() { return averageAlt; };    // get average Altitude
+	double readAVGalt() { return averageAlt.value(); };    // get average Altitude
 	double readCuralt() { return _currentAlt; };   // get current Altitude
 	void setTE( double te ); // for testing purposes
 	void configChange();
+#ifdef BMPVario_Test
+	static void filter_test();
+#endif
 
 private:
+	double filterStep(double alt, float dt);
+
 	gpio_num_t _negative;
 	gpio_num_t _positive;
 	double _alpha;
@@ -74,12 +80,12 @@ private:
 	double predictAlt;
 	double Altitude;
 	double lastAltitude;
-	double averageAlt;
-	Average<FILTER_LEN, double, double> TEavg;
+	Iir1<double> averageAlt;
+	TimeWindowAverage<FILTER_LEN * TE_MAX_RATE / 10> TEavg;
 	double _analog_adj;
 	int    index;
-	double _TEF;
-	Average<60, float, float> avgTE;
+	Iir1<double> _TEF;
+	MovingAverage<60> avgTE;
 	double _avgTE;
 	double bmpTemp;
 	bool _test;
@@ -89,7 +95,8 @@ private:
 	double _currentAlt;
 	static int   holddown;
 	S2F * myS2F;
-	int N;
+	float _sec_time;  // time since the last one second sample
+	float _tick_time; // time since the last 100 msec sample
 };
 
 extern BMPVario bmpVario;
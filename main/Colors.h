@@ -37,6 +37,12 @@ extern uint8_t g_col_header_light_b;
 #define COLOR_BROWN   205, 240, 250  // Chocolate Brown
 #define COLOR_EARTH   119, 176, 232
 
+// A color as the display takes it in RGB565 mode, the fixed palette shades stay apart in it
+constexpr uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) { return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3); }
+static_assert(rgb565(COLOR_GREEN) != rgb565(COLOR_DGREEN) && rgb565(COLOR_BLUE) != rgb565(COLOR_LBLUE)
+    && rgb565(COLOR_BBLUE) != rgb565(COLOR_LBBLUE) && rgb565(DARK_GREY) != rgb565(DARK_DGREY)
+    && rgb565(COLOR_MGREY) != rgb565(COLOR_LGREY) && rgb565(COLOR_LGREY) != rgb565(COLOR_WGREY)
+    && rgb565(COLOR_BROWN) != rgb565(COLOR_EARTH), "palette shades merge in RGB565");
 
 extern int16_t DISPLAY_H;
 extern int16_t DISPLAY_W;
@@ -60,7 +60,6 @@ Compass::Compass( MagnetSensor *sens ) :
 	m_headingValid = false;
 	_tick = 0;
 	gyro_age = 0;
-	_heading_average = -1000;
 	calibrationRunning = false;
 	_heading = 0;
 	errors = 0;
@@ -141,15 +140,8 @@ void Compass:: progress(){
 		m_headingValid = true;
 	}
 
-	float diff = Vector::angleDiffDeg( m_gyro_fused_heading, _heading_average );
-	if( _heading_average == -1000 ) {
-		_heading_average = m_gyro_fused_heading;
-	}
-	else {
-		_heading_average += diff * (1/(10*compass_damping.get()));
-	}
-	_heading_average = Vector::normalizeDeg( _heading_average );
-	// ESP_LOGI(FNAME,"average hd=%.1f mag:%.1f gfh:%.1f", _heading_average, m_magn_heading, m_gyro_fused_heading );
+	_heading_average.filter( m_gyro_fused_heading, 1/(10*compass_damping.get()) );
+	// ESP_LOGI(FNAME,"average hd=%.1f mag:%.1f gfh:%.1f", _heading_average.value(), m_magn_heading, m_gyro_fused_heading );
 }
 
 void Compass::begin(){
@@ -167,7 +159,7 @@ void Compass::start(){
 float Compass::filteredHeading( bool *okIn )
 {
 	*okIn = m_headingValid;
-	return _heading_average;
+	return _heading_average.value();
 }
 
 float Compass::rawHeading( bool *okIn )
@@ -177,13 +169,13 @@ float Compass::rawHeading( bool *okIn )
 }
 
 float Compass::filteredTrueHeading( bool *okIn, bool withDeviation ){ // consider deviation table
-	float fth = _heading_average;
+	float fth = _heading_average.value();
 	if( withDeviation ){
-		float deviation_cur = getDeviation(  _heading_average );
-		fth = Vector::normalizeDeg( _heading_average + deviation_cur );
+		float deviation_cur = getDeviation( fth );
+		fth = Vector::normalizeDeg( fth + deviation_cur );
 	}
 	*okIn = m_headingValid;
-	// ESP_LOGI(FNAME,"filteredTrueHeading head=%.1f hddev=%.1f ok=%d", _heading_average, fth, *okIn   );
+	// ESP_LOGI(FNAME,"filteredTrueHeading head=%.1f hddev=%.1f ok=%d", _heading_average.value(), fth, *okIn   );
 	return fth;
 }
 
@@ -203,9 +195,9 @@ void Compass::calcCalibration(){
 			return;
 		}
 	}
-	avg_calib_sample.x = (*avgX)( magRaw.x );
-	avg_calib_sample.y = (*avgY)( magRaw.y );
-	avg_calib_sample.z = (*avgZ)( magRaw.z );
+	avg_calib_sample.x = avgX->filter( medX.filter( magRaw.x ) );
+	avg_calib_sample.y = avgY->filter( medY.filter( magRaw.y ) );
+	avg_calib_sample.z = avgZ->filter( medZ.filter( magRaw.z ) );
 	// Variance low pass filtered
 	var.x = magRaw.x - avg_calib_sample.x;
 	var.y = magRaw.y - avg_calib_sample.y;
@@ -273,9 +265,12 @@ bool Compass::calibrate( bool (*reporter)( vector_i16 raw, vector_f scale, vecto
 		max = { 0,0,0 };
 		bits = { false, false, false, false, false, false };
 		avg_calib_sample = { 0,0,0 };
-		avgX = new Average<10, int16_t>;
-		avgY = new Average<10, int16_t>;
-		avgZ = new Average<10, int16_t>;
+		avgX = new MovingAverage<10, int16_t, int32_t>;
+		avgY = new MovingAverage<10, int16_t, int32_t>;
+		avgZ = new MovingAverage<10, int16_t, int32_t>;
+		medX.reset();
+		medY.reset();
+		medZ.reset();
 		nrsamples=0;
 		while( true )
 		{
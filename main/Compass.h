@@ -24,7 +24,7 @@ Last update: 2021-03-07
 #include "Deviation.h"
 #include "MagnetSensor.h"
 #include "math/vector_3d.h"
-#include "average.h"
+#include "sensor/Filters.h"
 
 class MagnetSensor;
 
@@ -139,7 +139,7 @@ private:
 	bool m_headingValid;
 
 	int _tick;
-	float _heading_average;
+	Iir1<float, true> _heading_average;
 	int gyro_age;
 
 	/** Variables used by calibration. */
@@ -148,9 +148,10 @@ private:
 	vector_f scale;
 	vector_i16 min;
 	vector_i16 max;
-	Average<10, int16_t> *avgX = 0; // only for calibration
-	Average<10, int16_t> *avgY = 0;
-	Average<10, int16_t> *avgZ = 0;
+	MovingAverage<10, int16_t, int32_t> *avgX = 0; // only for calibration
+	MovingAverage<10, int16_t, int32_t> *avgY = 0;
+	MovingAverage<10, int16_t, int32_t> *avgZ = 0;
+	Median<5, int16_t> medX, medY, medZ; // spike rejection ahead of the min/max peaks
 	bool calibrationRunning;
 	int nrsamples;
 	bitfield_compass bits;
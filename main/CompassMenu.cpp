@@ -21,7 +21,7 @@ Last update: 2021-12-30
 
 #include "setup/SetupMenu.h"
 #include "AdaptUGC.h"
-#include "sensor.h"  // we need spiMutex
+#include "sensor.h"
 #include "vector.h"
 #include "Colors.h"
 #include "logdefnone.h"
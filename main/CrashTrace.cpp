@@ -0,0 +1,279 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "CrashTrace.h"
+
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_freertos_hooks.h>
+#include <esp_app_desc.h>
+#include <esp_http_server.h>
+
+#include <cstring>
+#include <cstdlib>
+
+
+static constexpr uint32_t MAGIC = 0x32525458; // XTR2
+static constexpr uint32_t PENDING = 0x444e4550; // PEND
+
+// not touched by the startup code, lost on a power cycle only
+static RTC_NOINIT_ATTR CrashTrace::Ring rtc;
+static RTC_NOINIT_ATTR uint32_t pending; // rtc holds the trace of a crashed run, not yet fetched
+static CrashTrace::Ring *cur = nullptr;  // the ring of this run, on the heap while a crashed one is pending
+static CrashTrace::Ring *previous = nullptr;
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t running[portNUM_PROCESSORS];
+static uint32_t ticks[portNUM_PROCESSORS];
+static uint32_t task_count = 0;
+
+static bool keepTrace(esp_reset_reason_t why)
+{
+    switch ( why ) {
+    case ESP_RST_POWERON:
+    case ESP_RST_EXT:
+    case ESP_RST_SW:
+    case ESP_RST_DEEPSLEEP:
+        return false;
+    default:
+        return true; // crash, watchdog, brownout or unknown
+    }
+}
+
+// The trace of a crashed run stays in RTC until /trace fetched it, also over the software resets into
+// and out of the download mode. Meanwhile this run records on the heap.
+void CrashTrace::begin()
+{
+    esp_reset_reason_t why = esp_reset_reason();
+    bool valid = rtc.magic == MAGIC && rtc.size == SIZE && rtc.tasks == TASKS && rtc.loops == LOOPS;
+    uint32_t boot = valid ? rtc.boot + 1 : 0;
+    Ring *r = &rtc;
+    if ( valid && (keepTrace(why) || pending == PENDING) ) {
+        r = (Ring*)malloc(sizeof(Ring));
+        if ( r ) {
+            if ( pending != PENDING ) {
+                rtc.reset_reason = why;
+                pending = PENDING;
+            }
+            previous = &rtc;
+        }
+        else {
+            r = &rtc;
+        }
+    }
+    if ( r == &rtc ) {
+        pending = 0;
+    }
+    memset(r, 0, sizeof(Ring));
+    r->size = SIZE;
+    r->tasks = TASKS;
+    r->loops = LOOPS;
+    r->boot = boot;
+    char sha[sizeof(r->elf_sha) + 1];
+    esp_app_get_elf_sha256(sha, sizeof(sha));
+    memcpy(r->elf_sha, sha, sizeof(r->elf_sha));
+    r->magic = MAGIC;
+    cur = r;
+    record(BOOT, 0, why);
+
+    for ( int i = 0; i < portNUM_PROCESSORS; i++ ) {
+        esp_register_freertos_tick_hook_for_cpu(tickHook, i);
+    }
+    ESP_LOGI(FNAME, "crash trace of %d bytes, run %d, reset reason %d%s", (int)sizeof(Ring), (int)boot, why,
+        previous ? ", crashed trace pending" : "");
+}
+
+// in IRAM as the tick hooks, they run with the flash cache off as well
+void IRAM_ATTR CrashTrace::record(uint8_t type, uint16_t arg, uint32_t value)
+{
+    if ( ! cur ) {
+        return; // not yet begun
+    }
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    TaskHandle_t t = xTaskGetCurrentTaskHandle();
+    type |= xPortGetCoreID() << 7;
+
+    portENTER_CRITICAL_SAFE(&trace_mux);
+    // FreeRTOS leaves the task numbers at 0, number them on their first event
+    uint32_t number = 0;
+    if ( t ) {
+        number = uxTaskGetTaskNumber(t);
+        if ( ! number ) {
+            number = ++task_count % 255 + 1; // fits the entry
+            vTaskSetTaskNumber(t, number);
+        }
+    }
+    Ring &r = *cur;
+    Entry &e = r.entry[r.head % SIZE];
+    e.t = now;
+    e.value = value;
+    e.type = type;
+    e.task = number;
+    e.arg = arg;
+    r.head++;
+    Task &k = r.task[number % TASKS];
+    if ( t && k.number != number ) {
+        const char *name = pcTaskGetName(t);
+        k.number = number;
+        for ( int i = 0; i < (int)sizeof(k.name); i++ ) {
+            k.name[i] = *name;
+            if ( *name ) {
+                name++;
+            }
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&trace_mux);
+}
+
+// from the tick interrupt of each core
+void IRAM_ATTR CrashTrace::tickHook()
+{
+    int core = xPortGetCoreID();
+    if ( ++ticks[core] % TICK_DIV || ! cur ) {
+        return;
+    }
+    cur->alive = (uint32_t)esp_timer_get_time();
+    TaskHandle_t t = xTaskGetCurrentTaskHandle();
+    if ( t != running[core] ) {
+        running[core] = t;
+        record(TASK, 0, 0);
+    }
+}
+
+// the address of the call to a not inlined function
+static inline uint32_t caller(void *ra)
+{
+#ifdef __XTENSA__
+    // the two top bits hold the register window increment, back to the call instruction
+    return (((uint32_t)ra & 0x3fffffff) | 0x40000000) - 3;
+#else
+    return (uint32_t)(uintptr_t)ra;
+#endif
+}
+
+void __attribute__((noinline)) CrashTrace::queue(Event e, bool ok)
+{
+    record(e, ok ? 0 : FAILED, caller(__builtin_return_address(0)));
+}
+
+void __attribute__((noinline)) CrashTrace::mark(uint16_t arg)
+{
+    record(MARK, arg, caller(__builtin_return_address(0)));
+}
+
+// only the task of the loop writes its statistics
+void CrashTrace::loopBegin(Loop l)
+{
+    if ( ! cur ) {
+        return;
+    }
+    cur->loop[l].begun_us = (uint32_t)esp_timer_get_time();
+    record(LOOP_BEGIN, l, 0);
+}
+
+void CrashTrace::loopEnd(Loop l, uint32_t period_us)
+{
+    if ( ! cur ) {
+        return;
+    }
+    LoopStat &s = cur->loop[l];
+    uint32_t took = (uint32_t)esp_timer_get_time() - s.begun_us;
+    s.begun_us = 0;
+    s.runs++;
+    s.last_us = took;
+    if ( took > s.max_us ) {
+        s.max_us = took;
+    }
+    uint16_t arg = l;
+    if ( took > period_us ) {
+        s.overruns++;
+        arg |= OVERRUN;
+    }
+    record(LOOP_END, arg, took);
+}
+
+// The crashed trace got fetched, it moves to the heap and the running one into RTC again
+static void release()
+{
+    CrashTrace::Ring *tmp = (CrashTrace::Ring*)malloc(sizeof(CrashTrace::Ring));
+    if ( ! tmp ) {
+        return; // stays pending
+    }
+    memcpy(tmp, &rtc, sizeof(CrashTrace::Ring)); // frozen while pending
+    CrashTrace::Ring *heap = cur;
+    portENTER_CRITICAL(&trace_mux);
+    memcpy(&rtc, heap, sizeof(CrashTrace::Ring));
+    cur = &rtc;
+    portEXIT_CRITICAL(&trace_mux);
+    pending = 0;
+    memcpy(heap, tmp, sizeof(CrashTrace::Ring));
+    previous = heap;
+    free(tmp);
+    ESP_LOGI(FNAME, "crashed trace fetched, recording to RTC again");
+}
+
+// the kept trace of the former run, the running one if there is none or when asked for
+void CrashTrace::send(httpd_req *req, bool now)
+{
+    Ring *copy = nullptr;
+    const Ring *ring = previous;
+    if ( now || ! previous ) {
+        copy = (Ring*)malloc(sizeof(Ring));
+        if ( ! copy ) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+            return;
+        }
+        portENTER_CRITICAL(&trace_mux);
+        memcpy(copy, cur, sizeof(Ring));
+        portEXIT_CRITICAL(&trace_mux);
+        ring = copy;
+    }
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", ring == previous ? "attachment; filename=\"crash.trace\"" : "attachment; filename=\"now.trace\"");
+    bool sent = httpd_resp_send(req, (const char*)ring, sizeof(Ring)) == ESP_OK;
+    free(copy);
+    if ( sent && ring == &rtc ) {
+        release();
+    }
+}
+
+
+#ifdef CrashTrace_Test
+// cost of an event and the ring wrap, the test loop overruns every 4th run
+void CrashTrace::trace_test()
+{
+    uint32_t head = cur->head;
+    int64_t t0 = esp_timer_get_time();
+    for ( int i = 0; i < 1000; i++ ) {
+        queue(QUEUE_SEND, i & 1);
+    }
+    int64_t t1 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "1000 queue events %d us, head %d -> %d", (int)(t1 - t0), (int)head, (int)cur->head);
+
+    const Loop test = Loop(LOOPS - 1);
+    for ( int i = 0; i < 8; i++ ) {
+        loopBegin(test);
+        vTaskDelay(pdMS_TO_TICKS((i % 4) == 3 ? 30 : 5));
+        loopEnd(test, 20000);
+    }
+    const LoopStat &s = cur->loop[test];
+    ESP_LOGI(FNAME, "test loop runs %d, overruns %d, max %d us", (int)s.runs, (int)s.overruns, (int)s.max_us);
+    int tasks = 0;
+    for ( int i = 0; i < TASKS; i++ ) {
+        if ( cur->task[i].number ) {
+            ESP_LOGI(FNAME, "task %d %.10s", cur->task[i].number, cur->task[i].name);
+            tasks++;
+        }
+    }
+    ESP_LOGI(FNAME, "%d tasks seen, former trace %s", tasks, previous ? "pending" : "none");
+}
+#endif
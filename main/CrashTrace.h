@@ -0,0 +1,81 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+struct httpd_req;
+
+// Ring of the last scheduler, queue and loop events in RTC memory, it survives a reset (not a power
+// cycle). After a crash, watchdog or brownout reset the ring of the crashed run stays in RTC until /trace
+// served it, in normal operation or in the download mode, also over the software resets in between.
+// Meanwhile the running one records on the heap, /trace?now serves it. main/crash_trace.py symbolizes
+// the code addresses against the ELF and draws the timeline.
+//
+// The task running on a core is sampled every TICK_DIV ticks and recorded when it changed. Queue events
+// are recorded with the code address of the call, the loops with their duration.
+class CrashTrace
+{
+public:
+    enum Event : uint8_t { BOOT = 1, TASK, QUEUE_SEND, QUEUE_RECV, LOOP_BEGIN, LOOP_END, MARK }; // bit 7 core 1
+    enum Loop : uint8_t { SENSORS, CLIENT, LOOPS = 4 };
+    static constexpr uint16_t OVERRUN = 0x8000; // on the loop id of a LOOP_END
+    static constexpr uint16_t FAILED = 1;        // on a queue event
+    static constexpr int SIZE = 320;
+    static constexpr int TASKS = 24;
+    static constexpr int TICK_DIV = 4;
+
+    struct Entry {
+        uint32_t t;     // usec since boot, low 32 bits
+        uint32_t value; // code address, loop duration, reset reason
+        uint8_t type;
+        uint8_t task;   // FreeRTOS task number
+        uint16_t arg;
+    } __attribute__((packed));
+    struct Task {
+        uint16_t number;
+        char name[10];
+    } __attribute__((packed));
+    struct LoopStat {
+        uint32_t runs;
+        uint32_t max_us;
+        uint32_t overruns;
+        uint32_t last_us;
+        uint32_t begun_us; // start of the running iteration, 0 between them, set at a hang
+    } __attribute__((packed));
+    struct Ring {
+        uint32_t magic;        // XTR2
+        uint16_t size;
+        uint8_t tasks;
+        uint8_t loops;
+        uint32_t head;         // entries written, the next one goes to head % size
+        uint32_t boot;         // runs since the trace got valid
+        uint32_t reset_reason; // that ended this run, 0 while running
+        uint32_t alive;        // usec of the last tick sample, the run ended shortly after
+        char elf_sha[16];      // leading hex digits of the ELF SHA-256
+        LoopStat loop[LOOPS];
+        Task task[TASKS];
+        Entry entry[SIZE];
+    } __attribute__((packed));
+
+    static void begin(); // first thing in app_main
+    static void queue(Event e, bool ok);
+    static void loopBegin(Loop l);
+    static void loopEnd(Loop l, uint32_t period_us);
+    static void mark(uint16_t arg);
+    static void send(httpd_req *req, bool now);
+
+#ifdef CrashTrace_Test
+    static void trace_test();
+#endif
+
+private:
+    static void tickHook();
+    static void record(uint8_t type, uint16_t arg, uint32_t value);
+};
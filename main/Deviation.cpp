@@ -41,6 +41,9 @@ Deviation::Deviation()
 {
 	ESP_LOGI(FNAME,"Deviation()");
 	deviationSpline = 0;
+	_devActive = -1;
+	_devReaders[0] = 0;
+	_devReaders[1] = 0;
 	_devHolddown = 1800;
 	samples = 0;
 }
@@ -64,18 +67,39 @@ void Deviation::begin(){
 }
 
 /**
- * Compute heading deviation by using linear interpolation.
+ * Compute heading deviation by using linear interpolation in the 1° resampled spline.
+ * Lock and allocation free, the table is swapped atomically on recalculation.
  *
  * @param heading Heading value between 0...359
  */
 float Deviation::getDeviation( float heading )
 {
-	if( !deviationSpline )
-		return 0.0;
-	xSemaphoreTake(splineMutex,portMAX_DELAY );
-	float dev=(*deviationSpline)((double)heading);
+	// count in on the published buffer, again when it got replaced meanwhile
+	int cur = _devActive.load();
+	while( true ) {
+		if( cur < 0 )
+			return 0.0;
+		_devReaders[cur]++;
+		int now = _devActive.load();
+		if( now == cur )
+			break;
+		_devReaders[cur]--;
+		cur = now;
+	}
+	const float *lut = _devTable[cur];
+	int idx = (int)heading;
+	float frac = heading - idx;
+	if( frac < 0.f ) { // negative headings
+		idx--;
+		frac += 1.f;
+	}
+	idx %= LUT_SIZE;
+	if( idx < 0 )
+		idx += LUT_SIZE;
+	int next = (idx + 1 < LUT_SIZE) ? idx + 1 : 0;
+	float dev = lut[idx] + (lut[next] - lut[idx]) * frac;
+	_devReaders[cur]--;
 	// ESP_LOGI( FNAME, "RawHeading=%.1f : deviation=%0.2f", heading, dev );
-	xSemaphoreGive(splineMutex);
 	return( dev );
 }
 
@@ -217,6 +241,7 @@ void Deviation::recalcInterpolationSpline()
 	}
 
 	deviationSpline  = new tk::spline(X,Y, tk::spline::cspline_hermite );
+	publishLookupTable();
 	xSemaphoreGive(splineMutex );
 #ifdef VERBOSE_LOG
 	for( int dir=0; dir <= 360; dir+=45 ){
@@ -226,6 +251,29 @@ void Deviation::recalcInterpolationSpline()
 
 }
 
+// needs splineMutex
+void Deviation::publishLookupTable()
+{
+	// Fill the buffer that is not published, once the readers of the former publication left it.
+	// A reader counting in later sees the index changed and moves on to the published one.
+	int next = (_devActive.load() == 0) ? 1 : 0;
+	while( _devReaders[next].load() ) {
+		vTaskDelay(1);
+	}
+	float *lut = _devTable[next];
+	for( int dir=0; dir < LUT_SIZE; dir++ ){
+		lut[dir] = (float)( (*deviationSpline)((double)dir) );
+	}
+	_devActive.store(next);
+#ifdef VERBOSE_LOG
+	float max_err = 0;
+	for( float dir=0; dir < 360; dir+=0.1 ){
+		max_err = std::fmax( max_err, std::fabs(getDeviation(dir) - (float)(*deviationSpline)((double)dir)) );
+	}
+	ESP_LOGI( FNAME, "Deviation table vs. spline max error %.4f", max_err );
+#endif
+}
+
 void Deviation::readInterpolationData()
 {
 	ESP_LOGI( FNAME, "readInterpolationData()");
@@ -281,3 +329,50 @@ void Deviation::saveDeviation(){
 	}
 	xSemaphoreGive(splineMutex);
 }
+
+
+#ifdef Deviation_Test
+#include <esp_timer.h>
+
+static std::atomic<bool> lut_test_run;
+
+// Reads the deviation on the other core while tables of a constant deviation are published
+// back to back, n each. A reader mixing two tables gets a fraction between two of them.
+void Deviation::lut_test()
+{
+	static Deviation d;
+	static int torn, reads;
+	if( ! splineMutex )
+		splineMutex = xSemaphoreCreateMutex();
+	lut_test_run = true;
+	torn = reads = 0;
+	xTaskCreatePinnedToCore([](void *) {
+		while( lut_test_run ) {
+			for( int i=0; i < 100; i++ ) {
+				float v = d.getDeviation( i * 3.6f + 0.5f );
+				if( std::fabs(v - std::round(v)) > 1e-3f )
+					torn++;
+				reads++;
+			}
+			vTaskDelay(1);
+		}
+		vTaskDelete(NULL);
+	}, "devtest", 3072, nullptr, 5, nullptr, 1);
+
+	int64_t t0 = esp_timer_get_time();
+	constexpr int N = 200;
+	for( int n=1; n <= N; n++ ) {
+		std::vector<double> x = { 0, 90, 180, 270, 360 };
+		std::vector<double> y( x.size(), (double)n );
+		xSemaphoreTake(splineMutex, portMAX_DELAY);
+		delete d.deviationSpline;
+		d.deviationSpline = new tk::spline(x, y, tk::spline::cspline_hermite);
+		d.publishLookupTable();
+		xSemaphoreGive(splineMutex);
+	}
+	int64_t t1 = esp_timer_get_time();
+	lut_test_run = false;
+	vTaskDelay(pdMS_TO_TICKS(20));
+	ESP_LOGI(FNAME, "%d publications %lld usec each, %d reads, %d torn, last %.1f", N, (t1 - t0) / N, reads, torn, d.getDeviation(10.f));
+}
+#endif
@@ -24,6 +24,9 @@ Author: Eckhard Völlm, December 2021
 #include <freertos/semphr.h>
 
 #include <map>
+#include <atomic>
+
+// #define Deviation_Test 1
 
 class Deviation
 {
@@ -47,17 +50,30 @@ public:
 	void deviationReload();
 	void tick() { _devHolddown--; };
 
+#ifdef Deviation_Test
+	static void lut_test();
+#endif
+
 private:
 	 // Setup the deviation interpolation data.
 	void readInterpolationData();
 	 // Rebuild spline function
 	void recalcInterpolationSpline();
+	 // Resample the spline into the inactive lookup table and publish it
+	void publishLookupTable();
 
 	std::vector<double> X;
 	std::vector<double> Y;
 
 	static SemaphoreHandle_t splineMutex;
 	tk::spline *deviationSpline;
+	// Double buffered deviation lookup, one entry per degree. Readers count themselves in on the
+	// published buffer, the writer fills the other one under splineMutex once its readers left,
+	// and publishes it by the index.
+	static constexpr int LUT_SIZE = 360;
+	float _devTable[2][LUT_SIZE];
+	std::atomic<int> _devActive;  // published buffer, -1 for none yet
+	std::atomic<int> _devReaders[2];
 	std::map< int, double> devmap;
 	int _devHolddown;
 	int samples;
@@ -136,3 +136,32 @@ bool ESP32NVS::getBlob(const char * key, void *blob, size_t *length){
 	xSemaphoreGive(nvMutex);
 	return ret;
 }
+
+nvs_handle_t ESP32NVS::beginBatch(){
+	xSemaphoreTake(nvMutex,portMAX_DELAY );
+	nvs_handle_t h = open();
+	if( !h ) {
+		xSemaphoreGive(nvMutex);
+	}
+	return h;
+}
+
+bool ESP32NVS::setBlob(nvs_handle_t h, const char * key, const void* value, size_t length){
+	esp_err_t _err = nvs_set_blob(h, key, value, length);
+	if(_err != ESP_OK) {
+		ESP_LOGE(FNAME,"set blob %s error %d", key, _err );
+		return false;
+	}
+	return true;
+}
+
+bool ESP32NVS::endBatch(nvs_handle_t h){
+	bool ret=true;
+	if( nvs_commit(h) != ESP_OK ) {
+		ESP_LOGE(FNAME,"ESP32NVS::endBatch() commit error");
+		ret=false;
+	}
+	close(h);
+	xSemaphoreGive(nvMutex);
+	return ret;
+}
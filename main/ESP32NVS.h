@@ -19,6 +19,10 @@ public:
 	bool eraseAll();
 	bool erase(const char *key);
 	bool getBlob(const char *key, void* object, size_t *length);
+	// many blobs on one handle and one commit, the NVS stays locked from begin to end
+	nvs_handle_t beginBatch();
+	bool setBlob(nvs_handle_t h, const char *key, const void* object, size_t length);
+	bool endBatch(nvs_handle_t h);
 
 public:
 	static ESP32NVS *Instance;
@@ -16,6 +16,7 @@
 #include "setup/CruiseMode.h"
 #include "setup/SetupNG.h"
 #include "sensor.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
 #include <freertos/FreeRTOS.h>
@@ -750,7 +751,7 @@ void Audio::startSound(uint16_t style, bool overlay)
                 ev.cmd = ADD_SOUND; // overlay sound
             }
             
-            xQueueSend(AudioQueue, &ev, 0);
+            CrashTrace::queue(CrashTrace::QUEUE_SEND, xQueueSend(AudioQueue, &ev, 0) == pdTRUE);
         }
     }
 }
@@ -824,7 +825,7 @@ void Audio::updateTone()
     if (audio_mute_gen.get() == AUDIO_ON)
     {
         AudioEvent ev(DO_VARIO, 0); // update vario sound
-        xQueueSend(AudioQueue, &ev, 0);
+        CrashTrace::queue(CrashTrace::QUEUE_SEND, xQueueSend(AudioQueue, &ev, 0) == pdTRUE);
     }
 }
 
@@ -1039,6 +1040,7 @@ void Audio::dactask()
         AudioEvent event;
         if (xQueueReceive(AudioQueue, &event, pdMS_TO_TICKS(2000)) == pdTRUE)
         {
+            CrashTrace::queue(CrashTrace::QUEUE_RECV, true);
             // ESP_LOGI(FNAME, "AudioEvents queued %d", uxQueueMessagesWaiting(AudioQueue));
             // Process audio events
             if ( event.cmd == START_SOUND ) {
@@ -7,6 +7,7 @@
 #include "protocol/Clock.h"
 #include "comm/Mutex.h"
 #include "sensor.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
 #include <freertos/FreeRTOS.h>
@@ -36,7 +37,7 @@ bool IRAM_ATTR ESPRotary::tick()
 		if ( holdCount > lp_duration ) {
 			gotEvent = ButtonEvent(ButtonEvent::LONG_PRESS).raw;
 			holdCount = -1; // go for a "release"
-			xQueueSend(uiEventQueue, &gotEvent, 0);
+			uiPostEvent(gotEvent);
 		}
 	}
 	if ( debounceCount < 2 || (buttonRead == state) ) {
@@ -55,7 +56,7 @@ bool IRAM_ATTR ESPRotary::tick()
 		else {
 			gotEvent = ButtonEvent(ButtonEvent::SHORT_PRESS).raw;
 		}
-		xQueueSend(uiEventQueue, &gotEvent, 0);
+		uiPostEvent(gotEvent);
 		holdCount = 0; // stop counting
 	}
 
@@ -82,9 +83,8 @@ static bool IRAM_ATTR pcnt_event_handler(pcnt_unit_handle_t unit, const pcnt_wat
 		wp_value = sign(edata->watch_point_value);
 	}
 	//else suppress all of a sudden changes in rotational direction
-	int evt = RotaryEvent(step * wp_value).raw;
 	BaseType_t high_task_wakeup = pdFALSE;
-	xQueueSendFromISR((QueueHandle_t)user_ctx, &evt, &high_task_wakeup);
+	uiPostEventFromISR(RotaryEvent(step * wp_value).raw, &high_task_wakeup);
 	lastPulseTime = currentTime;
 	return high_task_wakeup;
 }
@@ -179,7 +179,7 @@ void ESPRotary::begin()
 	pcnt_event_callbacks_t cbs = {
 		.on_reach = pcnt_event_handler
 	};
-	ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_unit, &cbs, uiEventQueue));
+	ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_unit, &cbs, nullptr));
 
 	// Enable & start PCNT
 	pcnt_unit_enable(pcnt_unit);
@@ -267,10 +267,11 @@ bool ESPRotary::readSwitch(int delay) const
 {
     // return true for any button event in the queue, except a release
     // default: wait for just a very short time and shovel all not interresting events off the queue
-    int event;
+    UiQueueItem event;
     bool ret = false;
     while (xQueueReceive(uiEventQueue, &event, pdMS_TO_TICKS(delay)) == pdTRUE) {
-        if (event == ButtonEvent(ButtonEvent::SHORT_PRESS).raw || event == ButtonEvent(ButtonEvent::LONG_PRESS).raw) {
+        CrashTrace::queue(CrashTrace::QUEUE_RECV, true);
+        if (event.code == ButtonEvent(ButtonEvent::SHORT_PRESS).raw || event.code == ButtonEvent(ButtonEvent::LONG_PRESS).raw) {
             ret = true;
         }
     }
@@ -0,0 +1,151 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "EventTrace.h"
+
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_app_desc.h>
+#include <esp_http_server.h>
+
+#include <atomic>
+#include <cstdlib>
+
+
+#if EVENT_TRACE_LEVEL > 0
+
+static constexpr uint32_t MAGIC = 0x31564558; // XEV1
+
+// the header of /events, the valid records of both cores follow
+struct EventsHeader {
+    uint32_t magic;
+    uint16_t record_size;
+    uint8_t cores;
+    uint8_t level;
+    uint32_t now;     // usec at the fetch, the records are timed against it
+    uint32_t written; // events of all cores since boot
+    uint32_t count;   // records following
+    char elf_sha[16]; // leading hex digits of the ELF SHA-256
+} __attribute__((packed));
+
+// one writer per record, a task or an interrupt preempting it on the same core gets the next one
+struct Ring {
+    std::atomic<uint32_t> head{0};
+    EventTrace::Record rec[EventTrace::SIZE];
+};
+static Ring rings[portNUM_PROCESSORS];
+
+// in IRAM to be called from interrupts as well
+void IRAM_ATTR EventTrace::write(Id id, int nargs, const uint32_t *arg)
+{
+    int core = xPortGetCoreID();
+    Ring &r = rings[core];
+    uint32_t i = r.head.fetch_add(1, std::memory_order_relaxed);
+    Record &e = r.rec[i % SIZE];
+    __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release); // seq 0 visible before the record changes
+    e.t = (uint32_t)esp_timer_get_time();
+    e.id = id;
+    e.nargs = nargs;
+    e.flags = (core ? CORE1 : 0) | (xPortInIsrContext() ? ISR : 0);
+    for ( int k = 0; k < 4; k++ ) {
+        e.arg[k] = arg[k];
+    }
+    __atomic_store_n(&e.seq, i + 1, __ATOMIC_RELEASE);
+}
+
+// copy of the complete records of a ring, oldest first, a record written meanwhile is dropped
+static int snapshot(Ring &r, EventTrace::Record *out)
+{
+    uint32_t head = r.head.load(std::memory_order_acquire);
+    uint32_t first = head > EventTrace::SIZE ? head - EventTrace::SIZE : 0;
+    int n = 0;
+    for ( uint32_t i = first; i < head; i++ ) {
+        const EventTrace::Record &e = r.rec[i % EventTrace::SIZE];
+        if ( __atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != i + 1 ) {
+            continue;
+        }
+        out[n] = e;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( __atomic_load_n(&e.seq, __ATOMIC_RELAXED) == i + 1 ) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void EventTrace::send(httpd_req *req)
+{
+    Record *recs = (Record*)malloc(sizeof(Record) * SIZE * portNUM_PROCESSORS);
+    if ( ! recs ) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return;
+    }
+    EventsHeader h = {};
+    h.magic = MAGIC;
+    h.record_size = sizeof(Record);
+    h.cores = portNUM_PROCESSORS;
+    h.level = EVENT_TRACE_LEVEL;
+    h.now = (uint32_t)esp_timer_get_time();
+    int n = 0;
+    for ( int c = 0; c < portNUM_PROCESSORS; c++ ) {
+        h.written += rings[c].head.load(std::memory_order_relaxed);
+        n += snapshot(rings[c], recs + n);
+    }
+    h.count = n;
+    char sha[sizeof(h.elf_sha) + 1];
+    esp_app_get_elf_sha256(sha, sizeof(sha));
+    memcpy(h.elf_sha, sha, sizeof(h.elf_sha));
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"events.bin\"");
+    httpd_resp_send_chunk(req, (const char*)&h, sizeof(h));
+    httpd_resp_send_chunk(req, (const char*)recs, n * sizeof(Record));
+    httpd_resp_send_chunk(req, nullptr, 0);
+    free(recs);
+}
+
+#else
+
+void EventTrace::write(Id, int, const uint32_t*) {}
+
+void EventTrace::send(httpd_req *req)
+{
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Event trace not compiled in");
+}
+
+#endif
+
+
+#ifdef EventTrace_Test
+// cost of a recorded event, of one compiled out and of a printed ESP_LOGI for scale
+void EventTrace::event_test()
+{
+    constexpr int N = 10000;
+    int evaluated = 0;
+    int64_t t0 = esp_timer_get_time();
+    for ( int i = 0; i < N; i++ ) {
+        ETRACE(TRACE_TEST, i, (unsigned)i * 3, 0xdead, i * 0.5f);
+    }
+    int64_t t1 = esp_timer_get_time();
+    for ( int i = 0; i < N; i++ ) {
+        ETRACE(TRACE_DEBUG, ++evaluated);
+    }
+    int64_t t2 = esp_timer_get_time();
+    constexpr int L = 100;
+    for ( int i = 0; i < L; i++ ) {
+        ESP_LOGI(FNAME, "itf %d forward to device %d", 2, i);
+    }
+    int64_t t3 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "event %d ns, compiled out %d ns (%d args evaluated), ESP_LOGI %d ns",
+        (int)((t1 - t0) * 1000 / N), (int)((t2 - t1) * 1000 / N), evaluated, (int)((t3 - t2) * 1000 / L));
+}
+#endif
@@ -0,0 +1,106 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+struct httpd_req;
+
+// Binary event trace for the hot paths, instead of ESP_LOGx with its printf formatting on the console.
+// An event is a fixed record of its id, the usec time stamp and up to 4 arguments, written lock-free
+// into the ring of the core. The format text stays in the table below, main/event_trace.py reads it to
+// decode the records fetched from /events.
+//
+//   ETRACE(DL_FORWARD, itf, did);
+//
+// Events of a level above EVENT_TRACE_LEVEL or a category not in EVENT_TRACE_CATEGORIES are compiled
+// out together with their arguments, EVENT_TRACE_LEVEL 0 drops the rings as well.
+
+#define EVENT_TRACE_LEVEL 3 // 0 off, 1 error, 2 warning, 3 info, 4 debug
+#define EVENT_TRACE_CATEGORIES (EventTrace::bit(EventTrace::COMM) | EventTrace::bit(EventTrace::SENSOR) | EventTrace::bit(EventTrace::SYSTEM))
+// #define EventTrace_Test 1
+
+// EVENT(id, category, level, format), a new event goes to the end to keep the ids of older traces
+#define EVENT_TRACE_EVENTS(EVENT) \
+    EVENT(DL_FORWARD,   COMM,   DEBUG, "itf %d forward to device %d") \
+    EVENT(WIFI_RECV,    COMM,   DEBUG, "wifi socket %d port %d recv %d bytes") \
+    EVENT(TE_STEP,      SENSOR, INFO,  "TE alt %.2f m, vario %.2f, avg %.2f, dt %.3f s") \
+    EVENT(TE_GAP,       SENSOR, WARN,  "TE sample interval %.3f s") \
+    EVENT(TE_OOB,       SENSOR, WARN,  "TE delta out of bounds %.1f m") \
+    EVENT(TRACE_TEST,   SYSTEM, INFO,  "test %d %u %x %f") \
+    EVENT(TRACE_DEBUG,  SYSTEM, DEBUG, "debug %d")
+
+class EventTrace
+{
+public:
+    enum Category : uint8_t { COMM, SENSOR, UI, SYSTEM };
+    enum Level : uint8_t { ERROR = 1, WARN, INFO, DEBUG };
+#define ETRACE_ID(id, cat, lvl, fmt) id,
+    enum Id : uint16_t { NONE, EVENT_TRACE_EVENTS(ETRACE_ID) };
+#undef ETRACE_ID
+    static constexpr int SIZE = 128; // records per core
+    static constexpr uint8_t CORE1 = 1, ISR = 2; // record flags
+
+    struct Record {
+        uint32_t seq;  // ring index + 1, written last, 0 while the record is written
+        uint32_t t;    // usec since boot, low 32 bits
+        uint16_t id;
+        uint8_t nargs;
+        uint8_t flags;
+        uint32_t arg[4];
+    };
+
+    static constexpr uint32_t bit(Category c) { return 1u << c; }
+    static constexpr bool enabled(Id id) {
+        return levels[id] <= EVENT_TRACE_LEVEL && (categories[id] & EVENT_TRACE_CATEGORIES);
+    }
+
+    template<typename... A>
+    static inline void record(Id id, A... a) {
+        static_assert(sizeof...(A) <= 4, "up to 4 event arguments");
+        const uint32_t v[4] = { arg(a)... };
+        write(id, sizeof...(A), v);
+    }
+    static void send(httpd_req *req);
+
+#ifdef EventTrace_Test
+    static void event_test();
+#endif
+
+private:
+#define ETRACE_LEVEL(id, cat, lvl, fmt) lvl,
+#define ETRACE_CATEGORY(id, cat, lvl, fmt) 1u << cat,
+    static constexpr uint8_t levels[] = { 0, EVENT_TRACE_EVENTS(ETRACE_LEVEL) };
+    static constexpr uint32_t categories[] = { 0, EVENT_TRACE_EVENTS(ETRACE_CATEGORY) };
+#undef ETRACE_LEVEL
+#undef ETRACE_CATEGORY
+
+    // floats go as their bits, the decoder picks them by the format
+    template<typename T>
+    static inline uint32_t arg(T a) {
+        if constexpr ( std::is_floating_point_v<T> ) {
+            float f = a;
+            uint32_t u;
+            memcpy(&u, &f, sizeof(u));
+            return u;
+        } else if constexpr ( std::is_pointer_v<T> ) {
+            return (uint32_t)(uintptr_t)a;
+        } else {
+            return (uint32_t)a;
+        }
+    }
+    static void write(Id id, int nargs, const uint32_t *arg);
+};
+
+// the arguments are not evaluated for an event compiled out
+#define ETRACE(id, ...) do { \
+        if constexpr ( EventTrace::enabled(EventTrace::id) ) { EventTrace::record(EventTrace::id, ##__VA_ARGS__); } \
+    } while (0)
@@ -16,6 +16,9 @@ class Flarm {
 	friend class FlarmScreen;
 public:
 	static int alarmLevel(){ return AlarmLevel; };
+	static int relBearing(){ return RelativeBearing; };
+	static int relVertical(){ return RelativeVertical; };
+	static int relDistance(){ return RelativeDistance; };
 	static bool getGPS( float &gndSpeedKmh, float &gndTrack );
 	static bool getGPSknots( float &gndSpeed );
 	static bool gpsStatus() { return myGPS_OK; }
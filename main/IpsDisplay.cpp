@@ -17,6 +17,7 @@
 #include "screen/element/Altimeter.h"
 #include "screen/element/CruiseStatus.h"
 #include "screen/element/FlapsBox.h"
+#include "screen/element/RedrawScheduler.h"
 #include "screen/MessageBox.h"
 
 #include "math/Trigonometry.h"
@@ -131,6 +132,17 @@ int IpsDisplay::tempalt = -2000;
 temp_status_t IpsDisplay::siliconTempStatusOld = MPU_T_UNKNOWN;
 Point IpsDisplay::screen_edge[4];
 
+// Redraw scheduling of the retro vario screen, half of the 10Hz frame is left for the rest of the ui
+static RedrawScheduler scheduler(50000);
+// screen parts that are no screen elements (yet)
+static RenderSlot needleSlot("needle", 0);
+static RenderSlot figureSlot("figure", 200);
+static RenderSlot avgSlot("avgclimb", 400);
+static RenderSlot windSlot("wind", 200);
+static RenderSlot connSlot("conn", 1200);
+static RenderSlot tempSlot("temp", 1200);
+static RenderSlot batBlinkSlot("batblink", 1500);
+
 static union {
     struct {
         uint8_t wireless_alive     : 1;
@@ -402,6 +414,7 @@ void IpsDisplay::writeText( int line, std::string &text ){
 
 void IpsDisplay::clear(){
 	// ESP_LOGI(FNAME,"display clear()");
+	ucg->fence();
 	ucg->setColor( COLOR_BLACK );
 	ucg->drawBox( 0,0,DISPLAY_W,DISPLAY_H );
 	screens_init = INIT_DISPLAY_NULL;
@@ -521,10 +534,23 @@ void IpsDisplay::initDisplay() {
         MCgauge->setLarge(true);
     }
 
+    // target rates and change thresholds
+    if (MCgauge) {
+        MCgauge->setSchedule("mc", 500);
+    }
+    if (S2FBARgauge) {
+        S2FBARgauge->setSchedule("s2fbar", 100, 1.f);
+    }
+    BATgauge->setSchedule("battery", 3000, 0.1f);
+    if (FLAPSgauge) {
+        FLAPSgauge->setSchedule("flaps", 300);
+    }
+
     if (vario_lower_gauge.get()) {
         if (!ALTgauge) {
             ALTgauge = new Altimeter(INNER_RIGHT_ALIGN, (1. - OPT_Y_IN) * DISPLAY_H + 19);
         }
+        ALTgauge->setSchedule("altitude", 100);
     } else {
         if (ALTgauge) {
             delete ALTgauge;
@@ -537,6 +563,7 @@ void IpsDisplay::initDisplay() {
         } else {
             TOPgauge->setDisplay((MultiGauge::MultiDisplay)(vario_upper_gauge.get()));
         }
+        TOPgauge->setSchedule("top", 300);
     } else {
         if (TOPgauge) {
             delete TOPgauge;
@@ -915,43 +942,51 @@ void IpsDisplay::drawDisplay(float te_ms, float ate_ms, float polar_sink_ms, flo
 	float s2fd = Units::Speed( s2fd_ms );
 	// int airspeed = fast_iroundf_positive(Units::Airspeed( airspeed_kmh ));
 
+    scheduler.beginFrame();
+
     // average Climb
-    if (!(tick % 2)) {
+    if (scheduler.due(figureSlot, ate_ms)) {
         MAINgauge->drawFigure(ate_ms);
+        scheduler.done(figureSlot);
     }
 
     // S2F bar
-    if ((((int)s2fd != s2fdalt) || (s2falt != (int)(s2f + 0.5)) || !(tick % 11)) && S2FBARgauge) {
+    if (S2FBARgauge && scheduler.due(*S2FBARgauge, s2fd, s2f)) {
         // static float s=0; // check the bar code
         // s2fd = sin(s) * 42.;
         // s+=0.04;
         S2FBARgauge->draw(s2fd);
         S2FBARgauge->drawSpeed(s2f);
+        scheduler.done(*S2FBARgauge);
     }
 
     // MC val
-    if (MCgauge && !(tick % 5)) {
+    if (MCgauge && scheduler.due(*MCgauge, MC.get())) {
         MCgauge->draw(MC.get());
+        scheduler.done(*MCgauge);
     }
 
     // Bluetooth etc
-	if( !(tick%12) )
+	if( scheduler.due(connSlot) )
 	{
 		drawConnection(DISPLAY_W-25, FLOGO );
+		scheduler.done(connSlot);
 	}
 
     // Upper gauge
-    if (vario_upper_gauge.get() && !(tick % 3)) {
+    if (TOPgauge && scheduler.due(*TOPgauge)) {
         TOPgauge->draw();
+        scheduler.done(*TOPgauge);
     }
 
     // Altitude
-    if (ALTgauge) {
+    if (ALTgauge && scheduler.due(*ALTgauge, altitude.get())) {
         ALTgauge->draw(altitude.get());
+        scheduler.done(*ALTgauge);
     }
 
     // Wind & center aid
-    if (!(tick % 2)) {
+    if (scheduler.due(windSlot)) {
         if (theCenteraid && !VCMode.getCMode()) {
             theCenteraid->drawCenterAid();
         } else if (wind_enable.get() > WA_OFF) {
@@ -982,31 +1017,44 @@ void IpsDisplay::drawDisplay(float te_ms, float ate_ms, float polar_sink_ms, flo
             }
             WNDgauge->drawWind(wdir, wval, idir, ival);
         }
+        scheduler.done(windSlot);
     }
 
-    // Vario indicator
+    // Vario indicator, never dropped
+    scheduler.due(needleSlot);
     MAINgauge->draw(te_ms);
     if (VCMode.isGross()) {
         MAINgauge->drawPolarSink(polar_sink);
     }
+    scheduler.done(needleSlot);
 
     // Battery
-    if (!(tick % 15)) {
+    if (BATgauge->blinking(battery_voltage.get())) {
+        // the low voltage blink toggles the dirty flag, it keeps its own period
+        if (scheduler.due(batBlinkSlot)) {
+            BATgauge->draw(battery_voltage.get());
+            scheduler.done(batBlinkSlot);
+        }
+    }
+    else if (scheduler.due(*BATgauge, battery_voltage.get())) {
         BATgauge->draw(battery_voltage.get());
+        scheduler.done(*BATgauge);
     }
 
     // Temperature Value
 	temp_status_t mputemp = MPU.getSiliconTempStatus();
     float temp = OAT.get();
-	if( (((int)(temp*10) != tempalt) || (mputemp != siliconTempStatusOld)) && !(tick%12)) {
+	if( (((int)(temp*10) != tempalt) || (mputemp != siliconTempStatusOld)) && scheduler.due(tempSlot) ) {
 		drawTemperature( 4, 30, temp );
 		tempalt=(int)(temp*10);
 		siliconTempStatusOld = mputemp;
+		scheduler.done(tempSlot);
 	}
 
     // WK-Indicator
-    if (FLAPSgauge && !(tick % 3)) {
+    if (FLAPSgauge && scheduler.due(*FLAPSgauge)) {
         FLAPSgauge->draw(ias.get());
+        scheduler.done(*FLAPSgauge);
         // Check on flap speeds defined
         if ( FLAP->getNrPositions() == 0 && ! flags.flaps_mbox_shown) {
             MBOX->pushMessage(2, "Pls. set flap speeds" );
@@ -1025,11 +1073,21 @@ void IpsDisplay::drawDisplay(float te_ms, float ate_ms, float polar_sink_ms, flo
     }
 
     // Medium Climb Indicator
-    if (!(tick % 4)) {
+    if (scheduler.due(avgSlot)) {
         // static float s = 0; // check the diamond
         // average_climb.set(sin(s) * 2.);
         // s += 0.1;
         MAINgauge->drawAVG();
+        scheduler.done(avgSlot);
+    }
+
+    // render time accounting, every 30 seconds
+    if (!(tick % 300)) {
+        RenderSlot *const slots[] = { &needleSlot, &figureSlot, &avgSlot, &windSlot, &connSlot, &tempSlot,
+            &batBlinkSlot, S2FBARgauge ? &S2FBARgauge->_slot : nullptr, MCgauge ? &MCgauge->_slot : nullptr,
+            TOPgauge ? &TOPgauge->_slot : nullptr, ALTgauge ? &ALTgauge->_slot : nullptr,
+            &BATgauge->_slot, FLAPSgauge ? &FLAPSgauge->_slot : nullptr };
+        scheduler.logStats(slots, sizeof(slots) / sizeof(slots[0]));
     }
 
     if (flags.bottom_dirty) {
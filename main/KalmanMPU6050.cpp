@@ -182,6 +182,14 @@ void IMU::Process()
 	last_rts = rts;
 	if( ret )
 		return;
+	propagate(dt);
+	finishAttitude();
+}
+
+// Move the fused attitude vector by one gyro step of dt seconds and pull it towards the
+// centripetal force estimation of the current accel/gyro sample
+void IMU::propagate(float dt)
+{
 	float gravity_trust = 1;
 
 	// create a gyro base rotation axis
@@ -226,18 +234,30 @@ void IMU::Process()
 		petal = accel;
 		circle_omega = 0.f;
 	}
+	if ( fifoMode() ) {
+		// The trust factors are tuned to the 10Hz cycle. Keep the time constant of the accel
+		// correction for the FIFO step size, r^n stays the retained portion per 100msec.
+		float r = gravity_trust / (gravity_trust + 1.f);
+		r = std::pow(r, dt * 10.f);
+		gravity_trust = r / (1.f - r);
+	}
 	// ESP_LOGI( FNAME, " ax1:%f ay1:%f az1:%f Gx:%f Gy:%f GZ:%f dT:%f", petal.a, petal.b, petal.c, gyro.a, gyro.b, gyro.c, dt );
 	vector_f att_prev = att_vector;
 	update_fused_vector(att_vector, gravity_trust, petal, omega_step);
 	// ESP_LOGI(FNAME,"attv: %.3f %.3f %.3f ProjAccel: %f", att_vector.a, att_vector.b, att_vector.c, accel.dot(att_vector));
-	att_quat = Quaternion::fromAccelerometer(att_vector);
-	// ESP_LOGI(FNAME,"attq: %.3f %.3f %.3f %.3f", att_quat.a, att_quat.b, att_quat.c, att_quat.d );
-	// ESP_LOGI(FNAME,"Circle Omega: %f", circle_omega );
-	euler_rad = att_quat.toEulerRad() * -1.f;
 	if ( (att_vector-att_prev).get_norm2() > 0.5 ) {
 		[[maybe_unused]] vector_f euler = euler_rad * rad2deg(1.f);
 		ESP_LOGI( FNAME,"Euler R:%.1f P:%.1f OR:%.1f IMUP:%.1f %.1f@GA(%.3f,%.3f,%.3f)", euler.Roll(), euler.Pitch(), rad2deg(roll), rad2deg(pitch), rad2deg(w), axis.x, axis.y, axis.z );
 	}
+}
+
+// Derive the euler angles from the fused attitude and fuse the yaw of the last omega step with the compass
+void IMU::finishAttitude()
+{
+	att_quat = Quaternion::fromAccelerometer(att_vector);
+	// ESP_LOGI(FNAME,"attq: %.3f %.3f %.3f %.3f", att_quat.a, att_quat.b, att_quat.c, att_quat.d );
+	// ESP_LOGI(FNAME,"Circle Omega: %f", circle_omega );
+	euler_rad = att_quat.toEulerRad() * -1.f;
 	filterRoll_rad =  euler_rad.Roll();
 	filterPitch_rad =  euler_rad.Pitch();
 
@@ -288,15 +308,26 @@ float IMU::fallbackToGyro(){
 // Central read of IMU with reotation into the glider reference system
 esp_err_t IMU::MPU6050Read()
 {
-	static vector_f prev_accel(1,0,0), prev_gyro(0,0,0);
-
-	// Get new accelerometer values from MPU6050
-	mpud::raw_axes_t imuRaw; // holds x, y, z axes as int16
-	esp_err_t err = MPU.acceleration(&imuRaw);  // fetch raw data from the registers
+	// Get new accelerometer and gyro values from MPU6050
+	mpud::raw_axes_t accRaw, gyroRaw; // holds x, y, z axes as int16
+	esp_err_t err = MPU.acceleration(&accRaw);  // fetch raw data from the registers
 	if( err != ESP_OK ) {
-		ESP_LOGE(FNAME, "accel I2C error, X:%d Y:%d Z:%d", imuRaw.x, imuRaw.y, imuRaw.z );
+		ESP_LOGE(FNAME, "accel I2C error, X:%d Y:%d Z:%d", accRaw.x, accRaw.y, accRaw.z );
 	}
-	mpud::float_axes_t tmp = mpud::accelGravity(imuRaw, mpud::ACCEL_FS_8G); // raw data to gravity
+	err |= MPU.rotation(&gyroRaw);       // fetch raw data from the registers
+	if( err != ESP_OK ) {
+		ESP_LOGE(FNAME, "gyro I2C error, X:%d Y:%d Z:%d",  gyroRaw.x, gyroRaw.y, gyroRaw.z );
+	}
+	return err | takeSample(accRaw, gyroRaw);
+}
+
+// Convert one raw sample, check it for plausibility and take it over in glider reference
+esp_err_t IMU::takeSample(const mpud::raw_axes_t &accRaw, const mpud::raw_axes_t &gyroRaw)
+{
+	static vector_f prev_accel(1,0,0), prev_gyro(0,0,0);
+	esp_err_t err = ESP_OK;
+
+	mpud::float_axes_t tmp = mpud::accelGravity(accRaw, mpud::ACCEL_FS_8G); // raw data to gravity
 	vector_f tmpvec(tmp.x, tmp.y, tmp.z);
 
 	// Check on irrational changes
@@ -311,12 +342,7 @@ esp_err_t IMU::MPU6050Read()
 	}
 	prev_accel = tmpvec;
 
-	// Get new gyro values from MPU6050
-	err |= MPU.rotation(&imuRaw);       // fetch raw data from the registers
-	if( err != ESP_OK ) {
-		ESP_LOGE(FNAME, "gyro I2C error, X:%d Y:%d Z:%d",  imuRaw.x, imuRaw.y, imuRaw.z );
-	}
-	tmp = mpud::gyroDegPerSec(imuRaw, GYRO_FS);  // raw data to º/s
+	tmp = mpud::gyroDegPerSec(gyroRaw, GYRO_FS);  // raw data to º/s
 	tmpvec = vector_f(tmp.x, tmp.y, tmp.z);
 
 	// Check on irrational changes
@@ -335,12 +361,181 @@ esp_err_t IMU::MPU6050Read()
 		// into glider reference system
 		gyro = ref_rot * tmpvec;
 		// preserve the raw read-out
-		raw_gyro.x = imuRaw.x; raw_gyro.y = imuRaw.y; raw_gyro.z = imuRaw.z;
+		raw_gyro.x = gyroRaw.x; raw_gyro.y = gyroRaw.y; raw_gyro.z = gyroRaw.z;
 	}
 	prev_gyro = tmpvec;
 	return err;
 }
 
+//
+// FIFO acquisition
+//
+// The MPU6050 samples accel and gyro at the configured rate into its 1024 byte FIFO, 12 bytes per
+// sample. One drain per 100msec loop reads all complete packets in a single I2C burst. At 200Hz
+// this is 240 bytes, about 22msec on the 100kHz bus. Each sample runs through the attitude
+// propagation with the sample period as dt, the euler angles and the compass yaw fusion are
+// done once per drain on the accumulated rotation.
+//
+static constexpr int FIFO_SIZE = 1024;
+static constexpr int FIFO_PACKET = 12; // accel x,y,z, gyro x,y,z big endian int16
+static constexpr int FIFO_BATCH_MAX = FIFO_SIZE / FIFO_PACKET;
+float IMU::fifo_sample_s = 0.f;
+static float fifo_nominal_s = 0.f;
+// Sample clock tracking against the esp timer, the MPU oscillator is off by up to a few percent
+static int64_t fifo_window_start = 0;
+static uint32_t fifo_window_samples = 0;
+// Statistics
+static uint32_t fifo_drains = 0;
+static uint32_t fifo_overflows = 0;
+static uint32_t fifo_batch_us_max = 0;
+static uint32_t fifo_batch_us_sum = 0;
+
+esp_err_t IMU::startFifo(int rate_hz)
+{
+	if ( rate_hz <= 0 ) {
+		fifo_sample_s = 0.f;
+		return ESP_OK;
+	}
+	// The DLPF keeps the gyro output at 1kHz, anti aliasing well below the sample rate
+	esp_err_t err = MPU.setDigitalLowPassFilter(rate_hz > 100 ? mpud::DLPF_42HZ : mpud::DLPF_20HZ);
+	err |= MPU.setSampleRate(rate_hz);
+	err |= MPU.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO);
+	err |= MPU.setFIFOEnabled(true);
+	err |= MPU.resetFIFO();
+	if ( err != ESP_OK ) {
+		ESP_LOGE(FNAME, "FIFO setup failed, stay with register reads");
+		MPU.setFIFOEnabled(false);
+		fifo_sample_s = 0.f;
+		return err;
+	}
+	fifo_nominal_s = 1.f / MPU.getSampleRate();
+	fifo_sample_s = fifo_nominal_s;
+	fifo_window_start = esp_timer_get_time();
+	fifo_window_samples = 0;
+	ESP_LOGI(FNAME, "IMU FIFO mode at %d Hz", (int)MPU.getSampleRate());
+	return ESP_OK;
+}
+
+// Feed n FIFO packets through the attitude filter, dt is the sample period
+void IMU::processBatch(const uint8_t *buf, int n, float dt)
+{
+	Quaternion batch_step;
+	for (int i = 0; i < n; i++, buf += FIFO_PACKET) {
+		mpud::raw_axes_t a, g;
+		a.x = (buf[0] << 8) | buf[1];
+		a.y = (buf[2] << 8) | buf[3];
+		a.z = (buf[4] << 8) | buf[5];
+		g.x = (buf[6] << 8) | buf[7];
+		g.y = (buf[8] << 8) | buf[9];
+		g.z = (buf[10] << 8) | buf[11];
+		if ( takeSample(a, g) == ESP_OK ) {
+			propagate(dt);
+			batch_step = omega_step * batch_step;
+		}
+	}
+	// yaw fusion and euler angles on the rotation of the whole batch
+	omega_step = batch_step.normalize();
+	finishAttitude();
+}
+
+// Drain the FIFO, replaces MPU6050Read() and Process() in FIFO mode
+esp_err_t IMU::FifoRead()
+{
+	static uint8_t buf[FIFO_BATCH_MAX * FIFO_PACKET];
+
+	int64_t t0 = esp_timer_get_time();
+	uint16_t count = MPU.getFIFOCount();
+	esp_err_t err = MPU.lastError();
+	if ( err != ESP_OK ) {
+		ESP_LOGE(FNAME, "FIFO count I2C error");
+		return err;
+	}
+	if ( count > FIFO_SIZE - FIFO_PACKET ) {
+		// overflowed, samples are lost and the packet alignment is gone
+		ESP_LOGW(FNAME, "FIFO overflow %d", count);
+		fifo_overflows++;
+		MPU.resetFIFO();
+		fifo_window_start = t0;
+		fifo_window_samples = 0;
+		return ESP_FAIL;
+	}
+	int n = count / FIFO_PACKET;
+	if ( n == 0 ) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	err = MPU.readFIFO(n * FIFO_PACKET, buf);
+	if ( err != ESP_OK ) {
+		ESP_LOGE(FNAME, "FIFO read I2C error");
+		return err;
+	}
+	int64_t t1 = esp_timer_get_time();
+	processBatch(buf, n, fifo_sample_s);
+
+	// track the real sample period over 10 second windows
+	fifo_window_samples += n;
+	if ( t1 - fifo_window_start > 10000000 ) {
+		float measured = (float)(t1 - fifo_window_start) * 1e-6f / fifo_window_samples;
+		if ( std::fabs(measured - fifo_nominal_s) < 0.05f * fifo_nominal_s ) {
+			fifo_sample_s += (measured - fifo_sample_s) * 0.5f;
+		}
+		fifo_window_start = t1;
+		fifo_window_samples = 0;
+	}
+
+	uint32_t us = (uint32_t)(esp_timer_get_time() - t1);
+	fifo_batch_us_sum += us;
+	if ( us > fifo_batch_us_max ) {
+		fifo_batch_us_max = us;
+	}
+	if ( ++fifo_drains >= 300 ) {
+		ESP_LOGI(FNAME, "FIFO %d samples, read %dus, process avg %uus max %uus, period %.1fus, overflows %u", n, (int)(t1 - t0),
+			(unsigned)(fifo_batch_us_sum / fifo_drains), (unsigned)fifo_batch_us_max, fifo_sample_s * 1e6f, (unsigned)fifo_overflows);
+		fifo_drains = 0;
+		fifo_batch_us_sum = fifo_batch_us_max = 0;
+	}
+	return ESP_OK;
+}
+
+#ifdef IMU_FifoTest
+// Replay a synthetic FIFO dump of a constant rate roll through the batch processing and compare the
+// integrated rotation with the exact one, also report the processing time per drain.
+void IMU::fifo_test()
+{
+	const int rates[] = { 10, 100, 200 };
+	const float dps = 10.f; // roll rate
+	const int16_t graw = (int16_t)(dps * 131.f); // 250 DPS full scale, 131 LSB per deg/s
+	const float dps_exact = graw / 131.f;
+	for ( int rate : rates ) {
+		const int n = rate / 10;
+		static uint8_t dump[FIFO_BATCH_MAX * FIFO_PACKET];
+		for ( int i = 0; i < n; i++ ) {
+			uint8_t *p = dump + i * FIFO_PACKET;
+			const int16_t raw[6] = { 0, 0, 4096, graw, 0, 0 }; // 1g on z in 8G scale
+			for ( int k = 0; k < 6; k++ ) {
+				p[2*k] = (uint16_t)raw[k] >> 8;
+				p[2*k+1] = raw[k] & 0xff;
+			}
+		}
+		Quaternion total;
+		uint32_t us_max = 0, us_sum = 0;
+		for ( int drain = 0; drain < 100; drain++ ) { // 10 seconds
+			int64_t t = esp_timer_get_time();
+			processBatch(dump, n, 1.f / rate);
+			uint32_t us = (uint32_t)(esp_timer_get_time() - t);
+			us_sum += us;
+			us_max = std::max(us, us_max);
+			total = omega_step * total;
+		}
+		vector_f axis;
+		float angle = rad2deg(total.normalize().getAngleAndAxis(axis));
+		float exact = std::fmod(dps_exact * 10.f, 360.f);
+		ESP_LOGI(FNAME, "FIFO test %dHz: angle %.4f exact %.4f err %.2e deg, %d samples/drain avg %uus max %uus",
+			rate, angle, exact, angle - exact, n, (unsigned)(us_sum / 100), (unsigned)us_max);
+	}
+	init();
+}
+#endif
+
 float IMU::getVerticalAcceleration()
 {
 	// orthonormal projection of the current accelerometer reading to the attitude vector
@@ -21,6 +21,7 @@
 #include "math/vector_3d.h"
 #include "math/Quaternion.h"
 
+#include <MPU.hpp>
 #include <esp_err.h>
 
 class Quaternion;
@@ -75,6 +76,16 @@ public:
   static esp_err_t MPU6050Read();
   static void Process();
 
+  // High rate acquisition through the MPU FIFO. Once started, FifoRead() drains all samples
+  // collected since the last call in one burst and feeds them through the attitude filter,
+  // it replaces the MPU6050Read() and Process() pair.
+  static esp_err_t startFifo(int rate_hz);
+  static esp_err_t FifoRead();
+  static inline bool fifoMode() { return fifo_sample_s > 0.f; }
+#ifdef IMU_FifoTest
+  static void fifo_test();
+#endif
+
   // Accelerometer reading in glider reference and in [g]
   static inline vector_f getGliderAccel() { return accel; };
 
@@ -170,6 +181,11 @@ public:
   static inline vector_f getAHRSVector() { return att_vector; };
 
 private:
+  static esp_err_t takeSample(const mpud::raw_axes_t &accRaw, const mpud::raw_axes_t &gyroRaw);
+  static void propagate(float dt);
+  static void finishAttitude();
+  static void processBatch(const uint8_t *buf, int n, float dt);
+  static float fifo_sample_s;
   static float getGyroYawDelta();
   static void update_fused_vector(vector_f& fused, float gyro_trust, vector_f& petal_force, Quaternion& omega_step);
   static Kalman kalmanX; // Create the Kalman instances
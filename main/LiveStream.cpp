@@ -0,0 +1,385 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "LiveStream.h"
+
+#include "protocol/Clock.h"
+#include "setup/SetupNG.h"
+#include "KalmanMPU6050.h"
+#include "Flarm.h"
+#include "sensor.h"
+
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+////////////////////////////
+// JsonOut
+
+void JsonOut::key(const char *k)
+{
+    if ( ! (_first & (1u << _depth)) ) {
+        put(',');
+    }
+    _first &= ~(1u << _depth);
+    if ( k ) {
+        put('"');
+        while ( *k ) {
+            put(*k++);
+        }
+        put('"');
+        put(':');
+    }
+}
+
+void JsonOut::open(const char *k)
+{
+    if ( _depth > 0 ) {
+        key(k);
+    }
+    put('{');
+    _depth++;
+    _first |= 1u << _depth;
+}
+
+void JsonOut::close()
+{
+    put('}');
+    _depth--;
+}
+
+void JsonOut::num(const char *k, int32_t v, int decimals)
+{
+    key(k);
+    if ( v < 0 ) {
+        put('-');
+    }
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while ( u || n <= decimals );
+    while ( n-- ) {
+        put(digits[n]);
+        if ( n == decimals && decimals ) {
+            put('.');
+        }
+    }
+}
+
+int serializeLive(const LiveSnapshot &s, char *buf, int size)
+{
+    JsonOut j(buf, size - 1); // and the line end
+    j.open();
+    j.num("t", s.t);
+    j.open("vario");
+    j.num("te", s.te, 2);
+    j.num("netto", s.netto, 2);
+    j.num("avg", s.avg_te, 2);
+    j.num("mc", s.mc, 2);
+    j.close();
+    j.open("air");
+    j.num("ias", s.ias, 1);
+    j.num("tas", s.tas, 1);
+    j.num("alt", s.alt, 2);
+    j.close();
+    j.open("wind");
+    j.num("sdir", s.swind_dir, 1);
+    j.num("sspeed", s.swind_speed, 1);
+    j.num("cdir", s.cwind_dir, 1);
+    j.num("cspeed", s.cwind_speed, 1);
+    j.close();
+    j.open("attitude");
+    j.num("roll", s.roll, 2);
+    j.num("pitch", s.pitch, 2);
+    j.num("yaw", s.yaw, 2);
+    j.num("accz", s.accz, 3);
+    j.close();
+    j.open("traffic");
+    j.num("alarm", s.alarm);
+    j.num("bearing", s.bearing);
+    j.num("vertical", s.vertical);
+    j.num("distance", s.distance);
+    j.close();
+    j.open("perf");
+    j.num("uptime", s.uptime);
+    j.num("heap", s.heap);
+    j.num("heap_min", s.heap_min);
+    j.num("clients", s.clients);
+    j.num("json_us", s.json_us);
+    j.num("samples", s.samples);
+    j.num("sent", s.sent);
+    j.num("lost", s.lost);
+    j.close();
+    j.close();
+    if ( j.overflow() ) {
+        return 0;
+    }
+    buf[j.length()] = '\n';
+    return j.length() + 1;
+}
+
+
+////////////////////////////
+// LiveStream
+
+struct LiveClient {
+    void *ctx = nullptr;
+    LiveStream::SendFn send = nullptr;
+    LiveStream::CloseFn close = nullptr;
+    uint16_t period = 0; // msec
+    uint32_t next = 0;
+};
+
+static LiveClient clients[LiveStream::MAX_CLIENTS];
+static portMUX_TYPE clientLock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t liveTask = nullptr;
+static volatile bool closing = false;
+static char line[LiveStream::LINE_SIZE];
+static uint16_t json_us = 0;
+static uint32_t samples = 0, sent = 0, lost = 0;
+
+static int16_t i16(float v)
+{
+    return std::max(-32768L, std::min(32767L, std::lround(v)));
+}
+
+static uint16_t u16(float v)
+{
+    return std::max(0L, std::min(65535L, std::lround(v)));
+}
+
+void LiveStream::sample(LiveSnapshot &s)
+{
+    s = {};
+    s.t = Clock::getMillis();
+    s.te = i16(te_vario.get() * 100.f);
+    s.netto = i16(te_netto.get() * 100.f);
+    s.avg_te = i16(aTE * 100.f);
+    s.mc = i16(MC.get() * 100.f);
+    s.ias = u16(ias.get() * 10.f);
+    s.tas = u16(tas * 10.f);
+    s.alt = std::lround(altitude.get() * 100.f);
+    s.swind_dir = u16(swind_dir.get() * 10.f);
+    s.swind_speed = u16(swind_speed.get() * 10.f);
+    s.cwind_dir = u16(cwind_dir.get() * 10.f);
+    s.cwind_speed = u16(cwind_speed.get() * 10.f);
+    s.roll = i16(IMU::getRoll() * 100.f);
+    s.pitch = i16(IMU::getPitch() * 100.f);
+    s.yaw = u16(std::fmod((float)IMU::getYaw() + 360.f, 360.f) * 100.f);
+    s.accz = i16(IMU::getGliderAccelZ() * 1000.f);
+    s.alarm = Flarm::alarmLevel();
+    s.bearing = Flarm::relBearing();
+    s.vertical = Flarm::relVertical();
+    s.distance = Flarm::relDistance();
+    s.uptime = esp_timer_get_time() / 1000000;
+    s.heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    s.heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+bool LiveStream::add(void *ctx, SendFn send, CloseFn close, int rate_hz)
+{
+    rate_hz = std::max(1, std::min(MAX_RATE, rate_hz));
+    if ( ! liveTask && xTaskCreate(&task, "webLive", 4096, nullptr, 3, &liveTask) != pdPASS ) {
+        liveTask = nullptr;
+        return false;
+    }
+    bool ok = false;
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    taskENTER_CRITICAL(&clientLock);
+    for (LiveClient &c : clients) {
+        if ( ! c.send ) {
+            c.ctx = ctx;
+            c.send = send;
+            c.close = close;
+            c.period = 1000 / rate_hz;
+            c.next = now;
+            ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&clientLock);
+    if ( ok ) {
+        ESP_LOGI(FNAME, "Live client at %dHz", rate_hz);
+        xTaskNotifyGive(liveTask);
+    }
+    return ok;
+}
+
+// Closing happens in the stream task, no send is in the way
+void LiveStream::closeAll()
+{
+    if ( ! liveTask ) {
+        return;
+    }
+    closing = true;
+    xTaskNotifyGive(liveTask);
+    for (int i = 0; i < 50 && closing; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+// Serves the due clients, the msec until the next one is due or -1 without clients
+int32_t LiveStream::tick(uint32_t now)
+{
+    LiveClient due[MAX_CLIENTS];
+    int ndue = 0;
+    int nclients = 0;
+    int32_t wait = -1;
+
+    taskENTER_CRITICAL(&clientLock);
+    bool close_all = closing;
+    for (LiveClient &c : clients) {
+        if ( ! c.send ) {
+            continue;
+        }
+        if ( close_all ) {
+            due[ndue++] = c;
+            c = LiveClient();
+            continue;
+        }
+        nclients++;
+        if ( (int32_t)(now - c.next) >= 0 ) {
+            // keep the rate, but do not catch up on a stall
+            c.next += c.period;
+            if ( (int32_t)(now - c.next) >= 0 ) {
+                c.next = now + c.period;
+            }
+            due[ndue++] = c;
+        }
+        int32_t w = c.next - now;
+        wait = (wait < 0) ? w : std::min(wait, w);
+    }
+    taskEXIT_CRITICAL(&clientLock);
+
+    if ( close_all ) {
+        for (int i = 0; i < ndue; i++) {
+            due[i].close(due[i].ctx);
+        }
+        closing = false;
+        return -1;
+    }
+    if ( ndue == 0 ) {
+        return wait;
+    }
+
+    // one sample and one line for all
+    LiveSnapshot s;
+    sample(s);
+    s.clients = nclients;
+    s.json_us = json_us;
+    s.samples = ++samples;
+    s.sent = sent;
+    s.lost = lost;
+    int64_t t0 = esp_timer_get_time();
+    int len = serializeLive(s, line, sizeof(line));
+    json_us = esp_timer_get_time() - t0;
+
+    for (int i = 0; i < ndue; i++) {
+        if ( len && due[i].send(due[i].ctx, line, len) ) {
+            sent++;
+            continue;
+        }
+        // the browser is gone
+        lost++;
+        taskENTER_CRITICAL(&clientLock);
+        for (LiveClient &c : clients) {
+            if ( c.ctx == due[i].ctx ) {
+                c = LiveClient();
+            }
+        }
+        taskEXIT_CRITICAL(&clientLock);
+        due[i].close(due[i].ctx);
+    }
+    return wait;
+}
+
+void LiveStream::task(void *arg)
+{
+    while ( true ) {
+        int32_t wait = tick(xTaskGetTickCount() * portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, wait < 0 ? portMAX_DELAY : pdMS_TO_TICKS(std::max<int32_t>(wait, 1)));
+    }
+}
+
+
+#ifdef LiveStream_Test
+#include <cstring>
+
+// The serializer on a fixed sample, its output and speed, and the stream with three mock browsers at
+// 25, 10 and 1 Hz for two seconds, of which the second fails after five lines. All share one sample
+// per tick, the heap stays as it is while streaming.
+namespace {
+
+struct MockClient {
+    int lines = 0;
+    int fail_after = -1;
+    bool closed = false;
+};
+
+bool mock_send(void *ctx, const char *data, int len)
+{
+    MockClient *m = static_cast<MockClient *>(ctx);
+    if ( m->fail_after >= 0 && m->lines >= m->fail_after ) {
+        return false;
+    }
+    m->lines++;
+    return data[len - 1] == '\n';
+}
+
+void mock_close(void *ctx)
+{
+    static_cast<MockClient *>(ctx)->closed = true;
+}
+
+} // namespace
+
+void LiveStream::stream_test()
+{
+    static const char expect[] = "{\"t\":123456,\"vario\":{\"te\":-1.05,\"netto\":0.07,\"avg\":2.50,\"mc\":1.50},"
+        "\"air\":{\"ias\":98.7,\"tas\":105.2,\"alt\":-12.34},\"wind\":{\"sdir\":270.5,\"sspeed\":15.0,\"cdir\":0.0,\"cspeed\":9.9},"
+        "\"attitude\":{\"roll\":-30.00,\"pitch\":0.01,\"yaw\":359.99,\"accz\":-0.500},"
+        "\"traffic\":{\"alarm\":2,\"bearing\":-45,\"vertical\":-120,\"distance\":850},"
+        "\"perf\":{\"uptime\":3600,\"heap\":81234,\"heap_min\":60001,\"clients\":3,\"json_us\":42,\"samples\":7,\"sent\":20,\"lost\":1}}\n";
+    LiveSnapshot s = { 123456, -105, 7, 250, 150, 987, 1052, -1234, 2705, 150, 0, 99, -3000, 1, 35999, -500,
+        2, -45, -120, 850, 3600, 81234, 60001, 3, 42, 7, 20, 1 };
+    char buf[LINE_SIZE];
+    int len = serializeLive(s, buf, sizeof(buf));
+    bool match = len == (int)strlen(expect) && memcmp(buf, expect, len) == 0;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) {
+        serializeLive(s, buf, sizeof(buf));
+    }
+    int64_t t1 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "serialized %d bytes %s, %d.%02d us each, a short buffer %s", len, match ? "as expected" : "WRONG",
+        (int)((t1 - t0) / 1000), (int)((t1 - t0) / 10 % 100), serializeLive(s, buf, 100) ? "overflows" : "refused");
+
+    MockClient m[3];
+    m[1].fail_after = 5;
+    uint32_t samples0 = samples;
+    add(&m[0], mock_send, mock_close, 25);
+    add(&m[1], mock_send, mock_close, 10);
+    add(&m[2], mock_send, mock_close, 1);
+    size_t heap0 = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    size_t heap1 = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    closeAll();
+    ESP_LOGI(FNAME, "25Hz %d lines, 10Hz %d lines %s, 1Hz %d lines, %u samples for %d lines, heap %d bytes less, %s",
+        m[0].lines, m[1].lines, m[1].closed ? "closed" : "OPEN", m[2].lines, (unsigned)(samples - samples0),
+        m[0].lines + m[1].lines + m[2].lines, (int)(heap0 - heap1), m[0].closed && m[2].closed ? "all closed" : "NOT CLOSED");
+}
+#endif
@@ -0,0 +1,94 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+// Flight data and the internal counters of one sample, as fixed point integers
+struct LiveSnapshot {
+    uint32_t t;                      // msec
+    int16_t te, netto, avg_te, mc;   // cm/s
+    uint16_t ias, tas;               // 0.1 km/h
+    int32_t alt;                     // cm
+    uint16_t swind_dir, swind_speed; // 0.1 deg, 0.1 km/h
+    uint16_t cwind_dir, cwind_speed;
+    int16_t roll, pitch;             // 0.01 deg
+    uint16_t yaw;
+    int16_t accz;                    // mg
+    uint8_t alarm;                   // Flarm traffic
+    int16_t bearing, vertical;       // deg, m
+    int32_t distance;                // m
+    uint32_t uptime;                 // sec
+    uint32_t heap, heap_min;         // bytes
+    uint16_t clients;
+    uint16_t json_us;                // serializing the former sample
+    uint32_t samples;                // taken for all browsers
+    uint32_t sent;                   // lines to the browsers
+    uint32_t lost;                   // browsers gone on a failed send
+};
+
+// JSON writer into a fixed buffer, numbers as fixed point. Stops writing at the end of the buffer and
+// flags the overflow.
+class JsonOut
+{
+public:
+    JsonOut(char *buf, int size) : _buf(buf), _size(size) {}
+    void open(const char *key = nullptr);
+    void close();
+    void num(const char *key, int32_t v, int decimals = 0);
+    int length() const { return _n; }
+    bool overflow() const { return _overflow; }
+
+private:
+    void key(const char *k);
+    void put(char c) {
+        if ( _n < _size ) {
+            _buf[_n++] = c;
+        }
+        else {
+            _overflow = true;
+        }
+    }
+    char *_buf;
+    int _size;
+    int _n = 0;
+    uint32_t _first = 1; // bit per nesting level, nothing written yet
+    int _depth = 0;
+    bool _overflow = false;
+};
+
+// The sample as one line of JSON in m/s, km/h, m, deg and g, the length or 0 if it does not fit
+int serializeLive(const LiveSnapshot &s, char *buf, int size);
+
+// Streams the live data to the browsers, as chunked HTTP response of one JSON object per line. All
+// clients share the sample and its serialized line of a tick, each at its own rate. The line buffer
+// is static, there is no heap use per sample. The clients are not httpd bound, a client is a send and
+// a close function on its context.
+class LiveStream
+{
+public:
+    typedef bool (*SendFn)(void *ctx, const char *data, int len);
+    typedef void (*CloseFn)(void *ctx);
+    static constexpr int MAX_CLIENTS = 3;
+    static constexpr int MAX_RATE = 25; // Hz
+    static constexpr int DEFAULT_RATE = 5;
+    static constexpr int LINE_SIZE = 512;
+
+    static bool add(void *ctx, SendFn send, CloseFn close, int rate_hz);
+    static void closeAll();
+    static void sample(LiveSnapshot &s);
+
+#ifdef LiveStream_Test
+    static void stream_test();
+#endif
+
+private:
+    static void task(void *arg);
+    static int32_t tick(uint32_t now);
+};
@@ -0,0 +1,407 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "OtaDelta.h"
+
+#include "logdef.h"
+
+#include <esp_ota_ops.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+bool OtaDeltaSink::isDelta(const uint8_t *head)
+{
+    return memcmp(head, "XDL1", 4) == 0;
+}
+
+OtaDeltaSink::OtaDeltaSink(OtaSink *out, const esp_partition_t *base) :
+    _out(out),
+    _base(base ? base : esp_ota_get_running_partition())
+{
+    mbedtls_sha256_init(&_ctx);
+}
+
+OtaDeltaSink::~OtaDeltaSink()
+{
+    free(_window);
+    mbedtls_sha256_free(&_ctx);
+}
+
+bool OtaDeltaSink::start()
+{
+    if ( ! isDelta((const uint8_t *)_hdr.magic) || _hdr.new_size == 0
+        || _hdr.window_bits < 4 || _hdr.window_bits > MAX_WINDOW_BITS
+        || _hdr.lookahead_bits < 3 || _hdr.lookahead_bits > MAX_LOOKAHEAD_BITS ) {
+        ESP_LOGE(FNAME, "Bad delta header");
+        return false;
+    }
+    if ( ! _base || _hdr.old_size > _base->size ) {
+        ESP_LOGE(FNAME, "No base of %u bytes", (unsigned)_hdr.old_size);
+        return false;
+    }
+
+    // only the very image the delta was made for will do
+    uint8_t sha[32];
+    mbedtls_sha256_starts(&_ctx, 0);
+    for (uint32_t pos = 0; pos < _hdr.old_size; pos += SECTOR) {
+        uint32_t len = std::min((uint32_t)SECTOR, _hdr.old_size - pos);
+        if ( esp_partition_read(_base, pos, _cache, len) != ESP_OK ) {
+            return false;
+        }
+        mbedtls_sha256_update(&_ctx, _cache, len);
+    }
+    mbedtls_sha256_finish(&_ctx, sha);
+    if ( memcmp(sha, _hdr.old_sha, sizeof(sha)) != 0 ) {
+        ESP_LOGE(FNAME, "Delta made for another base image");
+        return false;
+    }
+
+    _window = (uint8_t *)calloc(1, 1 << _hdr.window_bits);
+    if ( ! _window || ! _out->begin(_hdr.new_size) ) {
+        return false;
+    }
+    _wmask = (1 << _hdr.window_bits) - 1;
+    mbedtls_sha256_starts(&_ctx, 0);
+    ESP_LOGI(FNAME, "Delta from %u to %u bytes, window %d", (unsigned)_hdr.old_size, (unsigned)_hdr.new_size, _wmask + 1);
+    _state = DIFF_LEN;
+    return true;
+}
+
+bool OtaDeltaSink::write(const uint8_t *data, int len)
+{
+    int i = 0;
+    if ( _state == HEADER ) {
+        i = std::min(len, (int)(sizeof(Header) - _hdr_len));
+        memcpy((uint8_t *)&_hdr + _hdr_len, data, i);
+        _hdr_len += i;
+        if ( _hdr_len < sizeof(Header) ) {
+            return true;
+        }
+        if ( ! start() ) {
+            _state = FAILED;
+            return false;
+        }
+    }
+
+    // LZSS symbols, the bits at hand never exceed 32 with at most 25 for a back reference
+    const int wbits = _hdr.window_bits;
+    const int lbits = _hdr.lookahead_bits;
+    const int ref = 1 + wbits + lbits;
+    for ( ; i < len && _state < DONE; i++ ) {
+        _acc = (_acc << 8) | data[i];
+        _bits += 8;
+        while ( _bits >= 9 && _state < DONE ) {
+            if ( (_acc >> (_bits - 1)) & 1 ) {
+                _bits -= 9;
+                if ( ! put((_acc >> _bits) & 0xff) ) {
+                    _state = FAILED;
+                }
+            }
+            else {
+                if ( _bits < ref ) {
+                    break;
+                }
+                _bits -= ref;
+                uint32_t dist = ((_acc >> (_bits + lbits)) & ((1 << wbits) - 1)) + 1;
+                uint32_t count = ((_acc >> _bits) & ((1 << lbits) - 1)) + 1;
+                while ( count-- && _state < DONE ) {
+                    if ( ! put(_window[(_wpos - dist) & _wmask]) ) {
+                        _state = FAILED;
+                    }
+                }
+            }
+            _acc &= (1u << _bits) - 1;
+        }
+    }
+    // the padding of the last byte or a damaged delta is left over
+    return _state != FAILED;
+}
+
+bool OtaDeltaSink::put(uint8_t c)
+{
+    _window[_wpos++ & _wmask] = c;
+    return record(c);
+}
+
+bool OtaDeltaSink::record(uint8_t c)
+{
+    switch ( _state ) {
+    case DIFF_LEN:
+    case EXTRA_LEN:
+    case SEEK:
+    {
+        _varint |= (uint32_t)(c & 0x7f) << _shift;
+        _shift += 7;
+        if ( c & 0x80 ) {
+            return _shift < 32;
+        }
+        uint32_t v = _varint;
+        _varint = 0;
+        _shift = 0;
+        if ( _state == DIFF_LEN ) {
+            _diff_len = v;
+            _state = EXTRA_LEN;
+        }
+        else if ( _state == EXTRA_LEN ) {
+            _extra_len = v;
+            _state = SEEK;
+        }
+        else {
+            _seek = (v & 1) ? -(int32_t)((v + 1) >> 1) : (int32_t)(v >> 1);
+            // no sums, they could wrap
+            if ( _old_pos > _hdr.old_size || _diff_len > _hdr.old_size - _old_pos
+                || _diff_len > _hdr.new_size - _produced
+                || _extra_len > _hdr.new_size - _produced - _diff_len ) {
+                ESP_LOGE(FNAME, "Delta record out of bounds at %u", (unsigned)_produced);
+                return false;
+            }
+            nextPart();
+        }
+        return true;
+    }
+    case DIFF:
+    {
+        uint8_t b;
+        if ( ! base(_old_pos++, b) || ! emit(c + b) ) {
+            return false;
+        }
+        if ( --_diff_len == 0 ) {
+            nextPart();
+        }
+        return true;
+    }
+    case EXTRA:
+        if ( ! emit(c) ) {
+            return false;
+        }
+        if ( --_extra_len == 0 ) {
+            nextPart();
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+void OtaDeltaSink::nextPart()
+{
+    if ( _diff_len ) {
+        _state = DIFF;
+    }
+    else if ( _extra_len ) {
+        _state = EXTRA;
+    }
+    else {
+        _old_pos += _seek;
+        _state = (_produced == _hdr.new_size) ? DONE : DIFF_LEN;
+    }
+}
+
+bool OtaDeltaSink::base(uint32_t pos, uint8_t &b)
+{
+    uint32_t sector = pos & ~(SECTOR - 1);
+    if ( sector != _cache_pos ) {
+        uint32_t len = std::min((uint32_t)SECTOR, _hdr.old_size - sector);
+        if ( esp_partition_read(_base, sector, _cache, len) != ESP_OK ) {
+            ESP_LOGE(FNAME, "Base read at 0x%x failed", (unsigned)sector);
+            return false;
+        }
+        _cache_pos = sector;
+    }
+    b = _cache[pos - sector];
+    return true;
+}
+
+bool OtaDeltaSink::emit(uint8_t b)
+{
+    _buf[_buf_len++] = b;
+    _produced++;
+    return _buf_len < SECTOR || flush();
+}
+
+bool OtaDeltaSink::flush()
+{
+    if ( _buf_len == 0 ) {
+        return true;
+    }
+    mbedtls_sha256_update(&_ctx, _buf, _buf_len);
+    bool ok = _out->write(_buf, _buf_len);
+    _buf_len = 0;
+    return ok;
+}
+
+bool OtaDeltaSink::end(bool ok)
+{
+    ok = ok && _state == DONE && flush();
+    if ( ok ) {
+        uint8_t sha[32];
+        mbedtls_sha256_finish(&_ctx, sha);
+        if ( memcmp(sha, _hdr.new_sha, sizeof(sha)) != 0 ) {
+            ESP_LOGE(FNAME, "Image rebuilt from the delta differs");
+            ok = false;
+        }
+    }
+    else if ( _state != DONE && _state != FAILED ) {
+        ESP_LOGE(FNAME, "Delta incomplete, %u of %u bytes", (unsigned)_produced, (unsigned)_hdr.new_size);
+    }
+    return _out->end(ok);
+}
+
+
+#ifdef OtaDelta_Test
+#include <esp_timer.h>
+#include <vector>
+
+// Makes a delta against the first 256 KB of the running partition: a part of it with some bytes
+// changed, a few new bytes, a skip and the rest with other changes. The delta is fed in sectors as the
+// pipeline does, to a sink that just counts. The second run with a wrong base hash must be refused.
+namespace {
+
+class DeltaMaker
+{
+public:
+    DeltaMaker(int wbits, int lbits) : _wbits(wbits), _max_run(1 << lbits), _lbits(lbits) {}
+    void byte(uint8_t c) {
+        if ( _run && c == _last && _run < _max_run ) {
+            _run++;
+            return;
+        }
+        flushRun();
+        bits(0x100 | c, 9);
+        _last = c;
+        _run = 1;
+    }
+    void varint(uint32_t v) {
+        while ( v >= 0x80 ) {
+            byte((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        byte(v);
+    }
+    std::vector<uint8_t> &finish() {
+        flushRun();
+        if ( _nbits ) {
+            _out.push_back(_acc << (8 - _nbits));
+        }
+        return _out;
+    }
+    std::vector<uint8_t> _out;
+
+private:
+    // repeats of the last byte as a back reference at distance 1
+    void flushRun() {
+        if ( _run > 3 ) {
+            bits(0, 1 + _wbits);
+            bits(_run - 2, _lbits);
+        }
+        else {
+            for (int i = 1; i < _run; i++) {
+                bits(0x100 | _last, 9);
+            }
+        }
+        _run = 0;
+    }
+    void bits(uint32_t v, int n) {
+        _acc = (_acc << n) | v;
+        _nbits += n;
+        while ( _nbits >= 8 ) {
+            _nbits -= 8;
+            _out.push_back(_acc >> _nbits);
+        }
+        _acc &= (1 << _nbits) - 1;
+    }
+    int _wbits;
+    int _max_run;
+    int _lbits;
+    uint8_t _last = 0;
+    int _run = 0;
+    uint32_t _acc = 0;
+    int _nbits = 0;
+};
+
+class CountSink final : public OtaSink
+{
+public:
+    bool begin(size_t size) override { _size = size; return true; }
+    bool write(const uint8_t *data, int len) override { _written += len; return true; }
+    bool end(bool ok) override { return ok && _written == _size; }
+    size_t _size = 0;
+    size_t _written = 0;
+};
+
+} // namespace
+
+void OtaDeltaSink::apply_test()
+{
+    const esp_partition_t *part = esp_ota_get_running_partition();
+    const uint32_t old_size = 256 * 1024;
+    const uint32_t part1 = 96 * 1024, skip = 32 * 1024, part2 = old_size - part1 - skip, extra = 300;
+    uint8_t *sector = (uint8_t *)malloc(SECTOR);
+    Header hdr = { { 'X', 'D', 'L', '1' }, old_size, part1 + extra + part2, 10, 12, 0, {}, {} };
+    DeltaMaker body(hdr.window_bits, hdr.lookahead_bits);
+    mbedtls_sha256_context old_ctx, new_ctx;
+    mbedtls_sha256_init(&old_ctx);
+    mbedtls_sha256_init(&new_ctx);
+    mbedtls_sha256_starts(&old_ctx, 0);
+    mbedtls_sha256_starts(&new_ctx, 0);
+
+    // diff, extra and seek of each record, then its bytes
+    uint32_t diff_len[2] = { part1, part2 }, extra_len[2] = { extra, 0 }, seek[2] = { skip, 0 };
+    uint32_t pos = 0;
+    for (int r = 0; r < 2; r++) {
+        body.varint(diff_len[r]);
+        body.varint(extra_len[r]);
+        body.varint(seek[r] * 2); // zigzag
+        for (uint32_t end = pos + diff_len[r]; pos < end; pos += SECTOR) {
+            esp_partition_read(part, pos, sector, SECTOR);
+            mbedtls_sha256_update(&old_ctx, sector, SECTOR);
+            for (int i = 0; i < SECTOR; i++) {
+                uint8_t d = (r == 0) ? ((pos + i) % 1000 == 0) : ((i & 0x3ff) == 0) * 0x55;
+                body.byte(d);
+                sector[i] += d;
+            }
+            mbedtls_sha256_update(&new_ctx, sector, SECTOR);
+        }
+        for (uint32_t i = 0; i < extra_len[r]; i++) {
+            sector[i] = i * 7;
+            body.byte(sector[i]);
+        }
+        mbedtls_sha256_update(&new_ctx, sector, extra_len[r]);
+        for (uint32_t end = pos + seek[r]; pos < end; pos += SECTOR) {
+            esp_partition_read(part, pos, sector, SECTOR);
+            mbedtls_sha256_update(&old_ctx, sector, SECTOR);
+        }
+    }
+    mbedtls_sha256_finish(&old_ctx, hdr.old_sha);
+    mbedtls_sha256_finish(&new_ctx, hdr.new_sha);
+    std::vector<uint8_t> &data = body.finish();
+    data.insert(data.begin(), (uint8_t *)&hdr, (uint8_t *)&hdr + sizeof(hdr));
+    free(sector);
+
+    for (int run = 0; run < 2; run++) {
+        if ( run == 1 ) {
+            data[offsetof(Header, old_sha)] ^= 1;
+        }
+        CountSink sink;
+        OtaDeltaSink *delta = new OtaDeltaSink(&sink, part);
+        int64_t t0 = esp_timer_get_time();
+        bool ok = true;
+        for (size_t off = 0; ok && off < data.size(); off += OtaPipeline::BLOCK_SIZE) {
+            ok = delta->write(&data[off], std::min((size_t)OtaPipeline::BLOCK_SIZE, data.size() - off));
+        }
+        ok = delta->end(ok);
+        int ms = (esp_timer_get_time() - t0) / 1000;
+        delete delta;
+        ESP_LOGI(FNAME, "%s base: delta %u bytes for %u bytes image, %s in %d ms, %d KB/s", run ? "wrong" : "right",
+            (unsigned)data.size(), (unsigned)hdr.new_size, ok ? "applied" : "refused", ms, ms ? (int)(sink._written / ms) : 0);
+    }
+}
+#endif
@@ -0,0 +1,86 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include "OtaPipeline.h"
+
+// Rebuilds an image from a delta made by ota_delta.py as it comes in, and passes it on to the next sink.
+// The base of the delta is the image in the running partition. Behind the header follow LZSS compressed
+// (heatshrink bit format) records: the diff bytes, added to the base bytes from the current base position
+// on, the extra bytes, taken as they are, and a seek of the base position. Besides two sector buffers the
+// decoder needs the LZSS window only, 1 KB as the tool makes it by default.
+class OtaDeltaSink final : public OtaSink
+{
+public:
+    struct Header {
+        char magic[4]; // XDL1
+        uint32_t old_size;
+        uint32_t new_size;
+        uint8_t window_bits;
+        uint8_t lookahead_bits;
+        uint16_t flags;
+        uint8_t old_sha[32];
+        uint8_t new_sha[32];
+    } __attribute__((packed));
+    static constexpr int MAX_WINDOW_BITS = 12;
+    static constexpr int MAX_LOOKAHEAD_BITS = 12;
+    static constexpr int SECTOR = 4096;
+
+    static bool isDelta(const uint8_t *head);
+    // the base is the running partition when not given
+    explicit OtaDeltaSink(OtaSink *out, const esp_partition_t *base = nullptr);
+    ~OtaDeltaSink();
+
+    bool write(const uint8_t *data, int len) override;
+    void idle() override { _out->idle(); }
+    bool end(bool ok) override;
+    uint32_t imageSize() const { return _hdr.new_size; }
+
+#ifdef OtaDelta_Test
+    static void apply_test();
+#endif
+
+private:
+    enum State : uint8_t { HEADER, DIFF_LEN, EXTRA_LEN, SEEK, DIFF, EXTRA, DONE, FAILED };
+    bool start();
+    bool put(uint8_t c);
+    bool record(uint8_t c);
+    void nextPart();
+    bool base(uint32_t pos, uint8_t &b);
+    bool emit(uint8_t b);
+    bool flush();
+
+    OtaSink *_out;
+    const esp_partition_t *_base;
+    Header _hdr = {};
+    unsigned _hdr_len = 0;
+    State _state = HEADER;
+
+    // LZSS
+    uint8_t *_window = nullptr;
+    uint32_t _wmask = 0;
+    uint32_t _wpos = 0;
+    uint32_t _acc = 0;
+    int _bits = 0;
+
+    // records
+    uint32_t _varint = 0;
+    int _shift = 0;
+    uint32_t _diff_len = 0;
+    uint32_t _extra_len = 0;
+    int32_t _seek = 0;
+    uint32_t _old_pos = 0;
+    uint32_t _produced = 0;
+
+    uint32_t _cache_pos = UINT32_MAX;
+    uint8_t _cache[SECTOR];
+    uint8_t _buf[SECTOR];
+    int _buf_len = 0;
+    mbedtls_sha256_context _ctx;
+};
@@ -0,0 +1,389 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "OtaPipeline.h"
+
+#include "logdef.h"
+
+#include <esp_ota_ops.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+
+static uint32_t nowMs()
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+////////////////////////////
+// OtaFlashSink
+
+bool OtaFlashSink::begin(size_t size)
+{
+    _part = esp_ota_get_next_update_partition(nullptr);
+    if ( ! _part || size == 0 || size > _part->size ) {
+        ESP_LOGE(FNAME, "No partition for an image of %u bytes", (unsigned)size);
+        return false;
+    }
+    _size = size;
+    _written = 0;
+    _erased = 0;
+    ESP_LOGI(FNAME, "Writing to partition subtype %d at offset 0x%x", _part->subtype, (unsigned)_part->address);
+    return true;
+}
+
+bool OtaFlashSink::eraseNext()
+{
+    uint32_t end = std::min((uint32_t)_part->size, (_size + ERASE_BLOCK - 1) / ERASE_BLOCK * ERASE_BLOCK);
+    if ( _erased >= end ) {
+        return false;
+    }
+    uint32_t len = std::min(ERASE_BLOCK, end - _erased);
+    esp_err_t err = esp_partition_erase_range(_part, _erased, len);
+    if ( err != ESP_OK ) {
+        ESP_LOGE(FNAME, "Erase at 0x%x failed: %s", (unsigned)_erased, esp_err_to_name(err));
+        return false;
+    }
+    _erased += len;
+    return true;
+}
+
+void OtaFlashSink::idle()
+{
+    if ( _part && _erased < _written + ERASE_AHEAD ) {
+        eraseNext();
+    }
+}
+
+bool OtaFlashSink::write(const uint8_t *data, int len)
+{
+    while ( _written + len > _erased ) {
+        if ( ! eraseNext() ) {
+            return false;
+        }
+    }
+    esp_err_t err = esp_partition_write(_part, _written, data, len);
+    if ( err != ESP_OK ) {
+        ESP_LOGE(FNAME, "Write at 0x%x failed: %s", (unsigned)_written, esp_err_to_name(err));
+        return false;
+    }
+    _written += len;
+    return true;
+}
+
+bool OtaFlashSink::end(bool ok)
+{
+    if ( ! ok || _written != _size ) {
+        return false;
+    }
+    // validates the image
+    esp_err_t err = esp_ota_set_boot_partition(_part);
+    if ( err != ESP_OK ) {
+        ESP_LOGE(FNAME, "Image not accepted: %s", esp_err_to_name(err));
+        return false;
+    }
+    const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
+    ESP_LOGI(FNAME, "Next boot partition subtype %d at offset 0x%x", boot_partition->subtype, (unsigned)boot_partition->address);
+    return true;
+}
+
+
+////////////////////////////
+// OtaPipeline
+
+OtaPipeline::OtaPipeline()
+{
+    mbedtls_sha256_init(&_ctx);
+}
+
+OtaPipeline::~OtaPipeline()
+{
+    if ( _running ) {
+        _failed = true;
+        finish();
+    }
+    if ( _full ) {
+        vQueueDelete(_full);
+    }
+    if ( _free ) {
+        vQueueDelete(_free);
+    }
+    if ( _done ) {
+        vSemaphoreDelete(_done);
+    }
+    free(_arena);
+    mbedtls_sha256_free(&_ctx);
+}
+
+bool OtaPipeline::begin(size_t size)
+{
+    _arena = (uint8_t *)malloc(NUM_BLOCKS * BLOCK_SIZE);
+    _free = xQueueCreate(NUM_BLOCKS, sizeof(Block));
+    _full = xQueueCreate(NUM_BLOCKS + 1, sizeof(Block)); // and the end mark
+    _done = xSemaphoreCreateBinary();
+    if ( ! _arena || ! _free || ! _full || ! _done ) {
+        ESP_LOGE(FNAME, "No memory for the OTA pipeline");
+        return false;
+    }
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        Block b = { _arena + i * BLOCK_SIZE, 0 };
+        xQueueSend(_free, &b, 0);
+    }
+    _size = size;
+    _stats = Stats();
+    _start_ms = nowMs();
+    mbedtls_sha256_starts(&_ctx, 0);
+    if ( xTaskCreate(&writerTask, "otaWriter", 4096, this, 6, nullptr) != pdPASS ) {
+        return false;
+    }
+    _running = true;
+    return true;
+}
+
+uint8_t *OtaPipeline::acquire(int &room)
+{
+    if ( ! _cur.data ) {
+        uint32_t t = nowMs();
+        if ( xQueueReceive(_free, &_cur, pdMS_TO_TICKS(10000)) != pdTRUE ) {
+            ESP_LOGE(FNAME, "OTA writer stuck");
+            _failed = true;
+            room = 0;
+            return nullptr;
+        }
+        _stats.producer_wait_ms += nowMs() - t;
+        _cur.len = 0;
+    }
+    room = BLOCK_SIZE - _cur.len;
+    return _cur.data + _cur.len;
+}
+
+void OtaPipeline::commit(int len)
+{
+    if ( len <= 0 || ! _cur.data ) {
+        return;
+    }
+    _cur.len += len;
+    _stats.received += len;
+    if ( _cur.len == BLOCK_SIZE || _stats.received >= _size ) {
+        handOver();
+    }
+}
+
+void OtaPipeline::handOver()
+{
+    if ( _cur.data ) {
+        xQueueSend(_full, &_cur, portMAX_DELAY);
+        _cur.data = nullptr;
+    }
+}
+
+bool OtaPipeline::finish()
+{
+    if ( ! _running ) {
+        return false;
+    }
+    handOver();
+    Block end = { nullptr, 0 };
+    xQueueSend(_full, &end, portMAX_DELAY);
+    xSemaphoreTake(_done, portMAX_DELAY);
+    _running = false;
+    _stats.elapsed_ms = nowMs() - _start_ms;
+    ESP_LOGI(FNAME, "OTA %u bytes in %u ms, producer waited %u ms, writer idle %u ms", (unsigned)_stats.written,
+        (unsigned)_stats.elapsed_ms, (unsigned)_stats.producer_wait_ms, (unsigned)_stats.writer_idle_ms);
+    return ! _failed && _stats.written == _size;
+}
+
+bool OtaPipeline::checkSha256(const char *hex) const
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++) {
+        if ( ! hex[2 * i] || ! hex[2 * i + 1]
+            || tolower(hex[2 * i]) != digits[_sha[i] >> 4]
+            || tolower(hex[2 * i + 1]) != digits[_sha[i] & 0xf] ) {
+            return false;
+        }
+    }
+    return hex[64] == '\0';
+}
+
+void OtaPipeline::writerTask(void *arg)
+{
+    OtaPipeline *p = static_cast<OtaPipeline *>(arg);
+    Block b;
+    while ( true ) {
+        uint32_t t = nowMs();
+        if ( xQueueReceive(p->_full, &b, pdMS_TO_TICKS(10)) != pdTRUE ) {
+            p->_stats.writer_idle_ms += nowMs() - t;
+            if ( p->_sink && ! p->_failed ) {
+                p->_sink->idle();
+            }
+            continue;
+        }
+        p->_stats.writer_idle_ms += nowMs() - t;
+        if ( ! b.data ) {
+            break; // end mark
+        }
+        if ( ! p->_failed ) {
+            mbedtls_sha256_update(&p->_ctx, b.data, b.len);
+            if ( p->_sink && p->_sink->write(b.data, b.len) ) {
+                p->_stats.written += b.len;
+            }
+            else {
+                p->_failed = true;
+            }
+        }
+        xQueueSend(p->_free, &b, portMAX_DELAY);
+    }
+    mbedtls_sha256_finish(&p->_ctx, p->_sha);
+    xSemaphoreGive(p->_done);
+    vTaskDelete(nullptr);
+}
+
+
+#ifdef OtaPipeline_Test
+#include <esp_timer.h>
+#include <cstring>
+
+// Feeds a 512 KB image from a modelled WiFi link through a mock flash, once the former way and once
+// through the pipeline. The link brings 150 KB/s into a TCP window of 5744 bytes and stalls while the
+// window is full. The mock flash takes 150 ms per 64 KB block erase and 11 ms per 4 KB of writes, it
+// erases on demand where a write runs past the erased part. The former way erased the whole image
+// size up front and then wrote each 2 KB received before reading on.
+namespace {
+
+class MockFlash final : public OtaSink
+{
+public:
+    explicit MockFlash(uint32_t size) : _size(size) { mbedtls_sha256_init(&_ctx); mbedtls_sha256_starts(&_ctx, 0); }
+    ~MockFlash() { mbedtls_sha256_free(&_ctx); }
+    void erase(uint32_t len) {
+        vTaskDelay(pdMS_TO_TICKS(150 * len / OtaFlashSink::ERASE_BLOCK));
+        _erased += len;
+    }
+    bool write(const uint8_t *data, int len) override {
+        while ( _written + len > _erased ) {
+            erase(OtaFlashSink::ERASE_BLOCK);
+        }
+        vTaskDelay(pdMS_TO_TICKS(11 * len / 4096));
+        mbedtls_sha256_update(&_ctx, data, len);
+        _written += len;
+        return true;
+    }
+    void idle() override {
+        if ( _erased < _size && _erased < _written + OtaFlashSink::ERASE_AHEAD ) {
+            erase(OtaFlashSink::ERASE_BLOCK);
+        }
+    }
+    bool end(bool ok) override {
+        mbedtls_sha256_finish(&_ctx, _sha);
+        return ok && _written == _size;
+    }
+    uint8_t _sha[32];
+
+private:
+    uint32_t _size;
+    uint32_t _written = 0;
+    uint32_t _erased = 0;
+    mbedtls_sha256_context _ctx;
+};
+
+class Link
+{
+public:
+    static constexpr int RATE = 150 * 1024;
+    static constexpr int WINDOW = 5744;
+    static constexpr int SEGMENT = 1436;
+
+    explicit Link(int size) : _left(size) { _t = esp_timer_get_time(); mbedtls_sha256_init(&_ctx); mbedtls_sha256_starts(&_ctx, 0); }
+    ~Link() { mbedtls_sha256_free(&_ctx); }
+    int recv(uint8_t *buf, int max) {
+        while ( true ) {
+            int64_t now = esp_timer_get_time();
+            _avail = std::min((double)WINDOW, _avail + RATE * (now - _t) / 1e6);
+            _t = now;
+            if ( _avail >= 1. ) {
+                break;
+            }
+            vTaskDelay(1);
+        }
+        int n = std::min({ max, (int)_avail, _left, SEGMENT });
+        for (int i = 0; i < n; i++) {
+            _seed = _seed * 1103515245 + 12345;
+            buf[i] = _seed >> 16;
+        }
+        mbedtls_sha256_update(&_ctx, buf, n);
+        _avail -= n;
+        _left -= n;
+        return n;
+    }
+    void sha(uint8_t *out) { mbedtls_sha256_finish(&_ctx, out); }
+
+private:
+    int _left;
+    double _avail = 0.;
+    int64_t _t;
+    uint32_t _seed = 4711;
+    mbedtls_sha256_context _ctx;
+};
+
+} // namespace
+
+void OtaPipeline::flash_test()
+{
+    const int size = 512 * 1024;
+    uint8_t link_sha[32];
+
+    // the former way
+    {
+        MockFlash flash(size);
+        Link link(size);
+        uint8_t *buf = (uint8_t *)malloc(2048);
+        int64_t t0 = esp_timer_get_time();
+        flash.erase((size + OtaFlashSink::ERASE_BLOCK - 1) / OtaFlashSink::ERASE_BLOCK * OtaFlashSink::ERASE_BLOCK);
+        for (int got = 0; got < size; ) {
+            int n = link.recv(buf, 2048);
+            flash.write(buf, n);
+            got += n;
+        }
+        bool ok = flash.end(true);
+        link.sha(link_sha);
+        free(buf);
+        ESP_LOGI(FNAME, "sequential: %d KB in %lld ms, %s", size / 1024, (esp_timer_get_time() - t0) / 1000,
+            ok ? "ok" : "failed");
+    }
+
+    // the pipeline
+    {
+        MockFlash flash(size);
+        Link link(size);
+        OtaPipeline pipe;
+        int64_t t0 = esp_timer_get_time();
+        pipe.begin(size);
+        pipe.setSink(&flash);
+        while ( pipe.received() < (size_t)size ) {
+            int room;
+            uint8_t *buf = pipe.acquire(room);
+            if ( ! buf ) {
+                break;
+            }
+            pipe.commit(link.recv(buf, room));
+        }
+        bool ok = pipe.finish();
+        ok = flash.end(ok);
+        link.sha(link_sha);
+        ESP_LOGI(FNAME, "pipelined:  %d KB in %lld ms, %s, producer waited %u ms, writer idle %u ms, sha %s, flash %s",
+            size / 1024, (esp_timer_get_time() - t0) / 1000, ok ? "ok" : "failed",
+            (unsigned)pipe.stats().producer_wait_ms, (unsigned)pipe.stats().writer_idle_ms,
+            memcmp(pipe.sha256(), link_sha, 32) ? "differs" : "matches",
+            memcmp(flash._sha, link_sha, 32) ? "differs" : "matches");
+    }
+}
+#endif
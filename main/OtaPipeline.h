@@ -0,0 +1,122 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Where a firmware image goes, fed by the writer task of the OtaPipeline in blocks of BLOCK_SIZE,
+// only the last one may be shorter.
+class OtaSink
+{
+public:
+    virtual ~OtaSink() = default;
+    // the size of the image to come
+    virtual bool begin(size_t size) { return true; }
+    virtual bool write(const uint8_t *data, int len) = 0;
+    // nothing to write for a while, time for work ahead
+    virtual void idle() {}
+    // the image is complete and its hash checked when ok, or the update is given up
+    virtual bool end(bool ok) = 0;
+};
+
+// The next OTA app partition, written directly in flash sectors. The sectors get erased ahead of the
+// write position in 64 KB blocks, while the writer waits for data. The image is verified when it is made
+// the boot partition.
+class OtaFlashSink final : public OtaSink
+{
+public:
+    static constexpr uint32_t ERASE_BLOCK = 64 * 1024;
+    static constexpr uint32_t ERASE_AHEAD = 4 * ERASE_BLOCK;
+
+    bool begin(size_t size) override;
+    bool write(const uint8_t *data, int len) override;
+    void idle() override;
+    bool end(bool ok) override;
+
+private:
+    bool eraseNext();
+    const esp_partition_t *_part = nullptr;
+    uint32_t _size = 0;
+    uint32_t _written = 0;
+    uint32_t _erased = 0;
+};
+
+// A producer/consumer pipeline from the receiver of an image to its sink. The producer fills blocks of a
+// ring in place and hands them over when full. The writer task hashes them with SHA-256 and passes them
+// to the sink, so receiving the next blocks overlaps with the flash or bus work for the former ones.
+//
+// The producer side is one task, the http server. The sink is set after the first bytes came in, they
+// tell the target of the image.
+class OtaPipeline
+{
+public:
+    static constexpr int BLOCK_SIZE = 4096; // one flash sector
+    static constexpr int NUM_BLOCKS = 6;
+
+    struct Stats {
+        uint32_t received = 0;
+        uint32_t written = 0;
+        uint32_t producer_wait_ms = 0; // waiting for a free block, the sink is the bottleneck
+        uint32_t writer_idle_ms = 0;   // waiting for a block, the link is the bottleneck
+        uint32_t elapsed_ms = 0;
+    };
+
+    OtaPipeline();
+    ~OtaPipeline();
+
+    bool begin(size_t size);
+    void setSink(OtaSink *sink) { _sink = sink; }
+    bool hasSink() const { return _sink != nullptr; }
+    OtaSink *sink() const { return _sink; }
+    // the free part of the current block, waits for the writer when all are queued
+    uint8_t *acquire(int &room);
+    const uint8_t *head() const { return _cur.data; } // the block being filled, the image start before the first hand over
+    void commit(int len);
+    // hand over the rest and wait for the writer, true when all went into the sink
+    bool finish();
+    void abort() { _failed = true; }
+    bool failed() const { return _failed; }
+    size_t received() const { return _stats.received; }
+    const uint8_t *sha256() const { return _sha; } // valid after finish()
+    bool checkSha256(const char *hex) const;
+    const Stats &stats() const { return _stats; }
+
+#ifdef OtaPipeline_Test
+    static void flash_test();
+#endif
+
+private:
+    struct Block {
+        uint8_t *data;
+        int len;
+    };
+    static void writerTask(void *arg);
+    void handOver();
+
+    uint8_t *_arena = nullptr;
+    QueueHandle_t _free = nullptr;
+    QueueHandle_t _full = nullptr;
+    SemaphoreHandle_t _done = nullptr;
+    OtaSink *_sink = nullptr;
+    Block _cur = {};
+    size_t _size = 0;
+    volatile bool _failed = false;
+    bool _running = false;
+    mbedtls_sha256_context _ctx;
+    uint8_t _sha[32] = {};
+    Stats _stats;
+    uint32_t _start_ms = 0;
+};
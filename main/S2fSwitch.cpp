@@ -58,13 +58,13 @@ bool IRAM_ATTR S2fSwitch::tick()
         {
             gotEvent = ModeEvent(ModeEvent::MODE_S2F).raw;
         }
-        xQueueSend(uiEventQueue, &gotEvent, 0);
+        uiPostEvent(gotEvent);
     }
     else if (!_state)
     {
         // toggle straight when pressed
         gotEvent = ModeEvent(ModeEvent::MODE_TOGGLE).raw;
-        xQueueSend(uiEventQueue, &gotEvent, 0);
+        uiPostEvent(gotEvent);
     }
 
     return false;
@@ -179,7 +179,7 @@ void S2fSwitch::checkCruiseMode()
                 _auto_state = cm;
                 ESP_LOGI(FNAME, "New S2F auto mode: %d", cm);
                 int gotEvent = ModeEvent(cm ? ModeEvent::MODE_S2F : ModeEvent::MODE_VARIO).raw;
-                xQueueSend(uiEventQueue, &gotEvent, 0);
+                uiPostEvent(gotEvent);
             }
             _lag_counter++;
         }
@@ -4,6 +4,11 @@
 #include "setup/SetupCommon.h"
 #include "comm/DeviceMgr.h"
 #include "protocol/NMEA.h"
+#include "OtaPipeline.h"
+#include "OtaDelta.h"
+#include "LiveStream.h"
+#include "CrashTrace.h"
+#include "EventTrace.h"
 #include "logdef.h"
 
 #include <esp_ota_ops.h>
@@ -29,11 +34,14 @@ extern const uint8_t milligram_min_css_gz_end[]     asm("_binary_milligram_min_c
 static esp_err_t GET_index_html_handler(httpd_req_t *req);
 static esp_err_t GET_milligram_min_css_handler(httpd_req_t *req);
 static esp_err_t GET_status_json_handler(httpd_req_t *req);
+static esp_err_t GET_live_handler(httpd_req_t *req);
 static esp_err_t POST_update_handler(httpd_req_t *req);
 static esp_err_t GET_backup_handler(httpd_req_t *req);
 static esp_err_t POST_restore_handler(httpd_req_t *req);
 static esp_err_t DELETE_reset_handler(httpd_req_t *req);
 static esp_err_t GET_coredump_handler(httpd_req_t *req);
+static esp_err_t GET_trace_handler(httpd_req_t *req);
+static esp_err_t GET_events_handler(httpd_req_t *req);
 
 httpd_uri_t GET_index_html = {
 	.uri = "/",
@@ -56,6 +64,13 @@ httpd_uri_t GET_stats_json = {
 	.user_ctx = NULL
 };
 
+httpd_uri_t GET_live = {
+	.uri = "/live",
+	.method = HTTP_GET,
+	.handler = GET_live_handler,
+	.user_ctx = NULL
+};
+
 httpd_uri_t POST_update = {
 	.uri = "/update",
 	.method = HTTP_POST,
@@ -91,6 +106,20 @@ httpd_uri_t GET_coredump = {
 	.user_ctx = NULL
 };
 
+httpd_uri_t GET_trace = {
+	.uri = "/trace",
+	.method = HTTP_GET,
+	.handler = GET_trace_handler,
+	.user_ctx = NULL
+};
+
+httpd_uri_t GET_events = {
+	.uri = "/events",
+	.method = HTTP_GET,
+	.handler = GET_events_handler,
+	.user_ctx = NULL
+};
+
 cWebserver& cWebserver::getInstance()
 {
     if(m_instance == nullptr)
@@ -123,7 +152,7 @@ void cWebserver::start()
 		
 	// Lets bump up the stack size (default was 4096)
 	config.stack_size = 8192;
-	config.max_uri_handlers = 10;
+	config.max_uri_handlers = 11;
 	
 	// Start the httpd server
 	ESP_LOGI(FNAME, "Starting http server on port: '%d'", config.server_port);
@@ -140,6 +169,8 @@ void cWebserver::start()
 		httpd_register_uri_handler(m_httpHandle, &POST_restore);
 		httpd_register_uri_handler(m_httpHandle, &DELETE_reset);
 	    httpd_register_uri_handler(m_httpHandle, &GET_coredump);
+	    httpd_register_uri_handler(m_httpHandle, &GET_trace);
+	    httpd_register_uri_handler(m_httpHandle, &GET_events);
 	}
     else
     {
@@ -147,8 +178,41 @@ void cWebserver::start()
     }
 }
 
+// On the Wifi AP of the normal operation, next to the socket servers of the data links. It shares
+// their sockets, a live stream holds one as long as the browser stays.
+void cWebserver::startDiag()
+{
+    if(m_httpHandle != nullptr)
+    {
+        return;
+    }
+
+	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+	config.max_uri_handlers = 4;
+	config.max_open_sockets = 3;
+
+	ESP_LOGI(FNAME, "Starting diagnostic http server on port: '%d'", config.server_port);
+	if (httpd_start(&m_httpHandle, &config) == ESP_OK)
+	{
+		httpd_register_uri_handler(m_httpHandle, &GET_stats_json);
+		httpd_register_uri_handler(m_httpHandle, &GET_live);
+		httpd_register_uri_handler(m_httpHandle, &GET_events);
+		httpd_register_uri_handler(m_httpHandle, &GET_trace);
+	}
+	else
+	{
+		ESP_LOGE(FNAME, "Error starting diagnostic http server!");
+		m_httpHandle = nullptr;
+	}
+}
+
 void cWebserver::stop()
 {
+    if(m_httpHandle == nullptr)
+    {
+        return;
+    }
+    LiveStream::closeAll();
     httpd_stop(m_httpHandle);
     m_httpHandle = nullptr;
 }
@@ -208,24 +272,155 @@ static esp_err_t GET_status_json_handler(httpd_req_t *req)
 	return ESP_OK;
 }
 
-bool otaStarted = false;
-char *otaBuffer = nullptr;
-const esp_partition_t *otaUpdatePartition;
-esp_ota_handle_t otaHandle = {0};
-size_t otaSize = 0;
-size_t otaReceived = 0;
+// GET /live?rate=5, one line of JSON per sample until the browser goes away. The request is handed
+// over to the LiveStream task, the server is free for other requests meanwhile.
+static bool live_send(void *ctx, const char *data, int len)
+{
+	return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK;
+}
 
-// Receive .Bin file
-static esp_err_t POST_update_handler(httpd_req_t *req)
+static void live_close(void *ctx)
 {
-	constexpr size_t OTA_BUFF_SIZE = 2 * 1024;
-	static int updateTarget = 0; // 1  - sensor; 2 - CanMag
-	static NmeaPrtcl *magsensp = nullptr;
-	static int otaSent = 0;
-	static int otaChunkNr = 0;
+	httpd_req_t *req = (httpd_req_t *)ctx;
+	httpd_resp_send_chunk(req, NULL, 0);
+	httpd_req_async_handler_complete(req);
+}
 
+static esp_err_t GET_live_handler(httpd_req_t *req)
+{
+	int rate = LiveStream::DEFAULT_RATE;
+	char query[32];
+	char value[8];
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+		&& httpd_query_key_value(query, "rate", value, sizeof(value)) == ESP_OK)
+	{
+		rate = atoi(value);
+	}
+	ESP_LOGI(FNAME, "live Requested at %dHz", rate);
+
+	httpd_req_t *live = nullptr;
+	if (httpd_req_async_handler_begin(req, &live) != ESP_OK)
+	{
+		return ESP_FAIL;
+	}
+	httpd_resp_set_type(live, "application/x-ndjson");
+	httpd_resp_set_hdr(live, "Cache-Control", "no-cache");
+	if (!LiveStream::add(live, live_send, live_close, rate))
+	{
+		httpd_resp_send_err(live, HTTPD_500_INTERNAL_SERVER_ERROR, "No live stream left");
+		httpd_req_async_handler_complete(live);
+	}
+	return ESP_OK;
+}
+
+// Forwards an image to the MagSens in the packets announced to it. Up to OTA_WINDOW packets may be on the
+// way unconfirmed, the MagSens confirms each one by its number.
+class MagSensSink final : public OtaSink
+{
+public:
+	static constexpr int OTA_PACKET = 2048;
+	static constexpr int OTA_WINDOW = 2;
+
+	explicit MagSensSink(NmeaPrtcl *nmea) : _nmea(nmea) {}
+	bool begin(size_t size) override
+	{
+		_sent = 0;
+		return _nmea->prepareUpdate(size, OTA_PACKET);
+	}
+	bool write(const uint8_t *data, int len) override
+	{
+		for (int off = 0; off < len; off += OTA_PACKET) {
+			if (_sent >= OTA_WINDOW) {
+				int tmp = _nmea->waitConfirmation(_sent - OTA_WINDOW + 1);
+				if (tmp < _sent - OTA_WINDOW + 1) {
+					ESP_LOGI(FNAME, "no confirmation %d", tmp);
+					return false;
+				}
+			}
+			_nmea->firmwarePacket((const char *)data + off, std::min(OTA_PACKET, len - off));
+			_sent++;
+		}
+		return true;
+	}
+	bool end(bool ok) override
+	{
+		return ok && _nmea->waitConfirmation(_sent) >= _sent;
+	}
+
+private:
+	NmeaPrtcl *_nmea;
+	int _sent = 0;
+};
+
+static OtaPipeline *otaPipe = nullptr;
+static OtaFlashSink *otaFlash = nullptr;
+static OtaDeltaSink *otaDelta = nullptr;
+static MagSensSink *otaMagSens = nullptr;
+static size_t otaSize = 0;
+static char otaSha[65] = "";
+
+static void ota_cleanup()
+{
+	delete otaPipe;
+	otaPipe = nullptr;
+	delete otaDelta;
+	otaDelta = nullptr;
+	delete otaFlash;
+	otaFlash = nullptr;
+	delete otaMagSens;
+	otaMagSens = nullptr;
+}
+
+// Recognize the target of the image from its first bytes and set up its sink
+static void ota_select_target(const char *head)
+{
+	if (OtaDeltaSink::isDelta((const uint8_t *)head))
+	{
+		// a delta to the running sensor image, rebuilt on the way to flash
+		ESP_LOGI(FNAME, "Recognized a delta update.");
+		otaFlash = new OtaFlashSink();
+		otaDelta = new OtaDeltaSink(otaFlash);
+		otaPipe->setSink(otaDelta);
+		return;
+	}
+	if (strncmp(&head[0x50], "sensor", 6) == 0)
+	{
+		ESP_LOGI(FNAME, "Recognized a sensor update.");
+		otaFlash = new OtaFlashSink();
+		if (otaFlash->begin(otaSize))
+		{
+			otaPipe->setSink(otaFlash);
+			return;
+		}
+		ESP_LOGE(FNAME, "Error With OTA Begin, Cancelling OTA");
+	}
+	else if (strncmp(&head[0x50], "CanMagSens", 10) == 0)
+	{
+		ESP_LOGI(FNAME, "Recognized a CanMagSens update.");
+		Device *mag = DEVMAN->getDevice(MAGSENS_DEV);
+		if ( mag ) {
+			ESP_LOGI(FNAME, "CANMAG is there.");
+			NmeaPrtcl *magsensp = static_cast<NmeaPrtcl*>(mag->getProtocol(MAGSENS_P));
+			ESP_LOGI(FNAME, "CANMAG_P is %p", magsensp);
+			if ( magsensp && magsensp->killStream() ) {
+				ESP_LOGI(FNAME, "Mag stream killed.");
+				otaMagSens = new MagSensSink(magsensp);
+				otaMagSens->begin(otaSize);
+				otaPipe->setSink(otaMagSens);
+				vTaskDelay(pdMS_TO_TICKS(5));
+				return;
+			}
+		}
+	}
+	otaPipe->abort();
+}
+
+// Receive .Bin file, the OtaPipeline hashes and writes it while the next parts come in. The image may
+// come in several requests.
+static esp_err_t POST_update_handler(httpd_req_t *req)
+{
 	size_t content_length = req->content_len;
-	int content_received = 0;
+	size_t content_received = 0;
 	int recv_len;
 
 	if (content_length < 1)
@@ -234,35 +429,40 @@ static esp_err_t POST_update_handler(httpd_req_t *req)
 	}
 
 	// Received first chunk - start OTA procedure
-	if (!otaStarted)
+	if (!otaPipe)
 	{
-		otaStarted = true;
-		if (!otaBuffer)
+		// Get total OTA file size, and the optional SHA-256 of it
+		char otaSizeBuffer[32];
+		if (httpd_req_get_hdr_value_str(req, "X-OTA-SIZE", otaSizeBuffer, sizeof(otaSizeBuffer)) == ESP_OK)
 		{
-			otaBuffer = (char *)malloc(OTA_BUFF_SIZE);
+			otaSize = atoi(otaSizeBuffer);
+			ESP_LOGI(FNAME, "Found header => X-OTA-SIZE: %s", otaSizeBuffer);
 		}
-
-		// Get total OTA file size
-		size_t buf_len = httpd_req_get_hdr_value_len(req, "X-OTA-SIZE") + 1;
-		if (buf_len > 1)
+		if (httpd_req_get_hdr_value_str(req, "X-OTA-SHA256", otaSha, sizeof(otaSha)) != ESP_OK)
 		{
-			char otaSizeBuffer[32];
-			if (httpd_req_get_hdr_value_str(req, "X-OTA-SIZE", otaSizeBuffer, sizeof(otaSizeBuffer)) == ESP_OK)
-			{
-				otaSize = atoi(otaSizeBuffer);
-				ESP_LOGI(FNAME, "Found header => X-OTA-SIZE: %s", otaSizeBuffer);
-			}
+			otaSha[0] = '\0';
 		}
 		ESP_LOGI(FNAME, "Update Request Header");
-		ESP_LOG_BUFFER_HEX(FNAME, req->handle, std::min(size_t(100), content_length));
-
-		otaUpdatePartition = esp_ota_get_next_update_partition(NULL);
+		otaPipe = new OtaPipeline();
+		if (otaSize == 0 || !otaPipe->begin(otaSize))
+		{
+			ESP_LOGE(FNAME, "Cannot start OTA of %d bytes", otaSize);
+			ota_cleanup();
+			return ESP_FAIL;
+		}
 	}
 
 	do
 	{
-		// Read the ota data
-		if ((recv_len = httpd_req_recv(req, otaBuffer, std::min(content_length, OTA_BUFF_SIZE))) < 0)
+		// Read the ota data straight into the pipeline
+		int room;
+		char *buf = (char *)otaPipe->acquire(room);
+		if (!buf)
+		{
+			ota_cleanup();
+			return ESP_FAIL;
+		}
+		if ((recv_len = httpd_req_recv(req, buf, std::min(content_length - content_received, (size_t)room))) < 0)
 		{
 			if (recv_len == HTTPD_SOCK_ERR_TIMEOUT)
 			{
@@ -271,117 +471,63 @@ static esp_err_t POST_update_handler(httpd_req_t *req)
 				continue;
 			}
 			ESP_LOGE(FNAME, "OTA Other Error %d", recv_len);
+			ota_cleanup();
 			return ESP_FAIL;
 		}
-		if (otaReceived == 0)
+		if (!otaPipe->hasSink() && !otaPipe->failed() && otaPipe->received() + recv_len >= 0x60)
 		{
 			ESP_LOGI(FNAME, "First 100 bytes");
-			ESP_LOG_BUFFER_HEX(FNAME, otaBuffer, std::min(100, recv_len));
-			updateTarget = 0; // reset target
-			if (strncmp(&otaBuffer[0x50], "sensor", 6) == 0)
-			{
-				ESP_LOGI(FNAME, "Recognized a sensor update.");
-				updateTarget = 1;
-				if (ESP_OK != esp_ota_begin(otaUpdatePartition, otaSize, &otaHandle))
-				{
-					ESP_LOGE(FNAME, "Error With OTA Begin, Cancelling OTA");
-					return ESP_FAIL;
-				}
-				else
-				{
-					ESP_LOGI(FNAME, "Writing to partition subtype %d at offset 0x%x", otaUpdatePartition->subtype, (unsigned int)otaUpdatePartition->address);
-				}
-			}
-			else if (strncmp(&otaBuffer[0x50], "CanMagSens", 10) == 0)
-			{
-				ESP_LOGI(FNAME, "Recognized a CanMagSens update.");
-				Device *mag = DEVMAN->getDevice(MAGSENS_DEV);
-				if ( mag ) {
-					ESP_LOGI(FNAME, "CANMAG is there.");
-					magsensp = static_cast<NmeaPrtcl*>(mag->getProtocol(MAGSENS_P));
-					ESP_LOGI(FNAME, "CANMAG_P is %p", magsensp);
-					if ( magsensp && magsensp->killStream() ) {
-						ESP_LOGI(FNAME, "Mag stream killed.");
-						magsensp->prepareUpdate(otaSize, OTA_BUFF_SIZE);
-						updateTarget = 2;
-						otaSent = 0;
-						otaChunkNr = 1;
-						vTaskDelay(pdMS_TO_TICKS(5));
-					}
-				}
-			}
-		}
-
-		if (updateTarget == 1)
-		{
-			// Flash OTA data
-			esp_ota_write(otaHandle, otaBuffer, recv_len);
-		}
-		else if (updateTarget == 2)
-		{
-			// Check on confirmations to slow down the wifi stream
-			if ( otaSent > (otaChunkNr*OTA_BUFF_SIZE) ) {
-				int tmp = magsensp->waitConfirmation();
-				if ( tmp != otaChunkNr ) {
-					updateTarget = 0; // abort
-					ESP_LOGI(FNAME, "no confirmation %d", tmp);
-				}
-				otaChunkNr = (otaReceived/OTA_BUFF_SIZE) + 1;
-			}
-			// Send OTA data to MagSens
-			ESP_LOGI(FNAME, "Send %db", recv_len);
-			magsensp->firmwarePacket(otaBuffer, recv_len);
-			otaSent += recv_len;
+			ESP_LOG_BUFFER_HEX(FNAME, otaPipe->head(), std::min(100, (int)otaPipe->received() + recv_len));
+			ota_select_target((const char *)otaPipe->head());
 		}
+		otaPipe->commit(recv_len);
 		content_received += recv_len;
-		otaReceived += recv_len;
 	} while (recv_len > 0 && content_received < content_length);
 
+	size_t otaReceived = otaPipe->received();
 	Webserver.setOtaProgress((otaReceived * 100.0f) / otaSize);
 	ESP_LOGI(FNAME, "Received %d / %d (%.02f)", otaReceived, otaSize, (otaReceived * 100.0) / otaSize);
 
 	if (otaReceived >= otaSize)
 	{
-		free(otaBuffer);
-		otaBuffer = nullptr;
-		otaStarted = false;
-		otaReceived = 0;
+		bool ok = otaPipe->finish();
+		if (ok && otaSha[0] && !otaPipe->checkSha256(otaSha))
+		{
+			ESP_LOGE(FNAME, "SHA-256 mismatch, image dropped");
+			ok = false;
+		}
+		bool magsens = otaMagSens != nullptr;
+		if (otaPipe->hasSink())
+		{
+			ok = otaPipe->sink()->end(ok);
+		}
+		else
+		{
+			ok = false;
+		}
+		ota_cleanup();
+
+		if (!ok)
+		{
+			ESP_LOGE(FNAME, "\r\n\r\n !!! OTA End Error !!!\r\n");
+			Webserver.setOtaStatus(otaStatus::ERROR);
+			httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Update failed");
+			return ESP_OK;
+		}
 		// End response
 		httpd_resp_set_type(req, "application/json");
 		httpd_resp_send(req, "OK", strlen("OK"));
 
-		if (updateTarget == 1)
-		{
-			if (esp_ota_end(otaHandle) == ESP_OK)
-			{
-				otaHandle = 0;
-				// Lets update the partition
-				if (esp_ota_set_boot_partition(otaUpdatePartition) == ESP_OK)
-				{
-					const esp_partition_t *boot_partition = esp_ota_get_boot_partition();
-
-					ESP_LOGI(FNAME, "Next boot partition subtype %d at offset 0x%x", boot_partition->subtype, (unsigned int)boot_partition->address);
-					ESP_LOGI(FNAME, "Rebooting in 3 seconds...");
-
-					Webserver.setOtaStatus(otaStatus::DONE);
-				}
-				else
-				{
-					ESP_LOGE(FNAME, "\r\n\r\n !!! Flashed Error !!!\r\n");
-				}
-			}
-		}
-		else if (updateTarget == 2)
+		if (magsens)
 		{
 			ESP_LOGI(FNAME, "Finished Mag Update");
 			vTaskDelay(20000 / portTICK_PERIOD_MS);
-			Webserver.setOtaStatus(otaStatus::DONE);
 		}
 		else
 		{
-			ESP_LOGE(FNAME, "\r\n\r\n !!! OTA End Error !!!\r\n");
+			ESP_LOGI(FNAME, "Rebooting in 3 seconds...");
 		}
-		updateTarget = 0;
+		Webserver.setOtaStatus(otaStatus::DONE);
 	}
 	else
 	{
@@ -395,9 +541,16 @@ static esp_err_t GET_backup_handler(httpd_req_t *req)
 {
 	ESP_LOGI(FNAME, "Backup Requested");
 
-	httpd_resp_set_type(req, "text/html");
-    // SetupCommon::giveConfigChanges(req);
-    send_config(req);
+	// the binary snapshot, the former text format with /backup?csv
+	char query[8] = "";
+	if ( httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK && strncmp(query, "csv", 3) == 0 ) {
+		httpd_resp_set_type(req, "text/csv");
+		SetupCommon::giveConfigChanges(req);
+	}
+	else {
+		httpd_resp_set_type(req, "application/octet-stream");
+		send_config(req);
+	}
 	return ESP_OK;
 }
 
@@ -405,11 +558,27 @@ static esp_err_t POST_restore_handler(httpd_req_t *req)
 {
 	const size_t max_len = 8192;
 	ESP_LOGI(FNAME, "Restore Requested %d", req->content_len );
-	char *buff = (char*)malloc(max_len);
-	int recv_len;
-	if ((recv_len = httpd_req_recv(req, buff, std::min(req->content_len, max_len ))) < 0){
+	if ( req->content_len > max_len ) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Config file too large");
+		return ESP_FAIL;
+	}
+	char *buff = (char*)malloc(req->content_len + 1);
+	if ( ! buff ) {
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
 		return ESP_FAIL;
 	}
+	int recv_len = 0;
+	while ( recv_len < (int)req->content_len ) {
+		int ret = httpd_req_recv(req, buff + recv_len, req->content_len - recv_len);
+		if ( ret == HTTPD_SOCK_ERR_TIMEOUT ) {
+			continue;
+		}
+		if ( ret <= 0 ) {
+			free(buff);
+			return ESP_FAIL;
+		}
+		recv_len += ret;
+	}
     ESP_LOGI(FNAME, "Len %d", recv_len );
 	httpd_resp_set_type(req, "text/html");
 	buff[recv_len] = '\0';
@@ -494,3 +663,21 @@ static esp_err_t GET_coredump_handler(httpd_req_t *req)
 	clear_coredump();
 	return ESP_OK;
 }
+
+// the crash trace of the former run, /trace?now the running one
+static esp_err_t GET_trace_handler(httpd_req_t *req)
+{
+	ESP_LOGI(FNAME, "Trace Requested");
+
+	char query[8] = "";
+	bool now = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK && strncmp(query, "now", 3) == 0;
+	CrashTrace::send(req, now);
+	return ESP_OK;
+}
+
+// the event trace rings of both cores
+static esp_err_t GET_events_handler(httpd_req_t *req)
+{
+	EventTrace::send(req);
+	return ESP_OK;
+}
@@ -19,6 +19,7 @@ public:
     void destroy();
 
     void start();
+    void startDiag(); // the diagnostic subset next to the normal operation
     void stop();
 
     otaStatus getOtaStatus(){return m_otaStatus;}
@@ -1,47 +1,49 @@
 #pragma once
 
-// returns initially fast results
-// runs steadily up to the value
-template <int N, typename T=int, typename Total=int >
-class Average
+// Time weighted moving average over a window given in seconds, for samples at arbitrary intervals.
+// Returns sum(sample*dt)/sum(dt) over the latest samples that fill the window, N caps the
+// number of samples kept (window length times highest sample rate).
+template <int N>
+class TimeWindowAverage
 {
 public:
-	T operator()(T sample)
+	float operator()(float sample, float dt)
 	{
-		total += sample;
-		if( full ){
-			T oldest = samples[num_sample];
-			samples[num_sample] = sample;
-			total -= oldest;
-			num_sample++;
-			num_sample = num_sample % length;
-			return (Total)(total / length );
+		if( count == N ) {
+			pop();
 		}
-		else{
-			samples[num_sample] = sample;
-			num_sample++;
-			if( num_sample == length ){
-				full = true;
-				num_sample = 0;
-				return (Total)(total / length);
-			}else
-				return (Total)(total / num_sample);
+		int in = (first + count) % N;
+		weighted[in] = sample * dt;
+		steps[in] = dt;
+		count++;
+		total += weighted[in];
+		time += dt;
+		// drop the oldest samples that are not needed to fill the window, half a step tolerance for jitter
+		while( count > 1 && (time - steps[first]) > (window - dt*0.5f) ) {
+			pop();
 		}
+		return (float)(total / time);
 	}
 	void reset()
 	{
-		num_sample = 0;
-		full = false;
-		total = (Total)0;
+		first = count = 0;
+		total = time = 0.;
 	}
-	void setLength( int len ) { if( len <=N ) { length = len; reset(); } };
+	void setWindow( float sec ) { window = sec; reset(); };
 
 private:
-	T     samples[N] = {0};
-	int   length = N;
-	int   num_sample = 0;
-	bool  full = false;
-	Total total = 0;
+	void pop()
+	{
+		total -= weighted[first];
+		time -= steps[first];
+		first = (first + 1) % N;
+		count--;
+	}
+	float  weighted[N] = {0};
+	float  steps[N] = {0};
+	float  window = 1.f;
+	int    first = 0;
+	int    count = 0;
+	double total = 0.;
+	double time = 0.;
 };
-
-
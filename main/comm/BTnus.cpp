@@ -11,7 +11,7 @@
 #include "BlueTooth.h"
 #include "DataLink.h"
 #include "setup/SetupCommon.h"
-#include "math/Floats.h"
+#include "protocol/Clock.h"
 #include "logdef.h"
 
 #include <esp_bt.h>
@@ -79,19 +79,44 @@ public:
         switch (event)
         {
         case ESP_GATTS_MTU_EVT:
+        {
             BLUEnus->peer_mtu = param->mtu.mtu;
             ESP_LOGI(FNAME, "Peer MTU: %d", BLUEnus->peer_mtu);
+            std::lock_guard<SemaphoreMutex> lock(BLUEnus->_tx_mutex);
+            BLUEnus->_tx.setPayload(BLUEnus->peer_mtu - 3);
             break;
-
+        }
         case ESP_GATTS_CONNECT_EVT: // Client connected
+        {
             ESP_LOGI(FNAME, "Client connected, conn_id: %d", param->connect.conn_id);
+            {
+                std::lock_guard<SemaphoreMutex> lock(BLUEnus->_tx_mutex);
+                BLUEnus->peer_mtu = 23;
+                BLUEnus->_tx.reset();
+                BLUEnus->_tx.takeStats();
+            }
+            BLUEnus->_connected_at = Clock::getMillis();
             BLUEnus->my_conn_id = param->connect.conn_id;
             BLUEnus->nus_notify_enabled = true;
-            break;
 
+            // Longest link layer packets, the client starts the MTU exchange against our local MTU
+            esp_ble_gap_set_pkt_data_len(param->connect.remote_bda, 251);
+            // A short connection interval, the phone may still choose a longer one
+            esp_ble_conn_update_params_t conn_params = {};
+            memcpy(conn_params.bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+            conn_params.min_int = 0x06; // 7.5 msec
+            conn_params.max_int = 0x18; // 30 msec
+            conn_params.latency = 0;
+            conn_params.timeout = 400;  // 4 sec
+            esp_ble_gap_update_conn_params(&conn_params);
+            Clock::start(BLUEnus);
+            break;
+        }
         case ESP_GATTS_DISCONNECT_EVT: // Client disconnected
         {
             ESP_LOGI(FNAME, "Client disconnected, reason: %d", param->disconnect.reason);
+            Clock::stop(BLUEnus);
+            BLUEnus->statsLog();
             BLUEnus->nus_notify_enabled = false;
             BLUEnus->my_conn_id = 0xFFFF;
 
@@ -177,23 +202,28 @@ public:
             break;
 
         case ESP_GATTS_CONF_EVT:
-            static int congestion = 0;
+            // the notification left, its credit returns and the next may go
             if (param->conf.status != ESP_GATT_OK)
             {
-                ESP_LOGE(FNAME, "Notification/Indication status: %d", param->conf.status);
-                if (param->conf.status == ESP_GATT_CONGESTED)
-                {
-                    ESP_LOGI(FNAME, "Congested, pacing: %d", congestion);
-                    if (congestion < 300)
-                        congestion++;
+                ESP_LOGD(FNAME, "Notification status: %d", param->conf.status);
+            }
+            {
+                std::lock_guard<SemaphoreMutex> lock(BLUEnus->_tx_mutex);
+                BLUEnus->_tx.confirm();
+                if (param->conf.status == ESP_GATT_CONGESTED) {
+                    BLUEnus->_tx.congested(true);
                 }
             }
-            else
+            BLUEnus->flush();
+            break;
+
+        case ESP_GATTS_CONGEST_EVT:
+            ESP_LOGD(FNAME, "Congested: %d", param->congest.congested);
             {
-                ESP_LOGD(FNAME, "Send OK, pacing: %d", congestion);
-                if (congestion)
-                    congestion--;
+                std::lock_guard<SemaphoreMutex> lock(BLUEnus->_tx_mutex);
+                BLUEnus->_tx.congested(param->congest.congested);
             }
+            BLUEnus->flush();
             break;
 
         case ESP_GATTS_REG_EVT:
@@ -295,7 +325,6 @@ public:
         case ESP_GATTS_CANCEL_OPEN_EVT:
         case ESP_GATTS_CLOSE_EVT:
         case ESP_GATTS_LISTEN_EVT:
-        case ESP_GATTS_CONGEST_EVT:
         case ESP_GATTS_RESPONSE_EVT:
         case ESP_GATTS_CREAT_ATTR_TAB_EVT:
         case ESP_GATTS_SET_ATTR_VAL_EVT:
@@ -361,6 +390,7 @@ public:
 
 BTnus::BTnus() :
     InterfaceCtrl(true),
+    Clock_I(1),
     core(BlueTooth::instance())
 {
     ESP_LOGI(FNAME, "BTnus constructor");
@@ -368,6 +398,7 @@ BTnus::BTnus() :
 }
 BTnus::~BTnus()
 {
+    Clock::stop(this);
     stop();
     core.release();
 }
@@ -407,20 +438,70 @@ void BTnus::ConfigureIntf(int cfg)
 
 int BTnus::Send(const char *msg, int &len, int port)
 {
-    int ret = 0;
     if (my_conn_id==0xFFFF || !tx_char_handle || my_gatts_if==ESP_GATT_IF_NONE) {
         ESP_LOGD(FNAME,"SendTry BTnus, id %d, tx %d, gatt %d", my_conn_id, tx_char_handle, my_gatts_if);
         return 0; // not connected; pretend everything is fine
     }
     if (nus_notify_enabled) {
         ESP_LOGD(FNAME,"Send BTnus: %s", msg);
-        if ( len >  peer_mtu - 3 ) {
-            len = peer_mtu - 3; // adjust to MTU
-            ret = fast_ceilf(peer_mtu / 700.f) * 15; // estimate time for larger packets (700 byte chunks, 15ms each)
+        bool queued;
+        {
+            std::lock_guard<SemaphoreMutex> lock(_tx_mutex);
+            queued = _tx.push(msg, len, Clock::getMillis());
+        }
+        if ( ! queued ) {
+            // the peer is behind, one retry, then the transmit task drops the message
+            len = 0;
+            return TX_LATENCY;
         }
-        esp_ble_gatts_send_indicate(my_gatts_if, my_conn_id, tx_char_handle, len, (uint8_t*)msg, false);
+        flush();
+    }
+    return 0;
+}
+
+// Hand all due notifications to the stack, it copies them. The transmit task, the clock tick and the
+// GATTS events flush, the lock spans pull and send so the notifications leave in queue order.
+void BTnus::flush()
+{
+    uint8_t note[NotifyBatcher::MAX_PAYLOAD];
+    std::lock_guard<SemaphoreMutex> lock(_tx_mutex);
+    while ( true ) {
+        int n = _tx.pull(note, Clock::getMillis());
+        if ( n == 0 ) {
+            break;
+        }
+        if ( esp_ble_gatts_send_indicate(my_gatts_if, my_conn_id, tx_char_handle, n, note, false) != ESP_OK ) {
+            _tx.confirm();
+            break;
+        }
+    }
+}
+
+// Releases what waited for the latency budget
+bool BTnus::tick()
+{
+    if ( nus_notify_enabled ) {
+        flush();
+    }
+    return false;
+}
+
+void BTnus::statsLog()
+{
+    if ( ! isConnected() ) {
+        return;
+    }
+    NotifyBatcher::Stats s;
+    int rate;
+    {
+        std::lock_guard<SemaphoreMutex> lock(_tx_mutex);
+        s = _tx.takeStats();
+        rate = _tx.rate();
     }
-    return ret;
+    ESP_LOGI(FNAME, "BTle conn %d mtu %d up %d sec, last period: in %lu, out %lu bytes in %lu notifications (%lu full), now %d B/s, rejected %lu, congested %lu, max queue %d, max delay %d ms",
+        my_conn_id, peer_mtu, (int)((Clock::getMillis() - _connected_at) / 1000),
+        (unsigned long)s.bytes_in, (unsigned long)s.bytes_out, (unsigned long)s.notifies, (unsigned long)s.full,
+        rate, (unsigned long)s.rejected, (unsigned long)s.congested, s.max_fill, s.max_delay);
 }
 
 bool BTnus::start()
@@ -432,6 +513,7 @@ bool BTnus::start()
 
 	esp_ble_gatts_register_callback(BTnus_EVENT_HANDLER::gatts_event_handler);
     esp_ble_gatts_app_register(0x42);
+    esp_ble_gatt_set_local_mtu(517); // offered to the client on its MTU exchange
 
     esp_ble_gap_set_device_name(SetupCommon::getID());
     static esp_ble_adv_data_t adv_data = {
@@ -9,12 +9,17 @@
 #pragma once
 
 #include "InterfaceCtrl.h"
+#include "NotifyBatcher.h"
+#include "Mutex.h"
+#include "protocol/ClockIntf.h"
 
 #include <cstdint>
 
 class BlueTooth;
 
-class BTnus final : public InterfaceCtrl
+// Messages are packed into MTU sized notifications by a NotifyBatcher, they leave when a notification
+// is full, on the confirmation of an earlier one, or latest with the 10 msec clock after the latency budget.
+class BTnus final : public InterfaceCtrl, public Clock_I
 {
 public:
     BTnus();
@@ -28,11 +33,16 @@ public:
     const char *getStringId() const override;
     void ConfigureIntf(int cfg) override;
     int Send(const char *msg, int &len, int port = 0) override;
+    void statsLog();
+
+    // Clock tick callback
+    bool tick() override;
 
 private:
 	BlueTooth& core; // shared BT recourses
     bool start();
     void stop();
+    void flush();
 
     // Receiving data
     friend class BTnus_EVENT_HANDLER;
@@ -41,9 +51,16 @@ private:
     uint16_t rx_char_handle = 0;
     uint16_t tx_char_handle = 0;
     uint16_t tx_cccd_handle = 0;
-    uint16_t peer_mtu;
+    uint16_t peer_mtu = 23;
     bool nus_notify_enabled = false;
 
+    // Sending data
+    static constexpr int TX_CREDITS = 6;    // notifications handed to the stack, not yet confirmed
+    static constexpr int TX_LATENCY = 20;   // msec budget to fill a notification
+    NotifyBatcher _tx{TX_CREDITS, TX_LATENCY};
+    SemaphoreMutex _tx_mutex;
+    uint32_t _connected_at = 0;
+
     bool _server_running = false;
 };
 
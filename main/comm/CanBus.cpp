@@ -4,15 +4,17 @@
 #include "DataLink.h"
 #include "setup/SetupNG.h"
 #include "sensor.h"
-#include "logdefnone.h"
+#include "logdef.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
 #include <driver/gpio.h>
 #include <esp_err.h>
+#include <esp_timer.h>
 #include <string>
 #include <mutex>
+#include <vector>
 
 
 /*
@@ -24,10 +26,54 @@
 // used CAN Id's
 static constexpr int CANTEST_ID = CAN_REG_PORT+1;
 
+static constexpr int RX_QUEUE_LEN = 15; // 1.5x the need of one NMEA sentence
+static constexpr int TX_QUEUE_LEN = 15;
+
 static TaskHandle_t rxTask = nullptr;
 CANbus *CAN = 0;
 static bool terminate_receiver = false;
 static bool do_recover = false;
+static bool do_refilter = false;
+
+// Traffic counters, reset with every log
+static struct {
+    uint32_t rx_frames;
+    uint32_t rx_batches;
+    uint32_t rx_max_batch;
+    uint32_t rx_unknown;   // passed the acceptance filter, but no data link
+    uint32_t rx_calls;     // data link calls, one per id and batch
+    int64_t  rx_lat_sum;   // reception of the first frame to processed, usec
+    int64_t  rx_lat_max;
+    uint32_t tx_frames;
+    uint32_t tx_windows;   // sends cut short by a full TX queue
+    uint32_t tx_errors;
+} stats;
+
+// Take a frame within wait and all that queued up meanwhile, at most a batch
+static int receiveBatch(CanFrame *batch, TickType_t wait, int frame_us)
+{
+    twai_message_t rx;
+    int n = 0;
+    if (ESP_OK == twai_receive(&rx, wait))
+    {
+        int64_t now = esp_timer_get_time();
+        do {
+            if ( rx.data_length_code > 0 && ! rx.rtr ) {
+                CanFrame &f = batch[n++];
+                f.id = rx.identifier;
+                f.len = std::min((int)rx.data_length_code, 8);
+                memcpy(f.data, rx.data, f.len);
+                f.rx_us = now;
+            }
+        } while ( n < CanBatch::MAX_FRAMES && twai_receive(&rx, 0) == ESP_OK );
+        // No time stamp from the driver, so back date the frames of the batch by the bus time
+        // of the frames received after them. Exact for a back to back burst, late otherwise.
+        for (int i = 0; i < n; i++) {
+            batch[i].rx_us -= (int64_t)(n - 1 - i) * frame_us;
+        }
+    }
+    return n;
+}
 
 // CAN receiver task
 void canRxTask(void *arg)
@@ -43,27 +89,15 @@ void canRxTask(void *arg)
         // return;
     }
 
-    std::string msg; // scratch buffer
-    msg.resize(10);
+    const int frame_us = canFrameUs(can->_kbit);
+    CanFrame batch[CanBatch::MAX_FRAMES];
     do {
-        // basically block on the twai receiver for ever
-        twai_message_t rx;
-        if (ESP_OK == twai_receive(&rx, pdMS_TO_TICKS(500)) && rx.data_length_code > 0)
+        // basically block on the twai receiver for ever, then take all that queued up meanwhile
+        int n = receiveBatch(batch, pdMS_TO_TICKS(500), frame_us);
+        if ( n > 0 )
         {
-            msg.assign((char *)rx.data, rx.data_length_code);
-            ESP_LOGD(FNAME, "CAN RX NMEA chunk, id:0x%x, len:%d msg: %s", (unsigned int)rx.identifier, rx.data_length_code, msg.c_str());
-            DataLink* dltarget = nullptr;
-            {
-                std::lock_guard<SemaphoreMutex> lock(can->_dlink_mutex);
-                auto dl = can->_dlink.find(rx.identifier);
-                if ( dl != can->_dlink.end() ) {
-                    dltarget = dl->second;
-                }
-            }
-            if ( dltarget ) {
-                dltarget->process(msg.data(), msg.size());
-                to_once = true;
-            }
+            can->dispatch(std::span<const CanFrame>(batch, n));
+            to_once = true;
         }
         else
         {
@@ -83,6 +117,23 @@ void canRxTask(void *arg)
             can->recover(); // Can only do this not waiting in twai_receive
             do_recover = false;
         }
+        if ( do_refilter ) {
+            // The acceptance filter is part of the driver installation, which drops the driver queues.
+            // Send waits meanwhile, the TX queue gets time to run empty and what got received is passed on.
+            do_refilter = false;
+            {
+                std::lock_guard<SemaphoreMutex> lock(can->_drv_mutex);
+                twai_status_info_t status;
+                for (int i = 0; i < 10 && twai_get_status_info(&status) == ESP_OK && status.msgs_to_tx > 0; i++) {
+                    vTaskDelay(pdMS_TO_TICKS(1));
+                }
+                n = receiveBatch(batch, 0, frame_us);
+                can->driverInstall(TWAI_MODE_NORMAL);
+            }
+            if ( n > 0 ) {
+                can->dispatch(std::span<const CanFrame>(batch, n));
+            }
+        }
 
         if ((tick++ % 100) == 0)
         {
@@ -94,13 +145,88 @@ void canRxTask(void *arg)
     } while (true);
 
     // cannot stop twai when waiting on twai_receive (->crash)
-    can->driverUninstall();
+    {
+        std::lock_guard<SemaphoreMutex> lock(can->_drv_mutex);
+        can->driverUninstall();
+    }
 
     terminate_receiver = false; // handshake
     rxTask = nullptr;
     vTaskDelete(NULL);
 }
 
+// Hand the frames of a batch to their data links, one lookup and one call per id
+void CANbus::dispatch(std::span<const CanFrame> batch)
+{
+    int ids[CanBatch::MAX_FRAMES];
+    DataLink *links[CanBatch::MAX_FRAMES];
+    int nids = 0;
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        for (const CanFrame &f : batch) {
+            int i = 0;
+            while ( i < nids && ids[i] != f.id ) {
+                i++;
+            }
+            if ( i == nids ) {
+                auto dl = _dlink.find(f.id);
+                ids[nids] = f.id;
+                links[nids++] = (dl != _dlink.end()) ? dl->second : nullptr;
+            }
+        }
+    }
+    CanBatch::forEachId(batch, [&](int id, const char *data, int len, int64_t rx_us) {
+        DataLink *dltarget = nullptr;
+        for (int i = 0; i < nids; i++) {
+            if ( ids[i] == id ) {
+                dltarget = links[i];
+            }
+        }
+        ESP_LOGD(FNAME, "CAN RX id:0x%x, len:%d", id, len);
+        if ( dltarget ) {
+            dltarget->process(data, len);
+            stats.rx_calls++;
+            int64_t lat = esp_timer_get_time() - rx_us;
+            stats.rx_lat_sum += lat;
+            stats.rx_lat_max = std::max(stats.rx_lat_max, lat);
+        }
+        else {
+            stats.rx_unknown += (len + 7) / 8;
+        }
+    });
+    stats.rx_frames += batch.size();
+    stats.rx_batches++;
+    stats.rx_max_batch = std::max(stats.rx_max_batch, (uint32_t)batch.size());
+}
+
+// Cover the ids of the data links with the acceptance filter. Takes effect with the next driver
+// installation, which the receiver task does when it is not waiting in twai_receive. The installed
+// filter stays as long as it passes all ids and is not more than twice as wide as needed, so a
+// removed data link or an added one within the filter cost no reinstallation.
+void CANbus::dataLinksChanged()
+{
+    std::vector<int> ids;
+    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+    bool passes = true;
+    for (auto &dl : _dlink) {
+        ids.push_back(dl.first);
+        passes = passes && _installed.accepts(dl.first);
+    }
+    _filter = CanFilter::cover(ids);
+    if ( _initialized && (! passes || _filter.width * 2 <= _installed.width) ) {
+        do_refilter = true;
+    }
+}
+
+void CANbus::statsLog()
+{
+    ESP_LOGI(FNAME, "CAN rx %lu frames in %lu batches (max %lu), %lu calls, %lu unknown id, latency avg %lld max %lld us; tx %lu frames, %lu full windows, %lu errors",
+        (unsigned long)stats.rx_frames, (unsigned long)stats.rx_batches, (unsigned long)stats.rx_max_batch, (unsigned long)stats.rx_calls,
+        (unsigned long)stats.rx_unknown, (long long)(stats.rx_calls ? stats.rx_lat_sum / stats.rx_calls : 0), (long long)stats.rx_lat_max,
+        (unsigned long)stats.tx_frames, (unsigned long)stats.tx_windows, (unsigned long)stats.tx_errors);
+    stats = {};
+}
+
 CANbus::CANbus()
 {
 
@@ -143,23 +269,26 @@ void CANbus::driverInstall(twai_mode_t mode)
     	ESP_LOGI(FNAME, "_slope_support is TRUE");
         g_config.bus_off_io = _slope_ctrl;
     }
-    g_config.rx_queue_len = 15; // 1.5x the need of one NMEA sentence
-    g_config.tx_queue_len = 15;
+    g_config.rx_queue_len = RX_QUEUE_LEN;
+    g_config.tx_queue_len = TX_QUEUE_LEN;
     ESP_LOGI(FNAME, "my alerts %X", (unsigned int)g_config.alerts_enabled);
 
     twai_timing_config_t t_config;
     _tx_timeout = 2; // 111usec/chunk -> 2msec
+    _kbit = 1000;
     if (can_speed.get() == CAN_SPEED_250KBIT)
     {
         ESP_LOGI(FNAME, "CAN rate 250KBit");
         t_config = TWAI_TIMING_CONFIG_250KBITS();
         _tx_timeout = 4; // 444usec/chunk -> 4msec
+        _kbit = 250;
     }
     else if (can_speed.get() == CAN_SPEED_500KBIT)
     {
         ESP_LOGI(FNAME, "CAN rate 500KBit");
         t_config = TWAI_TIMING_CONFIG_500KBITS();
         _tx_timeout = 2; // 222usec/chunk -> 2msec
+        _kbit = 500;
     }
     else if (can_speed.get() == CAN_SPEED_1MBIT)
     {
@@ -173,18 +302,18 @@ void CANbus::driverInstall(twai_mode_t mode)
     }
     // t_config.triple_sampling = true; // improved sampling incoming bits, no effect in test
 
+    // Only the ids of the data links pass, the self test needs all
     twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
-    // {
-    //     // Shift for standard-ID (11 Bit) by 21, for multi filter mode another one shifted by 5.
-    //     //.acceptance_code = uint32_t(JumboCmd::MAGSTREAM_ID << 21) | uint32_t(JumboCmd::MAGCTRL_ID << 5),
-    //     .acceptance_code = uint32_t(CANbus::CTRL_ID << 21), // | uint32_t(JumboCmd::MAGCTRL_ID << 5),
-    //     // Disregard bits that are set on this mask
-    //     // For single filter mode you most likely wnat to set any bit, but those 11 id bits
-    //     //  -> also disregard the first two message bytes: ~(uint32_t(0x7ff << 21))
-    //     // Here additionally the TEST_ID is disregarded (== let through(!))
-    //     .acceptance_mask = ~(uint32_t(0x7ff << 21)),
-    //     .single_filter = true
-    // };
+    CanFilter filter = CanFilter::acceptAll();
+    if ( mode == TWAI_MODE_NORMAL ) {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        filter = _filter;
+        f_config.acceptance_code = filter.code;
+        f_config.acceptance_mask = filter.mask;
+        f_config.single_filter = filter.single;
+        ESP_LOGI(FNAME, "CAN filter %s code %08x mask %08x, %d ids pass", filter.single ? "single" : "dual",
+            (unsigned)filter.code, (unsigned)filter.mask, filter.width);
+    }
     // Install TWAI driver
     if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK)
     {
@@ -200,6 +329,7 @@ void CANbus::driverInstall(twai_mode_t mode)
     if (twai_start() == ESP_OK)
     {
         ESP_LOGI(FNAME, "Driver started");
+        _installed = filter;
         _initialized = true;
         if (_slope_support)
         {
@@ -247,7 +377,10 @@ bool CANbus::begin()
 
     if ( ! _initialized )
     {
-        driverInstall(TWAI_MODE_NORMAL);
+        {
+            std::lock_guard<SemaphoreMutex> lock(_drv_mutex);
+            driverInstall(TWAI_MODE_NORMAL);
+        }
         terminate_receiver = false;
         xTaskCreate(&canRxTask, "canRxTask", 4096, this, 18, &rxTask);
     }
@@ -288,10 +421,10 @@ bool CANbus::selfTest()
         for (int i = 0; i < 3; i++)
         {
             // repeat test 3x
-        	ESP_LOGI(FNAME,"test #%d", i);
+        	ESP_LOGD(FNAME,"test #%d", i);
             char tx[10] = {"1827364"};
             int len = strlen(tx);
-            ESP_LOGI(FNAME, "strlen %d", len);
+            ESP_LOGD(FNAME, "strlen %d", len);
             twai_clear_receive_queue(); // there might be data from a remote device
             
             if ( ! sendData(id, tx, len, 1) ) {
@@ -324,28 +457,49 @@ bool CANbus::selfTest()
     return res;
 }
 
+// Queues the frames of a message as far as the TX queue has room, without waiting on it. The rest goes
+// with a retry, when the queue had time to take it.
 int CANbus::Send(const char *cptr, int &len, int port)
 {
     constexpr int chunk = 8;
 
-    int rem = len;
-    while (rem > 0)
+    // not while the receiver task reinstalls the driver
+    std::lock_guard<SemaphoreMutex> lock(_drv_mutex);
+    int free_slots = 0;
+    twai_status_info_t status;
+    if ( _initialized && twai_get_status_info(&status) == ESP_OK ) {
+        if ( status.state == TWAI_STATE_BUS_OFF ) {
+            do_recover = true;
+        }
+        else if ( status.state == TWAI_STATE_RUNNING ) {
+            free_slots = TX_QUEUE_LEN - status.msgs_to_tx;
+        }
+    }
+
+    twai_message_t message = {};
+    message.identifier = port;
+    int sent = 0;
+    while ( sent < len && free_slots > 0 )
     {
-        int dlen = std::min(chunk, rem);
-        if ( ! sendData(port, cptr, dlen) ) {
+        int dlen = std::min(chunk, len - sent);
+        message.data_length_code = dlen;
+        memcpy(message.data, cptr + sent, dlen);
+        if ( twai_transmit(&message, 0) != ESP_OK ) {
+            stats.tx_errors++;
             break;
         }
-        cptr += dlen;
-        rem -= dlen;
+        sent += dlen;
+        free_slots--;
+        stats.tx_frames++;
     }
 
-    if ( rem == 0 ) {
+    if ( sent == len ) {
         return 0;
     }
-    else {
-        len = len - rem; // buffered bytes
-        return (rem/chunk + 1) * _tx_timeout; // ETA to wait for next trial
-    }
+    stats.tx_windows++;
+    int frames_left = (len - sent + chunk - 1) / chunk;
+    len = sent; // buffered bytes
+    return canTxRetryMs(frames_left, free_slots, TX_QUEUE_LEN, _kbit); // ETA to wait for next trial
 }
 
 // Send, handle alerts, do max 3 retries
@@ -3,6 +3,7 @@
 #include <driver/twai.h>
 
 #include "InterfaceCtrl.h"
+#include "CanFrames.h"
 
 
 class DataLink;
@@ -32,13 +33,18 @@ public:
     void ConfigureIntf(int cfg) override;
     int Send(const char*, int&, int) override;
     bool selfTest();
+    void statsLog();
 
 private:
 	friend void TransmitTask(void *arg);
 	friend void canRxTask(void *arg);
 
+protected:
+    void dataLinksChanged() override;
+
 private:
     void recover();
+    void dispatch(std::span<const CanFrame> batch);
 	bool sendData(int id, const char *msg, int length, int self = 0);
 	void driverInstall(twai_mode_t mode);
 	void driverUninstall();
@@ -48,6 +54,10 @@ private:
 	bool _initialized = false;
 	bool _slope_support = false;
 	TickType_t _tx_timeout = 2; // [msec] about two times the time for 111 bit to send
+	int _kbit = 1000;
+	CanFilter _filter;          // acceptance of the registered ids, applied with the next driver install
+	CanFilter _installed;       // the one in the driver
+	SemaphoreMutex _drv_mutex;  // driver installation against transmission
 };
 
 extern CANbus *CAN;
@@ -0,0 +1,311 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "CanFrames.h"
+
+#include <algorithm>
+#include <bit>
+
+// Filter register layout for standard frames:
+//   single filter: id in bits 31..21, rtr bit 20, the first two data bytes in bits 15..0
+//   dual filter:   first id in bits 31..21, second id in bits 15..5, rtr and data nibbles in between
+constexpr uint32_t SINGLE_ID = 0x7ffu << 21;
+constexpr uint32_t DUAL_ID1 = 0x7ffu << 21;
+constexpr uint32_t DUAL_ID2 = 0x7ffu << 5;
+
+// Code and don't care bits of one filter over a subset of the ids
+static int span(std::span<const int> ids, unsigned sel, bool in, int &code)
+{
+    int diff = 0;
+    code = -1;
+    for (int i = 0; i < (int)ids.size(); i++) {
+        if ( (bool)(sel & (1u << i)) != in ) {
+            continue;
+        }
+        int id = ids[i] & 0x7ff;
+        if ( code < 0 ) {
+            code = id;
+        }
+        diff |= id ^ code;
+    }
+    return diff;
+}
+
+CanFilter CanFilter::cover(std::span<const int> ids)
+{
+    if ( ids.empty() ) {
+        return acceptAll();
+    }
+    CanFilter best;
+    int c, d = span(ids, 0, false, c);
+    best.code = c << 21;
+    best.mask = (d << 21) | ~SINGLE_ID;
+    best.single = true;
+    best.width = 1 << std::popcount((unsigned)d);
+
+    // all splits into two groups, the last id always in the second, a dozen ids at the most
+    int n = ids.size();
+    if ( n < 2 || n > 12 ) {
+        return best;
+    }
+    for (unsigned sel = 1; sel < (1u << (n - 1)); sel++) {
+        int ca, cb;
+        int da = span(ids, sel, true, ca);
+        int db = span(ids, sel, false, cb);
+        int width = (1 << std::popcount((unsigned)da)) + (1 << std::popcount((unsigned)db));
+        if ( width < best.width ) {
+            best.code = (ca << 21) | (cb << 5);
+            best.mask = (da << 21) | (db << 5) | ~(DUAL_ID1 | DUAL_ID2);
+            best.single = false;
+            best.width = width;
+        }
+    }
+    return best;
+}
+
+bool CanFilter::accepts(int id) const
+{
+    uint32_t id1 = ((uint32_t)id & 0x7ff) << 21;
+    if ( single ) {
+        return ((id1 ^ code) & ~mask & SINGLE_ID) == 0;
+    }
+    uint32_t id2 = ((uint32_t)id & 0x7ff) << 5;
+    return ((id1 ^ code) & ~mask & DUAL_ID1) == 0
+        || ((id2 ^ code) & ~mask & DUAL_ID2) == 0;
+}
+
+
+#ifdef CanBus_Test
+#include "logdef.h"
+#include <deque>
+#include <vector>
+
+// Simulates 10 sec of a 500 kbit bus with a master XCVario. It syncs with a second XCVario and serves a
+// MagSens and a Jumbo drive, while another vario pair and a sensor talk on other ids. The receiver runs
+// once the old way, a task wake up and a data link lookup per frame on an open filter, and once filtered
+// and batched. The transmitter sends the way of the former blocking chunk loop, and in windows over the
+// free TX queue slots. Higher priority tasks hold the CPU for 1.5 msec every 10 msec.
+namespace {
+
+struct Source {
+    int id;
+    int period_us;
+    int bytes;
+    int phase_us;
+    bool ours; // sent by the simulated vario
+};
+
+// rough cost of the receiver task on the ESP32, usec
+constexpr int WAKE_US = 20;
+constexpr int LOCK_US = 4;
+constexpr int CALL_US = 6;
+constexpr int QUEUE_LEN = 15;
+
+struct Frame {
+    uint16_t id;
+    uint8_t  len;
+    int64_t  t; // offered to the bus, received
+};
+
+struct Result {
+    int frames = 0, accepted = 0, delivered = 0, overflow = 0, wakeups = 0, locks = 0, calls = 0;
+    int64_t busy_us = 0, lat_sum = 0, lat_max = 0;
+    int tx_msgs = 0, tx_dropped = 0, tx_retries = 0;
+    int64_t tx_blocked_us = 0, tx_lat_sum = 0, tx_lat_max = 0;
+};
+
+Result simulate(const std::vector<Source> &srcs, std::span<const int> listen, const CanFilter &flt, bool batched, int kbit)
+{
+    auto registered = [&](int id) { return std::find(listen.begin(), listen.end(), id) != listen.end(); };
+    const int frame_us = canFrameUs(kbit);
+    const int64_t END = 10000000;
+    Result r;
+
+    std::deque<Frame> bus;     // frames of the other nodes, waiting for the bus
+    std::deque<Frame> txq;     // the vario's TX queue
+    std::deque<Frame> rxq;     // the vario's RX queue
+    struct Msg { int id; int left; int64_t t0; int tries; };
+    std::deque<Msg> outbox;    // messages for the transmit task
+    int64_t bus_free = 0, rx_busy = 0, tx_next = 0;
+    std::vector<int64_t> next(srcs.size());
+    for (size_t i = 0; i < srcs.size(); i++) {
+        next[i] = srcs[i].phase_us;
+    }
+
+    for (int64_t t = 0; t < END; t++) {
+        for (size_t i = 0; i < srcs.size(); i++) {
+            const Source &s = srcs[i];
+            if ( t < next[i] ) {
+                continue;
+            }
+            next[i] += s.period_us;
+            if ( s.ours ) {
+                outbox.push_back({ s.id, s.bytes, t, 0 });
+                continue;
+            }
+            for (int b = s.bytes; b > 0; b -= 8) {
+                bus.push_back({ (uint16_t)s.id, (uint8_t)std::min(b, 8), t });
+            }
+        }
+
+        // the transmit task
+        if ( t >= tx_next && ! outbox.empty() ) {
+            Msg &m = outbox.front();
+            if ( batched ) {
+                int sent = 0;
+                while ( m.left > 0 && (int)txq.size() < QUEUE_LEN ) {
+                    txq.push_back({ (uint16_t)m.id, (uint8_t)std::min(m.left, 8), t });
+                    m.left -= 8;
+                    sent++;
+                }
+                tx_next = t;
+                if ( m.left > 0 ) {
+                    // come back when the rest fits, drop after a retry without progress
+                    if ( m.tries && ! sent ) {
+                        r.tx_dropped++;
+                        outbox.pop_front();
+                    }
+                    else {
+                        m.tries = 1;
+                        r.tx_retries++;
+                        tx_next = t + canTxRetryMs(m.left, QUEUE_LEN - txq.size(), QUEUE_LEN, kbit) * 1000;
+                    }
+                }
+            }
+            else {
+                // a chunk at a time, waiting up to 2 msec three times for a free slot
+                if ( (int)txq.size() < QUEUE_LEN ) {
+                    txq.push_back({ (uint16_t)m.id, (uint8_t)std::min(m.left, 8), t });
+                    m.left -= 8;
+                    m.tries = 0;
+                }
+                else {
+                    r.tx_blocked_us++;
+                    if ( ++m.tries > 6000 ) {
+                        r.tx_dropped++;
+                        outbox.pop_front();
+                    }
+                }
+            }
+            if ( ! outbox.empty() && outbox.front().left <= 0 ) {
+                Msg &done = outbox.front();
+                int64_t lat = t - done.t0;
+                r.tx_msgs++;
+                r.tx_lat_sum += lat;
+                r.tx_lat_max = std::max(r.tx_lat_max, lat);
+                outbox.pop_front();
+            }
+        }
+
+        // the bus, the first frame offered wins
+        if ( t >= bus_free ) {
+            bool ours = ! txq.empty() && (bus.empty() || txq.front().t <= bus.front().t);
+            if ( ours ) {
+                txq.pop_front();
+                bus_free = t + frame_us;
+            }
+            else if ( ! bus.empty() && bus.front().t <= t ) {
+                Frame f = bus.front();
+                bus.pop_front();
+                bus_free = t + frame_us;
+                f.t = bus_free;
+                r.frames++;
+                if ( flt.accepts(f.id) ) {
+                    r.accepted++;
+                    if ( (int)rxq.size() < QUEUE_LEN ) {
+                        rxq.push_back(f);
+                    }
+                    else {
+                        r.overflow++;
+                    }
+                }
+            }
+        }
+
+        // the receiver task
+        bool preempted = (t % 10000) < 1500;
+        if ( ! preempted && t >= rx_busy && ! rxq.empty() && rxq.front().t <= t ) {
+            r.wakeups++;
+            r.locks++;
+            int64_t cost = WAKE_US + LOCK_US;
+            std::vector<Frame> batch;
+            do {
+                batch.push_back(rxq.front());
+                rxq.pop_front();
+            } while ( batched && ! rxq.empty() && rxq.front().t <= t && batch.size() < CanBatch::MAX_FRAMES );
+            if ( batched ) {
+                CanFrame cf[CanBatch::MAX_FRAMES];
+                for (size_t i = 0; i < batch.size(); i++) {
+                    cf[i] = { batch[i].id, batch[i].len, {}, batch[i].t };
+                }
+                CanBatch::forEachId(std::span<const CanFrame>(cf, batch.size()), [&](int id, const char *, int len, int64_t) {
+                    if ( registered(id) ) {
+                        r.calls++;
+                        cost += CALL_US + len / 3;
+                    }
+                });
+            }
+            else if ( registered(batch[0].id) ) {
+                r.calls++;
+                cost += CALL_US + batch[0].len / 3;
+            }
+            rx_busy = t + cost;
+            r.busy_us += cost;
+            for (const Frame &f : batch) {
+                if ( ! registered(f.id) ) {
+                    continue;
+                }
+                r.delivered++;
+                int64_t lat = rx_busy - f.t;
+                r.lat_sum += lat;
+                r.lat_max = std::max(r.lat_max, lat);
+            }
+        }
+    }
+    return r;
+}
+
+} // namespace
+
+void CanBatch::sim_test()
+{
+    const int kbit = 500;
+    // the vario is master, listens on 0x7f0 for registrations, 0x101 for the second vario, 0x031 for the
+    // legacy MagSens stream and 0x401 for the Jumbo drive
+    const std::vector<Source> srcs = {
+        { 0x101, 100000, 64, 0, false },    // second vario sync
+        { 0x031, 20000, 8, 3000, false },   // MagSens stream
+        { 0x401, 500000, 16, 7000, false }, // Jumbo replies
+        { 0x7f0, 5000000, 24, 11000, false }, // registrations
+        { 0x104, 100000, 64, 50000, false },  // another vario pair
+        { 0x105, 100000, 64, 51000, false },
+        { 0x250, 5000, 8, 1000, false },     // a foreign sensor at 200Hz
+        { 0x100, 100000, 240, 20000, true }, // our sync, three sentences
+        { 0x400, 500000, 16, 30000, true },  // our Jumbo commands
+    };
+    const int listen[] = { 0x7f0, 0x101, 0x031, 0x401 };
+    CanFilter flt = CanFilter::cover(listen);
+    ESP_LOGI(FNAME, "CAN filter %s code %08x mask %08x, %d ids pass", flt.single ? "single" : "dual",
+        (unsigned)flt.code, (unsigned)flt.mask, flt.width);
+    for (int id : listen) {
+        if ( ! flt.accepts(id) ) {
+            ESP_LOGE(FNAME, "CAN filter misses 0x%x", id);
+        }
+    }
+
+    for (int mode = 0; mode < 2; mode++) {
+        Result r = simulate(srcs, listen, mode ? flt : CanFilter::acceptAll(), mode, kbit);
+        ESP_LOGI(FNAME, "%s: rx %d frames, %d passed, %d overflow, %d wakeups, %d locks, %d calls, busy %.2f%%, latency avg %lld max %lld us",
+            mode ? "filtered+batched" : "open+per frame  ", r.frames, r.accepted, r.overflow, r.wakeups, r.locks, r.calls,
+            r.busy_us / 1e5, (long long)(r.delivered ? r.lat_sum / r.delivered : 0), (long long)r.lat_max);
+        ESP_LOGI(FNAME, "%s: tx %d msgs, %d dropped, %d retries, blocked %lld ms, msg latency avg %lld max %lld us",
+            mode ? "windowed        " : "chunk loop      ", r.tx_msgs, r.tx_dropped, r.tx_retries, (long long)(r.tx_blocked_us / 1000),
+            (long long)(r.tx_msgs ? r.tx_lat_sum / r.tx_msgs : 0), (long long)r.tx_lat_max);
+    }
+}
+#endif
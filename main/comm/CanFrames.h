@@ -0,0 +1,86 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+// CAN frame handling apart from the TWAI driver, standard 11 bit ids only as used on the XCVario bus.
+
+// A received frame
+struct CanFrame {
+    uint16_t id;
+    uint8_t  len;
+    uint8_t  data[8];
+    int64_t  rx_us; // reception time in esp_timer usec
+};
+
+// Bus time of a standard data frame with 8 bytes, bit stuffing included, in usec
+constexpr int canFrameUs(int kbit) { return 135 * 1000 / kbit; }
+
+// Msec until a windowed send may go on with frames_left: when enough of the TX queue went out for them,
+// or for the whole queue. One msec at the least, the tick of the transmit task.
+constexpr int canTxRetryMs(int frames_left, int free_slots, int queue_len, int kbit) {
+    int need = (frames_left < queue_len ? frames_left : queue_len) - free_slots;
+    int ms = (need * canFrameUs(kbit) + 999) / 1000;
+    return ms > 1 ? ms : 1;
+}
+
+// Acceptance filter of the TWAI controller in the SJA1000 register layout, the mask bits are don't care.
+// The hardware knows one filter over the id, or two filters, so a set of ids is covered by one or two
+// code/mask pairs. That lets through more ids than needed, the data link lookup sorts out the rest.
+struct CanFilter {
+    uint32_t code = 0;
+    uint32_t mask = 0xffffffff;
+    bool     single = true;
+    int      width = 2048; // number of ids let through
+
+    static CanFilter acceptAll() { return CanFilter(); }
+    // the tightest single or dual filter for the ids, all ids when the set is empty
+    static CanFilter cover(std::span<const int> ids);
+    bool accepts(int id) const;
+    bool operator==(const CanFilter &o) const { return code == o.code && mask == o.mask && single == o.single; }
+};
+
+// Sorts a batch of received frames by id, keeping the order per id, and hands the joined payload of each
+// id to the callback once: f(id, data, len, oldest rx_us). Returns the number of distinct ids.
+class CanBatch
+{
+public:
+    static constexpr int MAX_FRAMES = 16;
+
+    template <typename F>
+    static int forEachId(std::span<const CanFrame> batch, F f) {
+        char buf[MAX_FRAMES * 8];
+        bool done[MAX_FRAMES] = {};
+        int n = batch.size() < MAX_FRAMES ? batch.size() : MAX_FRAMES;
+        int nids = 0;
+        for (int i = 0; i < n; i++) {
+            if ( done[i] ) {
+                continue;
+            }
+            int len = 0;
+            for (int j = i; j < n; j++) {
+                if ( ! done[j] && batch[j].id == batch[i].id ) {
+                    for (int k = 0; k < batch[j].len; k++) {
+                        buf[len++] = batch[j].data[k];
+                    }
+                    done[j] = true;
+                }
+            }
+            f(batch[i].id, buf, len, batch[i].rx_us);
+            nids++;
+        }
+        return nids;
+    }
+
+#ifdef CanBus_Test
+    static void sim_test();
+#endif
+};
@@ -28,10 +28,12 @@
 #include "protocol/KRT2Remote.h"
 #include "protocol/MagSensBin.h"
 #include "protocol/TestQuery.h"
+#include "protocol/Telemetry.h"
 #include "DeviceMgr.h"
 #include "setup/DataMonitor.h"
 #include "protocol/AliveMonitor.h"
 #include "setup/SetupNG.h"
+#include "EventTrace.h"
 #include "logdefnone.h"
 
 #include <array>
@@ -44,7 +46,7 @@ DataLink::DataLink(int listen_port, int itfid) :
 
 DataLink::~DataLink()
 {
-    for (ProtocolItf* it : std::array<ProtocolItf*, 2>{_nmea, _binary}) {
+    for (ProtocolItf* it : std::array<ProtocolItf*, 3>{_nmea, _binary, _telemetry}) {
         if ( it ) {
             delete it;
         }
@@ -71,12 +73,22 @@ EnumList DataLink::addProtocol(ProtocolType ptyp, DeviceId did, int sendport)
         tmp = _nmea;
     } else if (_binary && _binary->hasProtocol(ptyp)) {
         tmp = _binary;
+    } else if (_telemetry && ptyp == TELEMETRY_P) {
+        tmp = _telemetry;
     }
     if ( tmp ) {
         ESP_LOGW(FNAME, "Double insertion of device/protocol %d/%d.", did, ptyp);
         return ret;
     }
 
+    if ( ptyp == TELEMETRY_P ) {
+        // a side channel, it neither takes the link nor its routing device id
+        ESP_LOGI(FNAME, "New Telemetry on send port %d", sendport);
+        _telemetry = new TelemetryBin(did, sendport, _tm_sm, *this);
+        ret.insert(ptyp);
+        return ret;
+    }
+
     // Check device id is equal to all others
     if ( _did != NO_DEVICE ) {
         if ( (_nmea && _nmea->getDeviceId() != did)
@@ -226,6 +238,13 @@ EnumList DataLink::addProtocol(ProtocolType ptyp, DeviceId did, int sendport)
     if ( tmp ) {
 
         if ( tmp->isBinary() ) {
+            if ( _binary ) {
+                // one binary protocol per link
+                ESP_LOGE(FNAME, "Binary protocol %d already on the link, %d not added", _binary->getProtocolId(), ptyp);
+                delete tmp;
+                ret.clear();
+                return ret;
+            }
             _binary = tmp;
             if ( !_nmea ) { _active = tmp; }
         } else {
@@ -254,6 +273,9 @@ ProtocolItf* DataLink::getProtocol(ProtocolType ptyp) const
         else if ( _binary && _binary->getProtocolId() == ptyp ) {
             return _binary;
         }
+        else if ( _telemetry && ptyp == TELEMETRY_P ) {
+            return _telemetry;
+        }
     }
     return nullptr;
 }
@@ -266,6 +288,9 @@ bool DataLink::hasProtocol(ProtocolType ptyp) const
     else if ( _binary && _binary->getProtocolId() == ptyp ) {
         return true;
     }
+    else if ( _telemetry && ptyp == TELEMETRY_P ) {
+        return true;
+    }
     return false;
 }
 
@@ -285,18 +310,24 @@ void DataLink::removeProtocol(ProtocolType ptyp)
         _binary = nullptr;
         _active = _nmea;
     }
+    else if ( _telemetry && ptyp == TELEMETRY_P ) {
+        delete(_telemetry);
+        _telemetry = nullptr;
+        _tm_sm.reset();
+    }
 }
 
-void DataLink::process(const char *packet, int len)
+void DataLink::process(const char *packet, int len, int peer)
 {
     // Feed the data monitor
     if (_monitoring) {
         DM->monitorString(DIR_RX, _active && _active->isBinary(), packet, len);
     }
 
-    if (_active == nullptr) {
+    if (_active == nullptr && _telemetry == nullptr) {
         return;
     }
+    _rx_peer = peer;
 
     if (packet == nullptr)
     {
@@ -316,12 +347,21 @@ void DataLink::process(const char *packet, int len)
     // process every frame byte through state machine
     for (; len > 0; ) {
         dl_control_t control = dl_control_t(NOACTION);
-        if ( _sm.checkSpaceOne() ) // only check for one byte buffer space, beyond that it is protocol resposibility
+        if ( _telemetry && (_active == nullptr || _active == _nmea)
+            && (_tm_sm._state != START_TOKEN || (*packet == TelemetryBin::START && _sm._state == START_TOKEN)) )
+        {
+            // a telemetry frame between the nmea sentences, it consumes up to the end of the frame
+            control = _telemetry->nextBytes(packet, len);
+        }
+        else if ( _active == nullptr ) {
+            // nothing else listens
+        }
+        else if ( _sm.checkSpaceOne() ) // only check for one byte buffer space, beyond that it is protocol resposibility
         {
             control = _active->nextBytes(packet, len);
             if ( control.act & FORWARD_BIT ) {
                 // DeviceId did = (control.did) ? control.did : _active->getDeviceId();
-                ESP_LOGI(FNAME, "forward %d", control.did);
+                ETRACE(DL_FORWARD, _itf_id.iid, control.did);
                 doForward(control.did);
             }
             if ( control.act == NXT_PROTO ) {
@@ -365,6 +405,14 @@ void DataLink::switchProtocol()
     }
 }
 
+// a client of the port left
+void DataLink::peerClosed(int peer)
+{
+    if ( _telemetry ) {
+        _telemetry->peerClosed(peer);
+    }
+}
+
 NmeaPlugin *DataLink::getNmeaPlugin(ProtocolType pid) const
 {
     if ( _nmea ) {
@@ -385,7 +433,7 @@ void DataLink::updateRoutes(DeviceId did)
 EnumList DataLink::getAllSendPorts() const
 {
     EnumList pl;
-    for (ProtocolItf* it : std::array<ProtocolItf*, 2>{_nmea, _binary}) {
+    for (ProtocolItf* it : std::array<ProtocolItf*, 3>{_nmea, _binary, _telemetry}) {
         if ( it ) {
             pl.insert(it->getSendPort());
         }
@@ -405,11 +453,14 @@ void DataLink::dumpProto()
     if ( _binary ) {
             ESP_LOGI(FNAME, "       bi did%d\tpid%d\tsp%d%c", _binary->getDeviceId(), _binary->getProtocolId(), _binary->getSendPort(), (_binary==_active)?'<':' ');
     }
+    if ( _telemetry ) {
+            ESP_LOGI(FNAME, "       tm did%d\tpid%d\tsp%d", _telemetry->getDeviceId(), _telemetry->getProtocolId(), _telemetry->getSendPort());
+    }
 }
 
 bool DataLink::isBinActive() const
 {
-    return _active->isBinary();
+    return _active && _active->isBinary();
 }
 
 // called only from one and always same itf receiver context
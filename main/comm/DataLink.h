@@ -20,6 +20,7 @@
 using EnumList = std::set<int>;
 class NmeaPrtcl;
 class NmeaPlugin;
+class TelemetryBin;
 
 // Data link layer to multiplex data stream to proper protocol parser.
 class DataLink
@@ -31,7 +32,9 @@ public:
     ProtocolItf* getProtocol(ProtocolType ptyp=NO_ONE) const;
     bool hasProtocol(ProtocolType ptyp) const;
     void removeProtocol(ProtocolType ptyp);
-    void process(const char *packet, int len);
+    void process(const char *packet, int len, int peer = -1);
+    void peerClosed(int peer);
+    int getRxPeer() const { return _rx_peer; } // the client of the packet in process, -1 := no clients
     ProtocolItf *goBIN();
     void goNMEA();
     void switchProtocol();
@@ -64,6 +67,10 @@ private:
     NmeaPrtcl   *_nmea   = nullptr; // the nmea protocoll shell
     ProtocolItf *_binary = nullptr; // if set it will be the priority parser
     ProtocolState _sm; // The message buffer for all protocol parser
+    // Telemetry runs next to the nmea stream, its frames are routed by the start token between the sentences
+    TelemetryBin *_telemetry = nullptr;
+    ProtocolState _tm_sm;
+    int _rx_peer = -1;
     // Listen on
     const ItfTarget _itf_id;
     bool _monitoring = false;
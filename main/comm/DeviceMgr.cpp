@@ -26,6 +26,7 @@
 #include "sensor/temp/OwSens.h"
 
 #include "sensor.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
 #include <freertos/FreeRTOS.h>
@@ -131,6 +132,9 @@ constexpr std::pair<DeviceId, DeviceAttributes> DEVATTR[] = {
     {DeviceId::FLARM_HOST2_DEV, {"Flarm Download", {{WIFI_APSTA, BT_SPP}}, {{FLARMHOST_P, FLARMBIN_P}, 2}, 8881, IS_SEL, &flarm_host2_setup}},
     {DeviceId::FLARM_HOST2_DEV, {"", {{BT_SPP}}, {{FLARMHOST_P, FLARMBIN_P}, 2}, 0, 0, nullptr}},
     {DeviceId::FLARM_HOST2_DEV, {"", {{BT_LE}}, {{FLARMHOST_P, FLARMBIN_P}, 2}, 0, 0, nullptr}},
+    {DeviceId::TELEMETRY_DEV, {"Telemetry", {{WIFI_APSTA, BT_LE, BT_SPP}}, {{TELEMETRY_P}, 1}, 8885, IS_SEL, &telemetry_devsetup}},
+    {DeviceId::TELEMETRY_DEV, {"", {{BT_LE}}, {{TELEMETRY_P}, 1}, 0, 0, nullptr}},
+    {DeviceId::TELEMETRY_DEV, {"", {{BT_SPP}}, {{TELEMETRY_P}, 1}, 0, 0, nullptr}},
     {DeviceId::RADIO_REMOTE_DEV, {"Radio remote", {{WIFI_APSTA}}, {{KRT2_REMOTE_P}, 1}, 8882, IS_SEL, &radio_host_setup}},
     {DeviceId::RADIO_KRT2_DEV, {"KRT 2", {{S2_RS232, CAN_BUS}}, {{KRT2_REMOTE_P}, 1}, 0, IS_SEL, &krt_devsetup}},
     {DeviceId::RADIO_ATR833_DEV, {"ATR833", {{S2_RS232, CAN_BUS}}, {{ATR833_REMOTE_P}, 1}, 0, IS_SEL, &atr_devsetup}},
@@ -220,6 +224,7 @@ constexpr std::pair<ProtocolType, std::string_view> PRTCLS[] = {
     {KRT2_REMOTE_P, "KRT2"},
     {ATR833_REMOTE_P, "ATR833"},
     {XCVQUERY_P, "XCV Query"},
+    {TELEMETRY_P, "Telemetry"},
 };
 
 std::string_view DeviceManager::getPrtclName(ProtocolType pid) {
@@ -251,7 +256,8 @@ static int tt_snd(Message *msg)
     if (itf)
     {
         ESP_LOGD(FNAME, "send %s/%d NMEA len %d, msg: %s", itf->getStringId(), port, len, msg->buffer.c_str());
-        plsrety = itf->Send(msg->buffer.c_str(), len, port);
+        plsrety = (msg->peer < 0) ? itf->Send(msg->buffer.c_str(), len, port)
+                                  : itf->SendTo(msg->buffer.c_str(), len, port, msg->peer);
         if ( plsrety > 0 ) {
             ESP_LOGD(FNAME, "reshedule message %d/%d", len, msg->buffer.length());
             msg->buffer.erase(0, len); // chop sent bytes off
@@ -278,6 +284,7 @@ static void transmit_task(void *arg)
         bool new_msg = xQueueReceive(queue, &msg, timeout) == pdTRUE;
 
         if ( new_msg ) {
+            CrashTrace::queue(CrashTrace::QUEUE_RECV, true);
             if (msg == nullptr) {
                 break;
             } // termination signal
@@ -1044,6 +1051,7 @@ Message* plsMessage(DeviceId target_id, int port)
     if ( m ) {
         m->target_id = target_id;
         m->port = port;
+        m->peer = -1;
         return m;
     }
     return nullptr;
@@ -1054,6 +1062,7 @@ Message* acqMessage(DeviceId target_id, int port)
     Message* m = MP.getOne();
     m->target_id = target_id;
     m->port = port;
+    m->peer = -1;
     return m;
 }
 
@@ -1064,7 +1073,9 @@ void relMessage(Message *msg)
 
 bool Send(Message* msg)
 {
-    if ( pdTRUE != xQueueSend( ItfSendQueue, (void * ) &msg, portMAX_DELAY ) ) {
+    bool queued = pdTRUE == xQueueSend( ItfSendQueue, (void * ) &msg, portMAX_DELAY );
+    CrashTrace::queue(CrashTrace::QUEUE_SEND, queued);
+    if ( ! queued ) {
         // drop it
         ESP_LOGW(FNAME, "Dropped message to %d", msg->target_id);
         MP.recycleMsg(msg);
@@ -35,7 +35,8 @@ enum DeviceId : uint8_t
     RADIO_PROXY,
     TEMPSENS_DEV,
     TEST_DEV,
-    TEST_DEV2
+    TEST_DEV2,
+    TELEMETRY_DEV
 };
 
 
@@ -63,7 +64,8 @@ enum ProtocolType : uint8_t
     XCVSYNC_P,
     XCNAV_P,
     SEEYOU_P, // <- 20
-    TEST_P
+    TEST_P,
+    TELEMETRY_P
 };
 // old ones .. P_EYE_PEYA, P_EYE_PEYI
 
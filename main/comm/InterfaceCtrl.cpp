@@ -35,89 +35,104 @@ DataLink* InterfaceCtrl::newDataLink(int port)
         ESP_LOGW(FNAME, "Interface %s does not support data links!", getStringId());
         return nullptr;
     }
-    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
-    if ( _one_to_one ) {
-        // Always reuse
-        if ( _dlink.empty() ) {
-            _dlink[port] = new DataLink(port, getId());
+    DataLink *newdl;
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        if ( _one_to_one ) {
+            // Always reuse
+            if ( ! _dlink.empty() ) {
+                return _dlink.begin()->second;
+            }
         }
-        return _dlink.begin()->second;
-    }
-    else {
-        // Should be a different port to all in the list, or reuse
-        auto it = _dlink.find(port);
-        if ( it != _dlink.end()) {
-            return it->second;
+        else {
+            // Should be a different port to all in the list, or reuse
+            auto it = _dlink.find(port);
+            if ( it != _dlink.end()) {
+                return it->second;
+            }
         }
-        DataLink *newdl = new DataLink(port, getId());
+        newdl = new DataLink(port, getId());
         _dlink[port] = newdl;
-        return newdl;
     }
+    dataLinksChanged();
+    return newdl;
 }
 
 // precondition: dl not yet in the map
 void InterfaceCtrl::addDataLink(DataLink *dl)
 {
-    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
-    if ( _one_to_one ) {
-        // Always replace
-        if ( ! _dlink.empty() ) {
-            DeleteAllDataLinksLocked();
-        }
-        _dlink[dl->getPort()] = dl;
-    }
-    else {
-        auto it = _dlink.find(dl->getPort());
-        if ( it != _dlink.end() ) {
-            DataLink *tmp = it->second;
-            it->second = dl;
-            delete tmp;
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        if ( _one_to_one ) {
+            // Always replace
+            if ( ! _dlink.empty() ) {
+                DeleteAllDataLinksLocked();
+            }
+            _dlink[dl->getPort()] = dl;
         }
         else {
-            _dlink[dl->getPort()] = dl;
+            auto it = _dlink.find(dl->getPort());
+            if ( it != _dlink.end() ) {
+                DataLink *tmp = it->second;
+                it->second = dl;
+                delete tmp;
+            }
+            else {
+                _dlink[dl->getPort()] = dl;
+            }
         }
     }
+    dataLinksChanged();
 }
 
 // returns possibly a nullptr, when port is not found in the map
 DataLink *InterfaceCtrl::MoveDataLink(int port)
 {
     DataLink *tmp = nullptr;
-    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
-    if ( _one_to_one ) {
-        tmp = _dlink.begin()->second;
-        _dlink.clear();
-    }
-    else {
-        auto it = _dlink.find(port);
-        if ( it != _dlink.end() ) {
-            tmp = it->second;
-            _dlink.erase(it);
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        if ( _one_to_one ) {
+            tmp = _dlink.begin()->second;
+            _dlink.clear();
+        }
+        else {
+            auto it = _dlink.find(port);
+            if ( it != _dlink.end() ) {
+                tmp = it->second;
+                _dlink.erase(it);
+            }
         }
     }
+    dataLinksChanged();
     return tmp;
 }
 
 void InterfaceCtrl::DeleteDataLink(int port)
 {
-    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
-    if ( _one_to_one ) {
-        DeleteAllDataLinksLocked();
-    }
-    else {
-        auto it = _dlink.find(port);
-        if ( it != _dlink.end() ) {
-            DataLink *tmp = it->second;
-            _dlink.erase(it);
-            delete tmp;
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        if ( _one_to_one ) {
+            DeleteAllDataLinksLocked();
+        }
+        else {
+            auto it = _dlink.find(port);
+            if ( it != _dlink.end() ) {
+                DataLink *tmp = it->second;
+                _dlink.erase(it);
+                delete tmp;
+            }
         }
     }
+    dataLinksChanged();
 }
 
 void InterfaceCtrl::DeleteAllDataLinks()
 {
-    std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
-    DeleteAllDataLinksLocked();
+    {
+        std::lock_guard<SemaphoreMutex> lock(_dlink_mutex);
+        DeleteAllDataLinksLocked();
+    }
+    dataLinksChanged();
 }
 
 void InterfaceCtrl::startMonitoring(ItfTarget tgt)
@@ -75,6 +75,8 @@ public:
     // if blocked returns number of ms for next possible invocation, returned len reflect the sent bytes
     // a negative return value reflects another error.
     virtual int Send(const char *msg, int &len, int port=0) = 0;
+    // to one client of a multi client port, the interfaces without clients just send to the port
+    virtual int SendTo(const char *msg, int &len, int port, int peer) { return Send(msg, len, port); }
     DataLink* newDataLink(int port);
     void addDataLink(DataLink *dl);
     DataLink* MoveDataLink(int port);
@@ -87,6 +89,8 @@ public:
     bool getTestOk() const { return _functional; }
 
 protected:
+    // called after a data link got added or removed, without the lock
+    virtual void dataLinksChanged() {}
     std::map<int, DataLink*> _dlink;
     mutable SemaphoreMutex _dlink_mutex;
     uint8_t _functional :1 = false; // to be flipped from self tests
@@ -31,6 +31,7 @@ public:
     bool busy = false;
     DeviceId target_id = DeviceId::NO_DEVICE;
     int port = 0;
+    int peer = -1; // one client of a multi client port, -1 := all
     std::string buffer;
 };
 
@@ -0,0 +1,229 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "NotifyBatcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+NotifyBatcher::NotifyBatcher(int credits, int latency_ms) :
+    _max_credits(credits),
+    _latency(latency_ms),
+    _credits(credits)
+{
+}
+
+void NotifyBatcher::reset(int payload)
+{
+    _head = _count = 0;
+    _mhead = _mcount = 0;
+    _in = _out = 0;
+    _credits = _max_credits;
+    _congested = false;
+    _rate = 0;
+    _windows = 0;
+    _win_start = 0;
+    _win_bytes = 0;
+    setPayload(payload);
+}
+
+void NotifyBatcher::setPayload(int payload)
+{
+    _payload = std::clamp(payload, MIN_PAYLOAD, MAX_PAYLOAD);
+}
+
+bool NotifyBatcher::push(const char *msg, int len, uint32_t now)
+{
+    if ( len <= 0 ) {
+        return true;
+    }
+    // the credits' worth until the rate is known, an empty queue takes any message that fits
+    int room = std::min(QUEUE_SIZE, _rate ? _rate * MAX_AGE / 1000 : _payload * _max_credits);
+    if ( len > QUEUE_SIZE || (_count && _count + len > room) ) {
+        _stats.rejected++;
+        return false;
+    }
+    int tail = (_head + _count) % QUEUE_SIZE;
+    int first = std::min(len, QUEUE_SIZE - tail);
+    memcpy(&_q[tail], msg, first);
+    memcpy(_q, msg + first, len - first);
+    _count += len;
+    _in += len;
+    if ( _mcount < MAX_MARKS ) {
+        _marks[(_mhead + _mcount) % MAX_MARKS] = { _in, now };
+        _mcount++;
+    }
+    else {
+        // out of marks, the newest one takes the bytes with its earlier time
+        _marks[(_mhead + _mcount - 1) % MAX_MARKS].end = _in;
+    }
+    _stats.bytes_in += len;
+    _stats.max_fill = std::max(_stats.max_fill, (uint16_t)_count);
+    return true;
+}
+
+int NotifyBatcher::nextDue(uint32_t now) const
+{
+    if ( ! _count ) {
+        return -1;
+    }
+    if ( _count >= _payload ) {
+        return 0;
+    }
+    int waited = (int32_t)(now - _marks[_mhead].time);
+    return std::max(0, _latency - waited);
+}
+
+int NotifyBatcher::pull(uint8_t *out, uint32_t now)
+{
+    if ( ! _credits || _congested || nextDue(now) != 0 ) {
+        return 0;
+    }
+    int n = std::min(_count, _payload);
+    int first = std::min(n, QUEUE_SIZE - _head);
+    memcpy(out, &_q[_head], first);
+    memcpy(out + first, _q, n - first);
+    _head = (_head + n) % QUEUE_SIZE;
+    _count -= n;
+    _out += n;
+    _credits--;
+
+    _stats.max_delay = std::max(_stats.max_delay, (uint16_t)(now - _marks[_mhead].time));
+    while ( _mcount && (int32_t)(_marks[_mhead].end - _out) <= 0 ) {
+        _mhead = (_mhead + 1) % MAX_MARKS;
+        _mcount--;
+    }
+    // drain rate over windows of 200 msec, from the first notification of the connection on
+    if ( ! _windows ) {
+        _windows = 1;
+        _win_start = now;
+    }
+    _win_bytes += n;
+    int win = (int32_t)(now - _win_start);
+    if ( win >= 200 ) {
+        // the first window holds the burst into the free credits, not what the link drains
+        if ( _windows > 1 ) {
+            int r = _win_bytes * 1000 / win;
+            _rate = _rate ? (_rate + r) / 2 : r;
+        }
+        _windows = 2;
+        _win_start = now;
+        _win_bytes = 0;
+    }
+    _stats.bytes_out += n;
+    _stats.notifies++;
+    if ( n == _payload ) {
+        _stats.full++;
+    }
+    return n;
+}
+
+void NotifyBatcher::confirm()
+{
+    if ( _credits < _max_credits ) {
+        _credits++;
+    }
+}
+
+void NotifyBatcher::congested(bool on)
+{
+    if ( on && ! _congested ) {
+        _stats.congested++;
+    }
+    _congested = on;
+}
+
+NotifyBatcher::Stats NotifyBatcher::takeStats()
+{
+    Stats s = _stats;
+    _stats = Stats();
+    return s;
+}
+
+
+#ifdef NotifyBatcher_Test
+#include "logdef.h"
+// Runs the batcher against a simulated link for 10 sec of NMEA and telemetry traffic. A notification
+// is on air at the first connection event after its release, at most per_event of them, and returns its
+// credit then. A rejected message is retried once after 20 msec and then dropped, like the transmit
+// task does. Logs the notifications per message, the fill of the notifications, the delays and drops.
+void NotifyBatcher::link_test()
+{
+    struct Case {
+        float interval; // msec
+        int   per_event;
+        int   payload;
+    };
+    const Case cases[] = {
+        { 7.5f, 4, 244 }, { 15.f, 4, 182 }, { 30.f, 4, 182 }, { 50.f, 2, 182 },
+        { 30.f, 2, 20 }, { 50.f, 1, 20 } // no MTU exchange, a slow peer
+    };
+    const int budgets[] = { 0, 20, 50 };
+    char msg[100];
+    memset(msg, 'x', sizeof(msg));
+
+    for ( const Case &c : cases ) {
+        for ( int budget : budgets ) {
+            NotifyBatcher b(6, budget);
+            b.reset(c.payload);
+            uint8_t note[MAX_PAYLOAD];
+            int on_stack = 0;      // released, not on air yet
+            float next_event = 0;
+            int msgs = 0, dropped = 0, retry_len = 0;
+            uint32_t retry_at = 0;
+            uint64_t delay_sum = 0;
+            for ( uint32_t t = 0; t < 10000; t++ ) {
+                // 2.4kB/sec: $PXCV at 10Hz, two sentences at 5Hz, a binary frame at 25Hz
+                int lens[4], n = 0;
+                if ( t % 100 == 0 ) lens[n++] = 95;
+                if ( t % 200 == 50 ) { lens[n++] = 70; lens[n++] = 70; }
+                if ( t % 40 == 0 ) lens[n++] = 30;
+                if ( retry_len && t >= retry_at ) {
+                    if ( ! b.push(msg, retry_len, t) ) {
+                        dropped++;
+                    }
+                    retry_len = 0;
+                }
+                for ( int i = 0; i < n; i++ ) {
+                    msgs++;
+                    if ( ! b.push(msg, lens[i], t) ) {
+                        if ( retry_len ) {
+                            dropped++;
+                        }
+                        retry_len = lens[i];
+                        retry_at = t + 20;
+                    }
+                }
+                if ( t >= next_event ) {
+                    next_event += c.interval;
+                    int sent = std::min(on_stack, c.per_event);
+                    on_stack -= sent;
+                    while ( sent-- ) {
+                        b.confirm();
+                    }
+                }
+                // what the clock tick and the confirmation would release
+                if ( t % 10 == 0 || b.pending() >= b.payload() ) {
+                    uint32_t oldest = b._mcount ? b._marks[b._mhead].time : t;
+                    while ( int len = b.pull(note, t) ) {
+                        on_stack++;
+                        delay_sum += (t - oldest) * len;
+                        oldest = b._mcount ? b._marks[b._mhead].time : t;
+                    }
+                }
+            }
+            Stats s = b.takeStats();
+            ESP_LOGI(FNAME, "ci %4.1fms x%d pl %3d budget %2dms: %4lu B/s, %.2f notify/msg, fill %3.0f%%, delay avg %3.0f max %4d ms, queue max %4d, dropped %d/%d",
+                c.interval, c.per_event, c.payload, budget, (unsigned long)(s.bytes_out / 10),
+                (float)s.notifies / msgs, 100.f * s.bytes_out / (s.notifies * c.payload + 1),
+                s.bytes_out ? (float)delay_sum / s.bytes_out : 0.f, s.max_delay, s.max_fill, dropped, msgs );
+        }
+    }
+}
+#endif
@@ -0,0 +1,88 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+// Packs the outgoing byte stream of a BLE notification link into MTU sized notifications.
+//
+// A message is queued whole or not at all. The queue takes what the link drains within MAX_AGE at its
+// measured rate, more pushes back to the sender, so a queued byte waits about MAX_AGE at most on a slow
+// link. Until the rate is measured the queue takes the credits' worth, and an empty queue takes any message
+// that fits, a longer wait of these is possible on a very slow link. The pending bytes
+// go out as soon as they fill a notification, or when the oldest of them waited for the latency budget.
+// The link holds a fixed number of credits, each notification takes one and its confirmation returns
+// it. A slow peer so throttles the queue here, and never the stack or the sender.
+//
+// Plain C++ without locking and without a clock, the caller serializes the calls and passes the time.
+class NotifyBatcher
+{
+public:
+    static constexpr int QUEUE_SIZE = 2048;
+    static constexpr int MAX_PAYLOAD = 512;    // longest attribute value
+    static constexpr int MIN_PAYLOAD = 23 - 3;
+    static constexpr int MAX_AGE = 250; // msec
+
+    struct Stats {
+        uint32_t bytes_in = 0;   // accepted message bytes
+        uint32_t bytes_out = 0;  // notified bytes
+        uint32_t notifies = 0;
+        uint32_t full = 0;       // notifications released with a full payload
+        uint32_t rejected = 0;   // messages pushed back for a full or stale queue
+        uint32_t congested = 0;  // congestion reports of the stack
+        uint16_t max_fill = 0;   // queue high water mark
+        uint16_t max_delay = 0;  // longest msec a byte waited in the queue
+    };
+
+    NotifyBatcher(int credits, int latency_ms);
+
+    void reset(int payload = MIN_PAYLOAD); // a new connection
+    void setPayload(int payload);          // mtu - 3
+    int  payload() const { return _payload; }
+
+    bool push(const char *msg, int len, uint32_t now);
+    int  pull(uint8_t *out, uint32_t now); // a due notification into out (payload() bytes), or 0
+    void confirm();                        // a notification left, its credit returns
+    void congested(bool on);
+    int  nextDue(uint32_t now) const;      // msec until the pending bytes are due, -1 for none
+    int  pending() const { return _count; }
+    int  credits() const { return _credits; }
+    int  rate() const { return _rate; }    // drained bytes/sec
+    Stats takeStats();                     // and start over
+
+#ifdef NotifyBatcher_Test
+    static void link_test();
+#endif
+
+private:
+    // arrival time of the queued bytes, one mark per message up to the end offset in the stream
+    static constexpr int MAX_MARKS = 32;
+    struct Mark {
+        uint32_t end;
+        uint32_t time;
+    };
+    uint8_t  _q[QUEUE_SIZE];
+    int      _head = 0;
+    int      _count = 0;
+    Mark     _marks[MAX_MARKS];
+    int      _mhead = 0;
+    int      _mcount = 0;
+    uint32_t _in = 0;  // stream offset of the queue end
+    uint32_t _out = 0; // stream offset of the queue head
+    const int _max_credits;
+    const int _latency;
+    int      _credits;
+    int      _payload = MIN_PAYLOAD;
+    int      _rate = 0;
+    uint8_t  _windows = 0; // rate windows seen, the first one is not taken
+    uint32_t _win_start = 0;
+    uint32_t _win_bytes = 0;
+    bool     _congested = false;
+    Stats    _stats;
+};
@@ -180,42 +180,6 @@ uint8_t OneWireBus::crc8(const uint8_t *data, size_t len)
     return onewire_crc8(0, data, len);
 }
 
-// @brief Group update for all temperature sensors (non-blocking).
-// Call every 100ms) from main sensor task.
-bool OneWireBus::groupUpdate(uint32_t now_ms)
-{
-    const uint32_t UPDATE_INTERVAL_MS = 1000;  // Desired update interval
-    const uint32_t MAX_CONVERSION_TIME_MS = 750;  // Max time for 12-bit conversion
-
-    // Read all sensors individually
-    for (auto* sensor : _all_sensor) {
-        if ( ! sensor->isConverting() ) {
-            if (now_ms - sensor->getLastUpdateTimeMs() < UPDATE_INTERVAL_MS) {
-                continue;
-            }
-
-            // Start conversion
-            if (! sensor->primeRead(now_ms)) {
-                ESP_LOGE(FNAME, "Failed to trigger conversion");
-            }
-
-            continue;
-        }
-
-        if (now_ms - sensor->getConvertStartMs() < MAX_CONVERSION_TIME_MS) {
-            continue;
-        }
-        
-        float val = sensor->doRead();
-        sensor->pushToHistory(val, sensor->getConvertStartMs());
-
-        ESP_LOGI(FNAME, "OW sensor %016llX: %umsec %.2f", sensor->getAddress(), (unsigned)sensor->getConvertStartMs(), val);
-    }
-
-    return true;
-}
-
-
 //
 // private helper
 //
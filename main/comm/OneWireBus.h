@@ -35,7 +35,6 @@ public:
     esp_err_t writeBytes(const uint8_t *buf, uint8_t size);
     esp_err_t readBytes(uint8_t *buf, size_t size);
     uint8_t crc8(const uint8_t *data, size_t len);
-    bool groupUpdate(uint32_t now_ms);
 
     // Ctrl
     InterfaceId getId() const override { return OW_BUS; }
@@ -0,0 +1,168 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "SpiBus.h"
+
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
+
+#include <cstring>
+
+// Tolerated wait per client, past it a waiter gets the bus before higher priority ones
+static const uint32_t DEADLINE_US[SPI_NUM_CLIENTS] = { 3000, 5000, 100000 };
+static const char *CLIENT_NAME[SPI_NUM_CLIENTS] = { "te", "baro", "display" };
+
+static portMUX_TYPE busLock = portMUX_INITIALIZER_UNLOCKED;
+// the owner of the bus holds it, a waiter blocked on it lends its priority to the owner
+static SemaphoreHandle_t busMutex;
+static SemaphoreHandle_t grant[SPI_NUM_CLIENTS]; // back to the mutex after an out of turn take
+static volatile uint8_t waiting = 0;             // bit mask of waiting clients
+static uint8_t bounced = 0;                      // waiters that took the mutex out of turn
+static int turn = -1;                            // the waiter picked by release(), -1 := any
+static int64_t waitSince[SPI_NUM_CLIENTS];
+
+SpiBus::Stats SpiBus::_stats[SPI_NUM_CLIENTS];
+
+void SpiBus::begin()
+{
+    busMutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < SPI_NUM_CLIENTS; i++) {
+        grant[i] = xSemaphoreCreateBinary();
+    }
+    memset(_stats, 0, sizeof(_stats));
+}
+
+int SpiBus::pickNext(uint8_t mask, const int64_t *since, const uint32_t *deadline_us, int64_t now)
+{
+    int next = -1;
+    int64_t overdue = 0;
+    for (int i = 0; i < SPI_NUM_CLIENTS; i++) {
+        if ( ! (mask & (1 << i)) ) {
+            continue;
+        }
+        int64_t late = (now - since[i]) - deadline_us[i];
+        if ( next < 0 ) {
+            // the waiter with the highest priority
+            next = i;
+            overdue = late;
+        }
+        else if ( late > 0 && late > overdue ) {
+            // unless a lower priority one is even more overdue
+            next = i;
+            overdue = late;
+        }
+    }
+    return next;
+}
+
+void SpiBus::acquire(SpiClient c)
+{
+    int64_t t0 = esp_timer_get_time();
+    taskENTER_CRITICAL(&busLock);
+    waiting = waiting | (1 << c);
+    waitSince[c] = t0;
+    taskEXIT_CRITICAL(&busLock);
+    for (;;) {
+        xSemaphoreTake(busMutex, portMAX_DELAY);
+        uint8_t wake = 0;
+        taskENTER_CRITICAL(&busLock);
+        bool mine = turn < 0 || turn == c || ! (waiting & (1 << turn));
+        if ( mine ) {
+            waiting = waiting & ~(1 << c);
+            turn = -1;
+            wake = bounced;
+            bounced = 0;
+        }
+        else {
+            bounced = bounced | (1 << c);
+        }
+        taskEXIT_CRITICAL(&busLock);
+        if ( mine ) {
+            // the bounced ones queue on the mutex again, behind the owner
+            for (int i = 0; i < SPI_NUM_CLIENTS; i++) {
+                if ( wake & (1 << i) ) {
+                    xSemaphoreGive(grant[i]);
+                }
+            }
+            break;
+        }
+        // the mutex went by task priority, not to the picked client, hand it on
+        xSemaphoreGive(busMutex);
+        xSemaphoreTake(grant[c], portMAX_DELAY);
+    }
+    record(c, (uint32_t)(esp_timer_get_time() - t0));
+}
+
+void SpiBus::release(SpiClient c)
+{
+    taskENTER_CRITICAL(&busLock);
+    turn = pickNext(waiting, waitSince, DEADLINE_US, esp_timer_get_time());
+    taskEXIT_CRITICAL(&busLock);
+    xSemaphoreGive(busMutex);
+}
+
+bool SpiBus::preempt(SpiClient c)
+{
+    if ( ! waiting ) {
+        return false;
+    }
+    // any waiter of higher priority, or an overdue one
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&busLock);
+    uint8_t w = waiting;
+    bool yield = w & ((1 << c) - 1);
+    for (int i = 0; i < SPI_NUM_CLIENTS && ! yield; i++) {
+        yield = (w & (1 << i)) && (now - waitSince[i]) > DEADLINE_US[i];
+    }
+    taskEXIT_CRITICAL(&busLock);
+    if ( yield ) {
+        _stats[c].preempted++;
+    }
+    return yield;
+}
+
+void SpiBus::record(SpiClient c, uint32_t wait_us)
+{
+    Stats &s = _stats[c];
+    int bin = 0;
+    for (uint32_t lim = 32; bin < HIST_BINS - 1 && wait_us >= lim; lim <<= 1) {
+        bin++;
+    }
+    s.hist[bin]++;
+    s.count++;
+    if ( wait_us > s.max_us ) {
+        s.max_us = wait_us;
+    }
+    if ( wait_us > DEADLINE_US[c] ) {
+        s.missed++;
+    }
+}
+
+void SpiBus::statsLog()
+{
+    for (int i = 0; i < SPI_NUM_CLIENTS; i++) {
+        Stats &s = _stats[i];
+        if ( ! s.count ) {
+            continue;
+        }
+        ESP_LOGI(FNAME, "SPI %-7s n:%u max:%uus missed:%u preempted:%u wait<32us..>=8ms: %u %u %u %u %u %u %u %u %u %u",
+            CLIENT_NAME[i], (unsigned)s.count, (unsigned)s.max_us, (unsigned)s.missed, (unsigned)s.preempted,
+            (unsigned)s.hist[0], (unsigned)s.hist[1], (unsigned)s.hist[2], (unsigned)s.hist[3], (unsigned)s.hist[4],
+            (unsigned)s.hist[5], (unsigned)s.hist[6], (unsigned)s.hist[7], (unsigned)s.hist[8], (unsigned)s.hist[9]);
+        memset(&s, 0, sizeof(s));
+    }
+}
+
+extern "C" {
+void spibus_acquire(int client) { SpiBus::acquire((SpiClient)client); }
+void spibus_release(int client) { SpiBus::release((SpiClient)client); }
+bool spibus_preempt(int client) { return SpiBus::preempt((SpiClient)client); }
+}
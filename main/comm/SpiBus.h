@@ -0,0 +1,63 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cinttypes>
+
+// Clients of the shared SPI bus, in the order of their priority.
+// The display hal in components/eglib refers to SPI_DISPLAY by its number.
+enum SpiClient : uint8_t {
+    SPI_TE = 0,
+    SPI_BARO,
+    SPI_DISPLAY,
+    SPI_NUM_CLIENTS
+};
+
+// Arbitration of the SPI bus shared by the pressure sensors and the display.
+//
+// A released bus goes to the waiting client with the highest priority, except a waiter has
+// exceeded its wait deadline, then the most overdue one comes first. The display splits its
+// pixel transfers into chunks and checks preempt() in between, so a sensor read waits for
+// one chunk at most instead of a complete screen update.
+//
+// The owner holds a FreeRTOS mutex, so a waiting sensor task lends its priority to a display task
+// that owns the bus. A waiter the mutex went to out of turn hands it on to the picked client.
+class SpiBus
+{
+public:
+    static void begin();
+    static void acquire(SpiClient c);
+    static void release(SpiClient c);
+    // a client of higher priority or an overdue one waits for the bus
+    static bool preempt(SpiClient c);
+    static void statsLog();
+
+    // the arbitration policy, free of any OS dependency
+    static int pickNext(uint8_t mask, const int64_t *since, const uint32_t *deadline_us, int64_t now);
+
+    static constexpr int HIST_BINS = 10; // wait time bins of <32us, <64us, .. <8ms, >=8ms
+
+private:
+    struct Stats {
+        uint32_t hist[HIST_BINS];
+        uint32_t count;
+        uint32_t max_us;
+        uint32_t missed;   // deadline exceeded
+        uint32_t preempted;
+    };
+    static void record(SpiClient c, uint32_t wait_us);
+    static Stats _stats[SPI_NUM_CLIENTS];
+};
+
+// C entry points for the display hal
+extern "C" {
+void spibus_acquire(int client);
+void spibus_release(int client);
+bool spibus_preempt(int client);
+}
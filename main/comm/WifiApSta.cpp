@@ -5,6 +5,8 @@
 #include "setup/SetupCommon.h"
 #include "comm/DataLink.h"
 #include "ESPRotary.h"
+#include "EventTrace.h"
+#include "Webserver.h"
 #include "logdefnone.h"
 
 #include <freertos/FreeRTOS.h>
@@ -100,6 +102,15 @@ int sock_server_t::connect_sta_socket()
 class WIFI_EVENT_HANDLER
 {
 public:
+	// let the data link of the port drop its state of a gone client
+	static void peer_closed(WifiApSta *wifi, int port, int peer)
+	{
+		std::lock_guard<SemaphoreMutex> lock(wifi->_dlink_mutex);
+		auto dl = wifi->_dlink.find(port);
+		if ( dl != wifi->_dlink.end() ) {
+			dl->second->peerClosed(peer);
+		}
+	}
 
 	// WiFi Task
 	static void socket_server(void *arg)
@@ -198,11 +209,10 @@ public:
 						}
 					} else {
 						// This is a client socket, we can read from it
-						ESP_LOGI(FNAME, "FD_ISSET client socket: %d, port %d", config->sock_hndl, config->port );
 						char r[ProtocolItf::MAX_LEN + 1];
 						ssize_t sizeRead = recv(config->sock_hndl, r, ProtocolItf::MAX_LEN - 1, MSG_DONTWAIT);
+						ETRACE(WIFI_RECV, config->sock_hndl, config->port, sizeRead);
 						if (sizeRead > 0) {
-							ESP_LOGI(FNAME, "FD socket recv: connection %d, port %d, read:%d bytes", config->sock_hndl, config->port, sizeRead );
 							tmp_alive = true;
 							DataLink* dltarget = nullptr;
 							{
@@ -232,11 +242,10 @@ public:
 				for (auto it = config->peers.begin(); it != config->peers.end(); ) {
 					peer_record_t &client_rec = *it;
 					if (FD_ISSET(client_rec.peer, &read_fds)) {
-						ESP_LOGI(FNAME, "FD_ISSET socket: connection %d, port %d", client_rec.peer, config->port );
 						char r[ProtocolItf::MAX_LEN + 1];
 						ssize_t sizeRead = recv(client_rec.peer, r, ProtocolItf::MAX_LEN - 1, MSG_DONTWAIT);
+						ETRACE(WIFI_RECV, client_rec.peer, config->port, sizeRead);
 						if (sizeRead > 0) {
-							ESP_LOGI(FNAME, "FD socket recv: connection %d, port %d, read:%d bytes", client_rec.peer, config->port, sizeRead );
 							tmp_alive = true;
 							DataLink* dltarget = nullptr;
 							{
@@ -247,7 +256,7 @@ public:
 								}
 							}
 							if (dltarget) {
-								dltarget->process(r, sizeRead);
+								dltarget->process(r, sizeRead, client_rec.peer);
 							}
 							client_rec.retries = 0;
 						}
@@ -256,6 +265,7 @@ public:
 							ESP_LOGI(FNAME, "Client %d disconnected", client_rec.peer);
 							shutdown(client_rec.peer, SHUT_RDWR);
 							close(client_rec.peer);
+							peer_closed(wifi, config->port, client_rec.peer);
 							it = config->peers.erase(it); // Remove client from the list
 							continue; // Skip to the next iteration
 						}
@@ -266,6 +276,7 @@ public:
 					if (client_rec.retries > 100) {
 						ESP_LOGW(FNAME, "tcp client %d (port %d) permanent send error: %s, removing!", client_rec.peer, config->port, strerror(errno));
 						close(client_rec.peer);
+						peer_closed(wifi, config->port, client_rec.peer);
 						it = config->peers.erase(it);
 						continue; // Skip to the next iteration
 					}
@@ -376,6 +387,7 @@ WifiApSta::~WifiApSta()
 
 	// stop the server task
 	_terminte_sock_server = true;
+	Webserver.stop();
 
 	esp_wifi_stop();
 	if ( _ap_netif ) {
@@ -462,7 +474,7 @@ void WifiApSta::ConfigureIntf(int port)
 {
 	bool isAP = ! ((xcv_role.get()==SECOND_ROLE) && (port==8884));
 	bool need_to_start = false;
-	if (port >= 8880 && port <= 8884) {
+	if (port >= 8880 && port <= 8885) {
 		if ( port == 8884 && _sta_netif && _socks[8884-8880] && _socks[8884-8880]->sock_hndl <= 0) {
 			ESP_LOGI(FNAME, "Only connecting STA");
 			client_connect();
@@ -481,7 +493,7 @@ void WifiApSta::ConfigureIntf(int port)
 		return;  // no socket server for the OTA webserver
 	}
 	else {
-		ESP_LOGE(FNAME, "Invalid cfg: %d, should be between 8880 and 8884, or 80", port);
+		ESP_LOGE(FNAME, "Invalid cfg: %d, should be between 8880 and 8885, or 80", port);
 		return;
 	}
 
@@ -510,13 +522,16 @@ void WifiApSta::ConfigureIntf(int port)
 		ESP_LOGI(FNAME,"now start wifi");
 		ESP_ERROR_CHECK(esp_wifi_start());
 	}
+	if ( isAP ) {
+		Webserver.startDiag(); // once for all ports
+	}
 
 }
 
 int WifiApSta::Send(const char *msg, int &len, int port)
 {
-	if (port < 8880 || port > 8884 || !socket_server_task_pid) {
-		ESP_LOGE(FNAME, "Invalid port: %d, should be between 8880 and 8884", port);
+	if (port < 8880 || port > 8885 || !socket_server_task_pid) {
+		ESP_LOGE(FNAME, "Invalid port: %d, should be between 8880 and 8885", port);
 		return -1;
 	}
 	// ESP_LOGI(FNAME, "port %d to sent %d: bytes, %s", port, len, msg );
@@ -547,7 +562,7 @@ int WifiApSta::Send(const char *msg, int &len, int port)
 	else {
 		for(auto &rec : socks->peers)  // iterate through all clients
 		{
-			if( rec.peer >= 0 ){
+			if( rec.peer >= 0 && ! rec.single ){
 				int num = send(rec.peer, msg, len, MSG_DONTWAIT);
 				// ESP_LOGI(FNAME, "client %d, num send %d", rec.client, num );
 				if( num == len ){  // at least once we needed to sent the rest in one step for okay status
@@ -569,6 +584,35 @@ int WifiApSta::Send(const char *msg, int &len, int port)
 	return 50;  // this port -> socket number is currently unavailable please try again 50 ms later
 }
 
+// Send to one client of an AP port only, from now on the client is left out of the port broadcast
+int WifiApSta::SendTo(const char *msg, int &len, int port, int peer)
+{
+	if (port < 8880 || port > 8885 || !socket_server_task_pid) {
+		ESP_LOGE(FNAME, "Invalid port: %d, should be between 8880 and 8885", port);
+		return -1;
+	}
+	sock_server_t *socks = _socks[port-8880];
+	if( socks == nullptr || ! socks->is_ap ) {
+		return Send(msg, len, port);
+	}
+	for(auto &rec : socks->peers)
+	{
+		if( rec.peer == peer ){
+			rec.single = true;
+			int num = (len > 0) ? send(rec.peer, msg, len, MSG_DONTWAIT) : 0;
+			if( num == len ){
+				rec.retries = 0;
+				socks->alive = true;
+				return 0;
+			}
+			ESP_LOGW(FNAME, "tcp send to  %d (port: %d), %d retries", rec.peer, port, rec.retries );
+			len = 0;
+			return 50;
+		}
+	}
+	return 0; // the client is gone, drop it
+}
+
 static esp_netif_t *wifi_consfig_sta(const char* staid)
 {
 	ESP_LOGV(FNAME,"now esp_netif_create_default_wifi_sta");
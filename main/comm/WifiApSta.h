@@ -12,12 +12,13 @@ extern bool netif_initialized;
 
 class WifiApSta;
 
-#define NUM_TCP_PORTS 5
+#define NUM_TCP_PORTS 6
 
 typedef struct client_record {
 	int peer;
 	int retries;
 	struct sockaddr_in clientAddress;
+	bool single = false; // addressed one by one, left out of the port broadcast
 }peer_record_t;
 
 struct sock_server_t {
@@ -46,8 +47,9 @@ public:
 	// Ctrl
 	InterfaceId getId() const override { return WIFI_APSTA; }
 	const char *getStringId() const override { return "WiFi"; }
-	void ConfigureIntf(int port) override; // 8880, 8881, 8882, 8883, 8884, 80
+	void ConfigureIntf(int port) override; // 8880, 8881, 8882, 8883, 8884, 8885, 80
 	virtual int Send(const char *msg, int &len, int port = 0) override;
+	int SendTo(const char *msg, int &len, int port, int peer) override;
 
 	bool isAlive(); // returns true if AP is up and running
 	bool isAP() const { return _ap_netif != nullptr; }
@@ -0,0 +1,237 @@
+#!/usr/bin/python
+#
+# Crash trace of the vario (see CrashTrace.h): the last task switches, queue events and loop runs before a
+# crash or watchdog reset. Fetches the trace from the web server, symbolizes the code addresses against the
+# ELF of the build and prints the timeline.
+#
+#   crash_trace.py fetch -o crash.trace                  (trace of the crashed run, --now for the running one)
+#   crash_trace.py show crash.trace -e build/xcvario_pro.elf  (events with code lines, --lanes for the task lanes)
+
+import argparse
+import hashlib
+import os
+import shutil
+import string
+import struct
+import subprocess
+import sys
+import urllib.request
+
+MAGIC = 0x32525458  # XTR2
+HEADER = struct.Struct("<IHBBIIII16s")  # magic, size, tasks, loops, head, run, reset reason, last tick, ELF SHA-256
+LOOP = struct.Struct("<IIIII")         # runs, max usec, overruns, last usec, start of the running one
+TASK = struct.Struct("<H10s")          # task number, name
+ENTRY = struct.Struct("<IIBBH")        # usec, value, event (bit 7 core 1), task number, argument
+
+BOOT, TASK_IN, QUEUE_SEND, QUEUE_RECV, LOOP_BEGIN, LOOP_END, MARK = range(1, 8)
+OVERRUN = 0x8000
+FAILED = 1
+LOOP_NAMES = ["readSensors", "clientLoop", "loop2", "test"]
+RESET_REASONS = ["unknown", "power on", "external pin", "software", "panic", "interrupt watchdog",
+                 "task watchdog", "other watchdog", "deep sleep", "brownout", "SDIO", "USB", "JTAG", "efuse",
+                 "power glitch", "CPU lockup"]
+
+
+class Trace:
+    def __init__(self, data):
+        magic, size, ntasks, nloops, self.head, self.run, self.reset, self.alive_raw, sha = HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("not a crash trace")
+        if len(data) < HEADER.size + nloops * LOOP.size + ntasks * TASK.size + size * ENTRY.size:
+            raise ValueError("trace truncated")
+        self.elf_sha = sha.decode("ascii", "replace")
+        pos = HEADER.size
+        self.loops = [LOOP.unpack_from(data, pos + i * LOOP.size) for i in range(nloops)]
+        pos += nloops * LOOP.size
+        self.tasks = {}
+        for i in range(ntasks):
+            number, name = TASK.unpack_from(data, pos + i * TASK.size)
+            if number:
+                self.tasks[number & 0xff] = name.split(b"\0")[0].decode("ascii", "replace")
+        pos += ntasks * TASK.size
+        slots = [ENTRY.unpack_from(data, pos + i * ENTRY.size) for i in range(size)]
+        if self.head > size:
+            first = self.head % size
+            slots = slots[first:] + slots[:first]
+        else:
+            slots = slots[:self.head]
+        # usec since boot, the 32 bits wrap after 71 minutes
+        self.events = []
+        base = last = 0
+        for t, value, event, task, arg in slots:
+            if t + base < last - (1 << 31):
+                base += 1 << 32
+            last = t + base
+            self.events.append((last, event >> 7, event & 0x7f, task, arg, value))
+        self.alive = self.alive_raw + base
+        if self.alive < last - (1 << 31):
+            self.alive += 1 << 32
+
+    def task_name(self, number):
+        return self.tasks.get(number, "#%d" % number)
+
+
+def reset_name(reason):
+    if reason == 0:
+        return "still running"
+    return RESET_REASONS[reason] if reason < len(RESET_REASONS) else "reset %d" % reason
+
+
+def find_addr2line(tool):
+    for t in (tool, "xtensa-esp32-elf-addr2line", "addr2line"):
+        if t and shutil.which(t):
+            return t
+    return None
+
+
+def symbolize(elf, addresses, tool):
+    """code line of each address, by one addr2line run"""
+    addresses = sorted(set(addresses))
+    tool = find_addr2line(tool)
+    if not elf or not addresses or not tool:
+        return {}
+    out = subprocess.run([tool, "-pfaC", "-e", elf] + ["0x%08x" % a for a in addresses],
+                         capture_output=True, text=True).stdout
+    lines = {}
+    for line in out.splitlines():
+        if not line.startswith("0x"):
+            continue
+        addr, _, where = line.partition(": ")
+        func, _, src = where.partition(" at ")
+        src = os.path.basename(src) if src and not src.startswith("??") else "?"
+        lines[int(addr, 16)] = "%s %s" % (func, src) if func != "??" else "?"
+    return lines
+
+
+def describe(trace, e, lines):
+    t, core, event, task, arg, value = e
+    if event == BOOT:
+        return "boot after %s" % reset_name(value)
+    if event == TASK_IN:
+        return "running"
+    if event in (QUEUE_SEND, QUEUE_RECV):
+        what = "queue send" if event == QUEUE_SEND else "queue receive"
+        fail = "  FAILED" if arg & FAILED else ""
+        return "%-13s %s%s" % (what, lines.get(value, "0x%08x" % value), fail)
+    if event == LOOP_BEGIN:
+        return "%s begin" % loop_name(arg)
+    if event == LOOP_END:
+        over = "  OVERRUN" if arg & OVERRUN else ""
+        return "%s end %.1f ms%s" % (loop_name(arg & 0xff), value / 1000.0, over)
+    if event == MARK:
+        return "mark %d at %s" % (arg, lines.get(value, "0x%08x" % value))
+    return "event %d arg %d value 0x%x" % (event, arg, value)
+
+
+def loop_name(n):
+    return LOOP_NAMES[n] if n < len(LOOP_NAMES) else "loop%d" % n
+
+
+def show_lanes(trace, end, span_ms, width):
+    """the task running on each core per column, loop begin [ and end ] (! on overrun) below"""
+    start = end - span_ms * 1000
+    names = {}
+    letters = string.ascii_uppercase + string.ascii_lowercase + string.digits
+    cores = sorted(set(e[1] for e in trace.events))
+    running = {c: None for c in cores}
+    cols = int(span_ms)
+    lanes = {c: [" "] * cols for c in cores}
+    loops = [" "] * cols
+    events = iter(trace.events)
+    pending = next(events, None)
+    for col in range(cols):
+        bucket_end = start + (col + 1) * 1000
+        while pending and pending[0] < bucket_end:
+            t, core, event, task, arg, value = pending
+            if event == TASK_IN:
+                running[core] = task
+            elif event == LOOP_BEGIN and t >= start:
+                loops[col] = "["
+            elif event == LOOP_END and t >= start:
+                loops[col] = "!" if arg & OVERRUN else "]"
+            pending = next(events, None)
+        for c in cores:
+            task = running[c]
+            if task is not None:
+                if task not in names:
+                    names[task] = letters[len(names) % len(letters)]
+                lanes[c][col] = names[task]
+    print("task lanes, 1 ms per column, the last %d ms" % cols)
+    for pos in range(0, cols, width):
+        print("%9.0f ms" % ((start + pos * 1000 - end) / 1000.0))
+        for c in cores:
+            print("  core %d  %s" % (c, "".join(lanes[c][pos:pos + width])))
+        print("  loops   %s" % "".join(loops[pos:pos + width]))
+    print("  " + ", ".join("%s %s" % (l, trace.task_name(t)) for t, l in sorted(names.items(), key=lambda x: x[1])))
+    print()
+
+
+def show(args):
+    trace = Trace(read(args.trace))
+    if not trace.events:
+        sys.exit("empty trace")
+    end = trace.events[-1][0]
+    print("run %d, ended by %s, %d events of %d, over the last %.1f ms" % (
+        trace.run, reset_name(trace.reset), len(trace.events), trace.head, (end - trace.events[0][0]) / 1000.0))
+    if trace.alive > end:
+        print("last tick %.1f ms after the last event" % ((trace.alive - end) / 1000.0))
+    if args.elf:
+        sha = hashlib.sha256(read(args.elf)).hexdigest()
+        if not sha.startswith(trace.elf_sha):
+            print("WARNING: trace of the ELF %s..., %s is %s..." % (trace.elf_sha, args.elf, sha[:16]))
+    print()
+    print("loop          runs   last ms    max ms  overruns")
+    for i, (runs, max_us, overruns, last_us, begun_us) in enumerate(trace.loops):
+        if runs:
+            print("%-12s %5d  %8.1f  %8.1f  %8d" % (loop_name(i), runs, last_us / 1000.0, max_us / 1000.0, overruns))
+    print()
+
+    if args.lanes:
+        show_lanes(trace, end, args.lanes, args.width)
+
+    events = trace.events[-args.last:] if args.last else trace.events
+    lines = symbolize(args.elf, [e[5] for e in events if e[2] in (QUEUE_SEND, QUEUE_RECV, MARK)], args.addr2line)
+    print("      t [ms]  core  task          event")
+    for e in events:
+        print("%12.3f  %4d  %-12s  %s" % ((e[0] - end) / 1000.0, e[1], trace.task_name(e[3]), describe(trace, e, lines)))
+    # a loop begun but not ended is the one hanging, its begin event is likely overwritten by then
+    for i, (runs, max_us, overruns, last_us, begun_us) in enumerate(trace.loops):
+        if begun_us:
+            print("%s did not end, running for %.1f ms at the last tick" % (loop_name(i), ((trace.alive_raw - begun_us) & 0xffffffff) / 1000.0))
+
+
+def fetch(args):
+    url = args.url.rstrip("/") + "/trace" + ("?now" if args.now else "")
+    with urllib.request.urlopen(url, timeout=10) as r:
+        data = r.read()
+    Trace(data)  # check it
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print("%d bytes to %s" % (len(data), args.out))
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    f = sub.add_parser("fetch")
+    f.add_argument("-u", "--url", default="http://192.168.4.1")
+    f.add_argument("--now", action="store_true", help="the trace of the running firmware")
+    f.add_argument("-o", "--out", default="crash.trace")
+    s = sub.add_parser("show")
+    s.add_argument("trace")
+    s.add_argument("-e", "--elf", help="the ELF of the traced firmware, build/xcvario_pro.elf")
+    s.add_argument("--addr2line", help="default xtensa-esp32-elf-addr2line")
+    s.add_argument("--last", type=int, default=0, help="events to list, all by default")
+    s.add_argument("--lanes", type=int, default=0, metavar="MS", help="task lanes of the last MS msec")
+    s.add_argument("--width", type=int, default=100, help="columns per lane line")
+    args = ap.parse_args()
+    fetch(args) if args.cmd == "fetch" else show(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+#!/usr/bin/python
+#
+# Event trace of the vario (see EventTrace.h): fetches the binary records of both cores from /events and
+# prints them with the format texts of the event table in main/EventTrace.h.
+#
+#   event_trace.py fetch -o events.bin
+#   event_trace.py show events.bin [-e build/xcvario_pro.elf] [--category COMM] [--stats]
+
+import argparse
+import collections
+import hashlib
+import os
+import re
+import struct
+import urllib.request
+
+MAGIC = 0x31564558  # XEV1
+HEADER = struct.Struct("<IHBBIII16s")  # magic, record size, cores, level, now, written, count, ELF SHA-256 digits
+RECORD = struct.Struct("<IIHBB4I")     # seq, usec, id, nargs, flags, arguments
+CORE1, ISR = 1, 2
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+LEVEL_NAMES = {"ERROR": 1, "WARN": 2, "INFO": 3, "DEBUG": 4}
+
+EVENT = re.compile(r'EVENT\((\w+),\s*(\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+CONVERSION = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)?([diouxXfFeEgGc%])")
+
+
+def read_events(header):
+    """id -> (name, category, level, format) from the EVENT_TRACE_EVENTS table"""
+    with open(header) as f:
+        text = f.read()
+    table = text[text.index("#define EVENT_TRACE_EVENTS"):]
+    events = {}
+    for n, (name, cat, level, fmt) in enumerate(EVENT.findall(table), 1):
+        events[n] = (name, cat, LEVEL_NAMES.get(level, 0), fmt.encode().decode("unicode_escape"))
+    return events
+
+
+def format_args(fmt, args):
+    """printf the way the firmware would have, floats come as their bits"""
+    args = list(args)
+
+    def conv(m):
+        flags, c = m.group(1), m.group(2)
+        if c == "%":
+            return "%"
+        if not args:
+            return "?"
+        v = args.pop(0)
+        if c in "fFeEgG":
+            return ("%" + flags + c) % struct.unpack("<f", struct.pack("<I", v))[0]
+        if c in "di":
+            return ("%" + flags + "d") % (v - (1 << 32) if v & 0x80000000 else v)
+        if c == "u":
+            return ("%" + flags + "d") % v
+        if c == "c":
+            return chr(v & 0xff)
+        return ("%" + flags + c) % v
+
+    return CONVERSION.sub(conv, fmt)
+
+
+class Events:
+    def __init__(self, data):
+        magic, size, self.cores, self.level, now, self.written, count, sha = HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("not an event trace")
+        if size != RECORD.size or len(data) < HEADER.size + count * size:
+            raise ValueError("records of %d bytes, %d expected, or truncated" % (size, RECORD.size))
+        self.elf_sha = sha.decode("ascii", "replace")
+        self.records = []
+        for i in range(count):
+            seq, t, id, nargs, flags, *args = RECORD.unpack_from(data, HEADER.size + i * size)
+            # usec before the fetch, the 32 bit time stamps wrap after 71 minutes
+            age = (now - t) & 0xffffffff
+            self.records.append((-age, seq, flags & CORE1, flags & ISR, id, args[:nargs]))
+        self.records.sort()
+
+
+def show(args):
+    with open(args.events, "rb") as f:
+        trace = Events(f.read())
+    events = read_events(args.header)
+    if args.elf:
+        with open(args.elf, "rb") as f:
+            sha = hashlib.sha256(f.read()).hexdigest()
+        if not sha.startswith(trace.elf_sha):
+            print("WARNING: trace of the ELF %s..., %s is %s..." % (trace.elf_sha, args.elf, sha[:16]))
+    print("%d events of %d written since boot, level %d, %d cores" % (
+        len(trace.records), trace.written, trace.level, trace.cores))
+
+    shown = []
+    for r in trace.records:
+        name, cat, level, fmt = events.get(r[4], ("#%d" % r[4], "?", 0, ""))
+        if args.category and cat not in args.category:
+            continue
+        if args.level and level > LEVEL_NAMES[args.level]:
+            continue
+        shown.append((r, name, cat, level, fmt))
+
+    if args.stats:
+        times = collections.defaultdict(list)
+        for r, name, cat, level, fmt in shown:
+            times[(cat, name)].append(r[0])
+        print("\ncategory  event          count   per sec")
+        for (cat, name), t in sorted(times.items(), key=lambda x: -len(x[1])):
+            span = (t[-1] - t[0]) / 1e6
+            rate = "%9.1f" % ((len(t) - 1) / span) if len(t) > 1 and span > 0 else "        -"
+            print("%-8s  %-12s %7d %s" % (cat, name, len(t), rate))
+        return
+
+    print("\n      t [ms]  core  event")
+    for (t, seq, core, isr, id, a), name, cat, level, fmt in shown:
+        text = format_args(fmt, a) if fmt else " ".join("0x%x" % v for v in a)
+        print("%12.3f  %d%s   %s %-7s %s" % (t / 1000.0, core, "i" if isr else " ", LEVELS.get(level, "?"), cat, text))
+
+
+def fetch(args):
+    with urllib.request.urlopen(args.url.rstrip("/") + "/events", timeout=10) as r:
+        data = r.read()
+    Events(data)  # check it
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print("%d bytes to %s" % (len(data), args.out))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    f = sub.add_parser("fetch")
+    f.add_argument("-u", "--url", default="http://192.168.4.1")
+    f.add_argument("-o", "--out", default="events.bin")
+    s = sub.add_parser("show")
+    s.add_argument("events")
+    s.add_argument("-e", "--elf", help="the ELF of the traced firmware, to check the event table matches")
+    s.add_argument("--header", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "EventTrace.h"),
+                   help="the event table, main/EventTrace.h of the traced build")
+    s.add_argument("--category", action="append", help="only this category, repeatable")
+    s.add_argument("--level", choices=LEVEL_NAMES.keys(), help="only up to this level")
+    s.add_argument("--stats", action="store_true", help="counts and rates per event instead of the records")
+    args = ap.parse_args()
+    fetch(args) if args.cmd == "fetch" else show(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,311 @@
+#!/usr/bin/python
+#
+# Binary delta between two firmware images for the WiFi update (see OtaDelta.h).
+#
+# A delta holds bsdiff style records against the image in the running partition, compressed with a
+# heatshrink style LZSS of a small window. The vario applies it on the fly to the next OTA partition,
+# upload it through the update page like a full image.
+#
+#   ota_delta.py make old.bin new.bin -o update.xdl
+#   ota_delta.py apply old.bin update.xdl -o new.bin    (reference decoder)
+#   ota_delta.py test old.bin new.bin                   (bit exact round trip, sizes and times)
+
+import argparse
+import gzip
+import hashlib
+import struct
+import sys
+import time
+
+MAGIC = b"XDL1"
+HEADER = struct.Struct("<4sIIBBH32s32s")  # magic, old size, new size, window bits, lookahead bits, flags, SHA-256 old, new
+MAX_WINDOW_BITS = 12
+MAX_LOOKAHEAD_BITS = 12
+
+KEY_LEN = 8        # length of the seeds looked up in the old image
+KEY_STEP = 4       # old image positions indexed
+MIN_REGION = 24    # shortest diff region worth a record
+CHAIN = 16         # LZSS candidates tried per position
+
+
+# Record stream
+#
+# Each record is the unsigned LEB128 lengths of its diff and extra part and the zigzag LEB128 seek,
+# followed by the diff bytes, added to the old image bytes from the current old position on, and the
+# extra bytes, taken as they are. Then the old position moves by the seek.
+
+def put_varint(out, v):
+    while v >= 0x80:
+        out.append((v & 0x7f) | 0x80)
+        v >>= 7
+    out.append(v)
+
+
+def zigzag(v):
+    return (v << 1) if v >= 0 else ((-v << 1) - 1)
+
+
+def unzigzag(v):
+    return (v >> 1) if not v & 1 else -((v + 1) >> 1)
+
+
+def extend(old, j, new, i):
+    """Length of the region from new[i] on that follows old[j] on in more than half of its bytes"""
+    lim = min(len(old) - j, len(new) - i)
+    score = best = best_len = k = 0
+    while k < lim:
+        if k + 32 <= lim and new[i + k:i + k + 32] == old[j + k:j + k + 32]:
+            score += 32
+            k += 32
+        else:
+            score += 1 if new[i + k] == old[j + k] else -1
+            k += 1
+        if score > best:
+            best, best_len = score, k
+        elif score < best - 64:
+            break
+    return best_len
+
+
+def make_records(old, new):
+    index = {}
+    for j in range(0, len(old) - KEY_LEN + 1, KEY_STEP):
+        index.setdefault(old[j:j + KEY_LEN], j)
+
+    out = bytearray()
+    dnew = dold = dlen = 0  # the diff region of the record in work
+    off = 0                 # old - new offset of the last region, the next one is likely alike
+    i = 0
+    n, m = len(new), len(old)
+
+    def close(extra_end, next_old):
+        put_varint(out, dlen)
+        put_varint(out, extra_end - dnew - dlen)
+        put_varint(out, zigzag(next_old - dold - dlen))
+        out.extend((new[dnew + k] - old[dold + k]) & 0xff for k in range(dlen))
+        out.extend(new[dnew + dlen:extra_end])
+
+    while i <= n - KEY_LEN:
+        j = i + off
+        if not (0 <= j <= m - KEY_LEN and old[j:j + KEY_LEN] == new[i:i + KEY_LEN]):
+            j = index.get(new[i:i + KEY_LEN])
+            if j is None:
+                i += 1
+                continue
+        length = extend(old, j, new, i)
+        if length < MIN_REGION:
+            i += 1
+            continue
+        # take back the exact matching end of the extra bytes
+        lit = dnew + dlen
+        while i > lit and j > 0 and new[i - 1] == old[j - 1]:
+            i -= 1
+            j -= 1
+            length += 1
+        close(i, j)
+        dnew, dold, dlen = i, j, length
+        off = j - i
+        i += length
+    close(n, dold + dlen)
+    return bytes(out)
+
+
+def apply_records(old, reader, new_size):
+    new = bytearray()
+    oldpos = 0
+    while len(new) < new_size:
+        dlen = reader.varint()
+        elen = reader.varint()
+        seek = unzigzag(reader.varint())
+        if oldpos + dlen > len(old) or len(new) + dlen + elen > new_size:
+            raise ValueError("record out of bounds at %d" % len(new))
+        diff = reader.take(dlen)
+        new.extend((diff[k] + old[oldpos + k]) & 0xff for k in range(dlen))
+        oldpos += dlen
+        new.extend(reader.take(elen))
+        oldpos += seek
+    return bytes(new)
+
+
+# LZSS in the heatshrink bit format, MSB first: 1 + 8 bit literal, or 0 + (distance - 1) in window
+# bits + (count - 1) in lookahead bits.
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.bits = 0
+
+    def put(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.bits += bits
+        while self.bits >= 8:
+            self.bits -= 8
+            self.out.append((self.acc >> self.bits) & 0xff)
+        self.acc &= (1 << self.bits) - 1
+
+    def flush(self):
+        if self.bits:
+            self.out.append((self.acc << (8 - self.bits)) & 0xff)
+        return bytes(self.out)
+
+
+def lzss_encode(data, wbits, lbits):
+    maxd, maxl = 1 << wbits, 1 << lbits
+    chains = {}
+    bw = BitWriter()
+    n = len(data)
+
+    def insert(p):
+        c = chains.setdefault(data[p:p + 3], [])
+        c.append(p)
+        if len(c) > 4 * CHAIN:
+            del c[:2 * CHAIN]
+
+    i = 0
+    while i < n:
+        best_len = best_d = 0
+        lim = min(maxl, n - i)
+        if lim >= 3:
+            c = chains.get(data[i:i + 3], ())
+            for p in reversed(c[-CHAIN:]):
+                d = i - p
+                if d > maxd:
+                    break
+                k = 3
+                while k + 16 <= lim and data[p + k:p + k + 16] == data[i + k:i + k + 16]:
+                    k += 16
+                while k < lim and data[p + k] == data[i + k]:
+                    k += 1
+                if k > best_len:
+                    best_len, best_d = k, d
+                    if k == lim:
+                        break
+        if best_len >= 3:
+            bw.put(best_d - 1, 1 + wbits)
+            bw.put(best_len - 1, lbits)
+            for p in range(i, i + best_len):
+                insert(p)
+            i += best_len
+        else:
+            bw.put(0x100 | data[i], 9)
+            insert(i)
+            i += 1
+    return bw.flush()
+
+
+class LzssReader:
+    """Decodes as far as the records are read"""
+
+    def __init__(self, data, wbits, lbits):
+        self.data, self.wbits, self.lbits = data, wbits, lbits
+        self.out = bytearray()
+        self.acc = self.bits = self.pos = self.read = 0
+
+    def decode(self):
+        wbits, lbits = self.wbits, self.lbits
+        while self.bits < 1 + wbits + lbits and self.pos < len(self.data):
+            self.acc = (self.acc << 8) | self.data[self.pos]
+            self.pos += 1
+            self.bits += 8
+        if self.bits < 9:
+            raise ValueError("delta truncated")
+        if self.acc >> (self.bits - 1) & 1:
+            self.bits -= 9
+            self.out.append(self.acc >> self.bits & 0xff)
+        elif self.bits < 1 + wbits + lbits:
+            raise ValueError("delta truncated")
+        else:
+            self.bits -= 1 + wbits + lbits
+            d = (self.acc >> (self.bits + lbits) & ((1 << wbits) - 1)) + 1
+            for _ in range((self.acc >> self.bits & ((1 << lbits) - 1)) + 1):
+                self.out.append(self.out[-d])
+        self.acc &= (1 << self.bits) - 1
+
+    def take(self, n):
+        while len(self.out) - self.read < n:
+            self.decode()
+        chunk = self.out[self.read:self.read + n]
+        self.read += n
+        return chunk
+
+    def varint(self):
+        v = shift = 0
+        while True:
+            b = self.take(1)[0]
+            v |= (b & 0x7f) << shift
+            shift += 7
+            if b < 0x80:
+                return v
+
+
+def make(old, new, wbits, lbits):
+    records = make_records(old, new)
+    body = lzss_encode(records, wbits, lbits)
+    hdr = HEADER.pack(MAGIC, len(old), len(new), wbits, lbits, 0,
+                      hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    return hdr + body, len(records)
+
+
+def apply(old, delta):
+    magic, old_size, new_size, wbits, lbits, _, old_sha, new_sha = HEADER.unpack_from(delta)
+    if magic != MAGIC:
+        raise ValueError("not a delta")
+    if old_size > len(old) or hashlib.sha256(old[:old_size]).digest() != old_sha:
+        raise ValueError("delta made for another base image")
+    reader = LzssReader(delta[HEADER.size:], wbits, lbits)
+    new = apply_records(old[:old_size], reader, new_size)
+    if hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("result differs")
+    return new
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("cmd", choices=("make", "apply", "test"))
+    ap.add_argument("old", help="image in the running partition")
+    ap.add_argument("other", help="new image, or the delta to apply")
+    ap.add_argument("-o", "--out")
+    ap.add_argument("--window", type=int, default=10, help="LZSS window bits, the RAM the decoder needs")
+    ap.add_argument("--lookahead", type=int, default=12, help="LZSS count bits, long runs of unchanged bytes")
+    args = ap.parse_args()
+    if not 4 <= args.window <= MAX_WINDOW_BITS or not 3 <= args.lookahead <= MAX_LOOKAHEAD_BITS:
+        sys.exit("window 4..%d and lookahead 3..%d bits" % (MAX_WINDOW_BITS, MAX_LOOKAHEAD_BITS))
+    old = read(args.old)
+
+    if args.cmd == "apply":
+        new = apply(old, read(args.other))
+        with open(args.out, "wb") as f:
+            f.write(new)
+        return
+
+    new = read(args.other)
+    t0 = time.time()
+    delta, records = make(old, new, args.window, args.lookahead)
+    t1 = time.time()
+    if args.out:
+        with open(args.out, "wb") as f:
+            f.write(delta)
+    if args.cmd == "make":
+        print("%d bytes delta for %d bytes image, %.1f%%" % (len(delta), len(new), 100.0 * len(delta) / len(new)))
+        return
+
+    back = apply(old, delta)
+    t2 = time.time()
+    if back != new:
+        sys.exit("FAILED: reconstruction differs")
+    full_gz = len(gzip.compress(new, 9))
+    print("image      %8d bytes" % len(new))
+    print("gzip image %8d bytes  %5.1f%%" % (full_gz, 100.0 * full_gz / len(new)))
+    print("records    %8d bytes  %5.1f%%" % (records, 100.0 * records / len(new)))
+    print("delta      %8d bytes  %5.1f%%  (window %d bytes)" % (len(delta), 100.0 * len(delta) / len(new), 1 << args.window))
+    print("make %.1f s, reference apply %.1f s (%.0f KB/s), bit exact" % (t1 - t0, t2 - t1, len(new) / 1024 / max(t2 - t1, 1e-3)))
+
+
+if __name__ == "__main__":
+    main()
@@ -9,51 +9,156 @@
 #include "Clock.h"
 #include "ClockIntf.h"
 
+#ifdef Clock_Test
+#include "logdef.h"
+#else
+#include "logdefnone.h"
+#endif
+
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
 
 #include <esp_attr.h>
-#include <set>
 
 esp_timer_handle_t Clock::_clock_timer = nullptr;
 
-QueueHandle_t request_queue = nullptr;
-enum CmdType { CMD_START, CMD_STOP };
-struct ClkRequest {
-    int8_t cmd; // 0=start, 1=stop
-    Clock_I* cb;
-};
-
 static volatile unsigned long msec_counter = 0;
 
-// Simple unique receiver registry
-static std::set<Clock_I*> clock_registry;
+// The timer wheel
+constexpr int WHEEL_BITS = 6;
+constexpr int WHEEL_SIZE = 1 << WHEEL_BITS;
+constexpr uint32_t WHEEL_MASK = WHEEL_SIZE - 1;
+constexpr int WHEEL_LEVELS = 3;
+constexpr uint32_t MAX_PERIOD = (1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
 
-// Timer SR (called in a timer task context)
-static void IRAM_ATTR clock_timer_sr(std::set<Clock_I*> *registry)
+static Clock_I *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static Clock_I *firing = nullptr;  // the due receivers detached from the wheel
+static uint32_t now_tick = 0;
+static TaskHandle_t tick_task = nullptr; // the esp_timer task running the receivers
+static portMUX_TYPE wheelLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Clock_I::_flags
+constexpr uint8_t IN_TICK = 1;     // tick() is running
+constexpr uint8_t STOP_REQ = 2;    // stopped from within tick()
+constexpr uint8_t RESTART_REQ = 4; // (re)started from within tick()
+
+// Put an armed receiver into its slot, the level is given by the distance to expiry
+void IRAM_ATTR Clock::insert(Clock_I *cb)
 {
-    // be in sync with millis, but sparse
-    msec_counter = esp_timer_get_time() / 1000;
+    uint32_t delta = cb->_expires - now_tick;
+    Clock_I **head;
+    if ( delta < WHEEL_SIZE ) {
+        head = &wheel[0][cb->_expires & WHEEL_MASK];
+    }
+    else if ( delta < (1 << (2 * WHEEL_BITS)) ) {
+        head = &wheel[1][(cb->_expires >> WHEEL_BITS) & WHEEL_MASK];
+    }
+    else {
+        head = &wheel[2][(cb->_expires >> (2 * WHEEL_BITS)) & WHEEL_MASK];
+    }
+    cb->_prev = nullptr;
+    cb->_next = *head;
+    if ( *head ) {
+        (*head)->_prev = cb;
+    }
+    *head = cb;
+    cb->_slot = head;
+}
 
-    // Check if there are any requests
-    ClkRequest msg;
-    if (xQueueReceive(request_queue, &msg, 0) == pdTRUE) {
-        if (msg.cmd == CMD_START) {
-            registry->insert(msg.cb);
-        }
-        else if (msg.cmd == CMD_STOP) {
-            registry->erase(msg.cb);
+void IRAM_ATTR Clock::unlink(Clock_I *cb)
+{
+    if ( cb->_prev ) {
+        cb->_prev->_next = cb->_next;
+    }
+    else {
+        *cb->_slot = cb->_next;
+    }
+    if ( cb->_next ) {
+        cb->_next->_prev = cb->_prev;
+    }
+    cb->_next = cb->_prev = nullptr;
+    cb->_slot = nullptr;
+}
+
+static inline uint32_t period(const Clock_I *cb)
+{
+    uint32_t m = cb->MULTIPLIER;
+    return m == 0 ? 1 : (m > MAX_PERIOD ? MAX_PERIOD : m);
+}
+
+// Move the receivers of the current higher level slot down, they expire within its range
+void IRAM_ATTR Clock::cascade(int level)
+{
+    Clock_I **head = &wheel[level][(now_tick >> (level * WHEEL_BITS)) & WHEEL_MASK];
+    Clock_I *cb = *head;
+    *head = nullptr;
+    while ( cb ) {
+        Clock_I *next = cb->_next;
+        insert(cb);
+        cb = next;
+    }
+}
+
+// One clock tick, fire the receivers that expire now
+void IRAM_ATTR Clock::advance()
+{
+    taskENTER_CRITICAL(&wheelLock);
+    now_tick++;
+    if ( (now_tick & WHEEL_MASK) == 0 ) {
+        if ( ((now_tick >> WHEEL_BITS) & WHEEL_MASK) == 0 ) {
+            cascade(2);
         }
+        cascade(1);
     }
-    // tick callbacks
-    for (auto it = registry->begin(); it != registry->end(); ) {
-        if ((*it)->myTurn()) {
-            if ((*it)->tick()) {
-                it = registry->erase(it);
-                continue;
-            }
+    // detach the due slot, so receivers can stop and start while being served
+    Clock_I **head = &wheel[0][now_tick & WHEEL_MASK];
+    firing = *head;
+    *head = nullptr;
+    for ( Clock_I *cb = firing; cb; cb = cb->_next ) {
+        cb->_slot = &firing;
+    }
+    while ( firing ) {
+        Clock_I *cb = firing;
+        unlink(cb);
+        cb->_flags = IN_TICK;
+        taskEXIT_CRITICAL(&wheelLock);
+
+        bool done = cb->tick();
+
+        taskENTER_CRITICAL(&wheelLock);
+        uint8_t flags = cb->_flags;
+        cb->_flags = 0;
+        if ( cb->_slot == nullptr && ((!done && !(flags & STOP_REQ)) || (flags & RESTART_REQ)) ) {
+            cb->_expires = now_tick + period(cb);
+            insert(cb);
         }
-        it++;
+    }
+    taskEXIT_CRITICAL(&wheelLock);
+}
+
+// Timer SR (called in a timer task context)
+void IRAM_ATTR Clock::timerSR(void *arg)
+{
+    static uint32_t last_target = 0;
+    tick_task = xTaskGetCurrentTaskHandle();
+
+    // be in sync with millis, but sparse
+    int64_t now = esp_timer_get_time();
+    msec_counter = now / 1000;
+
+    // catch up with skipped timer events
+    uint32_t target = (uint32_t)(now / (TICK_ATOM * 1000));
+    if ( last_target == 0 ) {
+        last_target = target - 1;
+    }
+    uint32_t due = target - last_target;
+    last_target = target;
+    if ( due > 10 ) {
+        ESP_LOGW(FNAME, "clock lags %d ticks", (int)due);
+        due = 10;
+    }
+    while ( due-- ) {
+        advance();
     }
 }
 
@@ -64,16 +169,14 @@ Clock::Clock()
     // setup clock timer only once
     if ( _clock_timer == 0 ) {
         esp_timer_create_args_t t_args = {
-            .callback = (esp_timer_cb_t)clock_timer_sr,
-            .arg = (void*)(&clock_registry),
+            .callback = (esp_timer_cb_t)timerSR,
+            .arg = nullptr,
             .dispatch_method = ESP_TIMER_TASK,
             .name = "clock",
             .skip_unhandled_events = true,
         };
         esp_timer_create(&t_args, &_clock_timer);
         esp_timer_start_periodic(_clock_timer, TICK_ATOM * 1000); // the timers API is on usec
-        clock_registry.clear();
-        request_queue = xQueueCreate(10, sizeof(ClkRequest));
     }
 }
 Clock::~Clock()
@@ -81,20 +184,70 @@ Clock::~Clock()
     if (_clock_timer) {
         esp_timer_stop(_clock_timer);
         esp_timer_delete(_clock_timer);
-        clock_registry.clear();
-        vQueueDelete(request_queue);
+        _clock_timer = nullptr;
     }
 }
 
 void Clock::start(Clock_I *cb)
 {
-    ClkRequest req = { CMD_START, cb };
-    xQueueSend(request_queue, &req, portMAX_DELAY);
+    taskENTER_CRITICAL(&wheelLock);
+    if ( cb->_flags & IN_TICK ) {
+        cb->_flags = (cb->_flags & ~STOP_REQ) | RESTART_REQ;
+    }
+    else if ( ! cb->_slot ) {
+        cb->_expires = now_tick + period(cb);
+        insert(cb);
+    }
+    taskEXIT_CRITICAL(&wheelLock);
 }
+
+// Called from another task than the clock, stop returns only after a running tick() of the
+// receiver finished, so the receiver may be destroyed right after.
 void Clock::stop(Clock_I *cb)
 {
-    ClkRequest req = { CMD_STOP, cb };
-    xQueueSend(request_queue, &req, portMAX_DELAY);
+    taskENTER_CRITICAL(&wheelLock);
+    bool running = cb->_flags & IN_TICK;
+    if ( running ) {
+        cb->_flags = (cb->_flags & ~RESTART_REQ) | STOP_REQ;
+    }
+    if ( cb->_slot ) {
+        unlink(cb);
+    }
+    taskEXIT_CRITICAL(&wheelLock);
+
+    if ( running && xTaskGetCurrentTaskHandle() != tick_task ) {
+        // advance() clears the flags under the lock and does not touch the receiver after that
+        do {
+            vTaskDelay(1);
+            taskENTER_CRITICAL(&wheelLock);
+            running = cb->_flags & IN_TICK;
+            if ( ! running && cb->_slot ) {
+                unlink(cb); // re-armed by its last tick()
+            }
+            taskEXIT_CRITICAL(&wheelLock);
+        } while ( running );
+    }
+}
+
+void IRAM_ATTR Clock::restart(Clock_I *cb)
+{
+    taskENTER_CRITICAL(&wheelLock);
+    if ( cb->_flags & IN_TICK ) {
+        cb->_flags = (cb->_flags & ~STOP_REQ) | RESTART_REQ;
+    }
+    else {
+        if ( cb->_slot ) {
+            unlink(cb);
+        }
+        cb->_expires = now_tick + period(cb);
+        insert(cb);
+    }
+    taskEXIT_CRITICAL(&wheelLock);
+}
+
+bool IRAM_ATTR Clock::isActive(const Clock_I *cb)
+{
+    return cb->_slot != nullptr || (cb->_flags & RESTART_REQ);
 }
 
 unsigned long Clock::getMillis()
@@ -105,3 +258,51 @@ int Clock::getSeconds()
 {
     return static_cast<int>(msec_counter / 1000);
 }
+
+#ifdef Clock_Test
+
+// Hundreds of receivers on the wheel, check every one fires at its period and measure the cost of a tick
+class TestReceiver final : public Clock_I
+{
+public:
+    TestReceiver() : Clock_I(1) {}
+    bool tick() override { count++; return false; }
+    uint32_t count = 0;
+};
+
+void Clock::wheel_test()
+{
+    constexpr int N = 500;
+    static TestReceiver rcv[N];
+    for ( int i = 0; i < N; i++ ) {
+        rcv[i].setMultiplier(1 + (i * 37) % 6000); // 10msec .. 60sec, on all levels
+        rcv[i].count = 0;
+    }
+    int64_t t0 = esp_timer_get_time();
+    for ( int i = 0; i < N; i++ ) {
+        start(&rcv[i]);
+    }
+    int64_t t1 = esp_timer_get_time();
+    // drive the wheel directly, 6000 ticks equal one minute of running receivers
+    uint32_t max_us = 0;
+    for ( int t = 0; t < 6000; t++ ) {
+        int64_t a = esp_timer_get_time();
+        advance();
+        uint32_t us = (uint32_t)(esp_timer_get_time() - a);
+        max_us = us > max_us ? us : max_us;
+    }
+    int64_t t2 = esp_timer_get_time();
+    for ( int i = 0; i < N; i++ ) {
+        stop(&rcv[i]);
+    }
+    int64_t t3 = esp_timer_get_time();
+    int errors = 0;
+    for ( int i = 0; i < N; i++ ) {
+        if ( rcv[i].count != 6000 / rcv[i].MULTIPLIER ) {
+            errors++;
+        }
+    }
+    ESP_LOGI(FNAME, "Wheel test %d receivers: start %.2fus stop %.2fus, tick avg %.2fus max %uus, count errors %d", N,
+        (t1 - t0) / (float)N, (t3 - t2) / (float)N, (t2 - t1) / 6000.f, (unsigned)max_us, errors);
+}
+#endif
@@ -9,10 +9,17 @@
 #pragma once
 
 #include <esp_timer.h>
+#include <cstdint>
 
 class Clock_I;
 
 // Clock based on esp_timer
+//
+// Receivers are kept in a hierarchical timer wheel of three levels with 64 slots each, the
+// wheel node is part of the Clock_I. Start and stop are O(1) and callable from any task, a
+// tick only visits the receivers that are due, plus one cascade of a higher level slot every
+// 64 ticks. Periods are limited to 2^18 ticks (43 min). Stop from another task waits for a
+// running tick() of the receiver.
 class Clock
 {
 public:
@@ -23,11 +30,21 @@ public:
     ~Clock();
 
     // API
-    static void start(Clock_I *cb);
+    static void start(Clock_I *cb);   // arm with the receivers period, no-op when armed already
     static void stop(Clock_I *cb);
+    static void restart(Clock_I *cb); // re-arm with a full period from now
+    static bool isActive(const Clock_I *cb);
     static unsigned long getMillis();
     static int getSeconds();
+#ifdef Clock_Test
+    static void wheel_test();
+#endif
 
 private:
+    static void timerSR(void *arg);
+    static void advance();
+    static void insert(Clock_I *cb);
+    static void unlink(Clock_I *cb);
+    static void cascade(int level);
     static esp_timer_handle_t _clock_timer;
 };
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 // Clock interface
 class Clock_I
 {
@@ -16,11 +18,15 @@ public:
     Clock_I() = delete;
     virtual ~Clock_I() = default;
 public:
-    inline bool myTurn() { return (++_counter % MULTIPLIER) == 0; }
     virtual bool tick() = 0; // return true to unregister
-    void setMultiplier(unsigned m) { MULTIPLIER = m; }
+    void setMultiplier(unsigned m) { MULTIPLIER = m; } // effective with the next period
     unsigned MULTIPLIER;
 private:
-    unsigned _counter = 0;
+    // intrusive timer wheel node, owned by the Clock
+    friend class Clock;
+    Clock_I  *_next = nullptr;
+    Clock_I  *_prev = nullptr;
+    Clock_I **_slot = nullptr; // list head while armed
+    uint32_t  _expires = 0;    // in clock ticks
+    uint8_t   _flags = 0;
 };
-
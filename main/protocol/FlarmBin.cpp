@@ -15,8 +15,6 @@
 
 #include "logdefnone.h"
 
-static uint16_t xmodem_crc(const uint8_t *data, int length, uint16_t crc0 = 0);
-
 // The FLARM binary protocol synchronizer.
 //
 constexpr int SEND_THRESH = 80; // need to be smaller than the message buffer
@@ -157,8 +155,8 @@ bool FlarmBinary::setBaudrate(int fnr, int br)
     msg->buffer.push_back((uint8_t)(fnr));
     msg->buffer.push_back((uint8_t)(fnr>>8));
     msg->buffer.push_back(0x02); // set baudrate msg type
-    uint16_t crc = xmodem_crc((uint8_t*)(msg->buffer.data()+1), 6);
-    crc = xmodem_crc((uint8_t*)&br, 1, crc);
+    uint16_t crc = NMEA::xmodemCRC((uint8_t*)(msg->buffer.data()+1), 6);
+    crc = NMEA::xmodemCRC((uint8_t*)&br, 1, crc);
     msg->buffer.push_back((uint8_t)(crc));
     msg->buffer.push_back((uint8_t)(crc>>8));
     msg->buffer.push_back((uint8_t)br);
@@ -176,7 +174,7 @@ bool FlarmBinary::ping()
     msg->buffer.push_back((uint8_t)(frc));
     msg->buffer.push_back((uint8_t)(frc>>8));
     msg->buffer.push_back(0x01); // ping msg type
-    uint16_t crc = xmodem_crc((uint8_t*)(msg->buffer.data()+1), 6);
+    uint16_t crc = NMEA::xmodemCRC((uint8_t*)(msg->buffer.data()+1), 6);
     msg->buffer.push_back((uint8_t)(crc));
     msg->buffer.push_back((uint8_t)(crc>>8));
     return DEV::Send(msg);
@@ -187,22 +185,3 @@ void FlarmBinary::setPeer(FlarmBinary *p)
     _binpeer = p;
     ESP_LOGD(FNAME, "BP%d peer is dl%d/g%d", _dl.getItfId(), _binpeer->getDL()->getItfId(), _binpeer->getDeviceId());
 }
-
-uint16_t xmodem_crc(const uint8_t *data, int length, uint16_t crc0)
-{
-    uint16_t crc = crc0;
-
-    while (length--) {
-        crc ^= (*data++) << 8;  // XOR byte into high byte of CRC
-        
-        for (int i = 0; i < 8; i++) {  // Process each bit
-            if (crc & 0x8000) {
-                crc = (crc << 1) ^ 0x1021;  // XOR with polynomial if MSB is 1
-            } else {
-                crc <<= 1;
-            }
-        }
-    }
-    return crc;
-}
-
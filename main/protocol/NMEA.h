@@ -145,7 +145,7 @@ public:
     bool killStream();
     bool prepareUpdate(int len, int pack);
     bool firmwarePacket(const char *buf, int len);
-    int waitConfirmation();
+    int waitConfirmation(int pack_nr); // the last confirmed packet
 
     // JumboCmd transmitter
     bool sendJPConnect();
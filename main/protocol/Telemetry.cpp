@@ -0,0 +1,431 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "Telemetry.h"
+
+#include "Clock.h"
+#include "ClockIntf.h"
+#include "nmea_util.h"
+#include "comm/Messages.h"
+#include "comm/DataLink.h"
+#include "setup/SetupNG.h"
+#include "KalmanMPU6050.h"
+#include "Flarm.h"
+#include "Flap.h"
+#include "sensor.h"
+
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <cmath>
+#include <algorithm>
+
+constexpr uint8_t START = TelemetryBin::START;
+constexpr uint8_t ESCAPE = 0x78;
+constexpr int HEADER_LEN = 8; // length, version, sequence, type, crc
+constexpr int MAX_PAYLOAD = 16;
+constexpr int MAX_FRAME = 1 + 2 * (HEADER_LEN + MAX_PAYLOAD); // all escaped in the worst case
+constexpr int MAX_LINKS = 8;
+
+// Minimum interval of the slowly changing groups, msec
+constexpr uint16_t SLOW_MS[TelemetryBin::NUM_GROUPS] = { 0, 0, 0, 1000, 250, 250 };
+
+// The links served by the stream, one per protocol instance plus one per subscribed WiFi client
+struct Link {
+    TelemetryBin *prtcl = nullptr;
+    DeviceId did = NO_DEVICE;
+    int      port = 0;
+    int      peer = -1; // the client socket, -1 := all clients without an own subscription
+    uint8_t  groups = 0;
+    uint16_t period = 0; // msec
+    uint32_t next = 0;
+    uint32_t slow_next[TelemetryBin::NUM_GROUPS] = {};
+    // statistics
+    uint32_t bytes = 0;
+    uint32_t frames = 0;
+    uint32_t drops = 0;
+};
+
+static Link links[MAX_LINKS];
+static uint16_t group_seq[TelemetryBin::NUM_GROUPS];
+static portMUX_TYPE linkLock = portMUX_INITIALIZER_UNLOCKED;
+
+
+// Little endian payload writer
+class Payload
+{
+public:
+    explicit Payload(uint32_t ts) { u32(ts); }
+    void u8(uint8_t v) { _b[_n++] = v; }
+    void i16(int v) { u16((uint16_t)(int16_t)std::max(-32768, std::min(32767, v))); }
+    void u16(uint16_t v) { u8(v); u8(v >> 8); }
+    void i32(int32_t v) { u16(v); u16((uint32_t)v >> 16); }
+    void u32(uint32_t v) { u16(v); u16(v >> 16); }
+    const uint8_t* data() const { return _b; }
+    int size() const { return _n; }
+private:
+    uint8_t _b[MAX_PAYLOAD];
+    int _n = 0;
+};
+
+// Sample the data of one group, false if there is nothing to send
+static bool sample(int group, Payload &p)
+{
+    switch ( group ) {
+    case TelemetryBin::ATTITUDE:
+    {
+        float yaw = std::fmod((float)IMU::getYaw() + 360.f, 360.f);
+        p.i16(std::lround(IMU::getRoll() * 100.f));  // 0.01 deg
+        p.i16(std::lround(IMU::getPitch() * 100.f));
+        p.u16(std::lround(yaw * 100.f));
+        p.i16(std::lround(IMU::getGliderAccelZ() * 1000.f)); // mg
+        return true;
+    }
+    case TelemetryBin::VARIO:
+        p.i16(std::lround(te_vario.get() * 100.f)); // cm/s
+        p.i16(std::lround(te_netto.get() * 100.f));
+        p.i16(std::lround(aTE * 100.f));
+        p.i16(std::lround(MC.get() * 100.f));
+        return true;
+    case TelemetryBin::AIR:
+        p.u16(std::lround(std::max(ias.get(), 0.f) * 10.f)); // 0.1 km/h
+        p.u16(std::lround(std::max(tas, 0.f) * 10.f));
+        p.i32(std::lround(altitude.get() * 100.f)); // cm
+        return true;
+    case TelemetryBin::WIND:
+        p.u16(std::lround(swind_dir.get() * 10.f)); // 0.1 deg
+        p.u16(std::lround(swind_speed.get() * 10.f)); // 0.1 km/h
+        p.u16(std::lround(cwind_dir.get() * 10.f));
+        p.u16(std::lround(cwind_speed.get() * 10.f));
+        return true;
+    case TelemetryBin::TRAFFIC:
+        p.u8(Flarm::alarmLevel());
+        p.i16(Flarm::relBearing()); // deg
+        p.i16(Flarm::relVertical()); // m
+        p.i32(Flarm::relDistance()); // m
+        return true;
+    case TelemetryBin::FLAP:
+        if ( ! FLAP ) {
+            return false;
+        }
+        p.i16(std::lround(FLAP->getFlapPosition() * 100.f));
+        p.i16(std::lround(FLAP->getOptimum(ias.get()) * 100.f));
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Frame and escape one payload
+static int frame(uint8_t *out, uint8_t type, uint16_t seq, const Payload &p)
+{
+    int len = HEADER_LEN + p.size();
+    uint8_t hdr[HEADER_LEN] = { (uint8_t)len, (uint8_t)(len >> 8), TelemetryBin::VERSION, (uint8_t)seq, (uint8_t)(seq >> 8), type };
+    uint16_t crc = NMEA::xmodemCRC(hdr, 6);
+    crc = NMEA::xmodemCRC(p.data(), p.size(), crc);
+    hdr[6] = (uint8_t)crc;
+    hdr[7] = (uint8_t)(crc >> 8);
+
+    int n = 0;
+    out[n++] = START;
+    auto put = [&](uint8_t c) {
+        if ( c == START || c == ESCAPE ) {
+            out[n++] = ESCAPE;
+            out[n++] = (c == START) ? 0x31 : 0x55;
+        }
+        else {
+            out[n++] = c;
+        }
+    };
+    for (uint8_t c : hdr) {
+        put(c);
+    }
+    for (int i = 0; i < p.size(); i++) {
+        put(p.data()[i]);
+    }
+    return n;
+}
+
+
+// The producer, samples and encodes each due group once per tick and hands the same frames to all
+// links that are due. Runs on the 10 msec clock as long as there are links.
+class TelemetryStream final : public Clock_I
+{
+public:
+    TelemetryStream() : Clock_I(1) {}
+    bool tick() override;
+};
+
+static TelemetryStream theStream;
+
+bool TelemetryStream::tick()
+{
+    struct Due {
+        int      idx;
+        DeviceId did;
+        int      port;
+        int      peer;
+        uint8_t  groups;
+    } due[MAX_LINKS];
+    int ndue = 0;
+    int nlinks = 0;
+    uint8_t need = 0;
+    uint32_t now = Clock::getMillis();
+
+    taskENTER_CRITICAL(&linkLock);
+    for (int i = 0; i < MAX_LINKS; i++) {
+        Link &l = links[i];
+        if ( ! l.prtcl ) {
+            continue;
+        }
+        nlinks++;
+        if ( ! l.groups || (int32_t)(now - l.next) < 0 ) {
+            continue;
+        }
+        // keep the rate, but do not catch up on a stall
+        l.next += l.period;
+        if ( (int32_t)(now - l.next) >= 0 ) {
+            l.next = now + l.period;
+        }
+        uint8_t groups = 0;
+        for (int g = 0; g < TelemetryBin::NUM_GROUPS; g++) {
+            if ( !(l.groups & (1 << g)) ) {
+                continue;
+            }
+            if ( SLOW_MS[g] ) {
+                if ( (int32_t)(now - l.slow_next[g]) < 0 ) {
+                    continue;
+                }
+                l.slow_next[g] = now + SLOW_MS[g];
+            }
+            groups |= 1 << g;
+        }
+        if ( groups ) {
+            due[ndue++] = { i, l.did, l.port, l.peer, groups };
+            need |= groups;
+        }
+    }
+    taskEXIT_CRITICAL(&linkLock);
+
+    if ( nlinks == 0 ) {
+        return true; // the last link is gone, restarted with the next one
+    }
+    if ( ndue == 0 ) {
+        return false;
+    }
+
+    // encode once
+    static uint8_t frames[TelemetryBin::NUM_GROUPS][MAX_FRAME];
+    int flen[TelemetryBin::NUM_GROUPS] = {};
+    for (int g = 0; g < TelemetryBin::NUM_GROUPS; g++) {
+        if ( need & (1 << g) ) {
+            Payload p(now);
+            if ( sample(g, p) ) {
+                flen[g] = frame(frames[g], TelemetryBin::GROUP_TYPE0 + g, group_seq[g]++, p);
+            }
+        }
+    }
+
+    // one message per link with all its due frames
+    for (int i = 0; i < ndue; i++) {
+        Message *msg = DEV::plsMessage(due[i].did, due[i].port);
+        uint32_t bytes = 0, nframes = 0;
+        if ( msg ) {
+            msg->peer = due[i].peer;
+            msg->buffer.clear();
+            for (int g = 0; g < TelemetryBin::NUM_GROUPS; g++) {
+                if ( (due[i].groups & (1 << g)) && flen[g] ) {
+                    msg->buffer.append((const char*)frames[g], flen[g]);
+                    nframes++;
+                }
+            }
+            bytes = msg->buffer.size();
+            DEV::Send(msg);
+        }
+        taskENTER_CRITICAL(&linkLock);
+        Link &l = links[due[i].idx];
+        if ( l.prtcl && l.did == due[i].did && l.peer == due[i].peer ) {
+            l.bytes += bytes;
+            l.frames += nframes;
+            l.drops += msg ? 0 : 1;
+        }
+        taskEXIT_CRITICAL(&linkLock);
+    }
+    return false;
+}
+
+
+TelemetryBin::TelemetryBin(DeviceId did, int sp, ProtocolState &sm, DataLink &dl) :
+    ProtocolItf(did, sp, sm, dl)
+{
+    bool ok = false;
+    taskENTER_CRITICAL(&linkLock);
+    for (Link &l : links) {
+        if ( ! l.prtcl ) {
+            l = Link();
+            l.prtcl = this;
+            l.did = did;
+            l.port = sp;
+            ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&linkLock);
+    if ( ! ok ) {
+        ESP_LOGW(FNAME, "No telemetry link left for dev %d", did);
+        return;
+    }
+    subscribe((1 << NUM_GROUPS) - 1, DEFAULT_RATE);
+    Clock::start(&theStream);
+}
+
+TelemetryBin::~TelemetryBin()
+{
+    taskENTER_CRITICAL(&linkLock);
+    for (Link &l : links) {
+        if ( l.prtcl == this ) {
+            l.prtcl = nullptr;
+        }
+    }
+    taskEXIT_CRITICAL(&linkLock);
+}
+
+// The subscription of the link, or of one client of it
+void TelemetryBin::subscribe(uint8_t groups, int rate_hz, int peer)
+{
+    if ( rate_hz > MAX_RATE ) {
+        rate_hz = MAX_RATE;
+    }
+    uint32_t now = Clock::getMillis();
+    Link *sub = nullptr;
+    bool claim = false;
+    taskENTER_CRITICAL(&linkLock);
+    for (Link &l : links) {
+        if ( l.prtcl == this && l.peer == peer ) {
+            sub = &l;
+            break;
+        }
+    }
+    if ( ! sub && peer >= 0 ) {
+        // the first subscription of a client, it leaves the common stream of the link
+        for (Link &l : links) {
+            if ( ! l.prtcl ) {
+                l = Link();
+                l.prtcl = this;
+                l.did = _did;
+                l.port = _send_port;
+                l.peer = peer;
+                sub = &l;
+                claim = true;
+                break;
+            }
+        }
+    }
+    if ( sub ) {
+        sub->groups = rate_hz > 0 ? (groups & ((1 << NUM_GROUPS) - 1)) : 0;
+        sub->period = rate_hz > 0 ? 1000 / rate_hz : 0;
+        sub->next = now;
+        for (uint32_t &sn : sub->slow_next) {
+            sn = now;
+        }
+    }
+    taskEXIT_CRITICAL(&linkLock);
+    if ( ! sub ) {
+        ESP_LOGW(FNAME, "No telemetry link left for dev %d client %d", _did, peer);
+        return;
+    }
+    if ( claim ) {
+        // an empty message to the client takes it out of the port broadcast, also when stopped
+        Message *msg = newMessage();
+        msg->peer = peer;
+        DEV::Send(msg);
+    }
+    ESP_LOGI(FNAME, "Telemetry dev %d client %d subscribed 0x%x at %dHz", _did, peer, groups, rate_hz);
+}
+
+void TelemetryBin::peerClosed(int peer)
+{
+    taskENTER_CRITICAL(&linkLock);
+    for (Link &l : links) {
+        if ( l.prtcl == this && l.peer == peer && peer >= 0 ) {
+            l.prtcl = nullptr;
+        }
+    }
+    taskEXIT_CRITICAL(&linkLock);
+}
+
+// Parse the frames from the client, only the subscription is known
+dl_control_t TelemetryBin::nextBytes(const char *cptr, int count)
+{
+    // _sm._frame holds the unescaped frame without the start token, _esc flags a pending escape
+    for (int i = 0; i < count; i++) {
+        uint8_t c = cptr[i];
+        if ( c == START ) {
+            // the start token is never escaped, always a new frame
+            _sm.reset();
+            _sm._state = HEADER;
+            continue;
+        }
+        if ( _sm._state == START_TOKEN ) {
+            continue;
+        }
+        if ( c == ESCAPE ) {
+            _sm._esc = ESCAPE;
+            continue;
+        }
+        if ( _sm._esc ) {
+            c = (c == 0x31) ? START : ESCAPE;
+            _sm._esc = 0;
+        }
+        _sm._frame.push_back(c);
+        int n = _sm._frame.size();
+        if ( n == 2 ) {
+            _sm._frame_len = (uint8_t)_sm._frame[0] | ((uint8_t)_sm._frame[1] << 8);
+            if ( _sm._frame_len < HEADER_LEN || _sm._frame_len > MAX_LEN ) {
+                _sm.reset();
+                return dl_control_t(NOACTION, _did, i + 1);
+            }
+        }
+        else if ( n > 2 && n >= _sm._frame_len ) {
+            handleFrame();
+            _sm.reset();
+            return dl_control_t(NOACTION, _did, i + 1); // hand the stream back after the frame
+        }
+    }
+    return dl_control_t(NOACTION, _did, count);
+}
+
+void TelemetryBin::handleFrame()
+{
+    const uint8_t *f = (const uint8_t*)_sm._frame.data();
+    uint16_t crc = NMEA::xmodemCRC(f, 6);
+    crc = NMEA::xmodemCRC(f + HEADER_LEN, _sm._frame_len - HEADER_LEN, crc);
+    if ( crc != (f[6] | (f[7] << 8)) ) {
+        ESP_LOGW(FNAME, "Telemetry crc error");
+        return;
+    }
+    if ( f[5] == SUBSCRIBE && _sm._frame_len >= HEADER_LEN + 2 ) {
+        subscribe(f[HEADER_LEN], f[HEADER_LEN + 1], _dl.getRxPeer());
+    }
+}
+
+void TelemetryBin::statsLog()
+{
+    for (Link &l : links) {
+        taskENTER_CRITICAL(&linkLock);
+        Link st = l;
+        l.bytes = l.frames = l.drops = 0;
+        taskEXIT_CRITICAL(&linkLock);
+        if ( ! st.prtcl ) {
+            continue;
+        }
+        ESP_LOGI(FNAME, "Telemetry dev %d port %d client %d: groups 0x%x at %dms, %u bytes %u frames %u dropped", st.did, st.port, st.peer, st.groups, st.period,
+            (unsigned)st.bytes, (unsigned)st.frames, (unsigned)st.drops);
+    }
+}
@@ -0,0 +1,51 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include "ProtocolItf.h"
+
+#include <cstdint>
+
+// Compact binary telemetry stream for tablet apps, an option next to the NMEA output.
+//
+// Framed like the Flarm BP protocol: start token 0x73, frame length (lsb, msb), version, sequence
+// number (lsb, msb), frame type, crc16 xmodem (lsb, msb) over header and payload, then the payload.
+// 0x73 and 0x78 are escaped with 0x78 0x31 and 0x78 0x55. The length counts all bytes after the
+// start token, before escaping. Payload values are little endian and start with the uint32 msec
+// time stamp of the sample, see telemetry_client.py for the field layout.
+//
+// Every frame is encoded once and the same bytes go to all connected links. A link subscribes to a
+// set of groups and a rate with a SUBSCRIBE frame, until then it gets all groups at 10Hz. A WiFi
+// client that subscribes gets its own stream, keyed by its socket. On a link shared with NMEA the
+// frames in both directions sit between the sentences, the data link routes them by the start token.
+class TelemetryBin final : public ProtocolItf
+{
+public:
+    enum Group : uint8_t { ATTITUDE, VARIO, AIR, WIND, TRAFFIC, FLAP, NUM_GROUPS };
+    static constexpr char START = 0x73;
+    static constexpr uint8_t VERSION = 1;
+    static constexpr uint8_t SUBSCRIBE = 0x40;   // payload: group mask, rate in Hz (0 stops the stream)
+    static constexpr uint8_t GROUP_TYPE0 = 0x41; // frame type of the first group
+    static constexpr int MAX_RATE = 25; // Hz
+    static constexpr int DEFAULT_RATE = 10;
+
+    TelemetryBin(DeviceId did, int sp, ProtocolState &sm, DataLink &dl);
+    virtual ~TelemetryBin();
+
+    ProtocolType getProtocolId() const override { return TELEMETRY_P; }
+    bool isBinary() const override { return true; }
+    dl_control_t nextBytes(const char *cptr, int count) override;
+
+    void subscribe(uint8_t groups, int rate_hz, int peer = -1);
+    void peerClosed(int peer);
+    static void statsLog();
+
+private:
+    void handleFrame();
+};
@@ -6,98 +6,76 @@
  ***       Copyright (C) Rohs Engineering Design         ***
  ***********************************************************/
 
- #include "WatchDog.h"
+#include "WatchDog.h"
+#include "Clock.h"
 
 #include <esp_attr.h>
 #include <cassert>
-#include <mutex>
 
-// Timer isr's
-class WdTimeOut {
-public:
-    static void IRAM_ATTR timeout(WatchDog_C* wd_obj)
-    {
-        wd_obj->_cb->barked();
-    }
-};
+static inline unsigned toTicks(const unsigned int t_ms)
+{
+    return (t_ms + Clock::TICK_ATOM - 1) / Clock::TICK_ATOM;
+}
 
 // Ctor
 WatchDog_C::WatchDog_C(WDBark_I *cb) :
-    _cb(cb)
+    _node(cb)
 {
     assert(cb);
-    esp_timer_create_args_t timer_args = {
-        .callback = (esp_timer_cb_t)WdTimeOut::timeout,
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "watchdog",
-        .skip_unhandled_events = true,
-    };
-    esp_timer_create(&timer_args, &_timer);
 }
 
 // Dtor
 WatchDog_C::~WatchDog_C()
 {
-    esp_timer_stop(_timer);
-    esp_timer_delete(_timer);
-    _timer = nullptr;
+    Clock::stop(&_node);
+}
+
+void WatchDog_C::setTimeout(const unsigned int t)
+{
+    _node.setMultiplier(toTicks(t));
 }
 
 // Start
 void WatchDog_C::start(const unsigned int t_ms)
 {
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    esp_timer_stop(_timer);
-    _timeout = t_ms * 1000;
-    esp_timer_start_once(_timer, _timeout);
+    setTimeout(t_ms);
+    Clock::restart(&_node);
 }
 
 // Re-Start, returns true for a real start of the timer
-// might be called from ISR !
 bool IRAM_ATTR WatchDog_C::restart()
 {
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    bool ret = ! esp_timer_is_active(_timer);
-    esp_timer_stop(_timer);
-    esp_timer_start_once(_timer, _timeout);
+    bool ret = ! Clock::isActive(&_node);
+    Clock::restart(&_node);
     return ret;
 }
 
 // Start in case of not yet startet, returns true when started
 bool WatchDog_C::startCond(const unsigned int t_ms)
 {
-    bool ret = false;
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    if ( ! esp_timer_is_active(_timer) ) {
-        _timeout = t_ms * 1000;
-        esp_timer_start_once(_timer, _timeout);
+    if ( Clock::isActive(&_node) ) {
+        return false;
     }
-    return ret;
+    start(t_ms);
+    return true;
 }
 
 // Pet
 void WatchDog_C::pet()
 {
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    if ( esp_timer_is_active(_timer) ) {
-        esp_timer_stop(_timer);
-        esp_timer_start_once(_timer, _timeout);
+    if ( Clock::isActive(&_node) ) {
+        Clock::restart(&_node);
     }
 }
 
 // Stop
 void WatchDog_C::stop()
 {
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    esp_timer_stop(_timer);
+    Clock::stop(&_node);
 }
 
 // Check
 bool WatchDog_C::isRunning() const
 {
-    std::lock_guard<SemaphoreMutex> lock(_mux);
-    bool ret = esp_timer_is_active(_timer);
-    return ret;
+    return Clock::isActive(&_node);
 }
-
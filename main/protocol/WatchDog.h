@@ -9,15 +9,11 @@
 #pragma once
 
 #include "WatchDogIntf.h"
+#include "ClockIntf.h"
 
-#include <comm/Mutex.h>
-
-#include <esp_timer.h>
 #include <cstdint>
 
-class WdTimeOut; // time out handler
-
-// Watchdog based on esp_timer
+// Watchdog as a one shot receiver on the clock wheel, resolution is one clock tick
 class WatchDog_C
 {
 public:
@@ -31,12 +27,16 @@ public:
     void pet();
     void stop();
     bool isRunning() const;
-    void setTimeout(const unsigned int t) { _timeout = static_cast<uint64_t>(t) * 1000; } // msec
+    void setTimeout(const unsigned int t); // msec
 
 private:
-    friend class WdTimeOut;
-    esp_timer_handle_t _timer;
-    uint64_t _timeout = 1000000;
-    WDBark_I* _cb;
-    mutable SemaphoreMutex _mux;
+    class Node final : public Clock_I
+    {
+    public:
+        explicit Node(WDBark_I *cb) : Clock_I(100), _cb(cb) {}
+        bool tick() override { _cb->barked(); return true; }
+    private:
+        WDBark_I* _cb;
+    };
+    Node _node;
 };
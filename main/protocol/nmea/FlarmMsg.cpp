@@ -167,7 +167,7 @@ dl_action_t FlarmMsg::parsePFLAU(NmeaPlugin *plg)
         ESP_LOGI(FNAME,"FLARM ALARM LEVEL %d", Flarm::AlarmLevel);
         // Send a flarm event to update display
         int evt = ScreenEvent(ScreenEvent::FLARM_ALARM).raw;
-        xQueueSend(uiEventQueue, &evt, 0);
+        uiPostEvent(evt);
     }
 
     if ( !status_ok && Flarm::GPS > 0 && Flarm::TX > 0 ) {
@@ -10,11 +10,14 @@
 #include "Flarm.h"
 #include "wind/CircleWind.h"
 #include "wind/WindCalcTask.h"
+#include "wmm/Declination.h"
 #include "setup/SetupNG.h"
 #include "sensor.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
 #include <cstring>
+#include <cmath>
 #include <time.h>
 #include <sys/time.h>
 
@@ -69,10 +72,11 @@ dl_action_t GpsMsg::parseGPRMC(NmeaPlugin *plg)
     if (BackgroundTaskQueue && Flarm::myGPS_OK) {
 
         // ESP_LOGI(FNAME,"Track: %3.2f, GPRMC: %s", gndCourse, gprmc );
-        circleWind->setNewSample(Vector(Flarm::gndCourse, gndspeed));
-
-        CalkTaskJob job(CalkTaskJob::CALK_TASK_EVENT_NEW_GPSPOSE);
-        xQueueSend(BackgroundTaskQueue, &job, 0);
+        if (circleWind) {
+            circleWind->setNewSample(Vector(Flarm::gndCourse, gndspeed));
+            CalkTaskJob job(CalkTaskJob::CALK_TASK_EVENT_NEW_GPSPOSE);
+            CrashTrace::queue(CrashTrace::QUEUE_SEND, xQueueSend(BackgroundTaskQueue, &job, 0) == pdTRUE);
+        }
         if (/*!Flarm::time_sync &&*/ (valid_time_scan && valid_date_scan))
         {
             ESP_LOGD(FNAME, "Start TimeSync");
@@ -85,6 +89,17 @@ dl_action_t GpsMsg::parseGPRMC(NmeaPlugin *plg)
             // Flarm::time_sync = true; fixme
             ESP_LOGD(FNAME, "Finish Time Sync");
         }
+        if (compass_declination_auto.get() && valid_date_scan) {
+            // ddmm.mmmm -> degree
+            float lat = atof(s + word->at(2));
+            float lon = atof(s + word->at(4));
+            lat = (int)(lat / 100) + std::fmod(lat, 100.f) / 60.f;
+            lon = (int)(lon / 100) + std::fmod(lon, 100.f) / 60.f;
+            if (*(s + word->at(3)) == 'S') { lat = -lat; }
+            if (*(s + word->at(5)) == 'W') { lon = -lon; }
+            float year = 1900.f + t.tm_year + (t.tm_mon - 1) / 12.f + t.tm_mday / 365.f;
+            Declination::newPosition(lat, lon, year);
+        }
     }
     // ESP_LOGI(FNAME,"parseGPRMC() GPS: %d, Speed: %3.1f knots, Track: %3.1f° ", myGPS_OK, gndSpeedKnots, gndCourse );
     return DO_ROUTING;
@@ -128,7 +143,7 @@ dl_action_t GpsMsg::parseGPGGA(NmeaPlugin *plg)
             if (BackgroundTaskQueue) {
                 CalkTaskJob job(CalkTaskJob::CALK_TASK_EVENT_NUMSAT);
                 job.setDetail(numSat);
-                xQueueSend(BackgroundTaskQueue, &job, 0);
+                CrashTrace::queue(CrashTrace::QUEUE_SEND, xQueueSend(BackgroundTaskQueue, &job, 0) == pdTRUE);
             }
         }
     }
@@ -17,7 +17,7 @@
 #include <string>
 
 // update packet counter, assuming there will be only one magsense at a time
-static int Conf_Pack_Nr = 0;
+static volatile int Conf_Pack_Nr = 0; // set by the receiver task, polled by the OTA writer
 
 
 // MagSensMsg NMEA protocol is just a simple one. Those queries are supported:
@@ -151,6 +151,8 @@ bool NmeaPrtcl::prepareUpdate(int len, int pack)
     Message* msg = newMessage();
     msg->buffer = "$PMSU, " + std::to_string(len) + ", " + std::to_string(pack);
     msg->buffer += "*" + NMEA::CheckSum(msg->buffer.c_str()) + "\r\n";
+    // packets are confirmed by number from 1 on
+    Conf_Pack_Nr = 0;
     return DEV::Send(msg);
 }
 
@@ -161,22 +163,15 @@ bool NmeaPrtcl::firmwarePacket(const char *buf, int len)
         msg->buffer.reserve(len);
     }
     msg->buffer.assign(buf, len);
-    // reset confirmation
-    Conf_Pack_Nr = -1;
     return DEV::Send(msg);
 }
 
-int NmeaPrtcl::waitConfirmation()
+int NmeaPrtcl::waitConfirmation(int pack_nr)
 {
-    // block until a confirmation or timeout received
+    // block until packet pack_nr is confirmed or timeout, the later packets may be on the way
     int try_times = 150;
-    do {
+    while ( Conf_Pack_Nr < pack_nr && --try_times > 0 ) {
         vTaskDelay(pdMS_TO_TICKS(10));
-        if ( Conf_Pack_Nr > 0 ) {
-            break;
-        }
     }
-    while ( --try_times > 0 );
-
     return Conf_Pack_Nr;
 }
@@ -87,7 +87,7 @@ dl_action_t XCNavMsg::parseDollar_g(NmeaPlugin *plg)
             ESP_LOGI(FNAME, "Escape");
             event.button = ButtonEvent(ButtonEvent::ESCAPE);
         }
-        xQueueSend(uiEventQueue, &event, 0);
+        uiPostEvent(event.code);
         break;
     }
     case 'w': // nonstandard CAI 302 extension for gear warning enable/disable
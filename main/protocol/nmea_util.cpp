@@ -105,5 +105,23 @@ std::string hexDump(const char *buffer, int len)
     return oss.str();
 }
 
+// CRC-16/XMODEM of the binary protocols, crc0 continues a previous block
+uint16_t xmodemCRC(const uint8_t *data, int length, uint16_t crc0)
+{
+    uint16_t crc = crc0;
+
+    while (length--) {
+        crc ^= (*data++) << 8;  // XOR byte into high byte of CRC
+        
+        for (int i = 0; i < 8; i++) {  // Process each bit
+            if (crc & 0x8000) {
+                crc = (crc << 1) ^ 0x1021;  // XOR with polynomial if MSB is 1
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+    return crc;
+}
 
 } // namespace
\ No newline at end of file
@@ -7,6 +7,7 @@
  ***********************************************************/
 
 #include <string>
+#include <cstdint>
 
 namespace NMEA {
 
@@ -17,5 +18,6 @@ std::string extractWord(const std::string &str, int &pos);
 void incrCRC(int &crc, const char c);
 void ensureTermination(std::string& str);
 std::string hexDump(const char *buffer, int len);
+uint16_t xmodemCRC(const uint8_t *data, int length, uint16_t crc0 = 0);
 
 }
\ No newline at end of file
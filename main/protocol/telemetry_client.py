@@ -0,0 +1,233 @@
+#!/usr/bin/python
+#
+# Reference decoder of the XCVario binary telemetry stream (see Telemetry.h).
+#
+# Connects to the telemetry port and optionally to the NMEA port of the same vario, subscribes to
+# the given groups and rate, and reports the bandwidth of both paths, the frame rates, the jitter of
+# the binary stream and how much earlier a TE change arrives over the binary stream than in $PXCV.
+#
+#   telemetry_client.py --host 192.168.4.1 --groups attitude,vario,air --rate 25 --time 60
+#   telemetry_client.py --file dump.bin    (decode a raw capture)
+
+import argparse
+import select
+import socket
+import statistics
+import struct
+import sys
+import time
+
+START = 0x73
+ESCAPE = 0x78
+HEADER_LEN = 8
+SUBSCRIBE = 0x40
+GROUP_TYPE0 = 0x41
+
+# group name, payload layout after the uint32 time stamp, field names, scales
+GROUPS = [
+    ("attitude", "<hhHh", ("roll", "pitch", "yaw", "accz"), (0.01, 0.01, 0.01, 0.001)),
+    ("vario", "<hhhh", ("te", "netto", "avg_te", "mc"), (0.01, 0.01, 0.01, 0.01)),
+    ("air", "<HHi", ("ias", "tas", "alt"), (0.1, 0.1, 0.01)),
+    ("wind", "<HHHH", ("sdir", "sspeed", "cdir", "cspeed"), (0.1, 0.1, 0.1, 0.1)),
+    ("traffic", "<Bhhi", ("alarm", "bearing", "vertical", "distance"), (1, 1, 1, 1)),
+    ("flap", "<hh", ("position", "optimum"), (0.01, 0.01)),
+]
+
+
+def xmodem_crc(data, crc=0):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+
+def escape(data):
+    out = bytearray()
+    for b in data:
+        if b == START:
+            out += bytes((ESCAPE, 0x31))
+        elif b == ESCAPE:
+            out += bytes((ESCAPE, 0x55))
+        else:
+            out.append(b)
+    return out
+
+
+def build_frame(ftype, payload, seq=0, version=1):
+    length = HEADER_LEN + len(payload)
+    hdr = struct.pack("<HBHB", length, version, seq, ftype)
+    crc = xmodem_crc(hdr + payload)
+    return bytes((START,)) + escape(hdr + struct.pack("<H", crc) + payload)
+
+
+def subscribe_frame(names, rate):
+    mask = 0
+    for n in names:
+        mask |= 1 << [g[0] for g in GROUPS].index(n)
+    return build_frame(SUBSCRIBE, bytes((mask, rate)))
+
+
+class Decoder:
+    """Byte stream to frames, resyncs on the start token"""
+
+    def __init__(self):
+        self.frame = None
+        self.esc = False
+        self.crc_errors = 0
+
+    def feed(self, data):
+        frames = []
+        for b in data:
+            if b == START:
+                self.frame = bytearray()
+                self.esc = False
+                continue
+            if self.frame is None:
+                continue
+            if b == ESCAPE:
+                self.esc = True
+                continue
+            if self.esc:
+                b = START if b == 0x31 else ESCAPE
+                self.esc = False
+            self.frame.append(b)
+            if len(self.frame) >= 2:
+                length = self.frame[0] | (self.frame[1] << 8)
+                if length < HEADER_LEN or length > 128:
+                    self.frame = None
+                elif len(self.frame) == length:
+                    f = self.process(bytes(self.frame))
+                    if f:
+                        frames.append(f)
+                    self.frame = None
+        return frames
+
+    def process(self, f):
+        length, version, seq, ftype, crc = struct.unpack_from("<HBHBH", f)
+        payload = f[HEADER_LEN:]
+        if xmodem_crc(f[:6] + payload) != crc:
+            self.crc_errors += 1
+            return None
+        idx = ftype - GROUP_TYPE0
+        if not 0 <= idx < len(GROUPS) or len(payload) < 4:
+            return None
+        name, fmt, fields, scales = GROUPS[idx]
+        ts = struct.unpack_from("<I", payload)[0]
+        values = struct.unpack_from(fmt, payload, 4)
+        return name, seq, ts, {k: v * s for k, v, s in zip(fields, values, scales)}
+
+
+class Stats:
+    def __init__(self, name):
+        self.name = name
+        self.bytes = 0
+        self.count = {}
+        self.offsets = []  # host receive minus vario time stamp, msec
+
+    def report(self, duration):
+        print("%-8s %7.0f bytes/s" % (self.name, self.bytes / duration))
+        for k, n in sorted(self.count.items()):
+            print("         %-9s %5.1f /s" % (k, n / duration))
+        if len(self.offsets) > 2:
+            base = min(self.offsets)
+            lat = [o - base for o in self.offsets]
+            print("         delay above best case: median %.1f ms, 95%% %.1f ms" %
+                  (statistics.median(lat), sorted(lat)[int(0.95 * len(lat))]))
+
+
+def te_of_pxcv(line):
+    # $PXCV,<te>,...
+    try:
+        return round(float(line.split(",")[1]), 1)
+    except (IndexError, ValueError):
+        return None
+
+
+def run_live(args):
+    names = args.groups.split(",")
+    tlm = socket.create_connection((args.host, args.port))
+    tlm.sendall(subscribe_frame(names, args.rate))
+    socks = [tlm]
+    nmea = None
+    if args.nmea_port:
+        nmea = socket.create_connection((args.host, args.nmea_port))
+        socks.append(nmea)
+
+    dec = Decoder()
+    bin_stats, nmea_stats = Stats("binary"), Stats("nmea")
+    nmea_buf = b""
+    last_bin_te, last_nmea_te = None, None
+    bin_change = {}  # te value -> host time of the change in the binary stream
+    lead = []  # how much earlier the binary stream showed a TE change, msec
+    t0 = time.monotonic()
+    while time.monotonic() - t0 < args.time:
+        ready, _, _ = select.select(socks, [], [], 1.0)
+        now = time.monotonic()
+        now_ms = now * 1000.0
+        for s in ready:
+            data = s.recv(4096)
+            if not data:
+                sys.exit("connection closed")
+            if s is tlm:
+                bin_stats.bytes += len(data)
+                for name, seq, ts, v in dec.feed(data):
+                    bin_stats.count[name] = bin_stats.count.get(name, 0) + 1
+                    bin_stats.offsets.append(now_ms - ts)
+                    if args.verbose:
+                        print(name, seq, ts, v)
+                    if name == "vario":
+                        te = round(v["te"], 1)
+                        if te != last_bin_te:
+                            bin_change.setdefault(te, now)
+                            last_bin_te = te
+            else:
+                nmea_stats.bytes += len(data)
+                nmea_buf += data
+                *lines, nmea_buf = nmea_buf.split(b"\n")
+                for line in lines:
+                    line = line.decode(errors="replace").strip()
+                    tag = line.split(",")[0]
+                    nmea_stats.count[tag] = nmea_stats.count.get(tag, 0) + 1
+                    if tag == "$PXCV":
+                        te = te_of_pxcv(line)
+                        if te is not None and te != last_nmea_te:
+                            if te in bin_change and now - bin_change[te] < 2.0:
+                                lead.append((now - bin_change[te]) * 1000.0)
+                            last_nmea_te = te
+
+    duration = time.monotonic() - t0
+    bin_stats.report(duration)
+    if nmea:
+        nmea_stats.report(duration)
+    if lead:
+        print("TE change seen over binary first by: median %.0f ms (%d changes)" % (statistics.median(lead), len(lead)))
+    if dec.crc_errors:
+        print("crc errors", dec.crc_errors)
+
+
+def run_file(args):
+    dec = Decoder()
+    with open(args.file, "rb") as f:
+        for name, seq, ts, v in dec.feed(f.read()):
+            print(name, seq, ts, v)
+    if dec.crc_errors:
+        print("crc errors", dec.crc_errors)
+
+
+if __name__ == "__main__":
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--host", default="192.168.4.1")
+    ap.add_argument("--port", type=int, default=8885, help="telemetry port")
+    ap.add_argument("--nmea-port", type=int, default=8880, help="0 to skip the NMEA comparison")
+    ap.add_argument("--groups", default=",".join(g[0] for g in GROUPS))
+    ap.add_argument("--rate", type=int, default=25)
+    ap.add_argument("--time", type=float, default=30)
+    ap.add_argument("--file", help="decode a raw capture instead")
+    ap.add_argument("-v", "--verbose", action="store_true")
+    args = ap.parse_args()
+    if args.file:
+        run_file(args)
+    else:
+        run_live(args)
@@ -261,6 +261,6 @@ void BootUpScreen::animate()
 bool BootUpScreen::tick()
 {
     int evt = ScreenEvent(ScreenEvent::BOOT_SCREEN).raw;
-    xQueueSend(uiEventQueue, &evt, 0);
+    uiPostEvent(evt);
     return false;
 }
@@ -29,12 +29,118 @@
 #include "Flarm.h"
 #include "sensor.h"
 #include "protocol/WatchDog.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
+#include <esp_timer.h>
+
+#include <atomic>
+
 
 // The context to serialize all display access.
 QueueHandle_t uiEventQueue = nullptr;
 
+// Coalesced redraw requests, one bit per screen event detail
+static std::atomic<uint32_t> pendingRedraw{0};
+static uint32_t redrawStamp = 0; // post time of the oldest pending redraw
+
+constexpr uint32_t COALESCED = (1 << ScreenEvent::MAIN_SCREEN) | (1 << ScreenEvent::MSG_BOX) | (1 << ScreenEvent::BOOT_SCREEN);
+
+// Dispatch age statistics
+enum { STAT_INPUT, STAT_ONESHOT, STAT_REDRAW, STAT_NUM };
+static struct {
+    uint32_t count;
+    uint32_t age_sum;
+    uint32_t age_max;
+} ageStats[STAT_NUM];
+
+static inline uint32_t IRAM_ATTR uiMillis()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void createUiEventQueue()
+{
+    uiEventQueue = xQueueCreate(10, sizeof(UiQueueItem));
+}
+
+static inline bool IRAM_ATTR isCoalesced(uint32_t code)
+{
+    return (code & EVT_SCREEN) && (code & 0xff) < 32 && (COALESCED & (1 << (code & 0xff)));
+}
+
+bool uiPostEvent(uint32_t code)
+{
+    UiQueueItem item = { code, uiMillis() };
+    if ( isCoalesced(code) ) {
+        if ( pendingRedraw.fetch_or(1 << (code & 0xff)) != 0 ) {
+            return true; // merged into the pending redraw
+        }
+        redrawStamp = item.stamp;
+        item.code = ScreenEvent(ScreenEvent::REDRAW).raw; // wake up the ui loop
+    }
+    bool ok = xQueueSend(uiEventQueue, &item, 0) == pdTRUE;
+    CrashTrace::queue(CrashTrace::QUEUE_SEND, ok);
+    return ok;
+}
+
+bool IRAM_ATTR uiPostEventFromISR(uint32_t code, BaseType_t *wakeup)
+{
+    UiQueueItem item = { code, uiMillis() };
+    return xQueueSendFromISR(uiEventQueue, &item, wakeup) == pdTRUE;
+}
+
+static void accountAge(int cls, uint32_t stamp)
+{
+    uint32_t age = uiMillis() - stamp;
+    ageStats[cls].count++;
+    ageStats[cls].age_sum += age;
+    if ( age > ageStats[cls].age_max ) {
+        ageStats[cls].age_max = age;
+    }
+}
+
+void uiEventStatsLog()
+{
+    static const char *names[STAT_NUM] = { "input", "oneshot", "redraw" };
+    for (int i = 0; i < STAT_NUM; i++) {
+        if ( ageStats[i].count ) {
+            ESP_LOGI(FNAME, "UI %s events: %d, age avg %dms max %dms", names[i], (int)ageStats[i].count,
+                (int)(ageStats[i].age_sum / ageStats[i].count), (int)ageStats[i].age_max);
+        }
+        ageStats[i] = {};
+    }
+}
+
+// time triggered screen updates, merged
+static void redraw(uint32_t dirty)
+{
+    if ( dirty & (1 << ScreenEvent::MAIN_SCREEN) ) {
+        if (!gflags.inSetup) {
+            switch (MenuRoot->getActiveScreen()) {
+                case SCREEN_VARIO:
+                    Display->drawDisplay(te_vario.get(), aTE, polar_sink, s2f_delta, as2f);
+                    break;
+                case SCREEN_GMETER:
+                    Display->drawLoadDisplay( IMU::getGliderAccelZ() );
+                    break;
+                case SCREEN_HORIZON:
+                    HorizonPage::HORIZON()->draw( IMU::getAHRSQuaternion() );
+                    break;
+            }
+        }
+    }
+    if ( dirty & (1 << ScreenEvent::MSG_BOX) ) {
+        if (MBOX->draw()) { // time triggered mbox update
+            // mbox finish, time to refresh the bottom line of the screen
+            Display->setBottomDirty();
+        }
+    }
+    if ( dirty & (1 << ScreenEvent::BOOT_SCREEN) ) {
+        BootUpScreen::draw(); // time triggered boot screen update
+    }
+}
+
 
 void UiEventLoop(void *arg)
 {
@@ -44,18 +150,22 @@ void UiEventLoop(void *arg)
     bool gear_warning_active = false;
 
     xQueueReset(uiEventQueue);
+    pendingRedraw = 0;
 
     while (1)
     {
-        // handle button events in this context
-        int eparam;
-        if (xQueueReceive(uiEventQueue, &eparam, pdMS_TO_TICKS(20)) == pdTRUE)
+        // handle button events in this context, a pending redraw waits for an empty queue
+        UiQueueItem item;
+        bool redraw_pending = pendingRedraw.load() != 0;
+        if (xQueueReceive(uiEventQueue, &item, pdMS_TO_TICKS(redraw_pending ? 0 : 20)) == pdTRUE)
         {
-            UiEvent event(eparam);
+            CrashTrace::queue(CrashTrace::QUEUE_RECV, true);
+            UiEvent event(item.code);
             uint8_t detail = event.getUDetail();
-            ESP_LOGI(FNAME, "Event (%d) param %x", uxQueueMessagesWaiting(uiEventQueue), eparam);
+            ESP_LOGI(FNAME, "Event (%d) param %x", uxQueueMessagesWaiting(uiEventQueue), (unsigned)item.code);
             if (event.isButtonEvent())
             {
+                accountAge(STAT_INPUT, item.stamp);
                 // ESP_LOGI(FNAME, "Button event %x", detail);
                 if (detail == ButtonEvent::SHORT_PRESS) {
                     knob.sendPress();
@@ -74,6 +184,7 @@ void UiEventLoop(void *arg)
                 }
             }
             else if (event.isRotaryEvent()) {
+                accountAge(STAT_INPUT, item.stamp);
                 // ESP_LOGI(FNAME, "Rotation step %d", event.getSDetail());
                 knob.sendRot(event.getSDetail());
                 if (uiMonitor) {
@@ -82,26 +193,10 @@ void UiEventLoop(void *arg)
             }
             else if (event.isScreenEvent()) {
                 // ESP_LOGI(FNAME, "Screen event %d", detail);
-                if (detail == ScreenEvent::MAIN_SCREEN) {
-                    if (!gflags.inSetup) {
-                        switch (MenuRoot->getActiveScreen()) {
-                            case SCREEN_VARIO:
-                                Display->drawDisplay(te_vario.get(), aTE, polar_sink, s2f_delta, as2f);
-                                break;
-                            case SCREEN_GMETER:
-                                Display->drawLoadDisplay( IMU::getGliderAccelZ() );
-                                break;
-                            case SCREEN_HORIZON:
-                                HorizonPage::HORIZON()->draw( IMU::getAHRSQuaternion() );
-                                break;
-                        }
-                    }
-                } else if (detail == ScreenEvent::MSG_BOX) {
-                    if (MBOX->draw()) { // time triggered mbox update
-                        // mbox finish, time to refresh the bottom line of the screen
-                        Display->setBottomDirty();
-                    }
+                if (detail == ScreenEvent::REDRAW) {
+                    // nothing, the coalesced redraw is served as soon as the queue is empty
                 } else if ( detail == ScreenEvent::FLARM_ALARM ) {
+                    accountAge(STAT_ONESHOT, item.stamp);
                     if ( ! FLARMSCREEN ) {
                         ESP_LOGI(FNAME,"Flarm::alarmLevel: %d, flarm_warning.get() %d", Flarm::alarmLevel(), flarm_warning.get() );
                         MenuRoot->push(FlarmScreen::create());
@@ -112,23 +207,25 @@ void UiEventLoop(void *arg)
                         // classify flarm as ui interaction, because flarm screen could have been pushed on top of the UI stack
                         uiMonitor->pet();
                     }
-                } else if ( detail == ScreenEvent::FLARM_ALARM_TIMEOUT ) {
-                    if ( FLARMSCREEN ) {
-                        FLARMSCREEN->remove();
+                } else {
+                    accountAge(STAT_ONESHOT, item.stamp);
+                    if ( detail == ScreenEvent::FLARM_ALARM_TIMEOUT ) {
+                        if ( FLARMSCREEN ) {
+                            FLARMSCREEN->remove();
+                        }
+                    } else if (detail == ScreenEvent::QNH_ADJUST) {
+                        MenuRoot->begin(SetupMenu::createQNHMenu());
+                    } else if (detail == ScreenEvent::BALLAST_CONFIRM) {
+                        MenuRoot->begin(SetupMenu::createBallastMenu());
+                    } else if (detail == ScreenEvent::VOLT_ADJUST) {
+                        MenuRoot->begin(SetupMenu::createVoltmeterAdjustMenu());
+                    } else if (detail == ScreenEvent::POLAR_CONFIG) {
+                        MenuRoot->begin(createGliderSelectMenu());
                     }
-                } else if (detail == ScreenEvent::BOOT_SCREEN) {
-                    BootUpScreen::draw(); // time triggered boot screen update
-                } else if (detail == ScreenEvent::QNH_ADJUST) {
-                    MenuRoot->begin(SetupMenu::createQNHMenu());
-                } else if (detail == ScreenEvent::BALLAST_CONFIRM) {
-                    MenuRoot->begin(SetupMenu::createBallastMenu());
-                } else if (detail == ScreenEvent::VOLT_ADJUST) {
-                    MenuRoot->begin(SetupMenu::createVoltmeterAdjustMenu());
-                } else if (detail == ScreenEvent::POLAR_CONFIG) {
-                    MenuRoot->begin(createGliderSelectMenu());
                 }
             }
             else if (event.isModeEvent()) {
+                accountAge(STAT_ONESHOT, item.stamp);
                 if (detail == ModeEvent::MODE_TOGGLE) {
                     VCMode.setCMode(!VCMode.getCMode());
                 }
@@ -140,6 +237,12 @@ void UiEventLoop(void *arg)
                 // ESP_LOGI(FNAME, "Unknown event %x", event);
             }
         }
+        else if ( redraw_pending ) {
+            uint32_t stamp = redrawStamp;
+            uint32_t dirty = pendingRedraw.exchange(0);
+            accountAge(STAT_REDRAW, stamp);
+            redraw(dirty);
+        }
 
         if ( ! BootUpScreen::isActive() )
         {
@@ -11,7 +11,26 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 
+#include <cstdint>
+
+// The ui queue element, event code plus post time stamp [ms]
+struct UiQueueItem
+{
+    uint32_t code;
+    uint32_t stamp;
+};
 
 // Everything is pumping events into this queue to update the screens
 extern QueueHandle_t uiEventQueue;
-void UiEventLoop(void *arg);
\ No newline at end of file
+void createUiEventQueue();
+
+// Post an event to the ui context. Time triggered redraws (main screen, message box, boot screen) are
+// coalesced into one pending redraw with merged dirty flags, that is only served once all queued
+// input and alarm events got dispatched.
+bool uiPostEvent(uint32_t code);
+bool uiPostEventFromISR(uint32_t code, BaseType_t *wakeup);
+
+// Event age at dispatch, logged and reset on each call
+void uiEventStatsLog();
+
+void UiEventLoop(void *arg);
@@ -191,5 +191,5 @@ void FlarmScreen::barked()
     // timeout
     int exitWarn = ScreenEvent(ScreenEvent::FLARM_ALARM_TIMEOUT).raw;
     // Route this event to the DrawDisplay context
-    xQueueSend(uiEventQueue, &exitWarn, 0);
+    uiPostEvent(exitWarn);
 }
\ No newline at end of file
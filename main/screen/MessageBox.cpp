@@ -201,7 +201,7 @@ bool MessageBox::draw()
 bool MessageBox::tick()
 {
     int evt = ScreenEvent(ScreenEvent::MSG_BOX).raw;
-    xQueueSend(uiEventQueue, &evt, 0);
+    uiPostEvent(evt);
     return false;
 }
 
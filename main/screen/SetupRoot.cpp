@@ -54,7 +54,7 @@ void SetupRoot::display(int mode)
 void SetupRoot::barked()
 {
     int exitMenu = ButtonEvent(ButtonEvent::ESCAPE).raw;
-    xQueueSend(uiEventQueue, &exitMenu, 0);
+    uiPostEvent(exitMenu);
 }
 
 void SetupRoot::initScreens()
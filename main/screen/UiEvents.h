@@ -57,7 +57,8 @@ struct ScreenEvent
         VOLT_ADJUST,
         POLAR_CONFIG,
         QNH_ADJUST,
-        BALLAST_CONFIRM };
+        BALLAST_CONFIRM,
+        REDRAW }; // wake-up token for coalesced redraws
 
     uint32_t raw;
     ScreenEvent() = delete;
@@ -152,16 +152,18 @@ void Altimeter::draw(float alt_m)
         _last_quant = used_quant;
         MYUCG->setColor(COLOR_BLACK);
         MYUCG->drawBox(_ref_x - 2 * _char_width, _ref_y - _char_height * 1.5, 2 * _char_width, _char_height * 2);
+        _lead.invalidate();
+    }
+    if (_dirty) {
+        _lead.invalidate();
     }
     MYUCG->setFont(ucg_font_fub25_hr, true);
-    MYUCG->setColor(COLOR_WHITE);
-    
+
     if (!used_quant)
     {
-        // Plain plot of altitude for m and ft
+        // Plain plot of altitude for m and ft, the changed digits only
         sprintf(s, "  %d", alt);
-        MYUCG->setPrintPos(_ref_x - MYUCG->getStrWidth(s), _ref_y);
-        MYUCG->print(s);
+        _lead.draw(_ref_x - MYUCG->getStrWidth(s), _ref_y, s, COLOR_WHITE);
     }
     else
     {
@@ -180,14 +182,32 @@ void Altimeter::draw(float alt_m)
         int alt_leadpart = alt / (mod * 10);           // left remaining part of altitude
         s[len - nr_rolling_digits] = '\0';
         len -= nr_rolling_digits; // chop nr_rolling_digits digits
-        if (std::abs(fraction - fraction_prev) > 0.01 || _dirty)
+        int base = mod / 10;
+        int lastdigit = alt % mod;
+        int16_t xp = _ref_x - nr_rolling_digits * _char_width;
+
+        // Roll leading digit independant of quant setting in 2 * (mod/10) range
+        int rollover = ((int)(alt_f) % mod) / base;
+        bool lead_rolls = (rollover < 1 && alt_leadpart != 0) || (rollover > 8); // [9.1,..,0.9]: roll-over needs clarification on leading digit
+        if (lead_rolls)
+        {
+            s[len - 1] = '\0';
+            len--; // chop another digits
+        }
+
+        // The static digits first, they blank the cell of a leading digit starting to roll
+        uint32_t px = _lead.pixels();
+        _lead.draw(xp - lead_rolls * _char_width - MYUCG->getStrWidth(s), _ref_y, s, COLOR_WHITE);
+        int budget = ROLL_BUDGET - (int)(_lead.pixels() - px);
+
+        // The rolling digits redraw when they moved by a pixel and fit into what is left of the budget,
+        // or when they were put off the frame before
+        int16_t m = sign * ((1.f - fraction) * _char_height - _char_height / 2); // to pixel offest
+        int cost = _char_width * nr_rolling_digits * _char_height * 1.8f;
+        if ((m != _roll_prev || _dirty) && (cost <= budget || _roll_late || _dirty))
         {
             // move last used_quant digit(s)
-            int base = mod / 10;
-            int lastdigit = alt % mod;
-            int16_t m = sign * ((1.f - fraction) * _char_height - _char_height / 2); // to pixel offest
             // ESP_LOGI(FNAME,"Last %f/%d: %f m%d .%d", altitude, alt, fraction, m, lastdigit);
-            int16_t xp = _ref_x - nr_rolling_digits * _char_width;
             // MYUCG->drawFrame(xp-1, _ref_y - _char_height* 1.35 -1, _char_width*nr_rolling_digits, _char_height*1.8 +1); // checker box
             MYUCG->setClipRange(xp, _ref_y - _char_height * 1.35, _char_width * nr_rolling_digits - 1, _char_height * 1.8); // space to get 2 digits displayed uncut
             MYUCG->setPrintPos(xp, _ref_y - m - _char_height);
@@ -204,21 +224,27 @@ void Altimeter::draw(float alt_m)
             sprintf(tmp, "%0*u", nr_rolling_digits, abs((lastdigit + mod - (sign * used_quant)) % mod));
             // ESP_LOGI(FNAME,"tmp2 %s ld: %d rd:%d s:%d aq:%d las:%d ", tmp, (lastdigit-(sign*used_quant))%mod, nr_rolling_digits, sign, used_quant, lastdigit );
             MYUCG->print(tmp); // one below
-            fraction_prev = fraction;
             MYUCG->undoClipRange();
+            _roll_prev = m;
+            _roll_late = false;
+            budget -= cost;
+        }
+        else if (m != _roll_prev)
+        {
+            _roll_late = true;
+        }
 
-            // Roll leading digit independant of quant setting in 2 * (mod/10) range
+        if (lead_rolls)
+        {
+            // Re-Quantized leading altitude part
             int lead_quant = 2 * base; // eg. 2 for Q=1 and Q=5
-            int rollover = ((int)(alt_f) % mod) / base;
-            if ((rollover < 1 && alt_leadpart != 0) || (rollover > 8) || _dirty)
-            { // [9.1,..,0.9]: roll-over needs clarification on leading digit
-                // Re-Quantized leading altitude part
-                fraction = (float)((int)((alt_f + base) * 10) % (mod * 10)) / (lead_quant * 10);
-                int16_t m = sign * fraction * _char_height; // to pixel offest
-                int lead_digit = ((alt + lead_quant) / mod) % 10;
-                // ESP_LOGI(FNAME,"Lead %f/%d: %f - %f m%d %d.", altitude, alt_leadpart, fraction, m, lead_digit);
-                nr_rolling_digits++; // one less digit remains to print
-                xp -= _char_width;   // one to the left
+            fraction = (float)((int)((alt_f + base) * 10) % (mod * 10)) / (lead_quant * 10);
+            int16_t m = sign * fraction * _char_height; // to pixel offest
+            int lead_digit = ((alt + lead_quant) / mod) % 10;
+            // ESP_LOGI(FNAME,"Lead %f/%d: %f - %f m%d %d.", altitude, alt_leadpart, fraction, m, lead_digit);
+            xp -= _char_width;   // one to the left
+            if ((m != _lead_prev || _dirty) && (_char_width * _char_height <= budget || _lead_prev == INT16_MIN || _dirty))
+            {
                 // MYUCG->drawFrame(xp-1, _ref_y - _char_height-1, _char_width+1, _char_height+1);
                 MYUCG->setClipRange(xp, _ref_y - _char_height, _char_width - 1, _char_height - 1);
                 MYUCG->setPrintPos(xp, _ref_y + m - _char_height);
@@ -227,16 +253,12 @@ void Altimeter::draw(float alt_m)
                 MYUCG->print((lead_digit + 9) % 10);
                 MYUCG->undoClipRange();
                 // ESP_LOGI(FNAME,"ld4: %d", (lead_digit+9)%10 );
-                s[len - 1] = '\0';
-                len--; // chop another digits
+                _lead_prev = m;
             }
         }
-        MYUCG->setPrintPos(_ref_x - MYUCG->getStrWidth(s) - nr_rolling_digits * _char_width, _ref_y);
-        if (strcmp(altpart_prev_s, s) != 0 || _dirty)
+        else
         {
-            MYUCG->print(s);
-            // ESP_LOGI(FNAME,"s5: %s", s );
-            strcpy(altpart_prev_s, s);
+            _lead_prev = INT16_MIN;
         }
     }
     _dirty = false;
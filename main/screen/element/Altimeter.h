@@ -9,6 +9,7 @@
 #pragma once
 
 #include "ScreenElement.h"
+#include "NumberField.h"
 
 #include <cstdint>
 
@@ -16,6 +17,7 @@
 class Altimeter : public ScreenElement
 {
 public:
+    static constexpr int ROLL_BUDGET = 4000; // pixels per draw for the digits that changed and the rolling ones
     Altimeter(int16_t cx, int16_t cy);
     // API
     using AltitudeDisplay = enum { MODE_QNH, MODE_QFE };
@@ -35,6 +37,8 @@ private: // attributes
 	int16_t _char_height;
     int16_t _quant = 0;
     uint8_t _last_quant = 0;
-    float fraction_prev = 1.;
-    char altpart_prev_s[32] = "";
+    int16_t _roll_prev = INT16_MIN; // pixel offset of the rolling digits on screen
+    int16_t _lead_prev = INT16_MIN; // of the rolling leading digit, min when it does not roll
+    bool _roll_late = false;        // the rolling digits moved but did not fit into the budget
+    NumberField _lead; // the digits left of the rolling ones
 };
\ No newline at end of file
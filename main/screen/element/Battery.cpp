@@ -42,6 +42,12 @@ void Battery::blank()
 }
 
 
+// below red every draw toggles between blank and the gauge
+bool Battery::blinking(float volt) const
+{
+    return volt < bat_red_volt.get();
+}
+
 void Battery::draw(float volt)
 {
 	if ( volt < bat_red_volt.get() && ! _dirty ) {
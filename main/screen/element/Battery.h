@@ -20,6 +20,7 @@ public:
     void setThresholds();
     void blank();
     void draw(float mc);
+    bool blinking(float volt) const;
 
     // attributes
 private:
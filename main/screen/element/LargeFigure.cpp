@@ -43,14 +43,16 @@ void LargeFigure::draw(float val) {
             sprintf(s, "%d.", abs(ival) / 10);
         }
         int16_t tmp = MYUCG->getStrWidth(s)/2;
+        if (_dirty) {
+            _field.invalidate();
+        }
         if (val < 0.f) {
-            MYUCG->setColor(COLOR_BBLUE);
+            _field.draw(_ref_x - tmp, _ref_y, s, COLOR_BBLUE);
         } else {
-            MYUCG->setColor(COLOR_WHITE);
+            _field.draw(_ref_x - tmp, _ref_y, s, COLOR_WHITE);
         }
-        MYUCG->setPrintPos(_ref_x - tmp, _ref_y);
-        MYUCG->print(s);
         _value = ival;
+        _dirty = false;
         MYUCG->setFontPosBottom();
     }
 }
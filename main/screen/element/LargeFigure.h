@@ -9,6 +9,7 @@
 #pragma once
 
 #include "ScreenElement.h"
+#include "NumberField.h"
 
 // a related prominent figure to the gauge visual indicator
 class LargeFigure : public ScreenElement
@@ -19,4 +20,5 @@ public:
     void draw(float a);
 private:
     int16_t _value = 0;
+    NumberField _field;
 };
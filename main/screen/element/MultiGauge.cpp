@@ -70,7 +70,6 @@ void MultiGauge::draw()
     if (val_prev == val && ! _dirty) return;
     ESP_LOGI(FNAME, "draw val %d (old: %d)", val, val_prev);
 
-    MYUCG->setColor(COLOR_WHITE);
     MYUCG->setFont(ucg_font_fub25_hn, true);
 
     char s[32];
@@ -84,8 +83,10 @@ void MultiGauge::draw()
             strcpy(s, "---");
         }
     }
-    MYUCG->setPrintPos(_ref_x - MYUCG->getStrWidth(s), _ref_y);
-    MYUCG->print(s);
+    if ( _dirty ) {
+        _field.invalidate();
+    }
+    _field.draw(_ref_x - MYUCG->getStrWidth(s), _ref_y, s, COLOR_WHITE);
 
     val_prev = val;
     _dirty = false;
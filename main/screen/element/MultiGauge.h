@@ -9,6 +9,7 @@
 #pragma once
 
 #include "ScreenElement.h"
+#include "NumberField.h"
 
 template <typename T>
 class SetupNG;
@@ -33,4 +34,5 @@ private:
     MultiDisplay _display = GAUGE_NONE;
     SetupNG<float> *_nvsvar = nullptr;
     int val_prev = -1;
+    NumberField _field;
 };
\ No newline at end of file
@@ -0,0 +1,166 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "NumberField.h"
+
+#include "Colors.h"
+#include "AdaptUGC.h"
+
+#include <algorithm>
+#include <cstring>
+
+extern AdaptUGC *MYUCG;
+
+
+void NumberField::draw(int16_t x, int16_t y, const char *s, uint8_t r, uint8_t g, uint8_t b)
+{
+    int16_t top, rows;
+    MYUCG->getTextCell(top, rows);
+
+    // the new layout
+    char ns[MAX_CHARS + 1];
+    int16_t nx[MAX_CHARS + 1];
+    int len = std::min((int)strlen(s), MAX_CHARS);
+    nx[0] = x;
+    for (int i = 0; i < len; i++) {
+        char c[2] = { s[i], '\0' };
+        ns[i] = s[i];
+        nx[i + 1] = nx[i] + MYUCG->getStrWidth(c);
+    }
+    ns[len] = '\0';
+    _full_pixels += (nx[len] - x) * rows;
+
+    bool same_row = _len && y == _y && top == _top && rows == _rows;
+    bool same_color = _rgb[0] == r && _rgb[1] == g && _rgb[2] == b;
+
+    // blank the former string where the new one does not go
+    if ( _len ) {
+        MYUCG->setColor(COLOR_BLACK);
+        if ( ! same_row ) {
+            MYUCG->drawBox(_x[0], _y + _top, _x[_len] - _x[0], _rows);
+            _pixels += (_x[_len] - _x[0]) * _rows;
+        }
+        else {
+            if ( _x[0] < nx[0] ) {
+                int16_t w = std::min(nx[0], _x[_len]) - _x[0];
+                MYUCG->drawBox(_x[0], y + top, w, rows);
+                _pixels += w * rows;
+            }
+            if ( _x[_len] > nx[len] ) {
+                int16_t from = std::max(nx[len], _x[0]);
+                MYUCG->drawBox(from, y + top, _x[_len] - from, rows);
+                _pixels += (_x[_len] - from) * rows;
+            }
+        }
+    }
+
+    // a cell is kept when the former string had the same character at the same place
+    bool keep[MAX_CHARS] = {};
+    if ( _valid && same_row && same_color ) {
+        for (int i = 0, j = 0; i < len; i++) {
+            while ( j < _len && _x[j] < nx[i] ) {
+                j++;
+            }
+            keep[i] = j < _len && _x[j] == nx[i] && _x[j + 1] == nx[i + 1] && _s[j] == ns[i];
+        }
+    }
+
+    // the changed cells, neighbours go out as one string
+    MYUCG->setColor(r, g, b);
+    for (int i = 0; i < len; ) {
+        if ( keep[i] ) {
+            i++;
+            continue;
+        }
+        int k = i + 1;
+        while ( k < len && ! keep[k] ) {
+            k++;
+        }
+        char run[MAX_CHARS + 1];
+        memcpy(run, ns + i, k - i);
+        run[k - i] = '\0';
+        MYUCG->setPrintPos(nx[i], y);
+        MYUCG->print(run);
+        _pixels += (nx[k] - nx[i]) * rows;
+        i = k;
+    }
+
+    memcpy(_s, ns, len + 1);
+    memcpy(_x, nx, (len + 1) * sizeof(int16_t));
+    _len = len;
+    _y = y;
+    _top = top;
+    _rows = rows;
+    _rgb[0] = r;
+    _rgb[1] = g;
+    _rgb[2] = b;
+    _valid = true;
+}
+
+
+#ifdef NumberField_Test
+#include "logdef.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Replays 20 min of a synthetic cross country flight at 10 Hz through the figures of the vario screen,
+// altitude, airspeed and the large vario figure, each drawn when its string changes. Thermals with
+// 2.5 m/s for 3 min alternate with glides at -1.2 m/s for 2 min, noise on all values. Logs the pixels
+// per second sent and what a repaint of the whole strings would have sent.
+void NumberField::replay_test()
+{
+    NumberField alt, ias, var;
+    char s_alt[16] = "", s_ias[16] = "", s_var[16] = "";
+    float h = 1200.f, te = 0.f;
+    srand(42);
+    const int steps = 20 * 60 * 10;
+    for (int t = 0; t < steps; t++) {
+        float phase = fmodf(t / 10.f, 300.f);
+        bool thermal = phase < 180.f;
+        float noise = (rand() % 1000 - 500) / 500.f;
+        float climb = (thermal ? 2.5f : -1.2f) + noise;
+        h += climb / 10.f;
+        te += (climb - te) * 0.2f;
+        float speed = (thermal ? 85.f : 130.f) + 3.f * (rand() % 1000 - 500) / 500.f;
+
+        char s[16];
+        sprintf(s, "  %d", (int)std::lround(h));
+        if ( strcmp(s, s_alt) ) {
+            strcpy(s_alt, s);
+            MYUCG->setFont(ucg_font_fub25_hr, true);
+            alt.draw(200 - MYUCG->getStrWidth(s), 220, s, COLOR_WHITE);
+        }
+        sprintf(s, "  %3d", (int)std::lround(speed));
+        if ( strcmp(s, s_ias) ) {
+            strcpy(s_ias, s);
+            MYUCG->setFont(ucg_font_fub25_hn, true);
+            ias.draw(200 - MYUCG->getStrWidth(s), 80, s, COLOR_WHITE);
+        }
+        sprintf(s, "%2.1f", std::abs(te));
+        if ( strcmp(s, s_var) ) {
+            strcpy(s_var, s);
+            MYUCG->setFont(ucg_font_fub35_hn, false);
+            MYUCG->setFontPosCenter();
+            if ( te < 0.f ) {
+                var.draw(110 - MYUCG->getStrWidth(s) / 2, 150, s, COLOR_BBLUE);
+            }
+            else {
+                var.draw(110 - MYUCG->getStrWidth(s) / 2, 150, s, COLOR_WHITE);
+            }
+            MYUCG->setFontPosBottom();
+        }
+    }
+    const NumberField *f[] = { &alt, &ias, &var };
+    const char *name[] = { "altitude", "airspeed", "vario" };
+    for (int i = 0; i < 3; i++) {
+        ESP_LOGI(FNAME, "%-8s: %6lu px/s digit diff, %6lu px/s whole string", name[i],
+            (unsigned long)(f[i]->pixels() * 10 / steps), (unsigned long)(f[i]->fullPixels() * 10 / steps));
+    }
+}
+#endif
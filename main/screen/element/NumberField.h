@@ -0,0 +1,45 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+// A number on the screen that repaints only the character cells that changed since its last draw.
+//
+// The cells are laid out by the glyph advance of the current font. A cell is skipped when the former
+// string had the same character at the same place, so with the tabular digits of the fonts a figure
+// going from 1234 to 1235 sends one glyph. Font, origin and color have to be set the same way on each
+// draw, a color change repaints all. What the former string covered outside the new one is blanked.
+class NumberField
+{
+public:
+    static constexpr int MAX_CHARS = 15;
+
+    // s at print position x,y in the current font
+    void draw(int16_t x, int16_t y, const char *s, uint8_t r, uint8_t g, uint8_t b);
+    void invalidate() { _valid = false; } // repaint all cells on the next draw
+    uint32_t pixels() const { return _pixels; } // pixels sent so far
+    uint32_t fullPixels() const { return _full_pixels; } // what repainting the whole strings would have sent
+
+#ifdef NumberField_Test
+    static void replay_test();
+#endif
+
+private:
+    char    _s[MAX_CHARS + 1] = "";
+    int16_t _x[MAX_CHARS + 1] = {}; // cell start positions, _x[_len] the end of the last cell
+    int     _len = 0;
+    int16_t _y = 0;
+    int16_t _top = 0;
+    int16_t _rows = 0;
+    uint8_t _rgb[3] = {};
+    bool    _valid = false;
+    uint32_t _pixels = 0;
+    uint32_t _full_pixels = 0;
+};
@@ -0,0 +1,96 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "RedrawScheduler.h"
+#include "ScreenElement.h"
+
+#include "logdef.h"
+
+#include <esp_timer.h>
+
+#include <cmath>
+
+void RedrawScheduler::beginFrame()
+{
+    int64_t now = esp_timer_get_time();
+    if ( _frame_start ) {
+        // half the last frame distance is the tolerance on a period, so a slot stamped at the
+        // frame start does not miss its frame on jitter
+        _half_frame_ms = (uint32_t)((now - _frame_start) / 2000);
+    }
+    _frame_start = now;
+}
+
+bool RedrawScheduler::due(RenderSlot &s, float value, float value2)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t now_ms = (uint32_t)(now / 1000);
+    if ( s.period ) {
+        uint32_t age = now_ms - s.last_ms;
+        if ( age + _half_frame_ms < s.period ) {
+            return false;
+        }
+        if ( s.thresh > 0.f && std::fabs(value - s.last_val) < s.thresh && std::fabs(value2 - s.last_val2) < s.thresh
+            && age < 8u * s.period ) {
+            return false;
+        }
+        if ( age < 2u * s.period && (now - _frame_start) + s.avg_us > _budget_us ) {
+            s.skipped++;
+            return false;
+        }
+    }
+    _slot_start = now;
+    _pending_val = value;
+    _pending_val2 = value2;
+    return true;
+}
+
+bool RedrawScheduler::due(ScreenElement &e, float value, float value2)
+{
+    if ( e._dirty ) {
+        // forced redraw, not rate limited
+        _slot_start = esp_timer_get_time();
+        _pending_val = value;
+        _pending_val2 = value2;
+        return true;
+    }
+    return due(e._slot, value, value2);
+}
+
+void RedrawScheduler::done(RenderSlot &s)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t dt = (uint32_t)(now - _slot_start);
+    s.last_ms = (uint32_t)(_frame_start / 1000); // the frame start, the render time must not add to the period
+    s.last_val = _pending_val;
+    s.last_val2 = _pending_val2;
+    s.count++;
+    s.sum_us += dt;
+    if ( dt > s.max_us ) {
+        s.max_us = dt;
+    }
+    s.avg_us = s.avg_us ? (s.avg_us * 7 + dt) / 8 : dt;
+}
+
+void RedrawScheduler::done(ScreenElement &e)
+{
+    done(e._slot);
+}
+
+void RedrawScheduler::logStats(RenderSlot *const *slots, int n)
+{
+    for (int i = 0; i < n; i++) {
+        RenderSlot *s = slots[i];
+        if ( ! s || ! s->count ) {
+            continue;
+        }
+        ESP_LOGI(FNAME, "render %-8s n:%4u avg:%5uus max:%5uus skipped:%u", s->name, (unsigned)s->count,
+            (unsigned)(s->sum_us / s->count), (unsigned)s->max_us, (unsigned)s->skipped);
+        s->count = s->skipped = s->sum_us = s->max_us = 0;
+    }
+}
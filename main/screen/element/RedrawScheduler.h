@@ -0,0 +1,61 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <cinttypes>
+
+class ScreenElement;
+
+// The scheduling unit of a screen part, its target rate, change threshold and render time statistics
+struct RenderSlot
+{
+    RenderSlot() = default;
+    RenderSlot(const char *n, uint16_t period_ms, float threshold = 0.f) : name(n), period(period_ms), thresh(threshold) {}
+    void set(const char *n, uint16_t period_ms, float threshold = 0.f) { name = n; period = period_ms; thresh = threshold; }
+
+    const char *name = "-";
+    uint16_t period = 0;   // target redraw period in ms, 0 := every frame and never dropped
+    float    thresh = 0.f; // value change that is worth a redraw, 0 := always redraw when due
+    // state
+    uint32_t last_ms = 0;
+    float    last_val = 0.f;
+    float    last_val2 = 0.f; // of a second value shown by the part
+    // statistics
+    uint32_t count = 0;
+    uint32_t skipped = 0;  // dropped because of the frame budget
+    uint32_t sum_us = 0;
+    uint32_t max_us = 0;
+    uint32_t avg_us = 0;   // running average, the cost estimate for the budget
+};
+
+// Decides per frame which screen parts get drawn. A slot is due when its period elapsed (counted from
+// the start of the frame it was last drawn in, half a frame tolerance) and its value,
+// or the second one, moved by at least the threshold (at the latest after 8 periods). Due slots are
+// dropped when their average render time does not fit into the remaining frame budget, unless they
+// are late by two periods already. Slots with period 0 (the vario needle) are always drawn.
+class RedrawScheduler
+{
+public:
+    explicit RedrawScheduler(uint32_t budget_us) : _budget_us(budget_us) {}
+
+    void beginFrame();
+    bool due(RenderSlot &s, float value = 0.f, float value2 = 0.f);
+    bool due(ScreenElement &e, float value = 0.f, float value2 = 0.f);
+    void done(RenderSlot &s);
+    void done(ScreenElement &e);
+    void logStats(RenderSlot *const *slots, int n);
+
+private:
+    uint32_t _budget_us;
+    int64_t _frame_start = 0;
+    uint32_t _half_frame_ms = 0;
+    int64_t _slot_start = 0;
+    float _pending_val = 0.f;
+    float _pending_val2 = 0.f;
+};
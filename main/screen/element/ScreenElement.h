@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include "RedrawScheduler.h"
+
 #include <cinttypes>
 
 class ScreenElement
@@ -17,9 +19,12 @@ public:
     ScreenElement(int16_t refx, int16_t refy) : _ref_x(refx), _ref_y(refy) {}
     ~ScreenElement() = default;
     void forceRedraw() { _dirty = true; }
+    // target redraw period and change threshold for the RedrawScheduler
+    void setSchedule(const char *name, uint16_t period_ms, float threshold = 0.f) { _slot.set(name, period_ms, threshold); }
 
 public:
     int16_t _ref_x;
     int16_t _ref_y;
     bool _dirty = true;
+    RenderSlot _slot;
 };
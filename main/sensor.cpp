@@ -6,6 +6,8 @@
 #include "ESP32NVS.h"
 #include "sensor/press_diff/AirspeedSensor.h"
 #include "sensor/SensorMgr.h"
+#include "sensor/SensorSched.h"
+#include "sensor/Filters.h"
 // #include "sensor/press_diff/abpmrr.h"
 // #include "sensor/press_diff/mcph21.h"
 #include "BMPVario.h"
@@ -13,6 +15,8 @@
 #include "comm/BTnus.h"
 #include "comm/OneWireBus.h"
 #include "setup/SetupNG.h"
+#include "CrashTrace.h"
+#include "EventTrace.h"
 #include "setup/CruiseMode.h"
 #include "ESPAudio.h"
 #include "ESPRotary.h"
@@ -26,6 +30,7 @@
 #include "protocol/Clock.h"
 #include "protocol/MagSensBin.h"
 #include "protocol/NMEA.h"
+#include "protocol/Telemetry.h"
 #include "protocol/WatchDog.h"
 #include "protocol/nmea/XCVSyncMsg.h"
 #include "protocol/CANPeerCaps.h"
@@ -34,11 +39,16 @@
 #include "screen/MessageBox.h"
 #include "screen/DrawDisplay.h"
 #include "screen/UiEvents.h"
+#include "screen/element/NumberField.h"
 
 // #include "math/Quaternion.h"
 // #include "math/Floats.h"
 // #include "wmm/geomag.h"
+// #include "wmm/Declination.h"
 #include "OTA.h"
+#include "OtaPipeline.h"
+#include "OtaDelta.h"
+#include "LiveStream.h"
 #include "S2fSwitch.h"
 #include "AverageVario.h"
 
@@ -56,8 +66,10 @@
 #include "comm/OneWireBus.h"
 #include "comm/CanBus.h"
 #include "comm/DeviceMgr.h"
+#include "comm/SpiBus.h"
 // #include "protocol/TestQuery.h"
 #include "AdaptUGC.h"
+#include <eglib/hal/four_wire_spi/esp32/esp32_ili9341.h>
 #include "logdef.h"
 #include "comm/Messages.h"
 
@@ -79,6 +91,7 @@
 #include <string>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
 
 
 
@@ -99,7 +112,6 @@ BMP:
 
 AirspeedSensor *asSensor = nullptr;
 
-SemaphoreHandle_t spiMutex=NULL;
 
 S2F Speed2Fly;
 int MyGliderPolarIndex; // Todo make private in S2F?
@@ -184,8 +196,9 @@ static void grabMPU()
 	const int NUM_GYRO_SAMPLES = 3000; // 10 per second -> 5 minutes, so T has been settled after power on
 	static uint16_t num_gyro_samples = 0;
 
-	// Read the IMU registers and check the output
-	if( IMU::MPU6050Read() == ESP_OK )
+	// Read the IMU registers or drain the FIFO and check the output
+	esp_err_t err = IMU::fifoMode() ? IMU::FifoRead() : IMU::MPU6050Read();
+	if( err == ESP_OK )
 	{
 		// Do the gyro auto bias
 		vector_f gyroDPS = IMU::getGliderGyro();
@@ -231,7 +244,9 @@ static void grabMPU()
 				}
 			}
 		}
-		IMU::Process();
+		if( ! IMU::fifoMode() ) {
+			IMU::Process();
+		}
 	}
 
 }
@@ -293,14 +308,10 @@ static void commonThingsLast(int count)
 
     s2f_ideal.set(std::roundf(as2f));
     // low pass damping
-    s2f_delta = s2f_delta + ((as2f - ias.get()) - s2f_delta) * (1 / (s2f_delay.get() * 10));
+    static Iir1<float> s2f_lpf;
+    s2f_delta = s2f_lpf.filter(as2f - ias.get(), 1 / (s2f_delay.get() * 10));
     // ESP_LOGI( FNAME, "te: %f, polar_sink: %f, netto %f, s2f: %f  delta: %f", aTES2F, polar_sink, te_netto.get(), as2f, s2f_delta );
 
-    if (OneWIRE) {
-        // read one wire sensors
-        OneWIRE->groupUpdate(Clock::getMillis());
-    }
-
     if (gflags.haveIMU && HAS_MPU_TEMP_CONTROL) {
         // ESP_LOGI(FNAME,"MPU temp control; T=%.2f", MPU.getTemperature() );
         MPU.temp_control(count, xcvTemp);
@@ -308,12 +319,26 @@ static void commonThingsLast(int count)
 
     AUDIO->updateTone();
     const int screenEvent = ScreenEvent(ScreenEvent::MAIN_SCREEN).raw;
-    xQueueSend(uiEventQueue, &screenEvent, 0);
+    uiPostEvent(screenEvent);
 }
 static void commonThings5Secs()
 {
     SetupCommon::commitDirty(); // very important, flash NVS settings permanently
 
+    static int spi_stats = 0;
+    if ( ++spi_stats >= 12 ) { // once a minute
+        SpiBus::statsLog();
+        SensorSched.statsLog();
+        TelemetryBin::statsLog();
+        if ( BLUEnus ) {
+            BLUEnus->statsLog();
+        }
+        if ( CAN && CAN->isInitialized() ) {
+            CAN->statsLog();
+        }
+        spi_stats = 0;
+    }
+
     ESP_LOGI(FNAME, "Free Heap: %d bytes", heap_caps_get_free_size(MALLOC_CAP_8BIT));
     if (uxTaskGetStackHighWaterMark(bpid) < 512)
     {
@@ -325,6 +350,7 @@ static void commonThings5Secs()
     }
     extern MessagePool MP;
     ESP_LOGI(FNAME, "MPool in-use:%d, acq-fails: %d", MP.nrUsed(), MP.nrAcqFails());
+    uiEventStatsLog();
 
     struct timeval tv;
     gettimeofday(&tv, NULL);
@@ -347,22 +373,25 @@ void clientLoop(void *pvParameters)
 	{
 		TickType_t xLastWakeTime = xTaskGetTickCount();
 		count++; // 10 Hz
+		CrashTrace::loopBegin(CrashTrace::CLIENT);
 
         commonThingsFirst();
-		aTE += (te_vario.get() - aTE)* (1/(10*vario_av_delay.get()));
+		static Iir1<float> aTE_lpf;
+		aTE = aTE_lpf.filter(te_vario.get(), 1/(10*vario_av_delay.get()));
 
 		if( !(count%2) )
 		{
-			double tmpalt = altitude.get(); // get pressure from altitude
+			float tmpalt = altitude.get(); // get pressure from altitude
+			float qnh = QNH.get();
 			if( (fl_auto_transition.get() == 1) && ((int)( Units::meters2FL( altitude.get() )) + (int)(gflags.standard_setting) > transition_alt.get() ) ) {
 				ESP_LOGI(FNAME,"Above transition altitude");
-				baroP = Atmosphere::calcPressureISA(tmpalt); // above transition altitude
-			}
-			else {
-				baroP = Atmosphere::calcPressure( QNH.get(), tmpalt);
+				qnh = 1013.25f; // above transition altitude
 			}
+			// pressure and TAS in one pass, TAS is referenced to the ISA pressure of the altitude
+			float isaP;
+			Atmosphere::calcPressureTAS( 1013.25f, tmpalt, ias.get(), OAT.get(), isaP, tas );
+			baroP = isaP * (qnh / 1013.25f);
 			dynamicP = Atmosphere::kmh2pascal(ias.get());
-			tas = Atmosphere::TAS2( ias.get(), altitude.get(), OAT.get() );
 			if( IMU::getGliderAccelZ() > gload_pos_max.get() ){
 				gload_pos_max.set( IMU::getGliderAccelZ() );
 			}else if( IMU::getGliderAccelZ() < gload_neg_max.get() ){
@@ -396,6 +425,7 @@ void clientLoop(void *pvParameters)
         }
         if (!(count % 50)) { commonThings5Secs(); }
 
+        CrashTrace::loopEnd(CrashTrace::CLIENT, 100000);
         esp_task_wdt_reset();
         vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(100));
 	}
@@ -414,24 +444,15 @@ void readSensors(void *pvParameters){
 	esp_task_wdt_add(NULL);
     int count = 0;
 	int16_t landed = 0; // airborne detection counter
-    uint32_t spartse_time;
 
 	while (1)
 	{
 		TickType_t xLastWakeTime = xTaskGetTickCount();
 		count++;   // 10x per second
+		CrashTrace::loopBegin(CrashTrace::SENSORS);
 
-        // pick the time
-        spartse_time = Clock::getMillis();
-
-        // loop over all sensors
-        for (SensorEntry *e = SensorRegistry::begin(); e != SensorRegistry::end(); ++e)
-        {
-            if ( ! e->isActive() ) break;
-            if ( e->dutycycle && ! (count%e->dutycycle) ) {
-                e->sensor->update(spartse_time);
-            }
-        }
+        // sensor reads due by now
+        SensorSched.run();
 
         float T=OAT.get(); // fixme
 		if( !gflags.validTemperature ) {
@@ -531,10 +552,14 @@ void readSensors(void *pvParameters){
 
 		// ESP_LOGI(FNAME,"Baro Pressure: %4.3f", baroP );
 		float altSTD = 0;
-		if( Flarm::validExtAlt() && alt_select.get() == AS_EXTERNAL )
+		float altQNH = 0;
+		const bool ext_alt = Flarm::validExtAlt() && alt_select.get() == AS_EXTERNAL; // once, altQNH depends on it
+		if( ext_alt )
 			altSTD = alt_external;
-		else
-			altSTD = Atmosphere::calcAltitudeISA( baroP );
+		else {
+			static Atmosphere::QNHFactor qnh_factor; // of this task only
+			Atmosphere::calcAltitudes( QNH.get(), baroP, altSTD, altQNH, qnh_factor ); // ISA and QNH altitude in one pass
+		}
 		float new_alt = 0;
 		if( alt_select.get() == AS_TE_SENSOR ) // TE
 			new_alt = bmpVario.readAVGalt();
@@ -549,10 +574,10 @@ void readSensors(void *pvParameters){
 				// ESP_LOGI(FNAME,"auto:%d alts:%f ss:%d ta:%f", fl_auto_transition.get(), altSTD, gflags.standard_setting, transition_alt.get() );
 			}
 			else {
-				if( Flarm::validExtAlt() && alt_select.get() == AS_EXTERNAL )
+				if( ext_alt )
 					new_alt = altSTD + ( QNH.get()- 1013.25)*8.2296;  // correct altitude according to ISA model = 27ft / hPa
 				else
-					new_alt = Atmosphere::calcAltitude( QNH.get(), baroP );
+					new_alt = altQNH;
 				gflags.standard_setting = false;
 				// ESP_LOGI(FNAME,"QNH %f baro: %f alt: %f SS:%d", QNH.get(), baroP, alt, gflags.standard_setting  );
 			}
@@ -643,8 +668,21 @@ void readSensors(void *pvParameters){
         commonThingsLast(count);
         if ((count % 50) == 0) { commonThings5Secs(); }
 
+		CrashTrace::loopEnd(CrashTrace::SENSORS, 100000);
 		esp_task_wdt_reset();
-		vTaskDelayUntil(&xLastWakeTime, pdMS_TO_TICKS(100));
+
+		// serve the sensor schedule until the next cycle
+		TickType_t cycle_end = xLastWakeTime + pdMS_TO_TICKS(100);
+		while ( true ) {
+			int32_t wait = (int32_t)(SensorSched.run() - millis());
+			int32_t left = (int32_t)(cycle_end - xTaskGetTickCount());
+			if ( left <= 0 ) {
+				break;
+			}
+			if ( wait > 0 ) {
+				vTaskDelay(pdMS_TO_TICKS(std::min(wait, left)));
+			}
+		}
 	}
 }
 
@@ -689,7 +727,7 @@ void system_startup(void *args){
 	ESP_LOGI(FNAME, "startup on core %d", xPortGetCoreID());
 
 	esp_wifi_set_mode(WIFI_MODE_NULL);
-	spiMutex = xSemaphoreCreateMutex();
+	SpiBus::begin();
 	ESP_LOGI( FNAME, "Log level set globally to INFO %d; Max Prio: %d Wifi: %d",  ESP_LOG_INFO, configMAX_PRIORITIES, ESP_TASKD_EVENT_PRIO-5 );
 	esp_chip_info_t chip_info;
 	esp_chip_info(&chip_info);
@@ -828,6 +866,10 @@ void system_startup(void *args){
 		if ( IMU::MPU6050Read() == ESP_OK) {
 			IMU::Process();
 		}
+#ifdef IMU_FifoTest
+		IMU::fifo_test();
+#endif
+		IMU::startFifo(imu_fifo_rate.get());
 		ESP_LOGI( FNAME,"MPU current offsets accl:%d/%d/%d gyro:%d/%d/%d ZERO:%d", ab.x, ab.y, ab.z, gb.x,gb.y,gb.z, gb.isZero() );
 	}
 
@@ -981,8 +1023,8 @@ void system_startup(void *args){
 		BME280_ESP32_SPI *bmpBA = new BME280_ESP32_SPI();
 		BME280_ESP32_SPI *bmpTE= new BME280_ESP32_SPI();
 		int spi_freq=rint( FREQ_BMP_SPI / 2 * ((100.0 + display_clock_adj.get())/100.0));
-		bmpBA->setSPIBus(SPI_SCLK, SPI_MOSI, SPI_MISO, CS_bme280BA, spi_freq);
-		bmpTE->setSPIBus(SPI_SCLK, SPI_MOSI, SPI_MISO, CS_bme280TE, spi_freq);
+		bmpBA->setSPIBus(SPI_SCLK, SPI_MOSI, SPI_MISO, CS_bme280BA, spi_freq, SPI_BARO);
+		bmpTE->setSPIBus(SPI_SCLK, SPI_MOSI, SPI_MISO, CS_bme280TE, spi_freq, SPI_TE);
 		bmpTE->begin();
 		bmpBA->begin();
 		baroSensor = bmpBA;
@@ -1197,7 +1239,7 @@ void system_startup(void *args){
             // factory use case
             ESP_LOGI(FNAME, "Do Factory Voltmeter adj");
             screenEvent = ScreenEvent(ScreenEvent::VOLT_ADJUST).raw;
-            xQueueSend(uiEventQueue, &screenEvent, 0);
+            uiPostEvent(screenEvent);
         }
 
         // airfield use case
@@ -1205,15 +1247,15 @@ void system_startup(void *args){
         ESP_LOGI(FNAME, "Check glider polar configuration %d, unchanged %d", glider_type.get(), S2F::isPolarEqualTo(MyGliderPolarIndex));
         if ( ! glider_polar_configured ) {
             screenEvent = ScreenEvent(ScreenEvent::POLAR_CONFIG).raw;
-            xQueueSend(uiEventQueue, &screenEvent, 0);
+            uiPostEvent(screenEvent);
         }
         // QNH adjust screen, always
         screenEvent = ScreenEvent(ScreenEvent::QNH_ADJUST).raw;
-        xQueueSend(uiEventQueue, &screenEvent, 0);
+        uiPostEvent(screenEvent);
         if ( ballast_kg.get() > 0 ) {
             // ballast set when boot-up, get a user confirmation
             screenEvent = ScreenEvent(ScreenEvent::BALLAST_CONFIRM).raw;
-            xQueueSend(uiEventQueue, &screenEvent, 0);
+            uiPostEvent(screenEvent);
         }
 
     }
@@ -1291,6 +1333,7 @@ extern "C" void  app_main(void)
 {
 	// global log level
 	esp_log_level_set("*", ESP_LOG_INFO);
+	CrashTrace::begin(); // keep the trace of a crashed run before anything else
 
 	ESP_LOGI(FNAME, "app main on core %d", xPortGetCoreID());
 
@@ -1344,7 +1387,7 @@ extern "C" void  app_main(void)
 	MPU.clearpwm(); // Stop MPU heating
 
 	// Init ui and screen UiEventLoop task recources
-	uiEventQueue = xQueueCreate(10, sizeof(int));
+	createUiEventQueue();
 
 	// Init of rotary
 	if( hardwareRevision.get() == XCVARIO_20 ){
@@ -1368,6 +1411,63 @@ extern "C" void  app_main(void)
 #endif
 #ifdef WMM_Test
 		WMM_Model::geomag_test();
+#endif
+#ifdef Declination_Test
+		Declination::declination_test();
+#endif
+#ifdef Deviation_Test
+		Deviation::lut_test();
+#endif
+#ifdef Atmosphere_Test
+		Atmosphere::kernel_test();
+#endif
+#ifdef BMPVario_Test
+		BMPVario::filter_test();
+#endif
+#ifdef Clock_Test
+		Clock::wheel_test();
+#endif
+#ifdef SensorSched_Test
+		SensorScheduler::sched_test();
+#endif
+#ifdef SensorHistory_Test
+		SensorBase::history_test();
+#endif
+#ifdef Filters_Test
+		BaseFilterItf::bench_test();
+#endif
+#ifdef NotifyBatcher_Test
+		NotifyBatcher::link_test();
+#endif
+#ifdef CanBus_Test
+		CanBatch::sim_test();
+#endif
+#ifdef ILI9341_Test
+		esp32_ili9341_sim_test();
+#endif
+#ifdef NumberField_Test
+		NumberField::replay_test();
+#endif
+#ifdef GlyphCache_Test
+		MYUCG->glyph_cache_test();
+#endif
+#ifdef OtaPipeline_Test
+		OtaPipeline::flash_test();
+#endif
+#ifdef OtaDelta_Test
+		OtaDeltaSink::apply_test();
+#endif
+#ifdef LiveStream_Test
+		LiveStream::stream_test();
+#endif
+#ifdef SetupSnapshot_Test
+		SetupCommon::snapshot_test();
+#endif
+#ifdef CrashTrace_Test
+		CrashTrace::trace_test();
+#endif
+#ifdef EventTrace_Test
+		EventTrace::event_test();
 #endif
 	system_startup( 0 );
 
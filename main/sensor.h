@@ -92,7 +92,6 @@ extern long unsigned int _gps_millis;
 
 extern ESPRotary *Rotary;
 
-extern SemaphoreHandle_t spiMutex;
 
 extern vector_f gravity_vector;
 
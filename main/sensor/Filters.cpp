@@ -12,14 +12,20 @@
 
 #include <cmath>
 
-void LowPassFilter::reset(float init_val)
+BiquadCoeffs BiquadCoeffs::lowpass(float fc, float fs, float q)
 {
-    _last_output = init_val;
-}
-float LowPassFilter::filter(float input)
-{
-    _last_output = _alpha * (input - _last_output) + _last_output;
-    return _last_output;
+    // bilinear transform of the analog prototype, after the audio EQ cookbook
+    float w0 = 2.f * (float)M_PI * fc / fs;
+    float alpha = sinf(w0) / (2.f * q);
+    float cw = cosf(w0);
+    float a0 = 1.f + alpha;
+    BiquadCoeffs c;
+    c.b0 = (1.f - cw) / 2.f / a0;
+    c.b1 = (1.f - cw) / a0;
+    c.b2 = c.b0;
+    c.a1 = -2.f * cw / a0;
+    c.a2 = (1.f - alpha) / a0;
+    return c;
 }
 
 float AirSpeedFilter::filter(float input)
@@ -31,3 +37,62 @@ float AirSpeedFilter::filter(float input)
     }
     return tmp;
 }
+
+
+#ifdef Filters_Test
+#include "logdef.h"
+#include <esp_cpu.h>
+#include <cstdint>
+
+// Cost of each filter in CPU cycles per sample, one by one and as a batch, on a noisy step with spikes
+template <class F>
+static void bench(const char *name, F &f, float *in, float *buf, int n)
+{
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    float sink = 0;
+    for (int i = 0; i < n; i++) {
+        sink += f.filter(in[i]);
+    }
+    uint32_t c1 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < n; i++) {
+        buf[i] = in[i];
+    }
+    f.reset();
+    uint32_t c2 = esp_cpu_get_cycle_count();
+    f.filter(std::span<float>(buf, n));
+    uint32_t c3 = esp_cpu_get_cycle_count();
+    ESP_LOGI(FNAME, "%-12s %5.1f cycles/sample, batch %5.1f, end value %.3f (%.1f)", name, (c1 - c0) / (float)n, (c3 - c2) / (float)n, buf[n - 1], sink / n);
+}
+
+void BaseFilterItf::bench_test()
+{
+    constexpr int N = 1000;
+    static float in[N], buf[N];
+    uint32_t rnd = 4711;
+    for (int i = 0; i < N; i++) {
+        rnd = rnd * 1664525u + 1013904223u;
+        in[i] = (i < N / 2 ? 0.f : 1.f) + ((rnd >> 8) % 1000) / 10000.f;
+        if ( i % 97 == 0 ) {
+            in[i] += 5.f; // spike
+        }
+    }
+    Iir1<float> iir(0.1f);
+    Iir1<float, true> angle(0.1f);
+    Biquad<float> biquad(BiquadCoeffs::lowpass(1.f, 10.f));
+    MovingAverage<10> ma10;
+    MovingAverage<60> ma60;
+    Median<5> med5;
+    bench("iir1", iir, in, buf, N);
+    bench("iir1 angle", angle, in, buf, N);
+    bench("biquad", biquad, in, buf, N);
+    bench("average 10", ma10, in, buf, N);
+    bench("average 60", ma60, in, buf, N);
+    bench("median 5", med5, in, buf, N);
+
+    Welford<float> w;
+    uint32_t c0 = esp_cpu_get_cycle_count();
+    w.add(std::span<const float>(in, N));
+    uint32_t c1 = esp_cpu_get_cycle_count();
+    ESP_LOGI(FNAME, "%-12s %5.1f cycles/sample, mean %.3f variance %.3f", "welford", (c1 - c0) / (float)N, w.mean(), w.variance());
+}
+#endif
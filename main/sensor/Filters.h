@@ -8,25 +8,250 @@
 
 #pragma once
 
-// A simple filter design not knowing the signal history
+#include <span>
+#include <type_traits>
+#include <cmath>
 
+//
+// Filter toolkit
+//
+// Plain templates without virtual calls, the sizes and types are template arguments. Every filter
+// takes one sample with filter(x), or a batch in place with filter(span). The first sample of an
+// IIR filter initializes its state, there is no ramp up from zero.
+//
+
+// First order IIR low pass, y += alpha * (x - y). With WRAP360 the signal is an angle in degrees,
+// it is filtered along the shorter way around and the output stays in 0..360.
+template <typename T = float, bool WRAP360 = false>
+class Iir1
+{
+public:
+    constexpr explicit Iir1(float alpha = 1.f) : _alpha(alpha) {}
+    void setAlpha(float alpha) { _alpha = alpha; }
+    T filter(T x) { return filter(x, _alpha); }
+    // for a varying sample interval, with the gain scaled to it by the caller
+    T filter(T x, float alpha) {
+        if ( ! _primed ) {
+            reset(x);
+            return _y;
+        }
+        T d = x - _y;
+        if constexpr (WRAP360) {
+            d -= 360.f * std::floor((d + 180.f) / 360.f);
+        }
+        _y += alpha * d;
+        if constexpr (WRAP360) {
+            _y -= 360.f * std::floor(_y / 360.f);
+        }
+        return _y;
+    }
+    void filter(std::span<T> buf) {
+        for (T &x : buf) {
+            x = filter(x);
+        }
+    }
+    T value() const { return _y; }
+    bool primed() const { return _primed; }
+    void reset(T init) { _y = init; _primed = true; }
+    void reset() { _y = T{}; _primed = false; }
+
+private:
+    float _alpha;
+    T     _y = T{};
+    bool  _primed = false;
+};
+
+// Second order IIR section (biquad), transposed direct form II
+struct BiquadCoeffs {
+    float b0, b1, b2, a1, a2; // normalized to a0
+    // Butterworth like low pass with the cutoff fc at a sample rate fs (both Hz)
+    static BiquadCoeffs lowpass(float fc, float fs, float q = 0.7071f);
+};
+
+template <typename T = float>
+class Biquad
+{
+public:
+    explicit Biquad(const BiquadCoeffs &c) : _c(c) {}
+    void setCoeffs(const BiquadCoeffs &c) { _c = c; }
+    T filter(T x) {
+        if ( ! _primed ) {
+            reset(x);
+        }
+        T y = _c.b0 * x + _z1;
+        _z1 = _c.b1 * x - _c.a1 * y + _z2;
+        _z2 = _c.b2 * x - _c.a2 * y;
+        return y;
+    }
+    void filter(std::span<T> buf) {
+        for (T &x : buf) {
+            x = filter(x);
+        }
+    }
+    // settle the state on a constant input
+    void reset(T init) {
+        _z2 = (_c.b2 - _c.a2) * init;
+        _z1 = (_c.b1 - _c.a1) * init + _z2;
+        _primed = true;
+    }
+    void reset() { _z1 = _z2 = T{}; _primed = false; }
+
+private:
+    BiquadCoeffs _c;
+    T     _z1 = T{};
+    T     _z2 = T{};
+    bool  _primed = false;
+};
+
+// Moving average over the latest N samples, less while it fills up. O(1) per sample, the running
+// total of a floating point type is summed up again every round to stop the rounding drift.
+template <int N, typename T = float, typename Acc = T>
+class MovingAverage
+{
+public:
+    T filter(T x) {
+        if ( _count == _length ) {
+            _total -= _buf[_idx];
+        }
+        else {
+            _count++;
+        }
+        _buf[_idx] = x;
+        _total += x;
+        if ( ++_idx == _length ) {
+            _idx = 0;
+            if constexpr (std::is_floating_point_v<Acc>) {
+                _total = Acc{};
+                for (int i = 0; i < _count; i++) {
+                    _total += _buf[i];
+                }
+            }
+        }
+        return value();
+    }
+    void filter(std::span<T> buf) {
+        for (T &x : buf) {
+            x = filter(x);
+        }
+    }
+    T value() const { return _count ? (T)(_total / (Acc)_count) : T{}; }
+    int count() const { return _count; }
+    int length() const { return _length; }
+    // a changed length starts over
+    void setLength(int len) {
+        if ( len > 0 && len <= N && len != _length ) {
+            _length = len;
+            reset();
+        }
+    }
+    void reset() {
+        _idx = _count = 0;
+        _total = Acc{};
+    }
+
+private:
+    T   _buf[N] = {};
+    int _length = N;
+    int _idx = 0;
+    int _count = 0;
+    Acc _total = Acc{};
+};
+
+// Median of the latest N samples, rejects spikes shorter than N/2 samples. O(N) per sample.
+// A NaN or infinite sample is not taken, the median stays.
+template <int N, typename T = float>
+class Median
+{
+    static_assert(N % 2 == 1, "Median of an odd number of samples");
+public:
+    T filter(T x) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if ( ! std::isfinite(x) ) {
+                return _count ? _sorted[(_count - 1) / 2] : x;
+            }
+        }
+        int pos;
+        if ( _count == N ) {
+            // drop the oldest from the sorted samples
+            T old = _ring[_idx];
+            for (pos = 0; pos < N - 1 && _sorted[pos] != old; pos++) {}
+            for (; pos < N - 1; pos++) {
+                _sorted[pos] = _sorted[pos + 1];
+            }
+        }
+        else {
+            _count++;
+        }
+        _ring[_idx] = x;
+        _idx = (_idx + 1) % N;
+        for (pos = _count - 1; pos > 0 && _sorted[pos - 1] > x; pos--) {
+            _sorted[pos] = _sorted[pos - 1];
+        }
+        _sorted[pos] = x;
+        return _sorted[(_count - 1) / 2];
+    }
+    void filter(std::span<T> buf) {
+        for (T &x : buf) {
+            x = filter(x);
+        }
+    }
+    void reset() { _idx = _count = 0; }
+
+private:
+    T   _ring[N] = {};
+    T   _sorted[N] = {};
+    int _idx = 0;
+    int _count = 0;
+};
+
+// Running mean and variance after Welford, numerically stable in a single pass
+template <typename T = float>
+class Welford
+{
+public:
+    void add(T x) {
+        _n++;
+        T d = x - _mean;
+        _mean += d / _n;
+        _m2 += d * (x - _mean);
+    }
+    void add(std::span<const T> buf) {
+        for (T x : buf) {
+            add(x);
+        }
+    }
+    unsigned count() const { return _n; }
+    T mean() const { return _mean; }
+    T variance() const { return _n > 1 ? _m2 / (_n - 1) : T{}; }
+    void reset() { _n = 0; _mean = _m2 = T{}; }
+
+private:
+    unsigned _n = 0;
+    T _mean = T{};
+    T _m2 = T{};
+};
+
+
+// Filter plugin interface for the sensors, see SensorTP::setFilter()
 class BaseFilterItf
 {
 public:
     virtual ~BaseFilterItf() = default;
     virtual float filter(float input) = 0;
+#ifdef Filters_Test
+    static void bench_test();
+#endif
 };
 
 // A simple low-pass filter
 class LowPassFilter : public BaseFilterItf
 {
 public:
-    explicit LowPassFilter(float alpha) : _alpha(alpha), _last_output(0.0f) {}
-    void reset(float init_val);
-    float filter(float input) override;
+    explicit LowPassFilter(float alpha) : _lpf(alpha) {}
+    void reset(float init_val) { _lpf.reset(init_val); }
+    float filter(float input) override { return _lpf.filter(input); }
 private:
-    float _alpha;
-    float _last_output;
+    Iir1<float> _lpf;
 };
 
 
@@ -37,5 +262,5 @@ public:
     explicit AirSpeedFilter(float alpha) : _lpf(alpha) {}
     float filter(float input) override;
 private:
-    LowPassFilter _lpf;
-};
\ No newline at end of file
+    Iir1<float> _lpf;
+};
@@ -10,14 +10,122 @@
 #include "SensorBase.h"
 
 #include "SensorMgr.h"
+#include "SensorSched.h"
 
 SensorBase::SensorBase(int ums, SensorId id) : _update_interval_ms(ums), _latency_ms(0), _last_update_time_ms(0)
 {
     SensorRegistry::registerSensor(id, this);
+    SensorSched.add(this);
 }
 
 SensorBase::~SensorBase()
 {
     // deregister
+    SensorSched.remove(this);
     SensorRegistry::deregisterSensor(this);
-}
\ No newline at end of file
+}
+
+#ifdef SensorHistory_Test
+#include "logdef.h"
+#include <esp_timer.h>
+
+// Naive reference of the window statistics, loops over the window oldest first
+static void naive_stats(const FixedSensorHistory<float> &h, size_t age_new, size_t age_old, double &mean, double &var, double &slope)
+{
+    int n = age_old - age_new + 1;
+    double sx = 0, sxx = 0, si = 0, sii = 0, six = 0;
+    for (int i = 0; i < n; i++) {
+        double x = h.at(age_old - i);
+        sx += x; si += i; sii += (double)i * i; six += i * x;
+    }
+    mean = sx / n;
+    var = 0;
+    for (int i = 0; i < n; i++) {
+        double d = h.at(age_old - i) - mean;
+        var += d * d;
+    }
+    var = n > 1 ? var / (n - 1) : 0;
+    double den = n * sii - si * si;
+    slope = den > 0 ? (n * six - si * sx) / den : 0;
+}
+
+// Naive reference of the interpolation, search the reconstructed sample times
+static bool naive_value(const FixedSensorHistory<float> &h, uint32_t t, uint32_t last, uint32_t dt, float &out)
+{
+    for (size_t a = 0; a + 1 < h.size(); a++) {
+        uint32_t t1 = last - a * dt, t0 = t1 - dt;
+        if ( t <= t1 && t >= t0 ) {
+            out = h.at(a + 1) + (h.at(a) - h.at(a + 1)) * (float)(t - t0) / dt;
+            return true;
+        }
+    }
+    return false;
+}
+
+// A drifting and noisy pressure like trace through the 50 sample history of a 10Hz sensor, over
+// several restarts of the prefix sums. Every step compares a random window and a random point in
+// time against the naive implementation and the cost of both is logged.
+void SensorBase::history_test()
+{
+    constexpr int CAP = 50;
+    constexpr uint32_t DT = 100;
+    static float buf[CAP + 4];
+    FixedSensorHistory<float> h(buf, CAP, true);
+
+    uint32_t rnd = 12345;
+    auto next = [&rnd]() { rnd = rnd * 1664525u + 1013904223u; return rnd >> 8; };
+    double max_mean = 0, max_var = 0, max_slope = 0, max_val = 0;
+    int errors = 0;
+    uint32_t last = 0;
+    for (int i = 0; i < 20000; i++) {
+        float v = 95000.f + 0.02f * i + 30.f * sinf(i * 0.05f) + (next() % 1000) / 1000.f;
+        h.push(v);
+        last += DT;
+        if ( h.size() < 2 ) {
+            continue;
+        }
+        size_t a_new = next() % h.size();
+        size_t a_old = a_new + next() % (h.size() - a_new);
+        HistoryStats st;
+        double mean, var, slope;
+        if ( ! h.stats(a_new, a_old, st) ) {
+            errors++;
+            continue;
+        }
+        naive_stats(h, a_new, a_old, mean, var, slope);
+        max_mean = std::max(max_mean, fabs(st.mean - mean));
+        max_var = std::max(max_var, fabs(st.var - var) / std::max(var, 1.));
+        max_slope = std::max(max_slope, fabs(st.slope - slope));
+
+        uint32_t t = last - next() % ((h.size() - 1) * DT);
+        float x, y;
+        bool ok = h.valueAt(t, last, DT, x);
+        if ( ok != naive_value(h, t, last, DT, y) ) {
+            errors++;
+        }
+        else if ( ok ) {
+            max_val = std::max(max_val, (double)fabs(x - y));
+        }
+    }
+    if ( max_mean > 1e-2 || max_var > 1e-3 || max_slope > 1e-3 || max_val > 1e-2 ) {
+        errors++;
+    }
+
+    HistoryStats st;
+    double mean, var, slope;
+    volatile float sink;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) {
+        h.stats(i % 8, CAP - 1, st);
+        sink = st.slope;
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) {
+        naive_stats(h, i % 8, CAP - 1, mean, var, slope);
+        sink = slope;
+    }
+    int64_t t2 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "History test max error: mean %.5f var %.6f%% slope %.6f value %.5f, errors %d", max_mean, max_var * 100, max_slope, max_val, errors);
+    ESP_LOGI(FNAME, "History test %d samples window: prefix %.2fus naive %.2fus", CAP, (t1 - t0) / 1000.f, (t2 - t1) / 1000.f);
+}
+#endif
@@ -14,6 +14,7 @@
 #include <type_traits>
 #include <cstdint>
 #include <cstring>  // for memcpy
+#include <cmath>
 
 //
 // Memory-optimized fixed-size history buffer for sensors.
@@ -25,32 +26,66 @@
 // 
 // - Timestamps in uint32_t milliseconds since boot (>1000h before roll-over).
 // - Capacity is computed to cover N seconds at the sensor's update rate.
+//
+// Queries by time interpolate linearly between the reconstructed sample times. Window statistics
+// (mean, variance, slope) come from prefix sums in O(1), when allocated at construction. The sums
+// are kept relative to a recent value and restarted every few thousand samples to stay precise.
+// A NaN sample (failed read) holds the previous value in the sums.
 // 
 
 constexpr int SENSOR_HISTORY_DURATION_MS = 5000;  // milliseconds
 
 enum SensorId : uint8_t;
 
+// Statistics over a window of the history, slope in units per sample or per second (SensorTP)
+struct HistoryStats {
+    float mean;
+    float var;
+    float slope;
+    int   n;
+};
+
 template <typename T>
 class FixedSensorHistory {
 public:
     FixedSensorHistory() = delete;
-    explicit FixedSensorHistory(T* buf, size_t cap) : 
+    explicit FixedSensorHistory(T* buf, size_t cap, bool stats = false) : 
         _capacity(cap), _head(0), _full(false), _heap_alloced(false), _buffer(buf) {
         if ( buf == nullptr ) {
-            _buffer = (T*)malloc(cap + 4);
+            _buffer = (T*)malloc(sizeof(T) * (cap + 4));
             _heap_alloced = true;
         }
         *_buffer = T{};
+        if constexpr (std::is_arithmetic_v<T>) {
+            // before any push, the sums are never (re)allocated under a running sensor
+            if ( stats ) {
+                _prefix = (Prefix*)malloc(sizeof(Prefix) * (_capacity + 1));
+                if ( _prefix ) {
+                    rebase(_seq - 1);
+                }
+            }
+        }
     }
     ~FixedSensorHistory() {
         if ( _heap_alloced ) free(_buffer);
+        if ( _prefix ) free(_prefix);
     }
     void push(const T& value) {
         int nxt = (_head + 1) % _capacity;
         _buffer[nxt] = value;
         _head = nxt;
         if (_head == 0) { _full = true; }
+        if constexpr (std::is_arithmetic_v<T>) {
+            if ( _prefix ) {
+                if ( _seq == _base || _seq - _base >= REBASE_SAMPLES ) {
+                    rebase(_seq);
+                }
+                else {
+                    accumulate(value);
+                }
+            }
+        }
+        _seq++;
     }
     size_t size() const {
         return _full ? _capacity : _head;
@@ -61,19 +96,143 @@ public:
     T* getHeadPtr() const {
         return &_buffer[_head];
     }
+    // Sample by age, 0 is the latest one, age < size()
+    T at(size_t age) const {
+        return _buffer[(_head + _capacity - age) % _capacity];
+    }
     void reset() {
         _head = 0;
         _full = false;
         std::memset(_buffer, 0, sizeof(T) * _capacity);
+        if ( _prefix ) {
+            rebase(_seq - 1);
+        }
+    }
+
+    bool hasStats() const {
+        return _prefix != nullptr;
+    }
+
+    // Value at t_ms, with the latest sample taken at last_ms. Times past the latest sample
+    // get the latest one, times before the oldest one fail.
+    bool valueAt(uint32_t t_ms, uint32_t last_ms, uint32_t interval_ms, T &out) const {
+        size_t n = size();
+        int32_t dt = (int32_t)(last_ms - t_ms);
+        if ( n == 0 ) {
+            return false;
+        }
+        if ( dt <= 0 ) {
+            out = at(0);
+            return true;
+        }
+        size_t age = dt / interval_ms;
+        if ( age + 1 >= n ) {
+            if ( age + 1 == n && dt % interval_ms == 0 ) {
+                out = at(age);
+                return true;
+            }
+            return false;
+        }
+        float f = (float)(dt % interval_ms) / interval_ms;
+        out = at(age) + (at(age + 1) - at(age)) * f;
+        return true;
+    }
+
+    // Statistics of the samples between age_new and age_old (both included), in O(1)
+    bool stats(size_t age_new, size_t age_old, HistoryStats &st) const {
+        if ( ! _prefix || age_new > age_old || age_old >= size() ) {
+            return false;
+        }
+        uint32_t s1 = _seq - 1 - age_new;
+        uint32_t s0 = _seq - 1 - age_old;
+        const Prefix &hi = _prefix[s1 % (_capacity + 1)];
+        const Prefix &lo = _prefix[(s0 + _capacity) % (_capacity + 1)]; // the one before s0
+        double n = s1 - s0 + 1;
+        double sx = hi.sx - lo.sx;
+        double sxx = hi.sxx - lo.sxx;
+        // sample index relative to the oldest one in the window
+        double six = (hi.skx - lo.skx) - (double)(s0 - _base) * sx;
+        st.n = (int)n;
+        st.mean = _ref + sx / n;
+        st.var = n > 1 ? (sxx - sx * sx / n) / (n - 1) : 0.f;
+        if ( st.var < 0 ) {
+            st.var = 0; // rounding
+        }
+        double si = n * (n - 1) / 2;
+        double sii = (n - 1) * n * (2 * n - 1) / 6;
+        double den = n * sii - si * si;
+        st.slope = den > 0 ? (n * six - si * sx) / den : 0.f;
+        return true;
+    }
+
+    // Statistics of the samples taken between from_ms and to_ms, slope per sample
+    bool statsAt(uint32_t from_ms, uint32_t to_ms, uint32_t last_ms, uint32_t interval_ms, HistoryStats &st) const {
+        int32_t d_new = (int32_t)(last_ms - to_ms);
+        int32_t d_old = (int32_t)(last_ms - from_ms);
+        if ( d_old < 0 || size() == 0 ) {
+            return false;
+        }
+        size_t age_new = d_new <= 0 ? 0 : (d_new + interval_ms - 1) / interval_ms;
+        size_t age_old = d_old / interval_ms;
+        if ( age_old >= size() ) {
+            age_old = size() - 1;
+        }
+        return stats(age_new, age_old, st);
     }
 
 private:
+    static constexpr uint32_t REBASE_SAMPLES = 4096;
+    struct Prefix {
+        double sx;  // sum of (value - _ref)
+        double sxx; // sum of squares
+        double skx; // sum weighted by the sample number since _base
+    };
+
+    void accumulate(const T& value) {
+        float v = value;
+        if ( std::isnan(v) ) {
+            v = _hold;
+        }
+        _hold = v;
+        double d = v - _ref;
+        const Prefix &p = _prefix[(_seq + _capacity) % (_capacity + 1)];
+        Prefix &q = _prefix[_seq % (_capacity + 1)];
+        q.sx = p.sx + d;
+        q.sxx = p.sxx + d * d;
+        q.skx = p.skx + (double)(_seq - _base) * d;
+    }
+    // Restart the sums from the samples in the buffer, O(capacity) every REBASE_SAMPLES
+    void rebase(uint32_t latest) {
+        size_t n = size();
+        _base = latest + 1 - n;
+        for (size_t a = 0; a < n; a++) {
+            if ( ! std::isnan((float)at(a)) ) {
+                _ref = at(a);
+                break;
+            }
+        }
+        _hold = _ref;
+        _prefix[(_base + _capacity) % (_capacity + 1)] = Prefix{};
+        uint32_t seq = _seq;
+        for (_seq = _base; _seq != latest + 1; _seq++) {
+            accumulate(at(latest - _seq));
+        }
+        _seq = seq;
+    }
+
     size_t _capacity;
     int    _head;       ///< Index of the next write position (also count when full)
     uint8_t _full :1;   ///< Whether the buffer has wrapped around
     uint8_t _heap_alloced :1; ///< Whether the buffer was heap allocated
 
     alignas(T) T* _buffer;
+
+    // window statistics
+    Prefix  *_prefix = nullptr; ///< Prefix sums ring, one more than the capacity
+    uint32_t _seq = 0;          ///< Number of the next sample
+    uint32_t _base = 0;         ///< Sample number the sums start with
+    float    _ref = 0;          ///< Offset of the summed values
+    float    _hold = 0;         ///< Last valid value
 };
 
 
@@ -88,8 +247,14 @@ public:
     virtual const char* name() const = 0;
     virtual bool probe() = 0;
     virtual bool setup() = 0;
-    virtual bool update(uint32_t now_ms) = 0;
+    // start a conversion, the readout follows _latency_ms later (see SensorScheduler)
+    virtual bool primeRead(uint32_t now_ms) { return true; }
+    virtual void readout(uint32_t now_ms) = 0;
     int getDutyCycle() const { return _update_interval_ms; }
+    uint32_t getLatency() const { return _latency_ms; }
+#ifdef SensorHistory_Test
+    static void history_test();
+#endif
 
 protected:
     int _update_interval_ms;  ///< Expected update interval
@@ -101,9 +266,9 @@ template <typename T>
 class SensorTP : public SensorBase {
 public:
     SensorTP() = delete;
-    SensorTP(void *buf, uint32_t ums, SensorId id) :
+    SensorTP(void *buf, uint32_t ums, SensorId id, bool stats = false) :
         SensorBase(ums, id),
-        _history((T*)buf, HistoryCapacity(ums))
+        _history((T*)buf, HistoryCapacity(ums), stats)
     {
     }
     virtual ~SensorTP() {
@@ -125,15 +290,10 @@ public:
     // optional: diagnostic info
     // virtual bool healthy() const { return true; }
 
-    // Call this periodically from main loop or task.
-    bool update(uint32_t now_ms) override {
-        if (now_ms - _last_update_time_ms < _update_interval_ms) {
-            return false;
-        }
-
+    // Called by the sensor scheduler at the sensor's rate
+    void readout(uint32_t now_ms) override {
         T value = doRead();
         pushToHistory(value, now_ms);
-        return true;
     }
 
     // The sensor bypass to fill the history directly (e.g. from group read)
@@ -212,6 +372,31 @@ public:
         return _last_update_time_ms;
     }
 
+    // Lag compensated access, the sample times are latency corrected already
+    bool hasStats() const {
+        return _history.hasStats();
+    }
+    bool valueAt(uint32_t t_ms, T &out) const {
+        return _history.valueAt(t_ms, _last_update_time_ms, _update_interval_ms, out);
+    }
+    // Mean, variance and slope per second of the samples taken between from_ms and to_ms
+    bool statsAt(uint32_t from_ms, uint32_t to_ms, HistoryStats &st) const {
+        if ( ! _history.statsAt(from_ms, to_ms, _last_update_time_ms, _update_interval_ms, st) ) {
+            return false;
+        }
+        st.slope *= 1000.f / _update_interval_ms;
+        return true;
+    }
+    // Derivative per second over the latest window_ms
+    bool slope(uint32_t window_ms, float &d) const {
+        HistoryStats st;
+        if ( ! statsAt(_last_update_time_ms - window_ms, _last_update_time_ms, st) || st.n < 2 ) {
+            return false;
+        }
+        d = st.slope;
+        return true;
+    }
+
 protected:
     // Capacity = ceil(5000 / _update_interval_ms)
     static constexpr size_t HistoryCapacity(uint32_t ums) { return (SENSOR_HISTORY_DURATION_MS + ums - 1) / ums; }
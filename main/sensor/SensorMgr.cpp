@@ -30,7 +30,7 @@ bool SensorRegistry::registerSensor(SensorId id, SensorBase *s)
 
     for (auto& e : all_sensors) {
         if (!e.isActive()) {
-            e = { id, s, s->getDutyCycle() / 100 }; // store dutycycle in 100ms units
+            e = { id, s };
             ESP_LOGI(FNAME, "Sensor registered with id %d", static_cast<int>(id));
             return true;
         }
@@ -45,21 +45,11 @@ void SensorRegistry::deregisterSensor(SensorBase* s) {
             ESP_LOGI(FNAME, "Sensor %d deregistered", static_cast<int>(e.id));
             e.id = SensorId::NONE;
             e.sensor = nullptr;
-            e.dutycycle = 0;
             return;
         }
     }
 }
 
-void SensorRegistry::removeFromUpdateLoop(SensorId id)
-{
-    SensorEntry *entry = find(id);
-    if (entry) {
-        ESP_LOGI(FNAME, "Sensor %d removed from update loop", static_cast<int>(entry->id));
-        entry->dutycycle = 0;
-    }
-}
-
 SensorEntry* SensorRegistry::find(SensorId id) {
     for (auto& e : all_sensors)
         if (e.id == id) return &e;
@@ -32,7 +32,6 @@ enum SensorId : uint8_t {
 struct SensorEntry {
     SensorId    id = SensorId::NONE; // enum
     SensorBase* sensor = nullptr;   // polymorph
-    int         dutycycle = 0;      // x 100msec loops, 0 for not part of the loop
     constexpr bool isActive() const { return sensor != nullptr; }
 };
 
@@ -43,7 +42,6 @@ public:
 
     static bool registerSensor(SensorId id, SensorBase* sensor);
     static void deregisterSensor(SensorBase* sensor);
-    static void removeFromUpdateLoop(SensorId id);
     static SensorEntry* find(SensorId id);
 
     static auto begin() { return all_sensors.begin(); }
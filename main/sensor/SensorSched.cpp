@@ -0,0 +1,243 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "SensorSched.h"
+
+#include "SensorBase.h"
+#include "logdef.h"
+
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+
+#include <cstdlib>
+
+// Sensors are created and deleted from other tasks while the sensor task runs the schedule
+static portMUX_TYPE schedLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t sched_millis()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+SensorScheduler SensorSched(sched_millis);
+
+
+SensorScheduler::SensorScheduler(uint32_t (*clock)()) :
+    _clock(clock)
+{
+}
+
+bool SensorScheduler::add(SensorBase *s)
+{
+    bool ok = false;
+    taskENTER_CRITICAL(&schedLock);
+    for (Slot &sl : _slot) {
+        if ( ! sl.sensor ) {
+            sl = Slot();
+            sl.sensor = s;
+            ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&schedLock);
+    if ( ! ok ) {
+        ESP_LOGE(FNAME, "No slot left to schedule %s", s->name());
+    }
+    return ok;
+}
+
+void SensorScheduler::remove(SensorBase *s)
+{
+    taskENTER_CRITICAL(&schedLock);
+    for (Slot &sl : _slot) {
+        if ( sl.sensor == s ) {
+            sl.sensor = nullptr;
+        }
+    }
+    taskEXIT_CRITICAL(&schedLock);
+}
+
+uint32_t SensorScheduler::run()
+{
+    while ( true ) {
+        uint32_t now = _clock();
+        Slot *pick = nullptr;
+        uint32_t pick_deadline = 0;
+        uint32_t next = now + 1000;
+
+        taskENTER_CRITICAL(&schedLock);
+        for (Slot &sl : _slot) {
+            if ( ! sl.sensor ) {
+                continue;
+            }
+            if ( sl.phase == NEW ) {
+                sl.release = sl.due = now;
+                sl.phase = IDLE;
+            }
+            if ( (int32_t)(sl.due - now) > 0 ) {
+                if ( (int32_t)(sl.due - next) < 0 ) {
+                    next = sl.due;
+                }
+                continue;
+            }
+            uint32_t deadline = sl.release + sl.sensor->getDutyCycle();
+            if ( ! pick || (int32_t)(deadline - pick_deadline) < 0 ) {
+                pick = &sl;
+                pick_deadline = deadline;
+            }
+        }
+        SensorBase *s = pick ? pick->sensor : nullptr;
+        Phase phase = pick ? pick->phase : IDLE;
+        taskEXIT_CRITICAL(&schedLock);
+
+        if ( ! s ) {
+            return next;
+        }
+
+        // the sensor access itself runs unlocked
+        if ( phase == IDLE && s->getLatency() > 0 ) {
+            bool ok = s->primeRead(now);
+            taskENTER_CRITICAL(&schedLock);
+            if ( pick->sensor == s ) {
+                if ( ok ) {
+                    pick->phase = CONVERTING;
+                    pick->due = now + s->getLatency();
+                }
+                else {
+                    // retry with the next period
+                    nextPeriod(*pick, _clock());
+                }
+            }
+            taskEXIT_CRITICAL(&schedLock);
+            if ( ! ok ) {
+                ESP_LOGW(FNAME, "%s failed to start a conversion", s->name());
+            }
+        }
+        else {
+            s->readout(now);
+            uint32_t end = _clock();
+            taskENTER_CRITICAL(&schedLock);
+            if ( pick->sensor == s ) {
+                complete(*pick, now, end);
+            }
+            taskEXIT_CRITICAL(&schedLock);
+        }
+    }
+}
+
+// Book a finished read and move on to the next period
+void SensorScheduler::complete(Slot &sl, uint32_t start, uint32_t end)
+{
+    uint32_t interval = sl.sensor->getDutyCycle();
+    Stats &st = sl.stats;
+    uint32_t jitter = start - (sl.release + (sl.phase == CONVERTING ? sl.sensor->getLatency() : 0));
+    st.count++;
+    st.sum_jitter += jitter;
+    if ( jitter > st.max_jitter ) {
+        st.max_jitter = jitter;
+    }
+    if ( (int32_t)(end - (sl.release + interval)) > 0 ) {
+        st.missed++;
+    }
+    nextPeriod(sl, end);
+}
+
+void SensorScheduler::nextPeriod(Slot &sl, uint32_t now)
+{
+    // an overrun skips the periods that already passed
+    uint32_t interval = sl.sensor->getDutyCycle();
+    uint32_t n = interval ? (now - sl.release) / interval : 1;
+    if ( n < 1 ) {
+        n = 1;
+    }
+    sl.stats.skipped += n - 1;
+    sl.release += n * interval;
+    sl.due = sl.release;
+    sl.phase = IDLE;
+}
+
+void SensorScheduler::statsLog()
+{
+    for (Slot &sl : _slot) {
+        taskENTER_CRITICAL(&schedLock);
+        SensorBase *s = sl.sensor;
+        Stats st = sl.stats;
+        sl.stats = Stats();
+        taskEXIT_CRITICAL(&schedLock);
+        if ( ! s || ! st.count ) {
+            continue;
+        }
+        ESP_LOGI(FNAME, "Sensor %-8s %dms n:%u jitter avg:%.1fms max:%ums missed:%u skipped:%u", s->name(), s->getDutyCycle(),
+            (unsigned)st.count, st.sum_jitter / (float)st.count, (unsigned)st.max_jitter, (unsigned)st.missed, (unsigned)st.skipped);
+    }
+}
+
+
+#ifdef SensorSched_Test
+#include "SensorMgr.h"
+
+// Mock sensors of the airspeed, flap and one wire kind on a virtual clock. Each access costs some
+// msec and the sensor task is busy for 15ms every 100ms. All reads have to happen at their rate
+// without missing a deadline.
+static uint32_t vclock = 0;
+static uint32_t vmillis() { return vclock; }
+
+class MockSensor final : public SensorBase
+{
+public:
+    MockSensor(const char *n, int ums, uint32_t lat, uint32_t cost) : SensorBase(ums, SensorId::NONE), _name(n), _cost(cost) {
+        _latency_ms = lat;
+        SensorSched.remove(this);
+    }
+    const char* name() const override { return _name; }
+    bool probe() override { return true; }
+    bool setup() override { return true; }
+    bool primeRead(uint32_t now_ms) override { vclock += 1; return true; }
+    void readout(uint32_t now_ms) override { vclock += _cost; reads++; }
+    uint32_t reads = 0;
+private:
+    const char *_name;
+    uint32_t _cost;
+};
+
+void SensorScheduler::sched_test()
+{
+    MockSensor as("as", 20, 0, 1), flap("flap", 50, 0, 1), ow("ow", 1000, 750, 5), slow("slow", 100, 10, 3);
+    MockSensor *all[] = { &as, &flap, &ow, &slow };
+    SensorScheduler sched(vmillis);
+    for (MockSensor *m : all) {
+        sched.add(m);
+    }
+
+    const uint32_t DURATION = 10000;
+    uint32_t busy = 100;
+    while ( vclock < DURATION ) {
+        uint32_t next = sched.run();
+        if ( (int32_t)(busy - vclock) <= 0 ) {
+            vclock += 15; // the sensor task main cycle
+            busy += 100;
+        }
+        else {
+            vclock = (int32_t)(next - busy) < 0 ? next : busy;
+        }
+    }
+
+    int errors = 0;
+    for (int i = 0; i < 4; i++) {
+        Slot &sl = sched._slot[i];
+        int expect = DURATION / sl.sensor->getDutyCycle();
+        if ( abs((int)all[i]->reads - expect) > 1 || sl.stats.missed || sl.stats.skipped ) {
+            errors++;
+        }
+        ESP_LOGI(FNAME, "Sched test %-4s reads %u/%d jitter avg %.1fms max %ums missed %u skipped %u", all[i]->name(),
+            (unsigned)all[i]->reads, expect, sl.stats.sum_jitter / (float)sl.stats.count, (unsigned)sl.stats.max_jitter,
+            (unsigned)sl.stats.missed, (unsigned)sl.stats.skipped);
+    }
+    ESP_LOGI(FNAME, "Sched test errors %d", errors);
+}
+#endif
@@ -0,0 +1,62 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+class SensorBase;
+
+// Earliest deadline first scheduling of the sensor reads.
+//
+// A sensor is released every _update_interval_ms, its deadline is the next release. Sensors with a
+// conversion latency are primed at the release and read out _latency_ms later, all others are read
+// right away. Of all due actions the one with the earliest deadline runs first. The conversion waits
+// overlap, a one wire temperature conversion does not hold back the airspeed reads.
+// The scheduler does not sleep, the caller runs it and waits until the returned time of the next action.
+class SensorScheduler
+{
+public:
+    static constexpr int MaxSlots = 12;
+
+    explicit SensorScheduler(uint32_t (*clock)());
+
+    bool add(SensorBase *s);
+    void remove(SensorBase *s);
+    // run all due actions, returns the time of the next one (msec)
+    uint32_t run();
+    void statsLog();
+#ifdef SensorSched_Test
+    static void sched_test();
+#endif
+
+private:
+    enum Phase : uint8_t { NEW, IDLE, CONVERTING };
+    struct Stats {
+        uint32_t count;      // completed reads
+        uint32_t sum_jitter; // read later than the ideal time, msec
+        uint32_t max_jitter;
+        uint32_t missed;     // read completed past the deadline
+        uint32_t skipped;    // periods lost to an overrun
+    };
+    struct Slot {
+        SensorBase *sensor = nullptr;
+        uint32_t    release = 0; // start of the current period
+        uint32_t    due = 0;     // time of the next action
+        Phase       phase = NEW;
+        Stats       stats {};
+    };
+    void complete(Slot &sl, uint32_t start, uint32_t end);
+    void nextPeriod(Slot &sl, uint32_t now);
+
+    uint32_t (*_clock)();
+    std::array<Slot, MaxSlots> _slot {};
+};
+
+extern SensorScheduler SensorSched;
@@ -21,7 +21,8 @@
 
 static float as_buffer[ (SENSOR_HISTORY_DURATION_MS / 100) + 4 ]; // history buffer for airspeed sensor
 
-AirspeedSensor::AirspeedSensor() : SensorTP<float>(as_buffer, 100, SensorId::DIFFPRESSURE)
+// with the window statistics of the history, for the airspeed trend
+AirspeedSensor::AirspeedSensor() : SensorTP<float>(as_buffer, 100, SensorId::DIFFPRESSURE, true)
 {
     setNVSVar(&ias);
     // todo airspeed_mode.get()
@@ -23,7 +23,6 @@ public:
         _latency_ms = 800;
     };
     virtual uint8_t family() = 0;
-    virtual bool primeRead(uint32_t now_ms) = 0;
     onewire_device_address_t getAddress() const { return _address; }
     bool isConverting() const { return _converting; }
     uint32_t getConvertStartMs() const { return _convert_start_ms; }
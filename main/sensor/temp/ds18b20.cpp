@@ -32,7 +32,6 @@ DS18B20::DS18B20(onewire_device_address_t addr) : OwSens(addr, SensorId::TEMPERA
 {
     setNVSVar(&OAT);
     setFilter(new LowPassFilter(0.3f));
-    SensorRegistry::removeFromUpdateLoop(SensorId::TEMPERATURE);
 }
 
 bool DS18B20::setup()
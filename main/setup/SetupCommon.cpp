@@ -13,7 +13,11 @@
 #include "comm/DeviceMgr.h"
 #include "comm/CanBus.h"
 #include "protocol/nmea/XCVSyncMsg.h"
+#ifdef SetupSnapshot_Test
+#include "logdef.h"
+#else
 #include "logdefnone.h"
+#endif
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -21,14 +25,18 @@
 #include <esp_http_server.h>
 #include <miniz.h>
 #include <esp_mac.h>
+#include <esp_timer.h>
 
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 char SetupCommon::_ID[18] = { 0 };
 char SetupCommon::default_id[6] = { 0 };
 std::vector<SetupCommon *> SetupCommon::instances;
+std::vector<SetupCommon *> SetupCommon::by_key;
 XCVSyncMsg *SetupCommon::syncProto = nullptr;
 
 
@@ -150,10 +158,27 @@ bool SetupCommon::sync(){
 	return false;
 }
 
+// sorted once in initSetup() after all static entries are constructed, and not changed later on
+void SetupCommon::buildIndex(){
+	by_key = instances;
+	std::stable_sort(by_key.begin(), by_key.end(), [](const SetupCommon *a, const SetupCommon *b) {
+		return a->_key < b->_key; });
+}
+
 SetupCommon *SetupCommon::getMember( const char * key ){
-	for(int i = 0; i < instances.size(); i++ ) {
-		if( std::string(key) == instances[i]->key() ){
-			// ESP_LOGI(FNAME,"found key %s", instances[i]->key() );
+	return getMember( std::string_view(key) );
+}
+
+SetupCommon *SetupCommon::getMember( std::string_view key ){
+	auto it = std::lower_bound(by_key.begin(), by_key.end(), key, [](const SetupCommon *a, std::string_view k) {
+		return a->_key < k; });
+	if( it != by_key.end() && (*it)->_key == key ) {
+		// ESP_LOGI(FNAME,"found key %s", (*it)->key() );
+		return *it;
+	}
+	// entries created at runtime follow the indexed ones
+	for( size_t i = by_key.size(); i < instances.size(); i++ ) {
+		if( instances[i]->_key == key ) {
 			return instances[i];
 		}
 	}
@@ -169,34 +194,227 @@ bool SetupCommon::syncEntry( int entry ){
 }
 
 
+static constexpr uint8_t SNAPSHOT_MAGIC[4] = { 0x8f, 'X', 'C', 'F' };
+static constexpr int SNAPSHOT_HEADER = 8;
+
+static bool httpd_out( void *ctx, const char *data, int len ){
+	return httpd_resp_send_chunk( static_cast<httpd_req_t*>(ctx), data, len ) == ESP_OK;
+}
+
+static bool log_out( void *ctx, const char *data, int len ){
+	ESP_LOGI(FNAME,"%.*s", len, data );
+	return true;
+}
+
+bool SetupCommon::inSnapshot( SetupCommon *item ){
+	return item->flags._volatile != VOLATILE && item->getSize() < 256 && ! item->isDefault();
+}
+
+int SetupCommon::writeSnapshot( ConfigOut out, void *ctx ){
+	char buf[SNAPSHOT_CHUNK];
+	int count = 0;
+	for( SetupCommon *item : instances ) {
+		if( inSnapshot(item) ) {
+			count++;
+		}
+	}
+	memcpy( buf, SNAPSHOT_MAGIC, 4 );
+	buf[4] = SNAPSHOT_VERSION;
+	buf[5] = 0;
+	buf[6] = count & 0xff;
+	buf[7] = count >> 8;
+	int len = SNAPSHOT_HEADER;
+	int total = 0;
+	mz_ulong crc = MZ_CRC32_INIT;
+	for( SetupCommon *item : instances ) {
+		if( ! inSnapshot(item) ) {
+			continue;
+		}
+		int klen = item->_key.size();
+		int size = item->getSize();
+		if( len + klen + size + 3 > SNAPSHOT_CHUNK ) {
+			crc = mz_crc32( crc, (const uint8_t*)buf, len );
+			if( ! out( ctx, buf, len ) ) {
+				return -1;
+			}
+			total += len;
+			len = 0;
+		}
+		buf[len++] = klen;
+		memcpy( buf + len, item->_key.data(), klen );
+		len += klen;
+		buf[len++] = item->typeName();
+		buf[len++] = size;
+		memcpy( buf + len, item->getPtr(), size );
+		len += size;
+	}
+	crc = mz_crc32( crc, (const uint8_t*)buf, len );
+	if( len + 4 > SNAPSHOT_CHUNK ) {
+		if( ! out( ctx, buf, len ) ) {
+			return -1;
+		}
+		total += len;
+		len = 0;
+	}
+	for( int i = 0; i < 4; i++ ) {
+		buf[len++] = crc >> (8 * i);
+	}
+	if( ! out( ctx, buf, len ) ) {
+		return -1;
+	}
+	ESP_LOGI(FNAME,"config snapshot %d entries, %d bytes", count, total + len );
+	return total + len;
+}
+
+int SetupCommon::writeConfigText( ConfigOut out, void *ctx ){
+	char buf[SNAPSHOT_CHUNK];
+	int len = 0;
+	int total = 0;
+	for( SetupCommon *item : instances ) {
+		if( item->isDefault() ) {
+			continue;
+		}
+		std::string val = item->getValueAsStr();
+		int klen = item->_key.size();
+		int n = klen + val.size() + 2;
+		if( val.empty() || n > SNAPSHOT_CHUNK ) {
+			continue;
+		}
+		if( len + n > SNAPSHOT_CHUNK ) {
+			if( ! out( ctx, buf, len ) ) {
+				return -1;
+			}
+			total += len;
+			len = 0;
+		}
+		memcpy( buf + len, item->_key.data(), klen );
+		len += klen;
+		buf[len++] = ',';
+		memcpy( buf + len, val.data(), val.size() );
+		len += val.size();
+		buf[len++] = '\n';
+	}
+	if( len && ! out( ctx, buf, len ) ) {
+		return -1;
+	}
+	return total + len;
+}
+
+void SetupCommon::giveConfigSnapshot( httpd_req *req ){
+	ESP_LOGI(FNAME,"giveConfigSnapshot");
+	writeSnapshot( httpd_out, req );
+	httpd_resp_send_chunk( req, nullptr, 0 ); // send a zero length message
+}
+
 void SetupCommon::giveConfigChanges( httpd_req *req, bool log_only ){
 	ESP_LOGI(FNAME,"giveConfigChanges");
-	for(int i = 0; i < instances.size(); i++ ) {
-		if( instances[i]->isDefault() == false ) {
-			std::string val = instances[i]->getValueAsStr();
-			if( ! val.empty() ){
-				std::string cfg(instances[i]->key());
-				cfg += ',' + val + '\n';
-				ESP_LOGI(FNAME,"%s,%s", instances[i]->key(), val.c_str() );
-				if( !log_only )
-					httpd_resp_send_chunk( req, cfg.c_str(), cfg.size() );
-			}
+	if( log_only ) {
+		writeConfigText( log_out, nullptr );
+		return;
+	}
+	writeConfigText( httpd_out, req );
+	httpd_resp_send_chunk( req, nullptr, 0 ); // send a zero length message
+}
+
+// NVS write of the given entries with one handle and one commit
+bool SetupCommon::commitBatch( const std::vector<SetupCommon *> &items ){
+	if( items.empty() ) {
+		return true;
+	}
+	nvs_handle_t h = NVS.beginBatch();
+	if( ! h ) {
+		return false;
+	}
+	for( SetupCommon *item : items ) {
+		if( item->flags._volatile == PERSISTENT && NVS.setBlob( h, item->key(), item->getPtr(), item->getSize() ) ) {
+			item->flags._dirty = false;
 		}
 	}
-	if( !log_only ) {
-		std::string cfg;
-		httpd_resp_send_chunk( req, cfg.c_str(), 0 ); // send a zero length message
+	if( ! NVS.endBatch( h ) ) {
+		for( SetupCommon *item : items ) {
+			item->setDirty(); // for a later commitDirty()
+		}
+		return false;
 	}
+	return true;
 }
 
+int SetupCommon::restoreSnapshot( const uint8_t *data, int len ){
+	if( len < SNAPSHOT_HEADER + 4 || memcmp( data, SNAPSHOT_MAGIC, 4 ) != 0 || data[4] != SNAPSHOT_VERSION ) {
+		ESP_LOGW(FNAME,"no config snapshot version %d", SNAPSHOT_VERSION );
+		return 0;
+	}
+	int count = data[6] | (data[7] << 8);
+	// the records are walked once for their length and CRC, nothing is taken from a damaged snapshot
+	int pos = SNAPSHOT_HEADER;
+	for( int i = 0; i < count; i++ ) {
+		if( pos + 1 > len || pos + data[pos] + 3 > len ) {
+			ESP_LOGW(FNAME,"config snapshot truncated");
+			return 0;
+		}
+		pos += data[pos] + 3 + data[pos + data[pos] + 2];
+	}
+	if( pos + 4 > len ) {
+		ESP_LOGW(FNAME,"config snapshot truncated");
+		return 0;
+	}
+	uint32_t crc = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+	if( crc != mz_crc32( MZ_CRC32_INIT, data, pos ) ) {
+		ESP_LOGW(FNAME,"config snapshot CRC error");
+		return 0;
+	}
+
+	std::vector<SetupCommon *> changed;
+	changed.reserve( count );
+	int restored = 0;
+	pos = SNAPSHOT_HEADER;
+	for( int i = 0; i < count; i++ ) {
+		int klen = data[pos];
+		std::string_view key( (const char*)data + pos + 1, klen );
+		char type = data[pos + klen + 1];
+		int size = data[pos + klen + 2];
+		const uint8_t *val = data + pos + klen + 3;
+		pos += klen + 3 + size;
+		SetupCommon *item = getMember( key );
+		if( ! item || item->typeName() != type || item->getSize() != size || item->flags._volatile == VOLATILE ) {
+			ESP_LOGW(FNAME,"skip %.*s(%c) of %d bytes", klen, key.data(), type, size );
+			continue;
+		}
+		if( memcmp( item->getPtr(), val, size ) != 0 ) {
+			uint8_t old[256];
+			memcpy( old, item->getPtr(), size );
+			memcpy( item->getPtr(), val, size );
+			if( ! item->isValid() ) {
+				ESP_LOGW(FNAME,"skip %.*s, invalid value", klen, key.data() );
+				memcpy( item->getPtr(), old, size );
+				continue;
+			}
+			item->setDirty();
+			changed.push_back( item );
+		}
+		restored++;
+	}
+	if( ! commitBatch( changed ) ) {
+		ESP_LOGE(FNAME,"config snapshot NVS commit failed");
+	}
+	ESP_LOGI(FNAME,"restored %d of %d, %d changed", restored, count, changed.size() );
+	return restored;
+}
 
 int SetupCommon::restoreConfigChanges( int len, char *data ){
+	// a snapshot starts behind the form data header of the upload
+	const char *snap = (const char*)memmem( data, len, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) );
+	if( snap ) {
+		return restoreSnapshot( (const uint8_t*)snap, len - (snap - data) );
+	}
+
 	ESP_LOGI(FNAME,"restoreConfigChanges len: %d \n %s", len, data );
 	std::istringstream fs;
 	fs.str( data );
 	std::string line;
 	int i=0;
 	int valid=0;
+	std::vector<SetupCommon *> changed;
 	while( std::getline(fs, line, '\n') ) {
 		if( line.find( "xcvario-config" ) != std::string::npos ){
 			valid++;
@@ -212,16 +430,22 @@ int SetupCommon::restoreConfigChanges( int len, char *data ){
 		}
 		else if( (line.length() > 1) && (valid >= 2) && line.find( "," ) != std::string::npos ){
 			ESP_LOGI(FNAME, "%d, len:%d, %s\n", i, line.length(), line.c_str() );
-			std::string key = line.substr(0, line.find(','));
+			std::string_view key( line.data(), line.find(',') );
 			std::string value = line.substr(line.find(',')+1, line.length());
-			ESP_LOGI(FNAME, "%d %s ", i, key.c_str()  );
-			SetupCommon * item = getMember( key.c_str() );
-			ESP_LOGI(FNAME, ", typename: %c \n", item->typeName()  );
+			SetupCommon * item = getMember( key );
+			if( ! item ) {
+				ESP_LOGW(FNAME, "%d unknown key %s", i, line.c_str() );
+				continue;
+			}
+			ESP_LOGI(FNAME, "%d %s, typename: %c \n", i, item->key(), item->typeName() );
 			item->setValueFromStr( value.c_str() );
-			item->commit();  // lets do that lazy later
+			if( item->getDirty() ) {
+				changed.push_back( item );
+			}
 			i++;
 		}
 	}
+	commitBatch( changed );
 	ESP_LOGI(FNAME,"return %d", i);
 	return i;
 }
@@ -311,11 +535,17 @@ bool SetupCommon::initSetup()
 			ESP_LOGE(FNAME,"Error init with default NVS: %s", instances[i]->key() );
 		}
 	}
+	// Installs from before the color depth setting keep the 18 bit mode they ran with
+	if( ! display_colors.exists() && hardwareRevision.exists() ) {
+		ESP_LOGI(FNAME,"Keep the RGB666 display mode of this install");
+		display_colors.set( DISPLAY_RGB666, false, false );
+	}
 
 	if( factory_reset.get() ) {
 		ret = factoryReset();
 		commitDirty();
 	}
+	buildIndex();
 	giveConfigChanges( 0, true );
 	return ret;
 };
@@ -381,3 +611,31 @@ bool SetupCommon::isWired()
 int SetupCommon::numEntries() {
 	return instances.size();
 }
+
+#ifdef SetupSnapshot_Test
+static bool append_out( void *ctx, const char *data, int len ){
+	static_cast<std::string*>(ctx)->append( data, len );
+	return true;
+}
+
+// backup and restore time of the text format and the snapshot, the restore rewrites the same values
+void SetupCommon::snapshot_test()
+{
+	std::string text( "filename=\"xcvario-config.csv\"\nContent-Type: text/csv\n\n" );
+	std::string snap;
+	int64_t t0 = esp_timer_get_time();
+	writeConfigText( append_out, &text );
+	int64_t t1 = esp_timer_get_time();
+	writeSnapshot( append_out, &snap );
+	int64_t t2 = esp_timer_get_time();
+	int nt = restoreConfigChanges( text.size(), text.data() );
+	int64_t t3 = esp_timer_get_time();
+	int ns = restoreSnapshot( (const uint8_t*)snap.data(), snap.size() );
+	int64_t t4 = esp_timer_get_time();
+	ESP_LOGI(FNAME, "config of %d entries", numEntries() );
+	ESP_LOGI(FNAME, "text     %5d bytes, %3d restored, backup %6d us, restore %6d us", (int)text.size(), nt, int(t1 - t0), int(t3 - t2) );
+	ESP_LOGI(FNAME, "snapshot %5d bytes, %3d restored, backup %6d us, restore %6d us", (int)snap.size(), ns, int(t2 - t1), int(t4 - t3) );
+	snap[snap.size() / 2] ^= 0x10;
+	ESP_LOGI(FNAME, "damaged snapshot %s", restoreSnapshot( (const uint8_t*)snap.data(), snap.size() ) ? "TAKEN" : "refused" );
+}
+#endif
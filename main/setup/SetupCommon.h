@@ -8,6 +8,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 
@@ -55,10 +56,29 @@ public:
 	static char *getDefaultID(bool enforce_four_diggits = false);
 	static const char *getFixedID();
 	static SetupCommon * getMember( const char * key );
+	static SetupCommon * getMember( std::string_view key );
 	static bool syncEntry( int entry );
 	static int numEntries();
+
+	// Config backup, all non default entries. The binary snapshot is
+	//   header  magic 8F 'X' 'C' 'F', version, 0, number of records (uint16, little endian)
+	//   record  key length, key, type name, value size, value bytes as stored in NVS
+	//   CRC-32 of all the bytes before (little endian)
+	// Both formats stream out of a fixed buffer in chunks of SNAPSHOT_CHUNK.
+	typedef bool (*ConfigOut)(void *ctx, const char *data, int len);
+	static constexpr int SNAPSHOT_CHUNK = 1024;
+	static constexpr uint8_t SNAPSHOT_VERSION = 1;
+	static int writeSnapshot( ConfigOut out, void *ctx ); // bytes written or -1
+	static int writeConfigText( ConfigOut out, void *ctx );
+	static void giveConfigSnapshot( httpd_req *req );
 	static void giveConfigChanges( httpd_req *req, bool log_only=false );
+	// Restores a snapshot or the text format, also as part of a form upload, in one NVS commit.
+	// Returns the number of entries restored, 0 on a format error.
 	static int restoreConfigChanges( int len, char *data );
+	static int restoreSnapshot( const uint8_t *data, int len );
+#ifdef SetupSnapshot_Test
+	static void snapshot_test();
+#endif
 	static bool getOldFloat( const char * key, float &val );
 	static bool getOldInt( const char * key, int &val );
 
@@ -81,7 +101,11 @@ protected:
 private:
 	static XCVSyncMsg *syncProto;
 	static bool factoryReset();
+	static bool inSnapshot( SetupCommon *item );
+	static void buildIndex();
+	static bool commitBatch( const std::vector<SetupCommon *> &items );
 	static std::vector<SetupCommon *> instances;
+	static std::vector<SetupCommon *> by_key; // instances sorted by key
 	static char _ID[18];
 	static char default_id[6];
 };
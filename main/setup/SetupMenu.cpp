@@ -1199,6 +1199,11 @@ void system_menu_create_hardware_type(SetupMenu *top) {
 			"Modify display clock by given percentage (restarts on exit)", 100);
 	top->addEntry(dcadj);
 
+	SetupMenuSelect *dcol = new SetupMenuSelect("Color Depth", RST_ON_EXIT, nullptr, &display_colors);
+	dcol->setHelp("Pixel format on the display bus, 16 bit RGB565 takes a third less transfer time than 18 bit (reboots)");
+	dcol->addEntry("18 bit");
+	dcol->addEntry("16 bit");
+	top->addEntry(dcol);
 }
 
 void system_menu_create_hardware_rotary(SetupMenu *top) {
@@ -1268,6 +1273,13 @@ void system_menu_create_hardware_ahrs_parameter(SetupMenu *top) {
 	gyrog->setHelp("Minimum accepted gyro rate in degree per second");
 	top->addEntry(gyrog);
 
+	SetupMenuSelect *imurate = new SetupMenuSelect("IMU Sample Rate", RST_ON_EXIT, nullptr, &imu_fifo_rate);
+	imurate->setHelp("Sample the IMU at a high rate into its FIFO and integrate every sample, instead of one register read per 100 msec");
+	imurate->addEntry("10 Hz", 0);
+	imurate->addEntry("100 Hz", 100);
+	imurate->addEntry("200 Hz", 200);
+	top->addEntry(imurate);
+
 	SetupMenuValFloat *tcontrol = new SetupMenuValFloat("AHRS Temp Control", "", nullptr, false, &mpu_temperature);
 	tcontrol->setPrecision(0);
 	tcontrol->setHelp(
@@ -169,7 +169,7 @@ static void flap_update_act() {
 }
 
 void send_config( httpd_req *req ){
-	SetupCommon::giveConfigChanges( req );
+	SetupCommon::giveConfigSnapshot( req );
 }
 
 int restore_config(int len, char *data){
@@ -348,6 +348,7 @@ SetupNG<float>		    ahrs_min_gyro_factor("AHRSLGYF", 20, true, SYNC_NONE, PERSIS
 SetupNG<float>		    ahrs_dynamic_factor("AHRSGDYN", 5, true, SYNC_NONE, PERSISTENT, nullptr, QUANT_NONE, LIMITS(0.5, 10, 0.1));
 SetupNG<int>		    ahrs_roll_check("AHRSRCHECK", 0 );
 SetupNG<float>       	gyro_gating("GYRO_GAT", 1.0, true, SYNC_NONE, PERSISTENT, nullptr, QUANT_NONE, LIMITS(0, 10, 0.1));
+SetupNG<int>		    imu_fifo_rate("IMU_FIFO", 0 );
 SetupNG<int>		    s2f_switch_type("S2FHWSW", S2F_HW_SWITCH );
 SetupNG<int>		    hardwareRevision("HWREV", HW_UNKNOWN );
 SetupNG<t_tenchar_id>	ahrs_licence("AHRS_LIC", t_tenchar_id(""), false );
@@ -380,6 +381,7 @@ SetupNG<float>          compass_z_scale( "CP_Z_SCALE", 1.0 );
 SetupNG<int>            compass_calibrated( "CP_CALIBRATED", 0 );
 SetupNG<float>          compass_declination( "CP_DECL", 0, true, SYNC_NONE, PERSISTENT, nullptr, QUANT_NONE, LIMITS(-180, 180, 1.0));
 SetupNG<int>            compass_declination_valid( "CP_DECL_VALID", 0 );
+SetupNG<int>            compass_declination_auto( "CP_DECL_AUTO", 0 );
 SetupNG<float>          compass_damping( "CPS_DAMP", 1.0, true, SYNC_NONE, PERSISTENT, nullptr, QUANT_NONE, LIMITS(0.1, 10.0, 0.1));
 SetupNG<int>            compass_nmea_hdm( "CP_NMEA_HDM", 0 );
 SetupNG<int>            compass_nmea_hdt( "CP_NMEA_HDT", 0 );
@@ -440,6 +442,7 @@ SetupNG<int> 			gear_warning("GEARWA", 0 );
 SetupNG<t_tenchar_id>	custom_wireless_id("WLID", t_tenchar_id("") );
 SetupNG<int> 			logging("LOGGING", 0 );
 SetupNG<float>      	display_clock_adj("DSCLADHJ", 0, true, SYNC_NONE, PERSISTENT, nullptr, QUANT_NONE, LIMITS(-2, 2, 0.1));
+SetupNG<int>      		display_colors("DSCOLORS", DISPLAY_RGB565, true, SYNC_NONE, PERSISTENT);
 
 SetupNG<float>				glider_ground_aa("GLD_GND_AA", 12.0, true, SYNC_FROM_MASTER, PERSISTENT, nullptr, QUANT_NONE, LIMITS(-5, 20, 1));
 SetupNG<Quaternion>			imu_reference("IMU_REFERENCE", Quaternion(), false);
@@ -460,6 +463,7 @@ SetupNG<DeviceNVS>		magsens_devsetup("MAGSENS", DeviceNVS() );
 SetupNG<DeviceNVS>		navi_devsetup("NAVI", DeviceNVS() );
 SetupNG<DeviceNVS>		flarm_host_setup("NAVIFLARM", DeviceNVS() );
 SetupNG<DeviceNVS>		flarm_host2_setup("NAVIFLDOWN", DeviceNVS() );
+SetupNG<DeviceNVS>		telemetry_devsetup("TELEMETRY", DeviceNVS() );
 SetupNG<DeviceNVS>		radio_host_setup("NAVIRADIO", DeviceNVS() );
 SetupNG<DeviceNVS>		krt_devsetup("KRTRADIO", DeviceNVS() );
 SetupNG<DeviceNVS>		atr_devsetup("ATRIRADIO", DeviceNVS() );
@@ -77,6 +77,7 @@ typedef enum e_altimeter_select { AS_TE_SENSOR, AS_BARO_SENSOR, AS_EXTERNAL } e_
 typedef enum e_s2f_arrow_color { AC_WHITE_WHITE, AC_BLUE_BLUE, AC_GREEN_RED } e_s2f_arrow_color_t;
 typedef enum e_vario_needle_color { VN_COLOR_WHITE, VN_COLOR_ORANGE, VN_COLOR_RED }  e_vario_needle_color_t;
 typedef enum e_display_orientation { DISPLAY_NORMAL, DISPLAY_TOPDOWN, DISPLAY_NINETY } e_display_orientation_t;
+typedef enum e_display_colors { DISPLAY_RGB666, DISPLAY_RGB565 } e_display_colors_t;
 typedef enum e_gear_warning_io { GW_OFF, GW_FLAP_SENSOR, GW_S2_RS232_RX, GW_FLAP_SENSOR_INV, GW_S2_RS232_RX_INV, GW_EXTERNAL }  e_gear_warning_io_t;
 typedef enum e_data_mon_mode { MON_MOD_ASCII, MON_MOD_BINARY } e_data_mon_mode_t;
 typedef enum e_hardware_rev {
@@ -441,6 +442,7 @@ extern SetupNG<float>		ahrs_min_gyro_factor;
 extern SetupNG<float>		ahrs_dynamic_factor;
 extern SetupNG<int>		    ahrs_roll_check;
 extern SetupNG<float>       gyro_gating;
+extern SetupNG<int>		    imu_fifo_rate;
 extern SetupNG<int>		    s2f_switch_type;
 extern SetupNG<int>		    hardwareRevision;
 extern SetupNG<t_tenchar_id> ahrs_licence;
@@ -473,6 +475,7 @@ extern SetupNG<float>       compass_z_scale;
 extern SetupNG<int>         compass_calibrated;
 extern SetupNG<float>       compass_declination;
 extern SetupNG<int>         compass_declination_valid;
+extern SetupNG<int>         compass_declination_auto;
 extern SetupNG<float>		compass_damping;
 extern SetupNG<int>         compass_nmea_hdm;
 extern SetupNG<int>         compass_nmea_hdt;
@@ -532,6 +535,7 @@ extern SetupNG<int> 		gear_warning;
 extern SetupNG<t_tenchar_id>  custom_wireless_id;
 extern SetupNG<int> 		logging;
 extern SetupNG<float>      	display_clock_adj;
+extern SetupNG<int>      	display_colors;
 
 extern SetupNG<float>		glider_ground_aa;
 extern SetupNG<Quaternion>	imu_reference;
@@ -551,6 +555,7 @@ extern SetupNG<DeviceNVS>	magsens_devsetup;
 extern SetupNG<DeviceNVS>	navi_devsetup;
 extern SetupNG<DeviceNVS>	flarm_host_setup;
 extern SetupNG<DeviceNVS>	flarm_host2_setup;
+extern SetupNG<DeviceNVS>	telemetry_devsetup;
 extern SetupNG<DeviceNVS>	radio_host_setup;
 extern SetupNG<DeviceNVS>	krt_devsetup;
 extern SetupNG<DeviceNVS>	atr_devsetup;
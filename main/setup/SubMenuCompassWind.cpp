@@ -14,6 +14,7 @@
 #include "logdef.h"
 #include "setup/SetupNG.h"
 #include "wind/WindCalcTask.h"
+#include "wmm/Declination.h"
 
 // compass menu handlers.
 static int compassDeviationAction(SetupMenuSelect *p) {
@@ -74,50 +75,63 @@ static void options_menu_create_compasswind_compass_nmea(SetupMenu *top) {
 }
 
 static void options_menu_create_compasswind_compass(SetupMenu *top) {
-	SetupMenuSelect *compSensorCal = new SetupMenuSelect("Sensor Calibration", RST_NONE, compassSensorCalibrateAction);
-	compSensorCal->addEntry("Cancel");
-	compSensorCal->addEntry("Start");
-	compSensorCal->addEntry("Show");
-	compSensorCal->addEntry("Show Raw Data");
-	compSensorCal->setHelp("Calibrate Magnetic Sensor, mandatory for operation");
-	top->addEntry(compSensorCal);
-
-	// Fixme replace by WMM
-	SetupMenuValFloat *cd = new SetupMenuValFloat("Setup Declination", "°", compassDeclinationAction, false, &compass_declination);
-	cd->setHelp("Set compass declination in degrees");
-	top->addEntry(cd);
-
-	SetupMenuSelect *devMenuA = new SetupMenuSelect("AutoDeviation", RST_NONE, nullptr, &compass_dev_auto);
-	devMenuA->setHelp("Automatic adaptive deviation and precise airspeed evaluation method using data from circling wind");
-	devMenuA->addEntry("Disable");
-	devMenuA->addEntry("Enable");
-	top->addEntry(devMenuA);
-
-	SetupMenu *devMenu = new SetupMenu("Setup Deviations", options_menu_create_compasswind_compass_dev);
-	devMenu->setHelp("Compass Deviations", 280);
-	top->addEntry(devMenu);
-
-	// Show comapss deviations
-	SetupMenuDisplay *smd = new SetupMenuDisplay("Show Deviations", display_deviations_action);
-	top->addEntry(smd);
-
-	SetupMenuSelect *sms = new SetupMenuSelect("Reset Deviations ", RST_NONE, compassResetDeviationAction);
-	sms->setHelp("Reset all deviation data to zero");
-	sms->addEntry("Cancel");
-	sms->addEntry("Reset");
-	top->addEntry(sms);
-
-	SetupMenu *nmeaMenu = new SetupMenu("Setup NMEA", options_menu_create_compasswind_compass_nmea);
-	top->addEntry(nmeaMenu);
-
-	SetupMenuValFloat *compdamp = new SetupMenuValFloat("Damping", "sec", nullptr, false, &compass_damping);
-	compdamp->setPrecision(1);
-	top->addEntry(compdamp);
-	compdamp->setHelp("Compass or magnetic heading damping factor in seconds");
-
-	// Show compass settings
-	SetupMenuDisplay *scs = new SetupMenuDisplay("Show Settings", show_compass_setting);
-	top->addEntry(scs);
+	if ( top->getNrChilds() == 0 ) {
+		top->setDynContent();
+
+		SetupMenuSelect *compSensorCal = new SetupMenuSelect("Sensor Calibration", RST_NONE, compassSensorCalibrateAction);
+		compSensorCal->addEntry("Cancel");
+		compSensorCal->addEntry("Start");
+		compSensorCal->addEntry("Show");
+		compSensorCal->addEntry("Show Raw Data");
+		compSensorCal->setHelp("Calibrate Magnetic Sensor, mandatory for operation");
+		top->addEntry(compSensorCal);
+
+		SetupMenuSelect *autoDecl = new SetupMenuSelect("Auto Declination", RST_NONE, windResourcesAction, &compass_declination_auto);
+		autoDecl->addEntry("Disable");
+		autoDecl->addEntry("Enable");
+		top->addEntry(autoDecl);
+
+		SetupMenuValFloat *cd = new SetupMenuValFloat("Setup Declination", "°", compassDeclinationAction, false, &compass_declination);
+		cd->setHelp("Set compass declination in degrees, overwritten while auto declination is enabled");
+		top->addEntry(cd);
+
+		SetupMenuSelect *devMenuA = new SetupMenuSelect("AutoDeviation", RST_NONE, nullptr, &compass_dev_auto);
+		devMenuA->setHelp("Automatic adaptive deviation and precise airspeed evaluation method using data from circling wind");
+		devMenuA->addEntry("Disable");
+		devMenuA->addEntry("Enable");
+		top->addEntry(devMenuA);
+
+		SetupMenu *devMenu = new SetupMenu("Setup Deviations", options_menu_create_compasswind_compass_dev);
+		devMenu->setHelp("Compass Deviations", 280);
+		top->addEntry(devMenu);
+
+		// Show comapss deviations
+		SetupMenuDisplay *smd = new SetupMenuDisplay("Show Deviations", display_deviations_action);
+		top->addEntry(smd);
+
+		SetupMenuSelect *sms = new SetupMenuSelect("Reset Deviations ", RST_NONE, compassResetDeviationAction);
+		sms->setHelp("Reset all deviation data to zero");
+		sms->addEntry("Cancel");
+		sms->addEntry("Reset");
+		top->addEntry(sms);
+
+		SetupMenu *nmeaMenu = new SetupMenu("Setup NMEA", options_menu_create_compasswind_compass_nmea);
+		top->addEntry(nmeaMenu);
+
+		SetupMenuValFloat *compdamp = new SetupMenuValFloat("Damping", "sec", nullptr, false, &compass_damping);
+		compdamp->setPrecision(1);
+		top->addEntry(compdamp);
+		compdamp->setHelp("Compass or magnetic heading damping factor in seconds");
+
+		// Show compass settings
+		SetupMenuDisplay *scs = new SetupMenuDisplay("Show Settings", show_compass_setting);
+		top->addEntry(scs);
+	}
+	// the model expiry is known once a position came in
+	SetupMenuSelect *autoDecl = static_cast<SetupMenuSelect*>(top->getEntry(1));
+	autoDecl->setHelp(Declination::modelExpired()
+		? "Derive the declination from GNSS position and date, the built in magnetic model has expired, values are extrapolated"
+		: "Derive the declination from GNSS position and date using the world magnetic model");
 }
 
 static void options_menu_create_compasswind_straightwind_filters(SetupMenu *top) {
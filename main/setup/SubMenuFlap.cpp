@@ -17,6 +17,7 @@
 #include "AnalogInput.h"
 #include "AdaptUGC.h"
 #include "sensor.h"
+#include "sensor/Filters.h"
 #include "logdefnone.h"
 
 #include <string>
@@ -72,7 +73,7 @@ static int select_flap_sens_pin(SetupMenuSelect *p)
     return 0;
 }
 
-static int wk_calib_level(SetupMenuSelect *p, int wk, Average<15> &filter)
+static int wk_calib_level(SetupMenuSelect *p, int wk, MovingAverage<15, int> &filter)
 {
     MYUCG->setPrintPos(1, 60);
     MYUCG->printf("Set Flap %s ", FLAP->getFL(wk)->label);
@@ -81,7 +82,7 @@ static int wk_calib_level(SetupMenuSelect *p, int wk, Average<15> &filter)
     while (! Rotary->readSwitch() && FLAP)
     {
         i++;
-        sensval = filter((int)(FLAP->getSensorRaw()));
+        sensval = filter.filter((int)(FLAP->getSensorRaw()));
         if (!(i % 5))
         {
             MYUCG->setPrintPos(1, 140);
@@ -107,7 +108,7 @@ static int flap_cal_act(SetupMenuSelect *p)
         ESP_LOGI(FNAME, "Abort calibration, no signal");
         return 0;
     }
-    Average<15> filter;
+    MovingAverage<15, int> filter;
     if (p->getSelect())
     {
         // do calibration
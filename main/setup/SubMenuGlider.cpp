@@ -132,7 +132,7 @@ void glider_selection_create(SetupMenu *top) {
     top->addEntry(glt);
     top->setHighlight(1);
     int event = ButtonEvent(ButtonEvent::SHORT_PRESS).raw;
-    xQueueSend(uiEventQueue, &event, 0); // virtually press the button to straight enter the selection
+    uiPostEvent(event); // virtually press the button to straight enter the selection
 }
 SetupMenu *createGliderSelectMenu() {
     SetupMenu *glt_menu = new SetupMenu("Set the glider type",glider_selection_create);
@@ -9,8 +9,10 @@
 #include "WindCalcTask.h"
 #include "CircleWind.h"
 #include "StraightWind.h"
+#include "wmm/Declination.h"
 #include "setup/SetupCommon.h"
 #include "setup/SetupNG.h"
+#include "CrashTrace.h"
 #include "logdefnone.h"
 
 #include <freertos/FreeRTOS.h>
@@ -35,6 +37,7 @@ static void wind_calc_task(void *arg)
         bool new_job = xQueueReceive(queue, &job, timeout) == pdTRUE;
 
         if ( new_job ) {
+            CrashTrace::queue(CrashTrace::QUEUE_RECV, true);
             if (job.raw == 0) {
                 break;
             } // termination signal
@@ -56,6 +59,9 @@ static void wind_calc_task(void *arg)
                     circleWind->newConstellation(job.getDetail());
                 }
                 break;
+            case CalkTaskJob::CALK_TASK_EVENT_DECLINATION:
+                Declination::refresh();
+                break;
             default:
                 ESP_LOGE(FNAME, "Unknown job type %d", job.getJobTyp() );
                 break;
@@ -116,12 +122,16 @@ void WindCalcTask::createWindResources()
             delete tmp;
         }
 
-        // wind calculation
-        if ( ! CalcTask && (circleWind || straightWind) ) {
+        // wind calculation, and the WMM declination
+        bool needBackground = circleWind || straightWind || compass_declination_auto.get();
+        if ( ! CalcTask && needBackground ) {
             CalcTask = new WindCalcTask();
             BackgroundTaskQueue = CalcTask->getQueue();
         }
-        else if ( CalcTask && ! (circleWind || straightWind) ) {
+        else if ( CalcTask && needBackground ) {
+            BackgroundTaskQueue = CalcTask->getQueue();
+        }
+        else if ( CalcTask && ! needBackground ) {
             BackgroundTaskQueue = nullptr;
             // WindCalcTask *tmp = CalcTask;
             // CalcTask = nullptr;
@@ -17,7 +17,8 @@ extern QueueHandle_t BackgroundTaskQueue;
 struct CalkTaskJob
 {
     enum { CALK_TASK_EVENT_NEW_GPSPOSE = 0x0100,
-           CALK_TASK_EVENT_NUMSAT = 0x0200
+           CALK_TASK_EVENT_NUMSAT = 0x0200,
+           CALK_TASK_EVENT_DECLINATION = 0x0300
     };
 
     uint16_t raw;
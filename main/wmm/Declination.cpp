@@ -0,0 +1,236 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#include "Declination.h"
+#include "geomag.h"
+#include "wmm_2020.h"
+#include "wind/WindCalcTask.h"
+#include "setup/SetupNG.h"
+#include "comm/Mutex.h"
+#include "CrashTrace.h"
+#include "logdefnone.h"
+
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+namespace {
+
+struct Node {
+    int16_t ilat = 0;
+    int16_t ilon = 0;
+    float dec = 0.f;
+    uint32_t used = 0; // lru stamp, 0 := empty
+};
+
+constexpr int LON_NODES = 360 / Declination::GRID_DEG;
+
+Node cache[Declination::CACHE_SIZE];
+uint32_t use_stamp = 0;
+float cache_year = 0.f; // model date the nodes got evaluated for
+SemaphoreMutex cache_mutex;
+
+// last fix, handed over to the background task
+float pos_lat = 0.f, pos_lon = 0.f, pos_year = 0.f;
+bool job_pending = false;
+
+WMM_Model *wmm = nullptr;
+bool model_expired = false; // the date is past the 5 year model life, extrapolated
+
+inline int wrapLon(int ilon) {
+    ilon %= LON_NODES;
+    return (ilon < 0) ? ilon + LON_NODES : ilon;
+}
+
+// grid cell of a position, poles are clamped away
+inline void cellOf(float lat, float lon, int &ilat, int &ilon) {
+    lat = std::fmin(std::fmax(lat, -88.f), 88.f - Declination::GRID_DEG);
+    ilat = (int)std::floor(lat / Declination::GRID_DEG);
+    ilon = (int)std::floor(lon / Declination::GRID_DEG);
+}
+
+// needs cache_mutex
+Node *findNode(int ilat, int ilon) {
+    ilon = wrapLon(ilon);
+    for (Node &n : cache) {
+        if (n.used && n.ilat == ilat && n.ilon == ilon) {
+            return &n;
+        }
+    }
+    return nullptr;
+}
+
+// needs cache_mutex
+Node *victim() {
+    Node *v = &cache[0];
+    for (Node &n : cache) {
+        if (n.used < v->used) {
+            v = &n;
+        }
+    }
+    return v;
+}
+
+void applyDeclination(float dec) {
+    if (!compass_declination_auto.get()) {
+        return;
+    }
+    dec = std::roundf(dec * 10.f) / 10.f;
+    if (dec != compass_declination.get()) {
+        ESP_LOGI(FNAME, "WMM declination %.1f", dec);
+        compass_declination.set(dec);
+    }
+    if (!compass_declination_valid.get()) {
+        compass_declination_valid.set(1);
+    }
+}
+
+} // anonymous namespace
+
+bool Declination::modelExpired()
+{
+    return model_expired;
+}
+
+bool Declination::lookup(float lat, float lon, float &dec)
+{
+    int ilat, ilon;
+    cellOf(lat, lon, ilat, ilon);
+
+    std::lock_guard<SemaphoreMutex> lock(cache_mutex);
+    Node *n00 = findNode(ilat, ilon);
+    Node *n01 = findNode(ilat, ilon + 1);
+    Node *n10 = findNode(ilat + 1, ilon);
+    Node *n11 = findNode(ilat + 1, ilon + 1);
+    if (!(n00 && n01 && n10 && n11)) {
+        return false;
+    }
+    n00->used = n01->used = n10->used = n11->used = ++use_stamp;
+
+    // bilinear, with the declination jump at +-180 unwrapped to the first node
+    float d01 = n01->dec, d10 = n10->dec, d11 = n11->dec;
+    if (d01 - n00->dec > 180.f) d01 -= 360.f; else if (d01 - n00->dec < -180.f) d01 += 360.f;
+    if (d10 - n00->dec > 180.f) d10 -= 360.f; else if (d10 - n00->dec < -180.f) d10 += 360.f;
+    if (d11 - n00->dec > 180.f) d11 -= 360.f; else if (d11 - n00->dec < -180.f) d11 += 360.f;
+    float u = lat / GRID_DEG - ilat;
+    float v = lon / GRID_DEG - ilon;
+    u = std::fmin(std::fmax(u, 0.f), 1.f); // clamped lat
+    dec = (1.f - u) * ((1.f - v) * n00->dec + v * d01) + u * ((1.f - v) * d10 + v * d11);
+    if (dec > 180.f) dec -= 360.f; else if (dec < -180.f) dec += 360.f;
+    return true;
+}
+
+void Declination::newPosition(float lat, float lon, float year)
+{
+    float dec;
+    if (std::fabs(year - cache_year) < 0.5f && lookup(lat, lon, dec)) {
+        applyDeclination(dec);
+        return;
+    }
+    // cache miss, let the background task do the expensive part
+    std::lock_guard<SemaphoreMutex> lock(cache_mutex);
+    pos_lat = lat;
+    pos_lon = lon;
+    pos_year = year;
+    if (!job_pending && BackgroundTaskQueue) {
+        CalkTaskJob job(CalkTaskJob::CALK_TASK_EVENT_DECLINATION);
+        job_pending = xQueueSend(BackgroundTaskQueue, &job, 0) == pdTRUE;
+        CrashTrace::queue(CrashTrace::QUEUE_SEND, job_pending);
+    }
+}
+
+void Declination::refresh()
+{
+    if (!wmm) {
+        wmm = new WMM_Model(MAXORD, EPOCH, (float*)&(WMMCOF[0][0]));
+    }
+
+    float lat, lon, year;
+    {
+        std::lock_guard<SemaphoreMutex> lock(cache_mutex);
+        lat = pos_lat;
+        lon = pos_lon;
+        year = pos_year;
+        job_pending = false;
+        if (std::fabs(year - cache_year) >= 0.5f) {
+            // secular variation, start over with the new date
+            for (Node &n : cache) { n.used = 0; }
+            cache_year = year;
+        }
+    }
+
+    int ilat, ilon;
+    cellOf(lat, lon, ilat, ilon);
+    for (int i = 0; i < 4; i++) {
+        int nlat = ilat + (i >> 1);
+        int nlon = wrapLon(ilon + (i & 1));
+        {
+            std::lock_guard<SemaphoreMutex> lock(cache_mutex);
+            if (findNode(nlat, nlon)) {
+                continue;
+            }
+        }
+        // the expensive part, w/o holding the lock
+        float x, y, z, h, dec, dip, ti, gv;
+        bool in_life = wmm->geomag(0.f, nlat * GRID_DEG, nlon * GRID_DEG, year, &x, &y, &z, &h, &dec, &dip, &ti, &gv);
+        if (!in_life && !model_expired) {
+            ESP_LOGW(FNAME, "WMM %d model expired for %.1f, declination extrapolated", (int)EPOCH, year);
+        }
+        model_expired = !in_life;
+        std::lock_guard<SemaphoreMutex> lock(cache_mutex);
+        Node *n = victim();
+        n->ilat = nlat;
+        n->ilon = nlon;
+        n->dec = dec;
+        n->used = ++use_stamp;
+        ESP_LOGI(FNAME, "WMM node %d/%d: %.2f", nlat * GRID_DEG, nlon * GRID_DEG, dec);
+    }
+
+    float dec;
+    if (lookup(lat, lon, dec)) {
+        applyDeclination(dec);
+    }
+}
+
+
+#ifdef Declination_Test
+#include <esp_timer.h>
+
+// geomag() cost and the interpolation error of the grid cache against the full model
+void Declination::declination_test()
+{
+    WMM_Model model(MAXORD, EPOCH, (float*)&(WMMCOF[0][0]));
+    float x, y, z, h, ref, dip, ti, gv;
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < 10; i++) {
+        model.geomag(0.f, 48.f + i * 0.1f, 8.f, 2025.f, &x, &y, &z, &h, &ref, &dip, &ti, &gv);
+    }
+    int64_t t1 = esp_timer_get_time();
+    ESP_LOGI(FNAME, "geomag(): %lldusec per call", (t1 - t0) / 10);
+
+    float max_err = 0.f;
+    int64_t lookup_us = 0, lookups = 0;
+    for (float lat = 46.1f; lat < 52.f; lat += 0.37f) {
+        for (float lon = 5.1f; lon < 15.f; lon += 0.41f) {
+            float dec;
+            pos_lat = lat; pos_lon = lon; pos_year = 2025.f;
+            t0 = esp_timer_get_time();
+            bool hit = lookup(lat, lon, dec);
+            lookup_us += esp_timer_get_time() - t0;
+            lookups++;
+            if (!hit) {
+                refresh();
+                lookup(lat, lon, dec);
+            }
+            model.geomag(0.f, lat, lon, 2025.f, &x, &y, &z, &h, &ref, &dip, &ti, &gv);
+            max_err = std::fmax(max_err, std::fabs(dec - ref));
+        }
+    }
+    ESP_LOGI(FNAME, "Grid %d°: max interpolation error %.3f°, lookup %lldusec", GRID_DEG, max_err, lookup_us / lookups);
+}
+#endif
@@ -0,0 +1,36 @@
+/***********************************************************
+ ***   THIS DOCUMENT CONTAINS PROPRIETARY INFORMATION.   ***
+ ***    IT IS THE EXCLUSIVE CONFIDENTIAL PROPERTY OF     ***
+ ***     Rohs Engineering Design AND ITS AFFILIATES.     ***
+ ***                                                     ***
+ ***       Copyright (C) Rohs Engineering Design         ***
+ ***********************************************************/
+
+#pragma once
+
+// #define Declination_Test 1
+
+// Automatic magnetic declination from the world magnetic model.
+//
+// The degree 12 expansion is only evaluated on the nodes of a coarse lat/lon grid and only
+// from within the background task. A GNSS fix bilinear interpolates over the four cached
+// nodes of its grid cell, a cache miss schedules the missing nodes for the background task.
+class Declination
+{
+public:
+    static constexpr int GRID_DEG = 2;    // grid spacing in degree
+    static constexpr int CACHE_SIZE = 16; // nodes, LRU replaced
+
+    // Called on every valid GNSS fix
+    static void newPosition(float lat, float lon, float year);
+    // Background task job, evaluates the missing nodes for the last position
+    static void refresh();
+    // Interpolated declination at a position, false on a cache miss
+    static bool lookup(float lat, float lon, float &dec);
+    // The GNSS date is past the life span of the built in model, the declination is extrapolated
+    static bool modelExpired();
+
+#ifdef Declination_Test
+    static void declination_test();
+#endif
+};